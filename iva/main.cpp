@@ -1,6 +1,7 @@
 #include "Application.h"
 #include "logging.hpp"
 #include "SoftwareLicense.h"
+#include "startupTimeline.hpp"
 #include <gflags/gflags.h>
 
 #include <iostream>
@@ -24,6 +25,7 @@ std::string getHomeDirectory() {
 
 int main(int argc, char *argv[])
 {
+  core::StartupTimeline::get().mark("process_start");
   std::string homeDir = getHomeDirectory();
   BASE_DIR = homeDir + "/.iva";
 
@@ -36,6 +38,7 @@ int main(int argc, char *argv[])
   bool success = license.start();
   if(!success)
     return EXIT_FAILURE;
+  core::StartupTimeline::get().mark("license_activated");
 
   /* Set up logging. Note that MY_LOG_LEVEL is set in CMakeLists.txt */
 #ifndef MY_LOG_LEVEL
@@ -47,6 +50,7 @@ int main(int argc, char *argv[])
 
   core::Logging::init(argv);
   google::InstallFailureSignalHandler();
+  core::StartupTimeline::get().mark("logging_ready");
 
 
   // start the app
@@ -33,10 +33,34 @@ void Application::_set_up()
   this->_app_context = app_context;
   this->_kafka = kafka;
   this->_pipeline = pipeline;
+  core::StartupTimeline::get().mark("modules_created");
 
   // set up modules with their configurations
   this->_app_context->_load_module_configs();
+  core::StartupTimeline::get().mark("configs_loaded");
   this->_distribute_module_configs();
+  core::StartupTimeline::get().mark("modules_configured");
+  this->_start_metrics_server();
+}
+
+/**
+ * @brief serve the runtime metrics when config.json application['metrics']['enable'] is set
+ *  (keys: enable, port (default 9464), address (default 127.0.0.1, local only))
+ */
+void Application::_start_metrics_server()
+{
+  njson configs = this->_app_context->get_configs(core::events::Type::APPLICATION).value("metrics", njson::object());
+  if (!configs.value("enable", false)) {
+    VLOG(DEBUG) << "Metrics endpoint disabled (application['metrics']['enable'])";
+    return;
+  }
+  int port = configs.value("port", 9464);
+  std::string address = configs.value("address", std::string("127.0.0.1"));
+  if (port <= 0 || port > 65535) {
+    LOG(ERROR) << "Invalid config.json element! application['metrics']['port'] must be a TCP port, metrics are not served";
+    return;
+  }
+  this->_metrics_server.start(address, port);
 }
 
 /**
@@ -45,14 +69,23 @@ void Application::_set_up()
 void Application::start()
 {
   this->_set_up();
+  // the modules report their failures from the moment they start
+  this->_app_context->start_supervisor();
   this->_start_modules();
+  core::StartupTimeline::get().mark("modules_started");
   if(this->_app_context->run_state)
   {
-    this->_app_context->app_state = core::APP_STATE::LIVE;
-  }
-  while (this->_app_context->app_state == core::APP_STATE::LIVE) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    this->_app_context->set_app_state(core::APP_STATE::LIVE);
+    this->_app_context->start_config_watch();
   }
+  // the mediator changes the state when the modules stopped (STOP_MODULES)
+  this->_app_context->wait_while_state(core::APP_STATE::LIVE);
+  // the complete timeline (the first kafka ack may come after the first inference)
+  core::StartupTimeline::get().dump();
+  this->_app_context->stop_config_watch();
+  this->_metrics_server.stop();
+  core::ShutdownTimeline::get().mark("application_stopped");
+  core::ShutdownTimeline::get().dump();
 }
 
 /// EVENTS
@@ -8,6 +8,9 @@
 #include "ApplicationContext.h"
 #include "KafkaBroker.h"
 #include "Pipeline.h"
+#include "metricsServer.hpp"
+#include "shutdownTimeline.hpp"
+#include "startupTimeline.hpp"
 
 
 using njson = nlohmann::json;
@@ -26,6 +29,8 @@ namespace core
  * the messaging service that enables communication with external clients
  * @var _pipeline
  * the gstreamer pipeline that runs all video and AI inference
+ * @var _metrics_server
+ * serves GET /metrics when application['metrics']['enable'] is set
  */
 class Application
 {
@@ -41,8 +46,10 @@ private:
     core::ApplicationContext *_app_context;
     core::KafkaBroker *_kafka;
     core::Pipeline *_pipeline;
+    core::MetricsServer _metrics_server;
 
     void _set_up();
+    void _start_metrics_server();
     void _stop_modules();
     void _start_modules();
 
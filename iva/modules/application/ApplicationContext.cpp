@@ -7,10 +7,37 @@ class Basecomponent;
 ApplicationContext::ApplicationContext()
 {
     this->_module_id = core::Module::APPLICATION_CONTEXT;
+    this->_lock = new std::mutex();
     LOG(INFO) << "CREATED: " << *this;
 }
 
 
+/**
+ * @brief change the state of the application and wake up the threads waiting on it. SHUT_DOWN is final: a module that stops before
+ *  the application went live keeps it down.
+ * @param state the new state (APP_STATE)
+ */
+void ApplicationContext::set_app_state(int state)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->_state_lock);
+		if (this->app_state == APP_STATE::SHUT_DOWN)
+			return;
+		this->app_state = state;
+	}
+	this->_state_changed.notify_all();
+}
+
+/**
+ * @brief block while the application is in a state (e.g. LIVE until a module stops it)
+ * @param state the state to wait out
+ */
+void ApplicationContext::wait_while_state(int state)
+{
+	std::unique_lock<std::mutex> lock(this->_state_lock);
+	this->_state_changed.wait(lock, [this, state]() { return this->app_state != state; });
+}
+
 /**
  * @brief loads module settings from config.json
  * @return `bool` true if successful
@@ -36,7 +63,10 @@ bool ApplicationContext::_load_module_configs()
         return false;
     if(!conf.contains("processing"))
         return false;
+	this->_lock->lock();
 	this->_configs = conf;
+	this->_reloaded = conf;
+	this->_lock->unlock();
 	VLOG(DEBUG) << "AppContext loaded in configs: \n" << this->_configs.dump(4);
 	return true;
 }
@@ -49,6 +79,7 @@ bool ApplicationContext::_load_module_configs()
  */
 njson ApplicationContext::get_configs(core::events::Type module_type)
 {
+	std::lock_guard<std::mutex> lock(*this->_lock);
 	njson module_settings;
 	if(module_type == core::events::Type::PIPELINE)
 	{
@@ -62,10 +93,216 @@ njson ApplicationContext::get_configs(core::events::Type module_type)
 	{
 		module_settings = this->_configs["messaging"];
 	}
+	else if (module_type == core::events::Type::APPLICATION)
+	{
+		module_settings = this->_configs.value("application", njson::object());
+	}
 	else
 	{
 		LOG(ERROR) << "Invalid call, module_type arg is not known in logic setup.";
 		throw "Invalid module_type";
 	}
 	return module_settings;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief the key of a module in config.json
+ * @param module_type the module type as defined in Event.h
+ * @return the key, empty for unknown modules
+ */
+std::string ApplicationContext::_section(core::events::Type module_type)
+{
+	switch (module_type) {
+		case core::events::Type::PIPELINE: return "pipeline";
+		case core::events::Type::PROCESSING: return "processing";
+		case core::events::Type::KAFKA: return "messaging";
+		case core::events::Type::APPLICATION: return "application";
+		default: return "";
+	}
+}
+
+/**
+ * @brief watch config.json while the application is live (application['watch_configs'], default true). A change is applied to
+ *  the modules that support it (processing), the settings that need a restart are reported.
+ * @return `bool` true if config.json is watched
+ */
+bool ApplicationContext::start_config_watch()
+{
+	if (!this->get_configs(core::events::Type::APPLICATION).value("watch_configs", true)) {
+		VLOG(DEBUG) << "config.json is not watched (application['watch_configs'])";
+		return false;
+	}
+	return this->_watcher.start(BASE_DIR + "/configs/config.json", [this]() { this->_reload_module_configs(); });
+}
+
+void ApplicationContext::stop_config_watch()
+{
+	this->_watcher.stop();
+}
+
+/**
+ * @brief config.json changed: read it again, report the settings that need a restart and ask the mediator to apply the others.
+ *  An invalid file is ignored (the modules keep running with their settings).
+ */
+void ApplicationContext::_reload_module_configs()
+{
+	std::string conf_dir = BASE_DIR + "/configs/config.json";
+	njson conf;
+	try {
+		std::ifstream f(conf_dir.c_str());
+		conf = njson::parse(f);
+	}
+	catch (const std::exception &e) {
+		LOG(WARNING) << "config.json changed but could not be parsed, the running configs are kept: " << e.what();
+		core::Metrics::get().counter("iva_config_reloads_total", "Changes of config.json by result.", {{"result", "rejected"}}).fetch_add(1);
+		return;
+	}
+	if (!conf.contains("messaging") || !conf.contains("pipeline") || !conf.contains("processing")) {
+		LOG(WARNING) << "config.json changed but misses messaging, pipeline or processing, the running configs are kept";
+		core::Metrics::get().counter("iva_config_reloads_total", "Changes of config.json by result.", {{"result", "rejected"}}).fetch_add(1);
+		return;
+	}
+
+	this->_lock->lock();
+	njson running = this->_configs;
+	this->_reloaded = conf;
+	this->_lock->unlock();
+
+	// the pipeline, kafka and application settings are used to build the modules
+	int restart = 0;
+	for (const char *module : {"pipeline", "messaging", "application"}) {
+		for (const std::string &key : core::changedKeys(running.value(module, njson::object()), conf.value(module, njson::object()))) {
+			LOG(WARNING) << "config.json " << module << "['" << key << "'] changed, restart the application to apply it";
+			restart++;
+		}
+	}
+	core::Metrics::get().gauge("iva_config_restart_pending", "Settings of config.json that changed and need a restart.").store(restart);
+
+	if (running["processing"] == conf["processing"]) {
+		VLOG(DEBUG) << "config.json changed, processing is unchanged";
+		return;
+	}
+	LOG(INFO) << "config.json processing changed, reloading it";
+	ApplicationEvent *event = new ApplicationEvent(core::events::Actions::RELOAD_CONFIGS, core::events::Module::MODULE_APPCONTEXT);
+	this->_mediator->notify(event);
+}
+
+/**
+ * @brief a module section of config.json as read after its last change
+ * @param module_type the module type as defined in Event.h
+ */
+njson ApplicationContext::get_reloaded_configs(core::events::Type module_type)
+{
+	std::lock_guard<std::mutex> lock(*this->_lock);
+	return this->_reloaded.value(_section(module_type), njson::object());
+}
+
+/**
+ * @brief result of a reload: a module that applied its reloaded section runs with it (get_configs returns it from now on)
+ * @param module_type the module type as defined in Event.h
+ * @param applied false if the module kept its settings
+ */
+void ApplicationContext::set_reload_result(core::events::Type module_type, bool applied)
+{
+	std::string section = _section(module_type);
+	std::lock_guard<std::mutex> lock(*this->_lock);
+	if (applied && this->_reloaded.contains(section))
+		this->_configs[section] = this->_reloaded[section];
+	core::Metrics::get()
+	    .counter("iva_config_reloads_total", "Changes of config.json by result.", {{"result", applied ? "applied" : "rejected"}})
+	    .fetch_add(1);
+}
+
+/**
+ * @brief start the module supervisor with config.json application['supervisor'] (an invalid section disables the restarts)
+ */
+void ApplicationContext::start_supervisor()
+{
+	njson conf = this->get_configs(core::events::Type::APPLICATION).value("supervisor", njson::object());
+	core::RestartPolicy policy;
+	try {
+		policy.enable = conf.value("enable", policy.enable);
+		policy.max_restarts = conf.value("max_restarts", policy.max_restarts);
+		policy.window_s = conf.value("window_s", policy.window_s);
+		policy.backoff_ms = conf.value("backoff_ms", policy.backoff_ms);
+		policy.max_backoff_ms = conf.value("max_backoff_ms", policy.max_backoff_ms);
+	}
+	catch (const std::exception &) {
+		policy.max_restarts = -1;
+	}
+	if (policy.max_restarts < 0 || policy.window_s <= 0 || policy.backoff_ms <= 0 || policy.max_backoff_ms < policy.backoff_ms) {
+		LOG(ERROR) << "Invalid config.json element! application['supervisor'] must have max_restarts >= 0, window_s > 0 and "
+					  "0 < backoff_ms <= max_backoff_ms, failed modules are not restarted";
+		policy = {.enable = false};
+	}
+	if (policy.enable)
+		LOG(INFO) << "Module supervisor: " << policy.max_restarts << " restarts per " << policy.window_s << "s, backoff "
+				  << policy.backoff_ms << "ms to " << policy.max_backoff_ms << "ms";
+	this->_supervisor.start(policy);
+}
+
+/**
+ * @brief stop restarting modules (the pending restarts are dropped), the application is stopping
+ */
+void ApplicationContext::stop_supervisor()
+{
+	this->_supervisor.stop();
+	njson health = this->get_module_health();
+	if (!health.empty())
+		LOG(INFO) << "Module health: " << health.dump(2);
+}
+
+/**
+ * @brief a module failed: the supervisor restarts it after its backoff (RESTART_MODULE on the supervisor thread)
+ * @param module the module (events::Module)
+ * @param shard the pipeline shard, -1 for the other modules
+ * @param reason what failed
+ * @return `bool` false if the module is given up (restarts disabled, too many restarts or the application is stopping)
+ */
+bool ApplicationContext::module_failed(int module, int shard, const std::string &reason)
+{
+	std::string name = _module_name(module, shard);
+	int delay_ms = this->_supervisor.failed(name, reason, g_get_monotonic_time());
+	if (delay_ms >= 0 && this->_supervisor.schedule(delay_ms, [this, module, shard]() {
+			HealthEvent *event = new HealthEvent(core::events::Actions::RESTART_MODULE, module, shard, "", core::events::Module::MODULE_APPCONTEXT);
+			this->_mediator->notify(event);
+		})) {
+		LOG(WARNING) << "Module " << name << " failed (" << reason << "), restarting it in " << delay_ms << "ms";
+		return true;
+	}
+	LOG(ERROR) << "Module " << name << " failed (" << reason << "), it is not restarted";
+	return false;
+}
+
+/**
+ * @brief a restarted module runs again
+ * @param module the module (events::Module)
+ * @param shard the pipeline shard, -1 for the other modules
+ */
+void ApplicationContext::module_recovered(int module, int shard)
+{
+	std::string name = _module_name(module, shard);
+	double recovery_s = this->_supervisor.recovered(name, g_get_monotonic_time());
+	if (recovery_s >= 0)
+		LOG(INFO) << "Module " << name << " recovered " << recovery_s << "s after its failure";
+}
+
+/**
+ * @brief failures, restarts and mean recovery time of the supervised modules
+ */
+njson ApplicationContext::get_module_health()
+{
+	return this->_supervisor.to_json();
+}
+
+/**
+ * @brief the name of a supervised module (kafka, pipeline_shard<N>)
+ */
+std::string ApplicationContext::_module_name(int module, int shard)
+{
+	if (module == core::events::Module::MODULE_PIPELINE)
+		return "pipeline_shard" + std::to_string(shard);
+	if (module == core::events::Module::MODULE_KAFKA)
+		return "kafka";
+	return "module" + std::to_string(module);
+}
@@ -2,6 +2,7 @@
 
 #include <gst/gst.h>
 
+#include <condition_variable>
 #include <map>
 #include <nlohmann/json.hpp>
 #include <string>
@@ -10,7 +11,10 @@
 
 #include "BaseComponent.h"
 #include "Mediator.h"
+#include "configReload.hpp"
 #include "logging.hpp"
+#include "metrics.hpp"
+#include "supervisor.hpp"
 
 using njson = nlohmann::json;
 
@@ -51,17 +55,42 @@ enum APP_STATE
  * describes the state machine's state
  * @var _lock
  * safe access to attribute updates
+ * @var _state_lock
+ * guards the transitions of app_state (set_app_state), with _state_changed
+ * @var _state_changed
+ * notified on every transition of app_state, the application waits on it instead of polling
  * @var _configs
- * the application module configurations loaded in Application.cpp
+ * the application module configurations loaded in Application.cpp (the settings the modules run with)
+ * @var _reloaded
+ * config.json as read after its last change, a module section is copied to _configs once the module accepted it
+ * @var _watcher
+ * watches config.json while the application is live (application['watch_configs'])
+ * @var _supervisor
+ * restarts the modules that failed (a pipeline shard, the kafka producer) through the mediator (application['supervisor'])
  */
 class ApplicationContext : public BaseComponent
 {
  public:
   ApplicationContext();
-  void kill_app() { this->app_state = APP_STATE::SHUT_DOWN; }
+  void kill_app() { this->set_app_state(APP_STATE::SHUT_DOWN); }
+  void set_app_state(int state);
+  void wait_while_state(int state);
   bool _load_module_configs();
   njson get_configs(core::events::Type module_type);
 
+  // config.json changes while running
+  bool start_config_watch();
+  void stop_config_watch();
+  njson get_reloaded_configs(core::events::Type module_type);
+  void set_reload_result(core::events::Type module_type, bool applied);
+
+  // module supervisor (failures and recoveries are notified through the mediator)
+  void start_supervisor();
+  void stop_supervisor();
+  bool module_failed(int module, int shard, const std::string &reason);
+  void module_recovered(int module, int shard);
+  njson get_module_health();
+
   /**************
    * App Details *
    ***************/
@@ -70,7 +99,16 @@ class ApplicationContext : public BaseComponent
 
  private:
   std::mutex *_lock;
+  std::mutex _state_lock;
+  std::condition_variable _state_changed;
   njson _configs;
+  njson _reloaded;
+  core::ConfigWatcher _watcher;
+  core::Supervisor _supervisor;
+
+  void _reload_module_configs();
+  static std::string _section(core::events::Type module_type);
+  static std::string _module_name(int module, int shard);
 
 };
 }  // namespace core
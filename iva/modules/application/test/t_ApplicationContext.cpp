@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
 // define private as public so that we can make unit tests on private class members and attributes
 #define private public
 #include "ApplicationContext.h"
@@ -76,6 +78,23 @@ TEST_F(ApplicationContextTest, member_kill_app)
   EXPECT_EQ(this->app_context->app_state, core::APP_STATE::SHUT_DOWN) << "validate kill_app() makes app_state=APP_STATE::SHUT_DOWN";
 }
 
+TEST_F(ApplicationContextTest, member_wait_while_state)
+{
+  this->app_context->set_app_state(core::APP_STATE::LIVE);
+  std::thread stopper([this]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    this->app_context->kill_app();
+  });
+  auto start = std::chrono::steady_clock::now();
+  this->app_context->wait_while_state(core::APP_STATE::LIVE);
+  auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  stopper.join();
+  EXPECT_EQ(this->app_context->app_state, core::APP_STATE::SHUT_DOWN) << "Validate the waiter wakes up on kill_app()";
+  EXPECT_LT(waited, 500) << "Validate the waiter is notified rather than polling";
+  this->app_context->set_app_state(core::APP_STATE::LIVE);
+  EXPECT_EQ(this->app_context->app_state, core::APP_STATE::SHUT_DOWN) << "Validate SHUT_DOWN is final";
+}
+
 TEST_F(ApplicationContextTest, member_get_configs)
 {
   njson pipeline_configs = this->app_context->get_configs(core::events::Type::PIPELINE);
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include "configReload.hpp"
+
+
+namespace test_suite
+{
+namespace configReload_test
+{
+namespace
+{
+
+struct Settings
+{
+  std::string topic;
+  int font_size;
+};
+
+TEST(ConfigReloadTest, snapshots_stay_valid_for_readers)
+{
+  core::Snapshot<Settings> settings;
+  EXPECT_EQ(settings.get(), nullptr) << "Validate nothing is published before the first configure";
+  std::shared_ptr<const Settings> first = settings.publish({.topic = "overlay", .font_size = 2});
+  std::shared_ptr<const Settings> reader = settings.get();
+  settings.publish({.topic = "reloaded", .font_size = 3});
+  EXPECT_EQ(reader, first);
+  EXPECT_EQ(reader->topic, "overlay") << "Validate a reader keeps the snapshot it loaded";
+  EXPECT_EQ(settings->topic, "reloaded") << "Validate the next read sees the reload";
+  EXPECT_EQ(settings.version(), 2u);
+}
+
+struct Counted
+{
+  static inline int alive = 0;
+  int value;
+  Counted(int value) : value(value) { alive++; }
+  Counted(const Counted &other) : value(other.value) { alive++; }
+  ~Counted() { alive--; }
+};
+
+TEST(ConfigReloadTest, old_snapshots_are_freed)
+{
+  {
+    core::Snapshot<Counted> settings;
+    std::shared_ptr<const Counted> reader = settings.publish(Counted(0));
+    for (int i = 1; i < 10; i++)
+      settings.publish(Counted(i));
+    EXPECT_EQ(reader->value, 0) << "Validate a stalled reader keeps its snapshot across any number of reloads";
+    EXPECT_EQ(Counted::alive, 2) << "Validate the replaced snapshots nobody reads are freed";
+    reader.reset();
+    EXPECT_EQ(Counted::alive, 1) << "Validate a snapshot is freed with its last reader";
+    EXPECT_EQ(settings->value, 9);
+    EXPECT_EQ(settings.version(), 10u) << "Validate the version counts every publish";
+  }
+  EXPECT_EQ(Counted::alive, 0) << "Validate the destructor frees the current snapshot";
+}
+
+TEST(ConfigReloadTest, changed_keys_of_a_section)
+{
+  njson before = {{"sources", {"a.mp4"}}, {"batch_size", 1}, {"live_source", false}};
+  njson after = {{"sources", {"a.mp4", "b.mp4"}}, {"batch_size", 1}, {"profile", "gpu"}};
+  std::vector<std::string> keys = core::changedKeys(before, after);
+  EXPECT_EQ(keys, (std::vector<std::string>{"live_source", "profile", "sources"})) << "Validate changed, removed and added keys";
+  EXPECT_TRUE(core::changedKeys(before, before).empty());
+}
+
+TEST(ConfigReloadTest, watcher_calls_back_when_the_file_is_replaced)
+{
+  std::string path = "/tmp/t_config_reload.json";
+  std::ofstream(path) << "{}";
+  std::atomic<int> changes = 0;
+  core::ConfigWatcher watcher;
+  watcher.settle_ms = 50;
+  ASSERT_TRUE(watcher.start(path, [&]() { changes++; }));
+
+  // editors write a new file and rename it over the old one
+  std::ofstream(path + ".tmp") << "{\"processing\": {}}";
+  std::rename((path + ".tmp").c_str(), path.c_str());
+  std::ofstream("/tmp/t_config_reload_other.json") << "{}";
+  for (int i = 0; i < 50 && changes == 0; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  watcher.stop();
+  EXPECT_EQ(changes, 1) << "Validate one callback per change of the watched file";
+}
+
+}  // namespace
+}  // namespace configReload_test
+}  // namespace test_suite
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include "metricsServer.hpp"
+
+
+namespace test_suite
+{
+namespace metrics_test
+{
+namespace
+{
+
+TEST(MetricsTest, counters_are_rendered_once_per_series)
+{
+  core::Metrics metrics;
+  std::atomic<uint64_t> &frames = metrics.counter("test_frames_total", "Frames.", {{"source", "0"}});
+  EXPECT_EQ(&frames, &metrics.counter("test_frames_total", "Frames.", {{"source", "0"}})) << "Validate a series is registered once";
+  frames.fetch_add(3);
+  metrics.counter("test_frames_total", "Frames.", {{"source", "1"}}).fetch_add(1);
+  metrics.observe("test_fps", "gauge", "Frame rate.", {}, []() { return std::numeric_limits<double>::quiet_NaN(); });
+
+  std::string body = metrics.render();
+  EXPECT_NE(body.find("# TYPE test_frames_total counter\n"), std::string::npos) << "Validate the type line";
+  EXPECT_NE(body.find("test_frames_total{source=\"0\"} 3\n"), std::string::npos) << "Validate the counter value";
+  EXPECT_NE(body.find("test_frames_total{source=\"1\"} 1\n"), std::string::npos) << "Validate series of the same metric";
+  EXPECT_NE(body.find("test_fps NaN\n"), std::string::npos) << "Validate values without samples";
+  EXPECT_NE(body.find("process_resident_memory_bytes "), std::string::npos) << "Validate the process memory";
+
+  metrics.remove("test_frames_total", "source", "1");
+  EXPECT_EQ(metrics.render().find("source=\"1\""), std::string::npos) << "Validate removed series are not rendered";
+  EXPECT_EQ(core::Metrics::formatLabels({{"uri", "a\"b\\c\n"}}), "{uri=\"a\\\"b\\\\c\\n\"}") << "Validate label escaping";
+}
+
+TEST(MetricsTest, server_answers_scrapes_only)
+{
+  EXPECT_EQ(core::MetricsServer::respond("GET /metrics HTTP/1.1\r\n\r\n").rfind("HTTP/1.0 200 OK", 0), 0u) << "Validate /metrics";
+  EXPECT_EQ(core::MetricsServer::respond("GET /metricsx HTTP/1.1\r\n\r\n").rfind("HTTP/1.0 404", 0), 0u) << "Validate other paths";
+  EXPECT_EQ(core::MetricsServer::respond("POST /metrics HTTP/1.1\r\n\r\n").rfind("HTTP/1.0 405", 0), 0u) << "Validate other methods";
+}
+
+}  // namespace
+}  // namespace metrics_test
+}  // namespace test_suite
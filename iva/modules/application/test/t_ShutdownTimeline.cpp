@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+#include "shutdownTimeline.hpp"
+
+
+namespace test_suite
+{
+namespace shutdownTimeline_test
+{
+namespace
+{
+
+TEST(ShutdownTimelineTest, first_reason_and_phases_are_kept)
+{
+  core::ShutdownTimeline timeline;
+  EXPECT_FALSE(timeline.started());
+  EXPECT_TRUE(timeline.begin("SIGTERM")) << "Validate the first begin() starts the shutdown";
+  EXPECT_FALSE(timeline.begin("pipeline finished")) << "Validate later begin() calls are ignored";
+  timeline.mark("shard0_stopped");
+  timeline.mark("pipeline_drained");
+  timeline.mark("shard0_stopped");
+  njson json = timeline.to_json();
+  EXPECT_EQ(json["reason"], "SIGTERM");
+  ASSERT_EQ(json["phases"].size(), 2u) << "Validate a phase is recorded once";
+  EXPECT_EQ(json["phases"][1]["phase"], "pipeline_drained") << "Validate phases are in order";
+  EXPECT_LE(json["phases"][0]["at_ms"].get<double>(), json["phases"][1]["at_ms"].get<double>()) << "Validate timestamps are monotonic";
+}
+
+TEST(ShutdownTimelineTest, mark_starts_the_shutdown)
+{
+  core::ShutdownTimeline timeline;
+  timeline.mark("application_stopped");
+  EXPECT_TRUE(timeline.started());
+  EXPECT_EQ(timeline.to_json()["reason"], "application stopped");
+  EXPECT_GE(timeline.to_json()["phases"][0]["at_ms"].get<double>(), 0.0);
+}
+
+}  // namespace
+}  // namespace shutdownTimeline_test
+}  // namespace test_suite
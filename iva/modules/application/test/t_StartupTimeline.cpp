@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+#include "startupTimeline.hpp"
+
+
+namespace test_suite
+{
+namespace startupTimeline_test
+{
+namespace
+{
+
+TEST(StartupTimelineTest, phases_keep_their_first_time)
+{
+  core::StartupTimeline timeline;
+  timeline.mark("configs_loaded");
+  timeline.mark("shard0_ready");
+  timeline.mark("configs_loaded");
+  njson phases = timeline.to_json();
+  ASSERT_EQ(phases.size(), 2u) << "Validate a phase is recorded once";
+  EXPECT_EQ(phases[0]["phase"], "configs_loaded") << "Validate phases are in order";
+  EXPECT_LE(phases[0]["at_ms"].get<double>(), phases[1]["at_ms"].get<double>()) << "Validate timestamps are monotonic";
+  EXPECT_GE(phases[1]["delta_ms"].get<double>(), 0.0) << "Validate delta since the previous phase";
+}
+
+TEST(StartupTimelineTest, milestones_are_exported_as_metrics)
+{
+  core::StartupTimeline timeline;
+  timeline.mark_first(core::Milestone::FIRST_FRAME);
+  timeline.mark_first(core::Milestone::FIRST_FRAME);
+  EXPECT_EQ(timeline.to_json().size(), 1u) << "Validate a milestone is recorded once";
+  std::map<std::string, double> metrics = timeline.metrics();
+  ASSERT_TRUE(metrics.count("startup_first_frame_seconds")) << "Validate metric name";
+  EXPECT_GE(metrics["startup_first_frame_seconds"], 0.0) << "Validate metric value";
+}
+
+}  // namespace
+}  // namespace startupTimeline_test
+}  // namespace test_suite
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "supervisor.hpp"
+
+
+namespace test_suite
+{
+namespace supervisor_test
+{
+namespace
+{
+
+TEST(SupervisorTest, restarts_back_off_and_give_up)
+{
+  core::Supervisor supervisor;
+  supervisor.start({.enable = true, .max_restarts = 3, .window_s = 10, .backoff_ms = 100, .max_backoff_ms = 250});
+  EXPECT_EQ(supervisor.failed("pipeline_shard0", "error", 0), 100) << "Validate the first restart waits backoff_ms";
+  EXPECT_EQ(supervisor.failed("pipeline_shard0", "error", 1000), 200) << "Validate the backoff doubles";
+  EXPECT_EQ(supervisor.failed("pipeline_shard0", "error", 2000), 250) << "Validate the backoff is capped";
+  EXPECT_EQ(supervisor.failed("pipeline_shard0", "error", 3000), -1) << "Validate the module is given up after max_restarts";
+  EXPECT_EQ(supervisor.failed("kafka", "error", 3000), 100) << "Validate modules are supervised independently";
+  EXPECT_EQ(supervisor.failed("pipeline_shard0", "error", 11000000), 100) << "Validate restarts out of the window are forgotten";
+  supervisor.stop();
+}
+
+TEST(SupervisorTest, recovery_time_is_averaged)
+{
+  core::Supervisor supervisor;
+  supervisor.start({});
+  EXPECT_EQ(supervisor.recovered("pipeline_shard1", 0), -1) << "Validate a module that did not fail has no recovery";
+  supervisor.failed("pipeline_shard1", "bus error", 1000000);
+  EXPECT_DOUBLE_EQ(supervisor.recovered("pipeline_shard1", 3000000), 2.0);
+  supervisor.failed("pipeline_shard1", "bus error", 5000000);
+  supervisor.failed("pipeline_shard1", "restart failed", 6000000);
+  EXPECT_DOUBLE_EQ(supervisor.recovered("pipeline_shard1", 9000000), 4.0) << "Validate the recovery starts at the first failure";
+  njson health = supervisor.to_json()["pipeline_shard1"];
+  EXPECT_EQ(health["restarts"], 3u);
+  EXPECT_DOUBLE_EQ(health["mean_recovery_s"].get<double>(), 3.0);
+  EXPECT_TRUE(health["up"].get<bool>());
+  supervisor.stop();
+}
+
+TEST(SupervisorTest, scheduled_restarts_run_in_order_until_stop)
+{
+  core::Supervisor supervisor;
+  supervisor.start({});
+  std::vector<int> order;
+  std::atomic<int> done = 0;
+  supervisor.schedule(60, [&]() { order.push_back(2); done++; });
+  supervisor.schedule(20, [&]() { order.push_back(1); done++; });
+  supervisor.schedule(5000, [&]() { order.push_back(3); done++; });
+  for (int i = 0; i < 100 && done < 2; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  supervisor.stop();
+  EXPECT_EQ(order, (std::vector<int>{1, 2})) << "Validate restarts run after their delay, the pending ones are dropped by stop()";
+  EXPECT_FALSE(supervisor.schedule(0, []() {})) << "Validate nothing is scheduled once stopped";
+}
+
+}  // namespace
+}  // namespace supervisor_test
+}  // namespace test_suite
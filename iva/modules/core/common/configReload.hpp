@@ -0,0 +1,212 @@
+#pragma once
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logging.hpp"
+
+using njson = nlohmann::json;
+
+namespace core
+{
+
+/**
+ * @class Snapshot
+ * @brief immutable settings read by the streaming threads, replaced as a whole by a reload. A reader takes a reference to the current
+ *  settings and keeps it for the frame it is processing; replaced settings are freed once their last reader dropped them, so a reader
+ *  never sees freed settings however long it stalls.
+ *
+ * @var _current
+ * the published settings, empty before the first publish (loaded and stored with std::atomic_load/std::atomic_store)
+ * @var _version
+ * number of publishes
+ * @var _lock
+ * serializes the writers (publish), never taken by the readers
+ */
+template <typename T>
+class Snapshot
+{
+public:
+    Snapshot() = default;
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    /**
+     * @brief the current settings, empty before the first publish
+     */
+    std::shared_ptr<const T> get() const { return std::atomic_load(&this->_current); }
+
+    // the reference lives until the end of the expression
+    std::shared_ptr<const T> operator->() const { return this->get(); }
+
+    /**
+     * @brief replace the settings, the readers see them with their next get()
+     * @param settings the new settings
+     * @return the published settings
+     */
+    std::shared_ptr<const T> publish(T settings)
+    {
+      std::lock_guard<std::mutex> lock(this->_lock);
+      std::shared_ptr<const T> published = std::make_shared<const T>(std::move(settings));
+      std::atomic_store(&this->_current, published);
+      this->_version++;
+      return published;
+    }
+
+    /**
+     * @brief number of publishes
+     */
+    size_t version()
+    {
+      std::lock_guard<std::mutex> lock(this->_lock);
+      return this->_version;
+    }
+
+private:
+    std::shared_ptr<const T> _current;
+    size_t _version = 0;
+    std::mutex _lock;
+};
+
+/**
+ * @brief the keys of two config objects whose values differ (added and removed keys included)
+ * @param before the settings that are running
+ * @param after the settings that were read
+ * @return the keys, sorted
+ */
+inline std::vector<std::string> changedKeys(const njson &before, const njson &after)
+{
+  std::vector<std::string> keys;
+  if (!before.is_object() || !after.is_object())
+    return before == after ? keys : std::vector<std::string>{""};
+  for (const auto &[key, value] : before.items()) {
+    if (!after.contains(key) || after[key] != value)
+      keys.push_back(key);
+  }
+  for (const auto &[key, value] : after.items()) {
+    if (!before.contains(key))
+      keys.push_back(key);
+  }
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+/**
+ * @class ConfigWatcher
+ * @brief watches a config file with inotify and calls back once the file settled after a change. The directory is watched rather
+ *  than the file: editors and deployment tools replace the file (rename) instead of writing it in place.
+ *
+ * @var _fd
+ * the inotify descriptor, -1 when stopped
+ * @var _thread
+ * the watch loop
+ * @var _running
+ * false to stop the watch loop
+ * @var settle_ms
+ * the callback runs when the file was not written for this long (a change usually takes several writes)
+ */
+class ConfigWatcher
+{
+public:
+    ~ConfigWatcher() { this->stop(); }
+
+    /**
+     * @brief watch a file on a thread
+     * @param path the file
+     * @param on_change called from the watch thread after the file changed
+     * @return false if the file cannot be watched
+     */
+    bool start(const std::string &path, std::function<void()> on_change)
+    {
+      std::filesystem::path file(path);
+      this->_name = file.filename().string();
+      this->_on_change = std::move(on_change);
+      this->_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (this->_fd < 0 ||
+          inotify_add_watch(this->_fd, file.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        LOG(ERROR) << "Could not watch " << path << ": " << strerror(errno) << ", config changes need a restart";
+        if (this->_fd >= 0)
+          close(this->_fd);
+        this->_fd = -1;
+        return false;
+      }
+      this->_running = true;
+      this->_thread = std::thread(&ConfigWatcher::_watch, this);
+      LOG(INFO) << "Watching " << path << " for changes";
+      return true;
+    }
+
+    /**
+     * @brief stop watching (the loop wakes up at least every 200ms) and join its thread
+     */
+    void stop()
+    {
+      if (!this->_running.exchange(false))
+        return;
+      if (this->_thread.joinable())
+        this->_thread.join();
+      close(this->_fd);
+      this->_fd = -1;
+    }
+
+    int settle_ms = 300;
+
+private:
+    int _fd = -1;
+    std::string _name;
+    std::function<void()> _on_change;
+    std::thread _thread;
+    std::atomic<bool> _running = false;
+
+    // true if the pending events touched the watched file
+    bool _read_events()
+    {
+      alignas(struct inotify_event) char buffer[4096];
+      bool touched = false;
+      ssize_t size;
+      while ((size = read(this->_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + size;) {
+          const struct inotify_event *event = (const struct inotify_event *) ptr;
+          if (event->len > 0 && this->_name == event->name)
+            touched = true;
+          ptr += sizeof(struct inotify_event) + event->len;
+        }
+      }
+      return touched;
+    }
+
+    void _watch()
+    {
+      pollfd fd = {.fd = this->_fd, .events = POLLIN, .revents = 0};
+      std::chrono::steady_clock::time_point changed;
+      bool pending = false;
+      while (this->_running) {
+        int ready = poll(&fd, 1, 200);
+        if (ready > 0 && this->_read_events()) {
+          changed = std::chrono::steady_clock::now();
+          pending = true;
+        }
+        if (pending && std::chrono::steady_clock::now() - changed >= std::chrono::milliseconds(this->settle_ms)) {
+          pending = false;
+          this->_on_change();
+        }
+      }
+    }
+};
+
+}  // namespace core
@@ -90,6 +90,7 @@ public:
         auto images = media_dir + "/image/";
         auto payloads = media_dir + "/payload/";
         auto videos = media_dir + "/video/";
+        auto clips = media_dir + "/clips/";
 
         if (!fs::exists(media_dir)) {
             // store generated outputs (json, video, images)
@@ -104,6 +105,11 @@ public:
             fs::create_directory(images);
             fs::permissions(images, fs::perms::all);
         }
+        if (!fs::exists(clips)) {
+            // event-triggered clips (pipeline['clips'])
+            fs::create_directory(clips);
+            fs::permissions(clips, fs::perms::all);
+        }
         if (!fs::exists(payloads)) {
             fs::create_directory(payloads);
             fs::permissions(payloads, fs::perms::all);
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace core
+{
+
+/**
+ * @brief labels of a series, in the order they are rendered
+ */
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @class Metrics
+ * @brief registry of the runtime metrics, rendered in the Prometheus text format by the metrics server (application['metrics']).
+ *  Series are registered when a module is configured or a source is added, and updated lock-free afterwards: counters and gauges are
+ *  atomics owned by the registry, callback series read atomics owned by the modules. The registry lock is only taken to register and
+ *  to render, never from the streaming threads, so a scrape never waits for the pipeline.
+ *
+ * @var _families
+ * series by metric name
+ * @var _counters
+ * values of the counters owned by the registry (stable addresses)
+ * @var _gauges
+ * values of the gauges owned by the registry (stable addresses)
+ * @var _lock
+ * protects the members (registration and rendering only)
+ */
+class Metrics
+{
+public:
+    /**
+     * @brief the metrics of the process
+     */
+    inline static Metrics &get()
+    {
+      static Metrics metrics;
+      return metrics;
+    }
+
+    /**
+     * @brief a counter owned by the registry, registering the same name and labels again returns the same counter
+     * @param name metric name (iva_<what>_total)
+     * @param help description of the metric
+     * @param labels labels of the series
+     * @return the counter, increment it with fetch_add (relaxed)
+     */
+    std::atomic<uint64_t> &counter(const std::string &name, const std::string &help, const MetricLabels &labels = {})
+    {
+      return this->_value(this->_counters, name, "counter", help, labels);
+    }
+
+    /**
+     * @brief a gauge owned by the registry (integer values, e.g. queue depths)
+     * @param name metric name
+     * @param help description of the metric
+     * @param labels labels of the series
+     * @return the gauge, update it with store/fetch_add/fetch_sub (relaxed)
+     */
+    std::atomic<int64_t> &gauge(const std::string &name, const std::string &help, const MetricLabels &labels = {})
+    {
+      return this->_value(this->_gauges, name, "gauge", help, labels);
+    }
+
+    /**
+     * @brief a series read at scrape time, replaces a series with the same name and labels
+     * @param name metric name
+     * @param type counter or gauge
+     * @param help description of the metric
+     * @param labels labels of the series
+     * @param value called on the scrape thread: must only read atomics (never take a lock of the streaming threads)
+     */
+    void observe(const std::string &name, const std::string &type, const std::string &help, const MetricLabels &labels,
+                 std::function<double()> value)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      Family &family = this->_family(name, type, help);
+      for (auto &series : family.series) {
+        if (series.first == labels) {
+          series.second = std::move(value);
+          return;
+        }
+      }
+      family.series.emplace_back(labels, std::move(value));
+    }
+
+    /**
+     * @brief remove every series of a metric with the given labels (e.g. a removed source)
+     * @param name metric name
+     * @param label label name
+     * @param value label value
+     */
+    void remove(const std::string &name, const std::string &label, const std::string &value)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      auto it = this->_families.find(name);
+      if (it == this->_families.end())
+        return;
+      auto &series = it->second.series;
+      series.erase(std::remove_if(series.begin(), series.end(), [&](const auto &s) {
+                     for (const auto &[k, v] : s.first) {
+                       if (k == label && v == value)
+                         return true;
+                     }
+                     return false;
+                   }), series.end());
+    }
+
+    /**
+     * @brief every series in the Prometheus text exposition format (version 0.0.4), with the resident memory of the process
+     * @return the body of a /metrics response
+     */
+    std::string render()
+    {
+      std::ostringstream oss;
+      oss.precision(10);
+      std::lock_guard<std::mutex> guard(this->_lock);
+      for (const auto &[name, family] : this->_families) {
+        if (family.series.empty())
+          continue;
+        oss << "# HELP " << name << " " << family.help << "\n# TYPE " << name << " " << family.type << "\n";
+        for (const auto &[labels, value] : family.series)
+        {
+          double v = value();
+          oss << name << formatLabels(labels) << " ";
+          if (std::isnan(v))
+            oss << "NaN";
+          else
+            oss << v;
+          oss << "\n";
+        }
+      }
+      oss << "# HELP process_resident_memory_bytes Resident memory size in bytes.\n# TYPE process_resident_memory_bytes gauge\n"
+          << "process_resident_memory_bytes " << residentMemoryBytes() << "\n";
+      return oss.str();
+    }
+
+    /**
+     * @brief labels in the exposition format, values escaped
+     * @return {name="value",...}, empty without labels
+     */
+    inline static std::string formatLabels(const MetricLabels &labels)
+    {
+      if (labels.empty())
+        return "";
+      std::string ret = "{";
+      for (const auto &[name, value] : labels) {
+        if (ret.size() > 1)
+          ret += ",";
+        ret += name + "=\"";
+        for (char c : value) {
+          if (c == '\n') {
+            ret += "\\n";
+            continue;
+          }
+          if (c == '\\' || c == '"')
+            ret += '\\';
+          ret += c;
+        }
+        ret += "\"";
+      }
+      return ret + "}";
+    }
+
+    /**
+     * @brief resident memory of the process (/proc/self/statm)
+     * @return bytes, 0 if unknown
+     */
+    inline static uint64_t residentMemoryBytes()
+    {
+      std::ifstream statm("/proc/self/statm");
+      uint64_t size = 0, resident = 0;
+      if (!(statm >> size >> resident))
+        return 0;
+      return resident * (uint64_t) sysconf(_SC_PAGESIZE);
+    }
+
+private:
+    struct Family {
+      std::string type;
+      std::string help;
+      std::vector<std::pair<MetricLabels, std::function<double()>>> series;
+    };
+    std::map<std::string, Family> _families;
+    std::deque<std::atomic<uint64_t>> _counters;
+    std::deque<std::atomic<int64_t>> _gauges;
+    std::mutex _lock;
+
+    Family &_family(const std::string &name, const std::string &type, const std::string &help)
+    {
+      Family &family = this->_families[name];
+      if (family.type.empty()) {
+        family.type = type;
+        family.help = help;
+      }
+      return family;
+    }
+
+    template <typename T>
+    std::atomic<T> &_value(std::deque<std::atomic<T>> &values, const std::string &name, const std::string &type, const std::string &help,
+                           const MetricLabels &labels)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      Family &family = this->_family(name, type, help);
+      for (const auto &series : family.series) {
+        if (series.first == labels && series.second.target<OwnedValue<T>>() != nullptr)
+          return *series.second.target<OwnedValue<T>>()->value;
+      }
+      std::atomic<T> *value = &values.emplace_back(0);
+      family.series.emplace_back(labels, OwnedValue<T>{value});
+      return *value;
+    }
+
+    template <typename T>
+    struct OwnedValue {
+      std::atomic<T> *value;
+      double operator()() const { return (double) this->value->load(std::memory_order_relaxed); }
+    };
+};
+
+}  // namespace core
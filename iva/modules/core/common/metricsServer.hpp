@@ -0,0 +1,144 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "logging.hpp"
+#include "metrics.hpp"
+
+namespace core
+{
+
+/**
+ * @class MetricsServer
+ * @brief minimal HTTP/1.0 server of GET /metrics (Prometheus text format) on a local port (application['metrics']). It runs on its
+ *  own thread and answers one scrape at a time, rendering the registry of core::Metrics.
+ *
+ * @var _socket
+ * the listening socket, -1 when stopped
+ * @var _thread
+ * the accept loop
+ * @var _running
+ * false to stop the accept loop
+ * @var scrapes
+ * number of requests served
+ */
+class MetricsServer
+{
+public:
+    ~MetricsServer() { this->stop(); }
+
+    /**
+     * @brief listen and serve scrapes on a thread
+     * @param address address to bind (127.0.0.1 keeps the endpoint local)
+     * @param port TCP port
+     * @return false if the port could not be bound
+     */
+    bool start(const std::string &address, int port)
+    {
+      this->_socket = socket(AF_INET, SOCK_STREAM, 0);
+      if (this->_socket < 0) {
+        LOG(ERROR) << "Could not create the metrics socket: " << strerror(errno);
+        return false;
+      }
+      int reuse = 1;
+      setsockopt(this->_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+      sockaddr_in addr{};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons((uint16_t) port);
+      if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1 || bind(this->_socket, (sockaddr *) &addr, sizeof(addr)) < 0 ||
+          listen(this->_socket, 4) < 0) {
+        LOG(ERROR) << "Could not serve metrics on " << address << ":" << port << ": " << strerror(errno);
+        close(this->_socket);
+        this->_socket = -1;
+        return false;
+      }
+      this->_running = true;
+      this->_thread = std::thread(&MetricsServer::_serve, this);
+      LOG(INFO) << "Serving metrics on http://" << address << ":" << port << "/metrics";
+      return true;
+    }
+
+    /**
+     * @brief stop serving (unblocks the accept loop and joins its thread)
+     */
+    void stop()
+    {
+      if (!this->_running.exchange(false))
+        return;
+      shutdown(this->_socket, SHUT_RDWR);
+      close(this->_socket);
+      this->_socket = -1;
+      if (this->_thread.joinable())
+        this->_thread.join();
+    }
+
+    /**
+     * @brief answer of the server to a request
+     * @param request the request line and headers
+     * @return a complete HTTP response
+     */
+    inline static std::string respond(const std::string &request)
+    {
+      std::string status = "200 OK", type = "text/plain; version=0.0.4; charset=utf-8", body;
+      if (request.rfind("GET /metrics", 0) == 0 && (request.size() == 12 || request[12] == ' ' || request[12] == '?'))
+        body = Metrics::get().render();
+      else if (request.rfind("GET ", 0) == 0) {
+        status = "404 Not Found";
+        body = "Not Found: the metrics are served on /metrics\n";
+      }
+      else {
+        status = "405 Method Not Allowed";
+        body = "Method Not Allowed\n";
+      }
+      return "HTTP/1.0 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) +
+             "\r\nConnection: close\r\n\r\n" + body;
+    }
+
+    std::atomic<uint64_t> scrapes = 0;
+
+private:
+    int _socket = -1;
+    std::thread _thread;
+    std::atomic<bool> _running = false;
+
+    void _serve()
+    {
+      while (this->_running) {
+        int client = accept(this->_socket, NULL, NULL);
+        if (client < 0) {
+          if (this->_running)
+            VLOG(DEBUG) << "Metrics accept failed: " << strerror(errno);
+          continue;
+        }
+        // a scrape that does not send its request within 2s is dropped
+        timeval timeout = {.tv_sec = 2, .tv_usec = 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        char buffer[2048];
+        ssize_t received = recv(client, buffer, sizeof(buffer) - 1, 0);
+        if (received > 0) {
+          std::string response = respond(std::string(buffer, received));
+          size_t sent = 0;
+          while (sent < response.size()) {
+            ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+              break;
+            sent += n;
+          }
+          this->scrapes++;
+        }
+        close(client);
+      }
+    }
+};
+
+}  // namespace core
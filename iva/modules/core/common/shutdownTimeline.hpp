@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "logging.hpp"
+#include "metrics.hpp"
+
+using njson = nlohmann::json;
+
+namespace core
+{
+
+/**
+ * @class ShutdownTimeline
+ * @brief monotonic timestamps of the shutdown phases (signal or end of the streams, every shard drained, kafka flushed, application
+ *  stopped), relative to the start of the shutdown. Exported as iva_shutdown_seconds{phase} and logged when the application stops.
+ *
+ * @var _origin
+ * start of the shutdown (the first begin() wins)
+ * @var _reason
+ * what started the shutdown (SIGTERM, SIGINT, end of stream, ...)
+ * @var _phases
+ * the phases in the order they were reached, with their time since _origin in microseconds
+ * @var _lock
+ * protects the members
+ */
+class ShutdownTimeline
+{
+public:
+    /**
+     * @brief the shutdown timeline of the process
+     */
+    inline static ShutdownTimeline &get()
+    {
+      static ShutdownTimeline timeline;
+      return timeline;
+    }
+
+    /**
+     * @brief start the shutdown, only the first call is kept
+     * @param reason what started it
+     * @return true if this call started the shutdown
+     */
+    bool begin(const std::string &reason)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      if (this->_started)
+        return false;
+      this->_started = true;
+      this->_origin = std::chrono::steady_clock::now();
+      this->_reason = reason;
+      LOG(INFO) << "Shutting down (" << reason << ")";
+      return true;
+    }
+
+    bool started()
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      return this->_started;
+    }
+
+    /**
+     * @brief record a phase, a phase marked twice keeps its first time (starts the shutdown if nothing did)
+     * @param phase name of the phase (snake_case)
+     */
+    void mark(const std::string &phase)
+    {
+      this->begin("application stopped");
+      std::lock_guard<std::mutex> guard(this->_lock);
+      for (const auto &[name, at] : this->_phases) {
+        if (name == phase)
+          return;
+      }
+      int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->_origin).count();
+      this->_phases.emplace_back(phase, now);
+      Metrics::get().observe("iva_shutdown_seconds", "gauge", "Time from the start of the shutdown to every shutdown phase.",
+                             {{"phase", phase}}, [now]() { return now / 1e6; });
+      VLOG(DEBUG) << "Shutdown phase=" << phase << " at " << now / 1000.0 << "ms";
+    }
+
+    /**
+     * @brief the phases reached so far
+     * @return {"reason": ..., "phases": [{phase, at_ms}]}
+     */
+    njson to_json()
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      njson phases = njson::array();
+      for (const auto &[phase, at] : this->_phases)
+        phases.push_back({{"phase", phase}, {"at_ms", at / 1000.0}});
+      return {{"reason", this->_reason}, {"phases", phases}};
+    }
+
+    /**
+     * @brief log the timeline
+     */
+    void dump()
+    {
+      njson timeline = this->to_json();
+      std::ostringstream oss;
+      oss << "Shutdown timeline (" << timeline["reason"].get<std::string>() << "):";
+      for (const auto &phase : timeline["phases"])
+        oss << "\n\t" << std::left << std::setw(36) << phase["phase"].get<std::string>() << std::right << std::setw(12) << std::fixed
+            << std::setprecision(1) << phase["at_ms"].get<double>() << "ms";
+      LOG(INFO) << oss.str();
+    }
+
+private:
+    bool _started = false;
+    std::chrono::steady_clock::time_point _origin;
+    std::string _reason;
+    std::vector<std::pair<std::string, int64_t>> _phases;
+    std::mutex _lock;
+};
+
+}  // namespace core
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "logging.hpp"
+#include "metrics.hpp"
+
+using njson = nlohmann::json;
+
+namespace core
+{
+
+/**
+ * @enum Milestone
+ * @brief phases reached from streaming or producer threads, recorded once (lock free once reached)
+ */
+enum class Milestone
+{
+  FIRST_FRAME = 0,
+  FIRST_INFERENCE,
+  FIRST_KAFKA_ACK,
+  COUNT
+};
+
+/**
+ * @class StartupTimeline
+ * @brief monotonic timestamps of the cold start phases (license activation, config parse, bin creation, READY->PLAYING, first frame,
+ *  first inference, first kafka ack), relative to the start of the process. Dumped as a timeline once the first inference is out and
+ *  exported as metrics (startup_<phase>_seconds) to logs/startup_timeline.json, and as iva_startup_seconds{phase} to core::Metrics.
+ *
+ * @var _origin
+ * start of the process (first use of the timeline, main() marks process_start first)
+ * @var _phases
+ * the phases in the order they were reached, with their time since _origin in microseconds
+ * @var _reached
+ * milestones already recorded
+ * @var _milestone_us
+ * time of the milestones (read by the metrics without the lock)
+ * @var _lock
+ * protects _phases
+ */
+class StartupTimeline
+{
+public:
+    /**
+     * @brief the timeline of the process
+     */
+    inline static StartupTimeline &get()
+    {
+      static StartupTimeline timeline;
+      static bool exported = timeline._export_metrics();
+      (void) exported;
+      return timeline;
+    }
+
+    /**
+     * @brief record a phase, a phase marked twice keeps its first time
+     * @param phase name of the phase (snake_case, used in the metric name)
+     */
+    void mark(const std::string &phase)
+    {
+      int64_t now = this->_elapsed_us();
+      if (!this->_record(phase, now) || !this->_exported)
+        return;
+      Metrics::get().observe("iva_startup_seconds", "gauge", "Time from the start of the process to every startup phase.",
+                             {{"phase", phase}}, [now]() { return now / 1e6; });
+    }
+
+    /**
+     * @brief record a milestone the first time it is reached, cheap enough for pad probes afterwards. The timeline is dumped
+     *  when the first inference is out.
+     * @param milestone the milestone
+     */
+    void mark_first(Milestone milestone)
+    {
+      if (this->_reached[(int) milestone].load(std::memory_order_relaxed) || this->_reached[(int) milestone].exchange(true))
+        return;
+      int64_t now = this->_elapsed_us();
+      this->_milestone_us[(int) milestone].store(std::max<int64_t>(1, now), std::memory_order_relaxed);
+      this->_record(milestoneName(milestone), now);
+      if (milestone == Milestone::FIRST_INFERENCE)
+        this->dump();
+      else if (milestone == Milestone::FIRST_KAFKA_ACK)
+        LOG(INFO) << "Startup: first kafka ack after " << this->_elapsed_us() / 1000 << "ms";
+    }
+
+    /**
+     * @brief name of a milestone in the timeline
+     */
+    inline static std::string milestoneName(Milestone milestone)
+    {
+      switch (milestone) {
+        case Milestone::FIRST_FRAME:
+          return "first_frame";
+        case Milestone::FIRST_INFERENCE:
+          return "first_inference";
+        case Milestone::FIRST_KAFKA_ACK:
+          return "first_kafka_ack";
+        default:
+          return "unknown";
+      }
+    }
+
+    /**
+     * @brief the phases reached so far
+     * @return json array of {phase, at_ms (since the start of the process), delta_ms (since the previous phase)}
+     */
+    njson to_json()
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      njson ret = njson::array();
+      int64_t previous = 0;
+      for (const auto &[phase, at] : this->_phases) {
+        ret.push_back({{"phase", phase}, {"at_ms", at / 1000.0}, {"delta_ms", (at - previous) / 1000.0}});
+        previous = at;
+      }
+      return ret;
+    }
+
+    /**
+     * @brief the phases as metrics
+     * @return map of startup_<phase>_seconds to the time since the start of the process
+     */
+    std::map<std::string, double> metrics()
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      std::map<std::string, double> ret;
+      for (const auto &[phase, at] : this->_phases)
+        ret["startup_" + phase + "_seconds"] = at / 1e6;
+      return ret;
+    }
+
+    /**
+     * @brief log the timeline and export its metrics to logs/startup_timeline.json
+     */
+    void dump()
+    {
+      njson timeline = this->to_json();
+      std::ostringstream oss;
+      oss << "Startup timeline:";
+      for (const auto &phase : timeline)
+        oss << "\n\t" << std::left << std::setw(36) << phase["phase"].get<std::string>() << std::right << std::setw(12) << std::fixed
+            << std::setprecision(1) << phase["at_ms"].get<double>() << "ms  (+" << phase["delta_ms"].get<double>() << "ms)";
+      LOG(INFO) << oss.str();
+
+      std::ofstream f("./logs/startup_timeline.json");
+      if (f.good())
+        f << njson{{"timeline", timeline}, {"metrics", this->metrics()}}.dump(2);
+    }
+
+private:
+    std::chrono::steady_clock::time_point _origin = std::chrono::steady_clock::now();
+    std::vector<std::pair<std::string, int64_t>> _phases;
+    std::array<std::atomic<bool>, (int) Milestone::COUNT> _reached{};
+    std::array<std::atomic<int64_t>, (int) Milestone::COUNT> _milestone_us{};
+    std::mutex _lock;
+    bool _exported = false;
+
+    // only the timeline of the process is exported (the milestones are reached on streaming threads, which never register metrics)
+    bool _export_metrics()
+    {
+      for (int m = 0; m < (int) Milestone::COUNT; m++) {
+        std::atomic<int64_t> *at = &this->_milestone_us[m];
+        Metrics::get().observe("iva_startup_seconds", "gauge", "Time from the start of the process to every startup phase.",
+                               {{"phase", milestoneName((Milestone) m)}}, [at]() {
+                                 int64_t us = at->load(std::memory_order_relaxed);
+                                 return us > 0 ? us / 1e6 : std::numeric_limits<double>::quiet_NaN();
+                               });
+      }
+      this->_exported = true;
+      return true;
+    }
+
+    bool _record(const std::string &phase, int64_t now)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      for (const auto &[name, at] : this->_phases) {
+        if (name == phase)
+          return false;
+      }
+      this->_phases.emplace_back(phase, now);
+      VLOG(DEBUG) << "Startup phase=" << phase << " at " << now / 1000.0 << "ms";
+      return true;
+    }
+
+    int64_t _elapsed_us()
+    {
+      return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->_origin).count();
+    }
+};
+
+}  // namespace core
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logging.hpp"
+#include "metrics.hpp"
+
+using njson = nlohmann::json;
+
+namespace core
+{
+
+/**
+ * @struct RestartPolicy
+ * @brief when the supervisor restarts a failed module (config.json application['supervisor'])
+ *
+ * @var enable
+ * restart the failed modules, otherwise a failed module is given up
+ * @var max_restarts
+ * restarts of a module allowed within window_s, the next failure is given up
+ * @var window_s
+ * period over which the restarts of a module are counted
+ * @var backoff_ms
+ * delay before the first restart of a module, doubled for every restart within window_s
+ * @var max_backoff_ms
+ * longest delay before a restart
+ */
+struct RestartPolicy {
+  bool enable = true;
+  int max_restarts = 5;
+  int window_s = 300;
+  int backoff_ms = 1000;
+  int max_backoff_ms = 30000;
+};
+
+/**
+ * @struct ModuleHealth
+ * @brief health of a supervised module (a pipeline shard or the kafka producer), the atomics are read by the metrics scrape
+ *
+ * @var restarts
+ * times of the restarts within the window (monotonic, microseconds)
+ * @var failed_us
+ * time of the failure being recovered, 0 while the module is up
+ * @var up
+ * 1 while the module runs, 0 from its failure to its recovery
+ * @var recovery_us
+ * sum of the recovery times (failure to running again) and number of recoveries
+ */
+struct ModuleHealth {
+  std::deque<int64_t> restarts;
+  int64_t failed_us = 0;
+  std::atomic<int64_t> up = 1;
+  std::atomic<uint64_t> *failures;
+  std::atomic<uint64_t> *restarted;
+  std::atomic<int64_t> recovery_us = 0;
+  std::atomic<int64_t> recoveries = 0;
+  std::string last_failure;
+};
+
+/**
+ * @class Supervisor
+ * @brief restarts a failed module with an exponential backoff, and gives it up when it keeps failing. The modules report their
+ *  failures and recoveries through the mediator; the restarts run on the thread of the supervisor after their delay, so the thread
+ *  of the failed module (a shard or the producer) is never blocked. Modules are never freed (the metrics read them).
+ *
+ * @var _modules
+ * health by module name (kafka, pipeline_shard<N>)
+ * @var _pending
+ * the scheduled restarts with their deadline
+ * @var _lock
+ * protects the members, _wake is notified when a restart is scheduled or the supervisor stops
+ */
+class Supervisor
+{
+public:
+    Supervisor() = default;
+    Supervisor(const Supervisor &) = delete;
+    Supervisor &operator=(const Supervisor &) = delete;
+    ~Supervisor() { this->stop(); }
+
+    /**
+     * @brief set the policy and start the thread that runs the restarts
+     */
+    void start(const RestartPolicy &policy)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      this->_policy = policy;
+      if (this->_running)
+        return;
+      this->_running = true;
+      this->_thread = std::thread(&Supervisor::_run, this);
+    }
+
+    /**
+     * @brief drop the pending restarts and join the thread (a restart that is running completes first)
+     */
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> guard(this->_lock);
+        if (!this->_running)
+          return;
+        this->_running = false;
+        this->_pending.clear();
+      }
+      this->_wake.notify_all();
+      if (this->_thread.joinable() && this->_thread.get_id() != std::this_thread::get_id())
+        this->_thread.join();
+      else if (this->_thread.joinable())
+        this->_thread.detach();
+    }
+
+    /**
+     * @brief a module failed: decide its restart
+     * @param module name of the module
+     * @param reason what failed (logged)
+     * @param now_us monotonic time
+     * @return delay before the restart in milliseconds, -1 if the module is given up
+     */
+    int failed(const std::string &module, const std::string &reason, int64_t now_us)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      ModuleHealth *health = this->_health(module);
+      health->failures->fetch_add(1, std::memory_order_relaxed);
+      health->up.store(0, std::memory_order_relaxed);
+      health->last_failure = reason;
+      if (health->failed_us == 0)
+        health->failed_us = now_us;
+      while (!health->restarts.empty() && now_us - health->restarts.front() > (int64_t) this->_policy.window_s * 1000000)
+        health->restarts.pop_front();
+      if (!this->_policy.enable || (int) health->restarts.size() >= this->_policy.max_restarts)
+        return -1;
+      int64_t delay = (int64_t) this->_policy.backoff_ms << std::min((int) health->restarts.size(), 20);
+      health->restarts.push_back(now_us);
+      health->restarted->fetch_add(1, std::memory_order_relaxed);
+      return (int) std::min(delay, (int64_t) this->_policy.max_backoff_ms);
+    }
+
+    /**
+     * @brief a module runs again after a restart
+     * @param module name of the module
+     * @param now_us monotonic time
+     * @return time since its failure in seconds, -1 if the module had not failed
+     */
+    double recovered(const std::string &module, int64_t now_us)
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      ModuleHealth *health = this->_health(module);
+      if (health->failed_us == 0)
+        return -1;
+      int64_t recovery = now_us - health->failed_us;
+      health->failed_us = 0;
+      health->up.store(1, std::memory_order_relaxed);
+      health->recovery_us.fetch_add(recovery, std::memory_order_relaxed);
+      health->recoveries.fetch_add(1, std::memory_order_relaxed);
+      return recovery / 1e6;
+    }
+
+    /**
+     * @brief run a restart on the thread of the supervisor after a delay (dropped if the supervisor stops first)
+     * @param delay_ms the delay
+     * @param restart the restart
+     * @return false if the supervisor is not running
+     */
+    bool schedule(int delay_ms, std::function<void()> restart)
+    {
+      {
+        std::lock_guard<std::mutex> guard(this->_lock);
+        if (!this->_running)
+          return false;
+        this->_pending.emplace(std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms), std::move(restart));
+      }
+      this->_wake.notify_all();
+      return true;
+    }
+
+    /**
+     * @brief restarts, failures and mean recovery time by module
+     */
+    njson to_json()
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      njson ret = njson::object();
+      for (const auto &[name, health] : this->_modules) {
+        int64_t recoveries = health->recoveries.load(std::memory_order_relaxed);
+        ret[name] = {{"up", health->up.load(std::memory_order_relaxed) == 1},
+                     {"failures", health->failures->load(std::memory_order_relaxed)},
+                     {"restarts", health->restarted->load(std::memory_order_relaxed)},
+                     {"mean_recovery_s", recoveries > 0 ? health->recovery_us.load(std::memory_order_relaxed) / 1e6 / recoveries : 0.0},
+                     {"last_failure", health->last_failure}};
+      }
+      return ret;
+    }
+
+private:
+    RestartPolicy _policy;
+    std::map<std::string, ModuleHealth *> _modules;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> _pending;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::thread _thread;
+    bool _running = false;
+
+    ModuleHealth *_health(const std::string &module)
+    {
+      auto it = this->_modules.find(module);
+      if (it != this->_modules.end())
+        return it->second;
+      ModuleHealth *health = new ModuleHealth();
+      MetricLabels labels = {{"module", module}};
+      Metrics &metrics = Metrics::get();
+      health->failures = &metrics.counter("iva_module_failures_total", "Failures of a supervised module.", labels);
+      health->restarted = &metrics.counter("iva_module_restarts_total", "Restarts of a supervised module.", labels);
+      metrics.observe("iva_module_up", "gauge", "1 while a supervised module runs, 0 while it is restarted.", labels,
+                      [health]() { return (double) health->up.load(std::memory_order_relaxed); });
+      metrics.observe("iva_module_recovery_seconds", "gauge", "Mean time from the failure of a module to its restart.", labels, [health]() {
+        int64_t recoveries = health->recoveries.load(std::memory_order_relaxed);
+        return recoveries > 0 ? health->recovery_us.load(std::memory_order_relaxed) / 1e6 / recoveries : 0.0;
+      });
+      this->_modules[module] = health;
+      return health;
+    }
+
+    void _run()
+    {
+      std::unique_lock<std::mutex> lock(this->_lock);
+      while (this->_running) {
+        if (this->_pending.empty()) {
+          this->_wake.wait(lock);
+          continue;
+        }
+        auto next = this->_pending.begin();
+        if (this->_wake.wait_until(lock, next->first) != std::cv_status::timeout)
+          continue;
+        next = this->_pending.begin();
+        if (next == this->_pending.end() || next->first > std::chrono::steady_clock::now())
+          continue;
+        std::function<void()> restart = std::move(next->second);
+        this->_pending.erase(next);
+        // a restart reports its failure to the supervisor again (failed), so it runs without the lock
+        lock.unlock();
+        restart();
+        lock.lock();
+      }
+    }
+};
+
+}  // namespace core
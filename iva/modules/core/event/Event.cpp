@@ -134,3 +134,65 @@ PipelineEvent::PipelineEvent(const int action, const std::string uuid, const gin
     this->t = core::events::Type::PIPELINE;
     this->_target = core::events::Module::MODULE_PIPELINE;
 }
+
+/***************
+ * SourceEvent *
+ ***************/
+
+/**
+ * @brief SourceEvent structure for adding a source to the running pipeline
+ *
+ * @param action    ADD_SOURCE (refer to Event.h)
+ * @param uri       the source to add
+ * @param sink      the sink of the source (ignored for pipeline['sink_type']=display)
+ * @param src       the sender module of the event
+ */
+core::SourceEvent::SourceEvent(const int action, const std::string uri, const std::string sink, const guint src)
+{
+  this->_action = action;
+  this->t = core::events::Type::PIPELINE;
+  this->_target = core::events::Module::MODULE_PIPELINE;
+  this->_source = src;
+  this->uri = uri;
+  this->sink = sink;
+}
+
+/**
+ * @brief SourceEvent structure for removing a source from the running pipeline
+ *
+ * @param action    REMOVE_SOURCE (refer to Event.h)
+ * @param source_id the id of the source to remove
+ * @param src       the sender module of the event
+ */
+core::SourceEvent::SourceEvent(const int action, const int source_id, const guint src)
+{
+  this->_action = action;
+  this->t = core::events::Type::PIPELINE;
+  this->_target = core::events::Module::MODULE_PIPELINE;
+  this->_source = src;
+  this->source_id = source_id;
+}
+
+/***************
+ * HealthEvent *
+ ***************/
+
+/**
+ * @brief HealthEvent structure for the failures, restarts and recoveries of a module
+ *
+ * @param action    MODULE_FAILED, RESTART_MODULE or MODULE_RECOVERED (refer to Event.h)
+ * @param module    the module (MODULE_KAFKA or MODULE_PIPELINE)
+ * @param shard     the pipeline shard, -1 for the other modules
+ * @param reason    why the module failed
+ * @param src       the sender module of the event
+ */
+core::HealthEvent::HealthEvent(const int action, const int module, const int shard, const std::string reason, const guint src)
+{
+  this->_action = action;
+  this->t = core::events::Type::APPCONTEXT;
+  this->_target = core::events::Module::MODULE_APPCONTEXT;
+  this->_source = src;
+  this->module = module;
+  this->shard = shard;
+  this->reason = reason;
+}
@@ -73,6 +73,12 @@ enum Actions {
   CONFIGURE_MODULES,
   KAFKA_PRODUCE_PAYLOAD,
   KAFKA_CONSUME_PAYLOAD,
+  ADD_SOURCE,
+  REMOVE_SOURCE,
+  RELOAD_CONFIGS,
+  MODULE_FAILED,
+  RESTART_MODULE,
+  MODULE_RECOVERED,
   ERROR_ACTION = 9999
 };
 
@@ -82,6 +88,12 @@ const std::map<Actions, std::string> action_to_str{{Actions::NO_ACTION, "NO_ACTI
                                                    {Actions::CONFIGURE_MODULES, "CONFIGURE_MODULES"},
                                                    {Actions::KAFKA_PRODUCE_PAYLOAD, "KAFKA_PRODUCE_PAYLOAD"},
                                                    {Actions::KAFKA_CONSUME_PAYLOAD, "KAFKA_CONSUME_PAYLOAD"},
+                                                   {Actions::ADD_SOURCE, "ADD_SOURCE"},
+                                                   {Actions::REMOVE_SOURCE, "REMOVE_SOURCE"},
+                                                   {Actions::RELOAD_CONFIGS, "RELOAD_CONFIGS"},
+                                                   {Actions::MODULE_FAILED, "MODULE_FAILED"},
+                                                   {Actions::RESTART_MODULE, "RESTART_MODULE"},
+                                                   {Actions::MODULE_RECOVERED, "MODULE_RECOVERED"},
                                                    {Actions::ERROR_ACTION, "ERROR_ACTION"}};
 
 std::ostream &operator<<(std::ostream &os, core::events::Actions action);
@@ -217,4 +229,49 @@ class KafkaEvent : public EventBase {
   std::string _requested_uuid;
 };
 
+/**
+ * @class SourceEvent
+ * @brief Derived from EventBase and responsible for adding/removing pipeline sources at runtime
+ * @var uri
+ * the source to add (same format as config.json pipeline['sources'])
+ * @var sink
+ * the sink of the source to add (same format as config.json pipeline['sinks'])
+ * @var source_id
+ * the id of the source to remove (set to the id of the added source by ADD_SOURCE, -1 if it failed)
+ */
+class SourceEvent : public EventBase {
+ public:
+  using EventBase::EventBase;
+
+  SourceEvent(const gint action, const std::string uri, const std::string sink = "", const guint src = 0);
+
+  SourceEvent(const gint action, const int source_id, const guint src = 0);
+
+  std::string uri;
+  std::string sink;
+  int source_id = -1;
+};
+
+/**
+ * @class HealthEvent
+ * @brief Derived from EventBase and responsible for the health of the modules (failures, restarts and recoveries supervised by
+ *  ApplicationContext)
+ * @var module
+ * the module (events::Module): MODULE_KAFKA or MODULE_PIPELINE
+ * @var shard
+ * the pipeline shard, -1 for the other modules
+ * @var reason
+ * why the module failed (MODULE_FAILED)
+ */
+class HealthEvent : public EventBase {
+ public:
+  using EventBase::EventBase;
+
+  HealthEvent(const gint action, const int module, const int shard = -1, const std::string reason = "", const guint src = 0);
+
+  int module = events::Module::MODULE_NONE;
+  int shard = -1;
+  std::string reason;
+};
+
 }  // namespace core
\ No newline at end of file
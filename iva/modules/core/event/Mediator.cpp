@@ -24,6 +24,8 @@ core::Mediator::Mediator(
     core::Pipeline *pipeline
     )
 {
+  for (const auto &[action, name] : events::action_to_str)
+    this->_event_counters[action] = &core::Metrics::get().counter("iva_events_total", "Events notified to the mediator.", {{"action", name}});
   LOG(INFO) << "Setting application and assigning mediator to all classes";
   this->app_context = app_context;
   this->kafka = kafka;
@@ -57,6 +59,9 @@ void core::Mediator::notify(core::EventBase *event)
   VLOG(EVENT)  << "Event Notification: \n" << *event;
 
   int action = event->action();
+  auto counter = this->_event_counters.find(action);
+  if (counter != this->_event_counters.end())
+    counter->second->fetch_add(1, std::memory_order_relaxed);
   // signal
   switch (action) {
     case events::Actions::CONFIGURE_MODULES: {
@@ -100,16 +105,14 @@ void core::Mediator::notify(core::EventBase *event)
        */
       LOG(INFO) << "Called: events::Actions::STOP_MODULES ";
       event->own();
+      this->app_context->stop_supervisor();
 
-      if (this->kafka->get_run_state()) {
-        LOG(INFO) << "Mediator closing kafka";
-        this->kafka->stop();
-      }
-      else
-        LOG(INFO) << "Mediator found that Kafka is already terminated";
+      // stop() returns once the producer flushed (or its deadline expired), it also ends a broker validation still retrying
+      LOG(INFO) << "Mediator closing kafka";
+      this->kafka->stop();
+      core::ShutdownTimeline::get().mark("kafka_flushed");
 
       LOG(INFO) << "Mediator closing app_context";
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
       this->app_context->kill_app();
       LOG(INFO) << "Mediator updated app_context to close app (state=" << this->app_context->app_state << ")";
       event->end();
@@ -126,6 +129,87 @@ void core::Mediator::notify(core::EventBase *event)
       event->end();
       break;
     }
+    case events::Actions::ADD_SOURCE: {
+      /**
+       * @brief adds a source (and its sink) to the running pipeline
+       */
+      VLOG(EVENT) << "Called: events::Actions::ADD_SOURCE ";
+      SourceEvent *poly_event = dynamic_cast<SourceEvent *>(event);
+      poly_event->own();
+      poly_event->source_id = this->pipeline->add_source(poly_event->uri, poly_event->sink);
+      if (poly_event->source_id < 0)
+        LOG(WARNING) << "Mediator could not add source=" << poly_event->uri;
+      event->end();
+      break;
+    }
+    case events::Actions::REMOVE_SOURCE: {
+      /**
+       * @brief removes a source (and its sink) from the running pipeline
+       */
+      VLOG(EVENT) << "Called: events::Actions::REMOVE_SOURCE ";
+      SourceEvent *poly_event = dynamic_cast<SourceEvent *>(event);
+      poly_event->own();
+      if (!this->pipeline->remove_source(poly_event->source_id))
+        LOG(WARNING) << "Mediator could not remove source=" << poly_event->source_id;
+      event->end();
+      break;
+    }
+    case events::Actions::RELOAD_CONFIGS: {
+      /**
+       * @brief config.json changed while running: processing takes its new settings (the other modules need a restart)
+       */
+      VLOG(EVENT) << "Called: events::Actions::RELOAD_CONFIGS ";
+      event->own();
+      bool applied = this->pipeline->processor->set_configs(this->app_context->get_reloaded_configs(core::events::Type::PROCESSING));
+      if (!applied)
+        LOG(WARNING) << "Mediator kept the running processing configs, config.json processing is invalid";
+      this->app_context->set_reload_result(core::events::Type::PROCESSING, applied);
+      event->end();
+      break;
+    }
+    case events::Actions::MODULE_FAILED: {
+      /**
+       * @brief a module failed: the supervisor of app_context restarts it after a backoff (RESTART_MODULE) or gives it up. A shard
+       *  given up ends like a finished stream, kafka given up drains the shards (EOS) and the application stops with STOP_MODULES.
+       */
+      VLOG(EVENT) << "Called: events::Actions::MODULE_FAILED ";
+      HealthEvent *poly_event = dynamic_cast<HealthEvent *>(event);
+      poly_event->own();
+      if (!this->app_context->module_failed(poly_event->module, poly_event->shard, poly_event->reason)) {
+        if (poly_event->module == events::Module::MODULE_PIPELINE)
+          this->pipeline->retire_shard(poly_event->shard);
+        else if (!this->pipeline->drain("kafka failed"))
+          this->app_context->kill_app();
+      }
+      event->end();
+      break;
+    }
+    case events::Actions::RESTART_MODULE: {
+      /**
+       * @brief restart a failed module (from the supervisor of app_context, after its backoff), the other modules keep running
+       */
+      VLOG(EVENT) << "Called: events::Actions::RESTART_MODULE ";
+      HealthEvent *poly_event = dynamic_cast<HealthEvent *>(event);
+      poly_event->own();
+      bool restarted = poly_event->module == events::Module::MODULE_PIPELINE ? this->pipeline->restart_shard(poly_event->shard)
+                                                                              : this->kafka->restart();
+      if (!restarted)
+        this->notify(new HealthEvent(events::Actions::MODULE_FAILED, poly_event->module, poly_event->shard, "restart failed",
+                                     events::Module::MODULE_APPCONTEXT));
+      event->end();
+      break;
+    }
+    case events::Actions::MODULE_RECOVERED: {
+      /**
+       * @brief a restarted module runs again
+       */
+      VLOG(EVENT) << "Called: events::Actions::MODULE_RECOVERED ";
+      HealthEvent *poly_event = dynamic_cast<HealthEvent *>(event);
+      poly_event->own();
+      this->app_context->module_recovered(poly_event->module, poly_event->shard);
+      event->end();
+      break;
+    }
   }
   // clean up
   if (event->completed() && !event->owned()) {
@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "logging.hpp"
+#include "metrics.hpp"
 #include "Event.h"
 
 namespace core
@@ -32,6 +33,8 @@ class EventBase;
  * the gstreamer service to run video pipelines and realtime inference
  * @var _mutex
  * safe access between threads or concurrent calls
+ * @var _event_counters
+ * events notified per action (iva_events_total{action}), built by the constructor and read-only afterwards
  */
 class Mediator
 {
@@ -49,6 +52,7 @@ private:
     core::KafkaBroker *kafka;
     core::Pipeline *pipeline;
     std::mutex _mutex;
+    std::map<int, std::atomic<uint64_t> *> _event_counters;
 };
 }  // namespace core
 
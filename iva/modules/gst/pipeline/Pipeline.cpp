@@ -14,7 +14,19 @@ Pipeline::Pipeline()
   LOG(INFO) << "CREATED: " << *this;
 }
 
-Pipeline::~Pipeline() {}
+/**
+ * @brief free the shards once their threads returned (the pool runs one thread per shard until its main loop quits)
+ */
+Pipeline::~Pipeline()
+{
+  this->_pool.wait_for_tasks();
+  // the elements of the QoS tables stay, the metrics read them
+  for (PipelineShard *shard : this->_shards) {
+    delete shard->bus_struct.qos;
+    delete shard;
+  }
+  this->_shards.clear();
+}
 
 /**
  * @brief set up the class to it can run a gstreamer pipeline
@@ -23,20 +35,62 @@ Pipeline::~Pipeline() {}
 bool Pipeline::_set_up()
 {
   this->processor->set_up(this->_configs.source_count);
-  if (!this->_setup_pipeline_bus())
-    return false;
+  std::vector<std::string> stages;
+  for (const auto &stage : this->_configs.inference)
+    stages.push_back(stage.name);
+  this->processor->set_inference_stages(stages);
+  gst_init(NULL, NULL);
+  this->_add_clip_recorder();
+  // nvdsosd draws the gpu mosaic from the batch metadata, nothing would consume the overlay queues
+  if (this->_configs.sink_type == "tiled" && this->_configs.profile == "gpu")
+    this->processor->disable_overlay();
+  // passthrough recordings keep the detections in a sidecar instead of drawing them
+  if (this->_configs.record.passthrough) {
+    this->processor->disable_overlay();
+    this->processor->add_payload_hook([this](int source_id, njson &payload) {
+      recording::Passthrough *recording = this->_recordings.get(source_id);
+      if (recording != nullptr)
+        recording->sidecar.payload(payload);
+    });
+  }
+
+  // payloads say whether their source was moving (the frames of a still source are only inferred for keep-alive)
+  if (this->_configs.motion_gate.enable) {
+    this->_motion.policy = this->_configs.motion_gate;
+    this->processor->add_payload_hook([this](int source_id, njson &payload) {
+      motionGate::SourceMotion *source = this->_motion.get(source_id);
+      if (source != nullptr)
+        payload["meta"]["motion"] = g_get_monotonic_time() < source->motion_until_us.load(std::memory_order_relaxed);
+    });
+  }
+
+  // partition the sources across independent pipelines (shards)
+  std::vector<std::vector<int>> partitions = pipelineUtils::partitionSources(this->_configs.source_count, this->_configs.shards);
+  for (int s = 0; s < this->_configs.shards; s++) {
+    PipelineShard *shard = new PipelineShard();
+    shard->id = s;
+    shard->source_ids = partitions[s];
+    // leave room in every shard's batch for the sources that can be added at runtime
+    int max_per_shard = (this->_configs.max_sources + this->_configs.shards - 1) / this->_configs.shards;
+    shard->batch_size = std::max((int) shard->source_ids.size(), max_per_shard);
+    this->_shards.push_back(shard);
+    if (!this->_setup_pipeline_bus(shard))
+      return false;
+  }
 
   bool ret = false;
 
   // check if using yaml builder or production builder
   if(this->_configs.src_type == "file" || this->_configs.src_type == "rtsp") {
-    LOG(INFO) << "Detected pipeline.type=(file, rtsp)=" << this->_configs.src_type;
-    ret = this->_create_pipeline();
+    LOG(INFO) << "Detected pipeline.type=(file, rtsp)=" << this->_configs.src_type << " with shards=" << this->_configs.shards;
+    ret = true;
+    for (PipelineShard *shard : this->_shards)
+      ret = ret && this->_create_pipeline(shard);
   }
 #ifdef YAML_CONFIGS
   else if (this->_configs.src_type == "yaml") {
     LOG(INFO) << "Detected pipeline.type=(yaml)=" << this->_configs.src_type;
-    ret = this->_create_pipeline_from_yaml(this->_yaml_configs);
+    ret = this->_create_pipeline_from_yaml(this->_shards[0], this->_yaml_configs);
   }
 #endif
   else {
@@ -106,10 +160,397 @@ bool Pipeline::set_configs(njson conf)
       return false;
     }
 
+    // optional: number of independent pipelines the sources are split across
+    int shards = 1;
+    if(conf.contains("shards")) {
+      if(!conf["shards"].is_number_integer() || conf["shards"].get<int>() < 1){
+        LOG(WARNING) << "Invalid config.json element! pipeline['shards'] must be an integer >= 1";
+        return false;
+      }
+      shards = conf["shards"].get<int>();
+    }
+
+    // optional: upper bound of sources (configured + added at runtime), used to size the batch of each shard
+    int max_sources = (int) conf["sources"].size();
+    if(conf.contains("max_sources")) {
+      if(!conf["max_sources"].is_number_integer() || conf["max_sources"].get<int>() < (int) conf["sources"].size()){
+        LOG(WARNING) << "Invalid config.json element! pipeline['max_sources'] must be an integer >= the number of pipeline['sources']";
+        return false;
+      }
+      max_sources = conf["max_sources"].get<int>();
+    }
+
+    // optional: backoff used to restart a source after an error
+    sourceHealth::ReconnectPolicy reconnect;
+    if(conf.contains("reconnect")) {
+      njson rc = conf["reconnect"];
+      if(!rc.is_object()){
+        LOG(WARNING) << "Invalid config.json element! pipeline['reconnect'] must be an object";
+        return false;
+      }
+      for (const std::string key : {"base_ms", "max_ms", "max_attempts"}) {
+        if(rc.contains(key) && (!rc[key].is_number_integer() || rc[key].get<int>() < 0)){
+          LOG(WARNING) << "Invalid config.json element! pipeline['reconnect']['" << key << "'] must be an integer >= 0";
+          return false;
+        }
+      }
+      if(rc.contains("jitter") && (!rc["jitter"].is_number() || rc["jitter"].get<double>() < 0 || rc["jitter"].get<double>() > 1)){
+        LOG(WARNING) << "Invalid config.json element! pipeline['reconnect']['jitter'] must be a number between 0 and 1";
+        return false;
+      }
+      reconnect.base_ms = rc.value("base_ms", reconnect.base_ms);
+      reconnect.max_ms = rc.value("max_ms", reconnect.max_ms);
+      reconnect.jitter = rc.value("jitter", reconnect.jitter);
+      reconnect.max_attempts = rc.value("max_attempts", reconnect.max_attempts);
+    }
+
+    // optional: buffer-flow watchdog of the sources
+    sourceHealth::WatchdogPolicy watchdog;
+    if(conf.contains("watchdog")) {
+      njson wd = conf["watchdog"];
+      if(!wd.is_object()){
+        LOG(WARNING) << "Invalid config.json element! pipeline['watchdog'] must be an object";
+        return false;
+      }
+      if(wd.contains("enable") && !wd["enable"].is_boolean()){
+        LOG(WARNING) << "Invalid config.json element! pipeline['watchdog']['enable'] must be a boolean";
+        return false;
+      }
+      for (const std::string key : {"interval_ms", "stall_ms"}) {
+        if(wd.contains(key) && (!wd[key].is_number_integer() || wd[key].get<int>() < 1)){
+          LOG(WARNING) << "Invalid config.json element! pipeline['watchdog']['" << key << "'] must be an integer >= 1";
+          return false;
+        }
+      }
+      if(wd.contains("actions")) {
+        if(!wd["actions"].is_array() || !pipelineUtils::areAllElementsStrings(wd["actions"])){
+          LOG(WARNING) << "Invalid config.json element! pipeline['watchdog']['actions'] must be an array of strings";
+          return false;
+        }
+        watchdog.log = false;
+        for (const auto &action : wd["actions"]) {
+          if (action == "log")
+            watchdog.log = true;
+          else if (action == "event")
+            watchdog.event = true;
+          else if (action == "restart")
+            watchdog.restart = true;
+          else {
+            LOG(WARNING) << "Invalid config.json element! pipeline['watchdog']['actions'] must be one of the following (log, event, restart): " << action;
+            return false;
+          }
+        }
+      }
+      watchdog.enable = wd.value("enable", watchdog.enable);
+      watchdog.interval_ms = wd.value("interval_ms", watchdog.interval_ms);
+      watchdog.stall_ms = wd.value("stall_ms", watchdog.stall_ms);
+    }
+
+    // optional: gpu (DeepStream elements) or cpu (software elements with a stub detector)
+#ifdef CPU_ONLY
+    std::string profile = "cpu";
+#else
+    std::string profile = "gpu";
+#endif
+    if(conf.contains("profile")) {
+      if(!conf["profile"].is_string() || (conf["profile"] != "gpu" && conf["profile"] != "cpu")){
+        LOG(WARNING) << "Invalid config.json element! pipeline['profile'] must be one of the following (gpu, cpu)";
+        return false;
+      }
+      profile = conf["profile"].get<std::string>();
+    }
+#ifdef CPU_ONLY
+    if(profile != "cpu") {
+      LOG(WARNING) << "Invalid config.json element! pipeline['profile'] must be cpu, the application is built without DeepStream (CPU_ONLY)";
+      return false;
+    }
+#endif
+
+    // optional: named encoder profiles of the rtmp/file sinks (merged over the built-in ones) and the one to use
+    std::map<std::string, encoding::EncoderProfile> encoders = encoding::defaultProfiles();
+    if(conf.contains("encoder_profiles")) {
+      if(!conf["encoder_profiles"].is_object()) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['encoder_profiles'] must be an object of named profiles";
+        return false;
+      }
+      for (auto &[name, encoder_conf] : conf["encoder_profiles"].items()) {
+        encoding::EncoderProfile encoder = encoders.count(name) ? encoders[name] : encoding::EncoderProfile();
+        if (!encoding::parseProfile(name, encoder_conf, encoder))
+          return false;
+        encoders[name] = encoder;
+      }
+    }
+    std::string encoder_name = conf.value("encoder_profile", (std::string) "realtime");
+    if(encoders.count(encoder_name) == 0) {
+      LOG(WARNING) << "Invalid config.json element! pipeline['encoder_profile'] is not a built-in profile nor in pipeline['encoder_profiles']: " << encoder_name;
+      return false;
+    }
+
+    // optional: mosaic of sink_type=tiled, rows/columns default to a square grid of max_sources tiles
+    pipelineUtils::TileLayout tiler;
+    if(conf.contains("tiler")) {
+      njson tl = conf["tiler"];
+      if(!tl.is_object()){
+        LOG(WARNING) << "Invalid config.json element! pipeline['tiler'] must be an object";
+        return false;
+      }
+      for (const char *key : {"rows", "columns", "width", "height"}) {
+        if(tl.contains(key) && (!tl[key].is_number_integer() || tl[key].get<int>() < 0)) {
+          LOG(WARNING) << "Invalid config.json element! pipeline['tiler']['" << key << "'] must be an integer >= 0";
+          return false;
+        }
+      }
+      tiler.rows = tl.value("rows", tiler.rows);
+      tiler.columns = tl.value("columns", tiler.columns);
+      tiler.width = tl.value("width", tiler.width);
+      tiler.height = tl.value("height", tiler.height);
+      if(tiler.width == 0 || tiler.height == 0) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['tiler'] width and height must be > 0";
+        return false;
+      }
+    }
+    tiler = pipelineUtils::computeTileLayout(tiler, max_sources);
+
     bool live_src = false;
     if(conf["src_type"] == "rtsp")
       live_src = true;
 
+    // optional: file sources seek back to their start instead of ending
+    bool loop = false;
+    if(conf.contains("loop")) {
+      if(!conf["loop"].is_boolean()){
+        LOG(WARNING) << "Invalid config.json element! pipeline['loop'] must be a boolean";
+        return false;
+      }
+      loop = conf["loop"].get<bool>();
+      if(loop && conf["src_type"] != "file") {
+        LOG(WARNING) << "pipeline['loop'] only applies to file sources (src_type=file), ignoring it";
+        loop = false;
+      }
+    }
+
+    // optional: per-buffer latency from the decoder to every stage of the pipeline (pad probes are only added when set)
+    bool trace_latency = false;
+    if(conf.contains("trace_latency")) {
+      if(!conf["trace_latency"].is_boolean()){
+        LOG(WARNING) << "Invalid config.json element! pipeline['trace_latency'] must be a boolean";
+        return false;
+      }
+      trace_latency = conf["trace_latency"].get<bool>();
+    }
+
+    // optional: time a shard has to drain after SIGTERM/SIGINT (the EOS finalizes the files) before it is stopped
+    int eos_timeout_ms = 5000;
+    if(conf.contains("eos_timeout_ms")) {
+      if(!conf["eos_timeout_ms"].is_number_integer() || conf["eos_timeout_ms"].get<int>() <= 0){
+        LOG(WARNING) << "Invalid config.json element! pipeline['eos_timeout_ms'] must be an integer > 0";
+        return false;
+      }
+      eos_timeout_ms = conf["eos_timeout_ms"].get<int>();
+    }
+
+    // optional: per-element throughput, processing time and queue fill, logged as a table of the hot elements
+    elementProfiler::ProfilerPolicy profiler;
+    if(conf.contains("profiler")) {
+      const njson &pc = conf["profiler"];
+      if(!pc.is_object()) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['profiler'] must be an object";
+        return false;
+      }
+      profiler.installed = true;
+      profiler.enabled = pc.value("enabled", profiler.enabled);
+      profiler.interval_s = pc.value("interval_s", profiler.interval_s);
+      profiler.top = pc.value("top", profiler.top);
+      if(profiler.interval_s <= 0 || profiler.top <= 0) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['profiler'] interval_s and top must be > 0";
+        return false;
+      }
+    }
+
+    // optional: record file sinks as received (no decode/draw/encode), the detections go to a sidecar
+    recording::RecordPolicy record;
+    if(conf.contains("record")) {
+      if(!conf["record"].is_string() || (conf["record"] != "encode" && conf["record"] != "passthrough")) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['record'] must be one of the following (encode, passthrough)";
+        return false;
+      }
+      record.passthrough = conf["record"] == "passthrough";
+      if(record.passthrough && (conf["sink_type"] != "file" || (conf["src_type"] != "file" && conf["src_type"] != "rtsp"))) {
+        LOG(WARNING) << "pipeline['record']=passthrough only applies to sink_type=file with file or rtsp sources, ignoring it";
+        record.passthrough = false;
+      }
+    }
+    if(conf.contains("record_segment_s")) {
+      if(!conf["record_segment_s"].is_number_integer() || conf["record_segment_s"].get<int>() < 0) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['record_segment_s'] must be an integer >= 0";
+        return false;
+      }
+      record.segment_s = conf["record_segment_s"].get<int>();
+    }
+
+    // optional: the nvinfer stages, a primary detector then secondary stages on its objects (default: model/detection.yml)
+    std::vector<inferenceCascade::InferenceStage> inference = inferenceCascade::defaultCascade(BASE_DIR + "/model");
+    if(conf.contains("inference")) {
+      std::string error;
+      if(!inferenceCascade::parseCascade(conf["inference"], BASE_DIR + "/model", inference, error)) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['inference']" << error;
+        return false;
+      }
+      if(profile != "gpu")
+        LOG(WARNING) << "pipeline['inference'] configures nvinfer and only applies to pipeline['profile']=gpu, ignoring it";
+    }
+
+    // optional: skip nvinfer on the batches of sources without motion (the tracker and the sinks still get every frame)
+    motionGate::MotionPolicy motion_gate;
+    if(conf.contains("motion_gate")) {
+      const njson &mc = conf["motion_gate"];
+      if(!mc.is_object()) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['motion_gate'] must be an object";
+        return false;
+      }
+      motion_gate.enable = mc.value("enable", true);
+      motion_gate.width = mc.value("width", motion_gate.width);
+      motion_gate.pixel_threshold = mc.value("pixel_threshold", motion_gate.pixel_threshold);
+      motion_gate.min_changed = mc.value("min_changed", motion_gate.min_changed);
+      motion_gate.hold_s = mc.value("hold_s", motion_gate.hold_s);
+      motion_gate.keep_alive_s = mc.value("keep_alive_s", motion_gate.keep_alive_s);
+      if(motion_gate.width < 16 || motion_gate.pixel_threshold < 0 || motion_gate.pixel_threshold > 254) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['motion_gate'] must have width >= 16 and 0 <= pixel_threshold < 255";
+        return false;
+      }
+      if(motion_gate.min_changed < 0 || motion_gate.min_changed > 1 || motion_gate.hold_s < 0 || motion_gate.keep_alive_s <= 0) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['motion_gate'] must have 0 <= min_changed <= 1, hold_s >= 0 and keep_alive_s > 0";
+        return false;
+      }
+      if(motion_gate.enable && profile != "gpu") {
+        LOG(WARNING) << "pipeline['motion_gate'] gates nvinfer and only applies to pipeline['profile']=gpu, ignoring it";
+        motion_gate.enable = false;
+      }
+    }
+
+    // optional: keep the last seconds of encoded video of every source and record a clip when a detection rule fires
+    clipRecorder::ClipPolicy clips;
+    if(conf.contains("clips")) {
+      const njson &cc = conf["clips"];
+      if(!cc.is_object()) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['clips'] must be an object";
+        return false;
+      }
+      clips.enable = cc.value("enable", clips.enable);
+      clips.pre_roll_s = cc.value("pre_roll_s", clips.pre_roll_s);
+      clips.post_roll_s = cc.value("post_roll_s", clips.post_roll_s);
+      clips.max_clip_s = cc.value("max_clip_s", clips.max_clip_s);
+      clips.max_bytes = (int64_t) cc.value("max_mb", (int) (clips.max_bytes >> 20)) << 20;
+      clips.max_active = cc.value("max_active", clips.max_active);
+      clips.gap_ms = cc.value("gap_ms", clips.gap_ms);
+      if(clips.pre_roll_s < 0 || clips.post_roll_s < 0 || clips.max_clip_s <= clips.pre_roll_s) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['clips'] must have pre_roll_s >= 0, post_roll_s >= 0 and max_clip_s > pre_roll_s";
+        return false;
+      }
+      if(clips.max_bytes <= 0 || clips.max_active <= 0 || clips.gap_ms <= 0) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['clips'] max_mb, max_active and gap_ms must be > 0";
+        return false;
+      }
+      if(!cc.contains("rules") || !cc["rules"].is_array() || cc["rules"].empty()) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['clips']['rules'] must be a list of rules";
+        return false;
+      }
+      for(const auto &rc : cc["rules"]) {
+        clipRecorder::ClipRule rule;
+        if(rc.is_object()) {
+          rule.label = rc.value("label", rule.label);
+          rule.min_confidence = rc.value("min_confidence", rule.min_confidence);
+          rule.min_duration_ms = rc.value("min_duration_ms", rule.min_duration_ms);
+        }
+        if(!rc.is_object() || rule.min_confidence < 0 || rule.min_confidence > 100 || rule.min_duration_ms < 0) {
+          LOG(WARNING) << "Invalid config.json element! pipeline['clips']['rules'] must be objects with label, 0 <= min_confidence <= 100 and min_duration_ms >= 0";
+          return false;
+        }
+        if(rule.label == "*")
+          rule.label.clear();
+        clips.rules.push_back(rule);
+      }
+      if(clips.enable && conf["src_type"] != "file" && conf["src_type"] != "rtsp") {
+        LOG(WARNING) << "pipeline['clips'] only applies to file and rtsp sources, ignoring it";
+        clips.enable = false;
+      }
+    }
+
+    // optional: end to end latency budget of live sources (leaky queues, jitterbuffer, mux timeout and sink lateness)
+    latencyBudget::LatencyBudget latency;
+    if(conf.contains("latency_budget_ms")) {
+      if(!conf["latency_budget_ms"].is_number_integer() || conf["latency_budget_ms"].get<int>() < 0){
+        LOG(WARNING) << "Invalid config.json element! pipeline['latency_budget_ms'] must be an integer >= 0";
+        return false;
+      }
+      if(live_src)
+        latency = latencyBudget::splitLatencyBudget(conf["latency_budget_ms"].get<int>());
+      else if(conf["latency_budget_ms"].get<int>() > 0)
+        LOG(WARNING) << "pipeline['latency_budget_ms'] only applies to live sources (src_type=rtsp), ignoring it";
+      if(latency.budget_ms > 0 && !conf["sync"].get<bool>())
+        LOG(WARNING) << "pipeline['latency_budget_ms'] syncs the display sinks on the clock to drop late frames, pipeline['sync']=false is ignored for them";
+    }
+
+    // optional: adapt nvstreammux batched-push-timeout (and batch-size) to the measured frame rate of the sources
+    batching::BatchPolicy batching;
+    // a partial batch never waits longer than the share of the latency budget given to the mux
+    if(latency.budget_ms > 0)
+      batching.target_latency_ms = std::max(1, latency.mux_timeout_us / 1000);
+    if(conf.contains("batching")) {
+      const njson &bc = conf["batching"];
+      if(!bc.is_object()) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['batching'] must be an object";
+        return false;
+      }
+      batching.adaptive = bc.value("adaptive", batching.adaptive);
+      batching.target_latency_ms = bc.value("target_latency_ms", batching.target_latency_ms);
+      batching.min_timeout_us = bc.value("min_timeout_us", batching.min_timeout_us);
+      batching.interval_ms = bc.value("interval_ms", batching.interval_ms);
+      if(batching.target_latency_ms <= 0 || batching.min_timeout_us <= 0 || batching.interval_ms <= 0) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['batching'] target_latency_ms, min_timeout_us and interval_ms must be > 0";
+        return false;
+      }
+      if(batching.adaptive && profile != "gpu")
+        LOG(WARNING) << "pipeline['batching'] tunes nvstreammux and only applies to pipeline['profile']=gpu, ignoring it";
+    }
+
+    // optional: period of the QoS summary (the QoS messages are always counted by element)
+    qosStats::QosPolicy qos;
+    if(conf.contains("qos")) {
+      const njson &qc = conf["qos"];
+      if(!qc.is_object() || (qc.contains("summary_s") && !(qc["summary_s"].is_number_integer() && qc["summary_s"] >= 0))) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['qos'] must be an object, summary_s an integer >= 0";
+        return false;
+      }
+      qos.summary_s = qc.value("summary_s", qos.summary_s);
+    }
+
+    // optional: raise/lower the nvinfer interval with the load of the shard (the tracker fills the skipped frames)
+    inferenceGovernor::GovernorPolicy governor;
+    if(conf.contains("inference_governor")) {
+      const njson &gc = conf["inference_governor"];
+      if(!gc.is_object()) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['inference_governor'] must be an object";
+        return false;
+      }
+      governor.adaptive = gc.value("adaptive", governor.adaptive);
+      governor.min_interval = gc.value("min_interval", governor.min_interval);
+      governor.max_interval = gc.value("max_interval", governor.max_interval);
+      governor.interval_ms = gc.value("interval_ms", governor.interval_ms);
+      governor.high_load = gc.value("high_load", governor.high_load);
+      governor.low_load = gc.value("low_load", governor.low_load);
+      if(governor.min_interval < 0 || governor.max_interval < governor.min_interval || governor.interval_ms <= 0) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['inference_governor'] must have 0 <= min_interval <= max_interval and interval_ms > 0";
+        return false;
+      }
+      if(governor.low_load <= 0 || governor.high_load <= governor.low_load) {
+        LOG(WARNING) << "Invalid config.json element! pipeline['inference_governor'] must have 0 < low_load < high_load";
+        return false;
+      }
+      if(governor.adaptive && profile != "gpu")
+        LOG(WARNING) << "pipeline['inference_governor'] tunes nvinfer and only applies to pipeline['profile']=gpu, ignoring it";
+    }
+
     // check that appropriate fields are included in the config.json file
     this->_configs = (PipelineConfigs){
         .src_type = conf["src_type"].get<std::string>(),
@@ -120,7 +561,26 @@ bool Pipeline::set_configs(njson conf)
         .img_height = conf["input_height"].get<int>(),
         .img_width = conf["input_width"].get<int>(),
         .live_source = live_src,
-        .sync = conf["sync"].get<bool>()
+        .sync = conf["sync"].get<bool>(),
+        .loop = loop,
+        .shards = shards,
+        .max_sources = max_sources,
+        .reconnect = reconnect,
+        .watchdog = watchdog,
+        .profile = profile,
+        .encoder = encoders[encoder_name],
+        .tiler = tiler,
+        .latency = latency,
+        .batching = batching,
+        .governor = governor,
+        .trace_latency = trace_latency,
+        .profiler = profiler,
+        .clips = clips,
+        .record = record,
+        .inference = inference,
+        .motion_gate = motion_gate,
+        .qos = qos,
+        .eos_timeout_ms = eos_timeout_ms
     };
 
   } catch (const std::exception &e) {
@@ -130,31 +590,49 @@ bool Pipeline::set_configs(njson conf)
 
 #ifdef YAML_CONFIGS
   // check that filepath exists if using YAML configs
-  this->_yaml_configs = conf["yaml_configs"].get<std::string>();
-  std::ifstream f(this->_configs.configs);
-  if(!f.good())
-    LOG(FATAL) << "Could not find element `pipeline['configs']` in " << BASE_DIR << "/configs/config.json. Check your path";
+  if(conf["src_type"] == "yaml") {
+    if(!conf["yaml_configs"].is_string()) {
+      LOG(WARNING) << "Invalid config.json element! pipeline['yaml_configs'] must be a string (path of the yaml pipeline)";
+      return false;
+    }
+    this->_yaml_configs = conf["yaml_configs"].get<std::string>();
+    std::ifstream f(this->_yaml_configs);
+    if(!f.good())
+      LOG(FATAL) << "Could not find pipeline['yaml_configs']=" << this->_yaml_configs << " from " << BASE_DIR << "/configs/config.json. Check your path";
+  }
 #endif
 
-  // check that mounted directory has detection.yml and tracker.yml
-  std::string detection_file = BASE_DIR + "/model/detection.yml";
-  std::string tracker_file = BASE_DIR + "/model/tracker.yml";
-  std::ifstream detection_f(detection_file);
-  std::ifstream tracker_f(tracker_file);
-  if(!detection_f.good())
-    LOG(FATAL) << "Could not find " << detection_file << ". Ensure that .cache/model has detection.yml";
-  if(!tracker_f.good())
-    LOG(FATAL) << "Could not find " << tracker_file << ". Ensure that .cache/model has tracker.yml";
+  // check that mounted directory has the configs of the inference stages (detection.yml by default) and tracker.yml (the cpu
+  // profile uses a stub detector)
+  if(this->_configs.profile == "gpu") {
+    std::string tracker_file = BASE_DIR + "/model/tracker.yml";
+    for(const auto &stage : this->_configs.inference) {
+      std::ifstream stage_f(stage.config);
+      if(!stage_f.good())
+        LOG(FATAL) << "Could not find " << stage.config << " (inference stage " << stage.name << "). Ensure that .cache/model has it";
+    }
+    std::ifstream tracker_f(tracker_file);
+    if(!tracker_f.good())
+      LOG(FATAL) << "Could not find " << tracker_file << ". Ensure that .cache/model has tracker.yml";
+  }
 
   /* SANITIZE INPUTS */
   bool ret = true;
 
   //ensure the sources are correct
+#ifdef YAML_CONFIGS
+  if(this->_configs.src_type != "file" && this->_configs.src_type != "rtsp" && this->_configs.src_type != "yaml")
+  {
+    LOG(WARNING) << "Invalid field in config.json: pipeline['src_type']=" << this->_configs.src_type << ". Must be one of the following (file, rtsp, yaml)";
+    ret = false;
+  }
+#else
   if(this->_configs.src_type != "file" && this->_configs.src_type != "rtsp")
   {
     LOG(WARNING) << "Invalid field in config.json: pipeline['src_type']=" << this->_configs.src_type << ". Must be one of the following (file, rtsp)";
     ret = false;
   }
+#endif
   if(this->_configs.sources.size() < 1)
   {
     LOG(WARNING) << "Invalid field pipeline['sources'] in config.json. Must have at least one source!";
@@ -162,16 +640,23 @@ bool Pipeline::set_configs(njson conf)
   }
 
   // ensure sink type is correct
-  if(this->_configs.sink_type != "display" && this->_configs.sink_type != "file" && this->_configs.sink_type != "rtmp")
+  if(this->_configs.sink_type != "display" && this->_configs.sink_type != "file" && this->_configs.sink_type != "rtmp" &&
+     this->_configs.sink_type != "tiled")
   {
-    LOG(WARNING) << "Invalid field in config.json: pipeline['sink_type']=" << this->_configs.sink_type << ". Must be one of the following (display, file, rtmp)";
+    LOG(WARNING) << "Invalid field in config.json: pipeline['sink_type']=" << this->_configs.sink_type << ". Must be one of the following (display, file, rtmp, tiled)";
     ret = false;
   }
-  if(this->_configs.sink_type != "display" && this->_configs.sinks.size() < 1)
+  if((this->_configs.sink_type == "file" || this->_configs.sink_type == "rtmp") && this->_configs.sinks.size() < 1)
   {
     LOG(WARNING) << "Invalid field pipeline['sinks'] in config.json. Must have at least one sink!";
     ret = false;
   }
+  // the mosaic has a single output: sinks[0] (rtmp url or mp4/mkv file), or the display when empty
+  if(this->_configs.sink_type == "tiled" && this->_configs.sinks.size() > 1)
+  {
+    LOG(WARNING) << "Invalid field pipeline['sinks'] in config.json. sink_type=tiled takes at most one sink (the mosaic output)!";
+    ret = false;
+  }
 
   if(this->_configs.img_height == 0)
   {
@@ -186,327 +671,864 @@ bool Pipeline::set_configs(njson conf)
 
   // check that files are correct
   for (size_t i = 0; i < this->_configs.sources.size(); ++i) {
-    // check that it is not empty
-    if(this->_configs.sources[i].get<std::string>().size() == 0) {
-      LOG(WARNING) << "Is empty: sources[" << i << "]=" << this->_configs.sources[i];
+    std::string uri = this->_configs.sources[i].get<std::string>();
+    if(!this->_sanitize_source(uri)) {
+      LOG(WARNING) << "Invalid source: sources[" << i << "]=" << this->_configs.sources[i];
       ret = false;
     }
-    if(this->_configs.src_type == "file") {
-      // check that ends with .mp4
-      if (!pipelineUtils::checkStringEndsWith(this->_configs.sources[i], ".mp4")) {
-        ret = false;
-        LOG(WARNING) << "mp4 file must end with .mp4: sources[" << i << "]=" << this->_configs.sources[i];
-      }
-      this->_configs.sources[i] = BASE_DIR + (std::string) "/" + (std::string) this->_configs.sources[i];
-      std::ifstream f(this->_configs.sources[i]);
-      if(!f.good())
-        LOG(FATAL) << "Could not find src: " << this->_configs.sources[i] << ". Check your path";
-    }
-    else if(this->_configs.src_type == "rtsp") {
-      // check that it starts with rtsp://
-      if (!pipelineUtils::checkStringStartsWith(this->_configs.sources[i], "rtsp://")) {
-        ret = false;
-        LOG(WARNING) << "rtsp url must start with rtsp://: sources[" << i << "]=" << this->_configs.sources[i];
-      }
-    }
-
+    this->_configs.sources[i] = uri;
   }
   // check that no duplicates exist
   if(!pipelineUtils::areAllElementsUniqueStrings(this->_configs.sources))
     ret = false;
 
-
   for (size_t i = 0; i < this->_configs.sinks.size(); ++i) {
-    // check that it is not empty
-    if(this->_configs.sinks[i].get<std::string>().size() == 0)
-    {
-      LOG(WARNING) << "Is empty: sinks[" << i << "]=" << this->_configs.sinks[i];
+    std::string sink = this->_configs.sinks[i].get<std::string>();
+    if(!this->_sanitize_sink(sink)) {
+      LOG(WARNING) << "Invalid sink: sinks[" << i << "]=" << this->_configs.sinks[i];
       ret = false;
     }
-
-    // checks that types entered are correct
-    if(this->_configs.sink_type == "file") {
-      // check that ends with .mp4
-      if(!pipelineUtils::checkStringEndsWith(this->_configs.sinks[i], ".mp4"))
-      {
-        ret = false;
-        LOG(WARNING) << "Is not an mp4 file: sinks[" << i << "]=" << this->_configs.sinks[i];
-      }
-      this->_configs.sinks[i] = (std::string) BASE_DIR + (std::string) "/outputs/video/" + this->_configs.sinks[i].get<std::string>();
-    }
-    else if(this->_configs.sink_type == "rtmp") {
-      // check that it starts with rtsp://
-      if (!pipelineUtils::checkStringStartsWith(this->_configs.sources[i], "rtmp://")) {
-        ret = false;
-        LOG(WARNING) << "rtmp url must start with rtmp://: sources[" << i << "]=" << this->_configs.sources[i];
-      }
-    }
+    this->_configs.sinks[i] = sink;
   }
 
   // check that no duplicates exist
   if(!pipelineUtils::areAllElementsUniqueStrings(this->_configs.sinks))
     ret = false;
 
+  // every source is composed into the same mosaic, so they must share one pipeline
+  if(this->_configs.sink_type == "tiled" && this->_configs.shards > 1)
+  {
+    LOG(WARNING) << "pipeline['shards']=" << this->_configs.shards << " is not supported with sink_type=tiled, using shards=1";
+    this->_configs.shards = 1;
+  }
+
+  // the yaml builder describes a single pipeline, the other shards would never reach EOS
+  if(this->_configs.src_type == "yaml" && this->_configs.shards > 1)
+  {
+    LOG(WARNING) << "pipeline['shards']=" << this->_configs.shards << " is not supported with src_type=yaml, using shards=1";
+    this->_configs.shards = 1;
+  }
+
+  // a shard without sources would be an empty pipeline
+  if(this->_configs.shards > this->_configs.source_count)
+  {
+    LOG(WARNING) << "pipeline['shards']=" << this->_configs.shards << " is larger than the number of sources, using shards=" << this->_configs.source_count;
+    this->_configs.shards = this->_configs.source_count;
+  }
+
   return ret;
 }
 
 /**
- * @brief setup the pipeline and gstreamer bus callback (bus, bus_watch, bus callback)
+ * @brief setup the shard's pipeline, main context and gstreamer bus callback (bus, bus_watch, bus callback)
+ * @param shard the shard to set up
  * @return true if good
  */
-bool Pipeline::_setup_pipeline_bus()
+bool Pipeline::_setup_pipeline_bus(PipelineShard *shard)
 {
   // Create gstreamer elements
-  gst_init(NULL, NULL);
-  this->pipeline = gst_pipeline_new("video-player0");
-  if (!pipeline) {
-    LOG(ERROR) << "Pipeline could not be created: [pipeline]. Exiting";
+  std::string pipeline_name = (std::string) "video-player" + std::to_string(shard->id);
+  shard->pipeline = gst_pipeline_new(pipeline_name.c_str());
+  if (!shard->pipeline) {
+    LOG(ERROR) << "Pipeline could not be created: [" << pipeline_name << "]. Exiting";
     return false;
   }
-  this->bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
-  this->bus_struct = {.loop = this->loop, .timeout_counter = 0, .timeout_counter_max = 50};
-  this->bus_watch_id = gst_bus_add_watch(this->bus, pipelineUtils::bus_call, (gpointer) & this->bus_struct);
+
+  // each shard dispatches its bus messages on its own main context, so a busy or failing shard does not block the others
+  shard->context = g_main_context_new();
+  shard->loop = g_main_loop_new(shard->context, FALSE);
+  // a restarted shard keeps its QoS table, the metrics read its elements
+  qosStats::ShardQos *qos = shard->bus_struct.qos;
+  if (qos != NULL)
+    qos->reset();
+  shard->bus_struct = {.loop = shard->loop, .shard_id = shard->id, .timeout_counter = 0, .timeout_counter_max = 50};
+  shard->bus_struct.on_source_error = [this, shard](int source_id) { return this->_on_source_error(shard, source_id); };
+  shard->bus_struct.dropped_frames = &core::Metrics::get().counter("iva_dropped_frames_total", "Frames dropped by the elements of a shard (QoS).",
+                                                                   {{"shard", std::to_string(shard->id)}});
+  shard->bus_struct.qos = qos != NULL ? qos : new qosStats::ShardQos(shard->id);
+  // a restarted shard has recovered once it plays again
+  shard->bus_struct.on_playing = [this, shard]() {
+    if (shard->recovering.exchange(false))
+      this->_mediator->notify(new HealthEvent(events::Actions::MODULE_RECOVERED, events::Module::MODULE_PIPELINE, shard->id, "",
+                                              events::Module::MODULE_PIPELINE));
+  };
+
+  GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(shard->pipeline));
+  shard->bus_watch = gst_bus_create_watch(bus);
+  g_source_set_callback(shard->bus_watch, (GSourceFunc) pipelineUtils::bus_call, (gpointer) &shard->bus_struct, NULL);
+  g_source_attach(shard->bus_watch, shard->context);
   gst_object_unref(bus);
+  core::StartupTimeline::get().mark("shard" + std::to_string(shard->id) + "_bus_ready");
   return true;
 }
 
 /**
- * @brief create gstreamer pipeline
+ * @brief create the gstreamer pipeline of a shard with its sources, inference bin and sinks
+ * @param shard the shard to populate
  * @return bool true if successful
  */
-bool Pipeline::_create_pipeline()
+bool Pipeline::_create_pipeline(PipelineShard *shard)
 {
   // use configs to create sourceBins and add them to the pipeline
-  if (this->_configs.src_type.compare("file") == 0) {
-    for(int b = 0; b < this->_configs.source_count; b++) {
-      std::string src_name = (std::string) "srcBin" + std::to_string(b);
-      std::string file_src = this->_configs.sources[b];
-      LOG(INFO) << "src_name=" << src_name << ", file_src=" << file_src;
-      GstElement *srcBin = pipelineUtils::createMp4SrcBin(src_name, file_src);
-      if(!gst_bin_add(GST_BIN(this->pipeline), srcBin))
-      {
-        LOG(ERROR) << "Failed to add srcBin[" << b << "] to pipeline";
-        return false;
-      }
-    }
-  } else if (this->_configs.src_type.compare("rtsp") == 0) {
-
-//    for(int b = 0; b < this->_configs.source_count; b++) {
-//      std::string src_name = (std::string) "srcBin" + std::to_string(b);
-//      std::string uri = this->_configs.sources[b];
-//      bool rtsp_available = rtspAnalyzer::analyzeRTSPStream(uri);
-//      std::string displayVal = (rtsp_available == true ? "true":"false");
-//      std::cout << "Checking URI: " << uri << ", src[" << b << "] Connection=" << displayVal << std::endl;
-//      if (!rtsp_available)
-//        return false;
-//    }
-
-    for(int b = 0; b < this->_configs.source_count; b++) {
-      std::string src_name = (std::string) "srcBin" + std::to_string(b);
-      std::string uri = this->_configs.sources[b];
-      LOG(INFO) << "src_name=" << src_name << ", uri=" << uri;
-      GstElement *srcBin = pipelineUtils::createRtspSrcBin(src_name, uri);
-      if(!gst_bin_add(GST_BIN(this->pipeline), srcBin))
-      {
-        LOG(ERROR) << "Failed to add srcBin[" << b << "] to pipeline";
-        return false;
-      }
+  for(int b : shard->source_ids) {
+    GstElement *srcBin = this->_create_source_bin(shard, b, this->_configs.sources[b]);
+    if(srcBin != NULL && this->_configs.record.passthrough)
+      this->_add_passthrough_recording(srcBin, b, this->_configs.sinks[b].get<std::string>());
+    if(srcBin != NULL && this->_configs.motion_gate.enable)
+      this->_add_motion_branch(srcBin, b);
+    if(srcBin == NULL || !gst_bin_add(GST_BIN(shard->pipeline), srcBin))
+    {
+      LOG(ERROR) << "Failed to add srcBin[" << b << "] to pipeline";
+      return false;
     }
   }
-  else {
-    LOG(FATAL) << "Type of source has not been configured";
-  }
+
+  // the tiled sink takes the whole batch, so the gpu inference bin skips its demux
+  bool tiled = this->_configs.sink_type == "tiled";
 
   // create inferenceBin and add it to the pipeline
-  GstElement *inferenceBin = pipelineUtils::createInferenceBinToStreamDemux("inferenceBin", this->_configs.source_count, this->_configs.img_width, this->_configs.img_height, this->_configs.live_source);
-  if(!gst_bin_add(GST_BIN(this->pipeline), inferenceBin))
+  GstElement *inferenceBin;
+  if (this->_configs.profile == "cpu")
+    inferenceBin = pipelineUtils::createCpuInferenceBin("inferenceBin", shard->source_ids, this->_configs.img_width, this->_configs.img_height);
+  else
+    inferenceBin = pipelineUtils::createInferenceBinToStreamDemux("inferenceBin", shard->source_ids, shard->batch_size, this->_configs.img_width,
+                                                                  this->_configs.img_height, this->_configs.inference, this->_configs.live_source, !tiled);
+  if(!gst_bin_add(GST_BIN(shard->pipeline), inferenceBin))
   {
     LOG(ERROR) << "Failed to add inferenceBin to pipeline";
     return false;
   }
-
-  // create sink bin
-  if (this->_configs.sink_type.compare("display") == 0)
-  {
-    for (int b=0; b < this->_configs.source_count; b++) {
-      std::string binName = (std::string) "sinkBin" + std::to_string(b);
-      GstElement* sinkBin = pipelineUtils::createSinkBinToDisplay(binName, this->_configs.sync);
-      if(!gst_bin_add(GST_BIN(this->pipeline), sinkBin))
+  this->_add_batch_probe(shard);
+  this->_add_governor_probes(shard);
+  this->_add_motion_gate_probe(shard);
+  this->_add_batch_trace_probes(shard);
+
+  // create the tiled sink bin (one mosaic for every source), or a sink bin per source
+  GstElement *tiledBin = NULL;
+  if (tiled) {
+    std::string output = this->_configs.sinks.empty() ? "" : this->_configs.sinks[0].get<std::string>();
+    tiledBin = pipelineUtils::createTiledSinkBin("sinkBinTiled", output, this->_configs.tiler, this->_configs.sync,
+                                                 pipelineUtils::getElementProfile(this->_configs.profile), this->_configs.encoder);
+    if(!gst_bin_add(GST_BIN(shard->pipeline), tiledBin))
+    {
+      LOG(ERROR) << "Failed to add sinkBinTiled to pipeline";
+      return false;
+    }
+    this->_add_latency_probe(tiledBin);
+    for (int b : shard->source_ids) {
+      if(!this->_add_tile(shard, b))
       {
-        LOG(ERROR) << "Failed to add sinkBin[" << b << "] to pipeline";
+        LOG(ERROR) << "Failed to add the tile of source[" << b << "] to sinkBinTiled";
         return false;
       }
-
-      // add callbacks to display bounding boxes
-      GstElement *cb_element = gst_bin_get_by_name(GST_BIN(sinkBin), "sink_caps");
-      if(cb_element == NULL)
-        LOG(FATAL) << "Could not find sink_caps in sinkBin(" << b << ")";
-
-      GstPad *probe_pad = gst_element_get_static_pad(cb_element, "src");
-      if(!gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::osd_callback, (gpointer)this->processor, NULL))
-        LOG(FATAL) << "Could not add pad probe to sink_caps";
-      gst_object_unref(probe_pad);
     }
   }
-  else if (this->_configs.sink_type.compare("rtmp") == 0) {
-    for (int b=0; b < this->_configs.source_count; b++) {
-      std::string binName = (std::string) "sinkBin" + std::to_string(b);
-      GstElement* sinkBin = pipelineUtils::createSinkBinToRTMP(binName, this->_configs.sinks[b], this->_configs.sync);
-      if(!gst_bin_add(GST_BIN(this->pipeline), sinkBin))
+  else {
+    for (int b : shard->source_ids) {
+      std::string sink = (this->_configs.sink_type == "display") ? "" : this->_configs.sinks[b].get<std::string>();
+      GstElement *sinkBin = this->_create_sink_bin(b, sink);
+      if(sinkBin == NULL || !gst_bin_add(GST_BIN(shard->pipeline), sinkBin))
       {
         LOG(ERROR) << "Failed to add sinkBin[" << b << "] to pipeline";
         return false;
       }
-
-      // add callbacks to display bounding boxes
-      GstElement *cb_element = gst_bin_get_by_name(GST_BIN(sinkBin), "sink_caps");
-      if(cb_element == NULL)
-        LOG(FATAL) << "Could not find sink_caps in sinkBin(" << b << ")";
-
-      GstPad *probe_pad = gst_element_get_static_pad(cb_element, "src");
-      if(!gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::osd_callback, (gpointer)this->processor, NULL))
-        LOG(FATAL) << "Could not add pad probe to sink_caps";
-      gst_object_unref(probe_pad);
     }
   }
-  else if (this->_configs.sink_type.compare("file") == 0) {
-    for (int b=0; b < this->_configs.source_count; b++) {
-      std::string binName = (std::string) "sinkBin" + std::to_string(b);
-      GstElement* sinkBin = pipelineUtils::createSinkBinToFile(binName, this->_configs.sinks[b], this->_configs.sync);
-      if(!gst_bin_add(GST_BIN(this->pipeline), sinkBin))
-      {
-        LOG(ERROR) << "Failed to add sinkBin[" << b << "] to pipeline";
-        return false;
-      }
 
-      // add callbacks to display bounding boxes
-      GstElement *cb_element = gst_bin_get_by_name(GST_BIN(sinkBin), "sink_caps");
-      if(cb_element == NULL)
-        LOG(FATAL) << "Could not find sink_caps in sinkBin(" << b << ")";
-
-      GstPad *probe_pad = gst_element_get_static_pad(cb_element, "src");
-      if(!gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::osd_callback, (gpointer)this->processor, NULL))
-        LOG(FATAL) << "Could not add pad probe to sink_caps";
-      gst_object_unref(probe_pad);
-    }
+  // Add callbacks
+  if (this->_configs.profile == "cpu") {
+    for (int b : shard->source_ids)
+      this->_add_cpu_inference_probe(inferenceBin, b);
   }
+#ifndef CPU_ONLY
   else {
-    LOG(ERROR) << "Invalid sink type in config.json: choose one of the following (display, rtmp)";
-    return false;
+    // the payloads are read after the last stage of the cascade (the tracker without secondary stages)
+    GstElement *cb_element = pipelineUtils::inferenceOutput(inferenceBin);
+    if(cb_element == NULL)
+      LOG(FATAL) << "Could not find the output of the inference cascade in inferenceBin";
+    GstPad *probe_pad = gst_element_get_static_pad(cb_element, "src");
+    if(!gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::probe_callback, (gpointer)this->processor, NULL))
+      LOG(FATAL) << "Could not add pad probe to " << GST_ELEMENT_NAME(cb_element);
+    gst_object_unref(probe_pad);
   }
+#endif
 
-  // Add callbacks
-  GstElement *cb_element = gst_bin_get_by_name(GST_BIN(inferenceBin), "nv_tracker");
-  if(cb_element == NULL)
-    LOG(FATAL) << "Could not find nv_tracker in inferenceBin";
-  GstPad *probe_pad = gst_element_get_static_pad(cb_element, "src");
-  if(!gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::probe_callback, (gpointer)this->processor, NULL))
-    LOG(FATAL) << "Could not add pad probe to nv_tracker";
-  gst_object_unref(probe_pad);
-
+  core::StartupTimeline::get().mark("shard" + std::to_string(shard->id) + "_bins_created");
   // set element state to NULL and save diagram
-  gst_element_set_state(GST_ELEMENT(this->pipeline), GST_STATE_NULL);
+  gst_element_set_state(GST_ELEMENT(shard->pipeline), GST_STATE_NULL);
   // create picture diagram of the pipeline in its current state
 
 #ifdef ENABLE_DOT
-    pipelineUtils::save_debug_dot(this->pipeline, "/src/logs", "NULL");
+    pipelineUtils::save_debug_dot(shard->pipeline, "/src/logs", "NULL");
 #endif
-  // link the source bins to inference bin
-  for (int b=0; b<this->_configs.source_count; b++)
+  // link the source bins to inference bin, and the inference bin to the sink bins
+  for (int b : shard->source_ids)
   {
-    std::string src_name = (std::string) "srcBin" + std::to_string(b);
-    GstElement *srcBin = gst_bin_get_by_name(GST_BIN(this->pipeline), src_name.c_str());
-    GstPad* srcPad = gst_element_get_static_pad(srcBin, "output0");
-    std::string inferenceBinPadName = (std::string) "input" + std::to_string(b);
-    GstPad* inferenceBinPad = gst_element_get_static_pad(inferenceBin, inferenceBinPadName.c_str());
-    if(srcPad == NULL)
-      LOG(FATAL) << "Could not get ghostPad from bin=" << src_name << " ,pad=output0";
-    if(inferenceBinPad == NULL)
-      LOG(FATAL) << "Could not get ghostPad from inferenceBin (pad=" << inferenceBinPadName << ")";
-
-    int ret = gst_pad_link (srcPad, inferenceBinPad);
-    if (ret != GST_PAD_LINK_OK)
-    {
-      LOG(ERROR) << "LINK ERROR:\t" << pipelineUtils::get_link_status(ret);
-      LOG(FATAL) << "Could not link srcPad to inferenceBinPad";
-    }
-    gst_object_unref (srcPad);
-    gst_object_unref (inferenceBinPad);
+    if(!this->_link_source(shard, b))
+      LOG(FATAL) << "Could not link source=" << b;
   }
-
-  // link the inferenceBin to sinkBins
-  for (int b=0; b<this->_configs.source_count; b++)
-  {
-    // get the sinkBin and its input pad
-    std::string bin_name = (std::string) "sinkBin" + std::to_string(b);
-    GstElement *sinkBin = gst_bin_get_by_name(GST_BIN(this->pipeline), bin_name.c_str());
-    GstPad* sinkBinPad = gst_element_get_static_pad(sinkBin, "input0");
-
-    // get output pad from the inference bin
-    std::string inferenceBinPadName = (std::string) "output" + std::to_string(b);
-    GstPad* inferenceBinPad = gst_element_get_static_pad(inferenceBin, inferenceBinPadName.c_str());
-
-    if(sinkBinPad == NULL)
-      LOG(FATAL) << "Could not get ghostPad from bin=" << bin_name << " ,pad=input0";
-    if(inferenceBinPad == NULL)
-      LOG(FATAL) << "Could not get ghostPad from inferenceBin (pad=" << inferenceBinPadName << ")";
-
-    int ret = gst_pad_link (inferenceBinPad, sinkBinPad);
-    if (ret != GST_PAD_LINK_OK)
-    {
-      LOG(ERROR) << "LINK ERROR:\t" << pipelineUtils::get_link_status(ret);
-      LOG(FATAL) << "Could not link inferenceBinPad to sinkBinPad";
-    }
-    gst_object_unref (inferenceBinPad);
-    gst_object_unref (sinkBinPad);
+  if (tiled && this->_configs.profile == "gpu") {
+    if(!gst_element_link_pads(inferenceBin, "output0", tiledBin, "input0"))
+      LOG(FATAL) << "Could not link inferenceBin to sinkBinTiled";
   }
+  // bound the time frames can wait in the pipeline
+  latencyBudget::applyLatencyBudget(shard->pipeline, this->_configs.latency);
   // set element state to READY
-  gst_element_set_state(GST_ELEMENT(this->pipeline), GST_STATE_READY);
+  gst_element_set_state(GST_ELEMENT(shard->pipeline), GST_STATE_READY);
+  core::StartupTimeline::get().mark("shard" + std::to_string(shard->id) + "_ready");
   // create picture diagram of the pipeline in its current state
 #ifdef ENABLE_DOT
-    pipelineUtils::save_debug_dot(this->pipeline, "/src/logs", "NULL_READY");
+    pipelineUtils::save_debug_dot(shard->pipeline, "/src/logs", "NULL_READY");
 #endif
   return true;
 }
 
 /**
- * @brief runs the main gstreamer thread, g_main_loop_run, which is the main thread on the pipeline's lifecycle
- *
+ * @brief validate a source from pipeline['sources'] (or added at runtime) against pipeline['src_type']
+ * @param uri the source; file sources are rewritten to their absolute path
+ * @return true if valid
  */
-void Pipeline::_run_pipeline()
+bool Pipeline::_sanitize_source(std::string &uri)
 {
-  /* Set the pipeline to "playing" state*/
-  LOG(INFO) << "STARTING PIPELINE";
-  VLOG(DEEP) << "[2]Reference count of pipeline: " << GST_OBJECT_REFCOUNT(this->pipeline);
+  // check that it is not empty
+  if(uri.size() == 0) {
+    LOG(WARNING) << "Source is empty";
+    return false;
+  }
+  if(this->_configs.src_type == "file") {
+    // check the container (parsebin detects the codec: H.264, H.265 or MJPEG)
+    if (!pipelineUtils::checkStringEndsWith(uri, ".mp4") && !pipelineUtils::checkStringEndsWith(uri, ".mkv") &&
+        !pipelineUtils::checkStringEndsWith(uri, ".ts")) {
+      LOG(WARNING) << "Is not an mp4, mkv or ts file: " << uri;
+      return false;
+    }
+    uri = BASE_DIR + (std::string) "/" + uri;
+    std::ifstream f(uri);
+    if(!f.good()) {
+      LOG(WARNING) << "Could not find src: " << uri << ". Check your path";
+      return false;
+    }
+  }
+  else if(this->_configs.src_type == "rtsp") {
+    // check that it starts with rtsp://
+    if (!pipelineUtils::checkStringStartsWith(uri, "rtsp://")) {
+      LOG(WARNING) << "rtsp url must start with rtsp://: " << uri;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief validate a sink from pipeline['sinks'] (or added at runtime) against pipeline['sink_type']
+ * @param sink the sink; file sinks are rewritten to their absolute path in outputs/video
+ * @return true if valid
+ */
+bool Pipeline::_sanitize_sink(std::string &sink)
+{
+  // check that it is not empty
+  if(sink.size() == 0) {
+    LOG(WARNING) << "Sink is empty";
+    return false;
+  }
+
+  // checks that types entered are correct (the output of a tiled sink is either)
+  std::string sink_type = this->_configs.sink_type;
+  if(sink_type == "tiled")
+    sink_type = pipelineUtils::checkStringStartsWith(sink, "rtmp://") ? "rtmp" : "file";
+  if(sink_type == "file") {
+    // check the container (selects the muxer)
+    if(!pipelineUtils::checkStringEndsWith(sink, ".mp4") && !pipelineUtils::checkStringEndsWith(sink, ".mkv")) {
+      LOG(WARNING) << "Is not an mp4 or mkv file: " << sink;
+      return false;
+    }
+    sink = (std::string) BASE_DIR + (std::string) "/outputs/video/" + sink;
+  }
+  else if(sink_type == "rtmp") {
+    // check that it starts with rtmp://
+    if (!pipelineUtils::checkStringStartsWith(sink, "rtmp://")) {
+      LOG(WARNING) << "rtmp url must start with rtmp://: " << sink;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief create the source bin (srcBin<id>) of a source, with the probes that track its health on the src_queue output
+ * @param shard the shard that will run the source
+ * @param source_id global id of the source
+ * @param uri sanitized source (absolute path to the video file or rtsp url)
+ * @return the bin, NULL if the source type is unknown
+ */
+GstElement *Pipeline::_create_source_bin(PipelineShard *shard, int source_id, std::string uri)
+{
+  std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+  LOG(INFO) << "src_name=" << src_name << ", uri=" << uri;
+  GstElement *srcBin = NULL;
+  pipelineUtils::ElementProfile profile = pipelineUtils::getElementProfile(this->_configs.profile);
+  if (this->_configs.src_type.compare("file") == 0)
+    srcBin = pipelineUtils::createFileSrcBin(src_name, uri, profile);
+  else if (this->_configs.src_type.compare("rtsp") == 0)
+    srcBin = pipelineUtils::createRtspSrcBin(src_name, uri, profile);
+  else {
+    LOG(ERROR) << "Type of source has not been configured";
+    return NULL;
+  }
+
+  GstElement *src_queue = gst_bin_get_by_name(GST_BIN(srcBin), "src_queue");
+  if (src_queue == NULL)
+    LOG(FATAL) << "Could not find src_queue in " << src_name;
+  GstPad *probe_pad = gst_element_get_static_pad(src_queue, "src");
+  SourceContext source_ctx = {.pipeline = this, .shard = shard, .source_id = source_id, .stats = this->_get_source_stats(source_id)};
+  GDestroyNotify free_ctx = [](gpointer data) { delete (SourceContext *) data; };
+
+  // first probe: the end of a looping file is replaced by a seek to its start, and the timestamps seen downstream keep increasing
+  if (this->_configs.loop) {
+    fileLoop::LoopState *loop_state = new fileLoop::LoopState();
+    gst_pad_add_probe(probe_pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                      fileLoop::loopProbe, loop_state, [](gpointer data) { delete (fileLoop::LoopState *) data; });
+    // found by _on_stop_signal, the state lives as long as the probe of the bin's pad
+    g_object_set_data(G_OBJECT(srcBin), "loop_state", loop_state);
+  }
+  // stamp the decoded frames with the timestamps seen downstream (after the loop offset)
+  this->_add_trace_stamp(probe_pad, source_id);
+  // keep the encoded frames (before the decoder) for the clips
+  this->_add_clip_tap(srcBin, source_id);
+
+  // count the buffers for the watchdog, and the first buffer after an outage closes the outage
+  gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        SourceContext *ctx = (SourceContext *) data;
+        int64_t now = g_get_monotonic_time();
+        core::StartupTimeline::get().mark_first(core::Milestone::FIRST_FRAME);
+        ctx->stats->last_buffer_us.store(now, std::memory_order_relaxed);
+        ctx->stats->buffers.fetch_add(1, std::memory_order_relaxed);
+        if (ctx->stats->outage_start_us.load(std::memory_order_relaxed) == 0)
+          return GST_PAD_PROBE_OK;
+        int64_t start = ctx->stats->outage_start_us.exchange(0);
+        if (start != 0) {
+          int64_t outage = now - start;
+          ctx->stats->last_outage_us = outage;
+          ctx->stats->total_outage_us += outage;
+          ctx->stats->attempt = 0;
+          ctx->stats->reconnects++;
+          LOG(INFO) << "Source=" << ctx->source_id << " reconnected after outage=" << outage / 1000 << "ms (reconnects=" << ctx->stats->reconnects << ")";
+        }
+        return GST_PAD_PROBE_OK;
+      }, new SourceContext(source_ctx), free_ctx);
+
+  // a file that reached its end is finished, not stalled
+  GstPadProbeCallback on_file_eos = [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS)
+      ((SourceContext *) data)->stats->finished = true;
+    return GST_PAD_PROBE_OK;
+  };
+  gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, this->_configs.live_source ? Pipeline::_on_live_eos : on_file_eos,
+                    new SourceContext(source_ctx), free_ctx);
+  gst_object_unref(probe_pad);
+  gst_object_unref(src_queue);
+  return srcBin;
+}
+
+/**
+ * @brief pad probe (src pad of src_queue, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) of a live source: a source that ends (camera/server
+ *  dropped the session) is restarted instead of ending the whole batch, unless the shard is stopping (its EOS drains the shard)
+ * @param pad the src pad of src_queue
+ * @param info the event
+ * @param data the SourceContext of the source
+ * @return GST_PAD_PROBE_DROP for the EOS of a running shard
+ */
+GstPadProbeReturn Pipeline::_on_live_eos(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS)
+    return GST_PAD_PROBE_OK;
+  SourceContext *ctx = (SourceContext *) data;
+  if (ctx->shard->stopping)
+    return GST_PAD_PROBE_OK;
+  LOG(WARNING) << "Unexpected EOS from live source=" << ctx->source_id << ", restarting it";
+  g_main_context_invoke_full(ctx->shard->context, G_PRIORITY_DEFAULT, [](gpointer data) -> gboolean {
+        SourceContext *ctx = (SourceContext *) data;
+        if (!ctx->pipeline->_on_source_error(ctx->shard, ctx->source_id))
+          g_main_loop_quit(ctx->shard->loop);
+        return G_SOURCE_REMOVE;
+      }, new SourceContext(*ctx), [](gpointer data) { delete (SourceContext *) data; });
+  return GST_PAD_PROBE_DROP;
+}
+
+/**
+ * @brief create the sink bin (sinkBin<id>) of a source and add the osd callback that draws its detections
+ * @param source_id global id of the source
+ * @param sink sanitized sink (file path or rtmp url, ignored for display)
+ * @return the bin, NULL if the sink type is unknown
+ */
+GstElement *Pipeline::_create_sink_bin(int source_id, std::string sink)
+{
+  std::string binName = (std::string) "sinkBin" + std::to_string(source_id);
+  GstElement *sinkBin = NULL;
+  pipelineUtils::ElementProfile profile = pipelineUtils::getElementProfile(this->_configs.profile);
+  if (this->_configs.sink_type.compare("display") == 0)
+    sinkBin = pipelineUtils::createSinkBinToDisplay(binName, this->_configs.sync, profile);
+  else if (this->_configs.sink_type.compare("rtmp") == 0)
+    sinkBin = pipelineUtils::createSinkBinToRTMP(binName, sink, this->_configs.sync, profile, this->_configs.encoder);
+  else if (this->_configs.sink_type.compare("file") == 0 && this->_configs.record.passthrough) {
+    // the source bin records the encoded stream, the decoded frames are only needed by the inference
+    sinkBin = pipelineUtils::createSinkBinToFakesink(binName);
+    this->_add_trace_probe(sinkBin, "sink", "sink", latencyTrace::SINK, source_id);
+    return sinkBin;
+  }
+  else if (this->_configs.sink_type.compare("file") == 0)
+    sinkBin = pipelineUtils::createSinkBinToFile(binName, sink, this->_configs.sync, profile, this->_configs.encoder);
+  else {
+    LOG(ERROR) << "Invalid sink type in config.json: choose one of the following (display, rtmp, file)";
+    return NULL;
+  }
+
+  this->_add_osd_probe(sinkBin, source_id);
+  this->_add_latency_probe(sinkBin);
+  this->_add_trace_probe(sinkBin, "sink_caps", "src", latencyTrace::SINK_CAPS, source_id);
+  this->_add_trace_probe(sinkBin, "sink", "sink", latencyTrace::SINK, source_id);
+  return sinkBin;
+}
+
+/**
+ * @brief add the osd callback that draws the detections of a source on the sink_caps of its bin
+ * @note the processing module finds the source id from the digits of the bin name (sinkBin<id>, tileBin<id>)
+ * @param bin the sink bin (or tile bin) of the source
+ * @param source_id global id of the source
+ */
+void Pipeline::_add_osd_probe(GstElement *bin, int source_id)
+{
+  GstElement *cb_element = gst_bin_get_by_name(GST_BIN(bin), "sink_caps");
+  if(cb_element == NULL)
+    LOG(FATAL) << "Could not find sink_caps in " << GST_ELEMENT_NAME(bin) << "(" << source_id << ")";
+
+  GstPad *probe_pad = gst_element_get_static_pad(cb_element, "src");
+  if(!gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::osd_callback, (gpointer)this->processor, NULL))
+    LOG(FATAL) << "Could not add pad probe to sink_caps";
+  gst_object_unref(probe_pad);
+  gst_object_unref(cb_element);
+}
+
+/**
+ * @brief give a source its tile in the mosaic of sink_type=tiled. On the gpu, nvmultistreamtiler places the frames of the batch by
+ *  their source id and nvdsosd draws the detections, so only the cpu compositor needs a tile bin (with the osd callback).
+ * @param shard the shard whose pipeline holds sinkBinTiled
+ * @param source_id global id of the source, also the index of its tile
+ * @return false if the source has no tile in the layout
+ */
+bool Pipeline::_add_tile(PipelineShard *shard, int source_id)
+{
+  int x, y, width, height;
+  if (!pipelineUtils::tileRect(this->_configs.tiler, source_id, x, y, width, height)) {
+    LOG(WARNING) << "Source=" << source_id << " has no tile in the " << this->_configs.tiler.rows << "x" << this->_configs.tiler.columns
+                 << " mosaic (refer to pipeline['tiler'] and pipeline['max_sources'])";
+    return false;
+  }
+  if (this->_configs.profile == "gpu")
+    return true;
+
+  GstElement *tiledBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), "sinkBinTiled");
+  GstElement *tileBin = pipelineUtils::addTiledSinkBinSource(tiledBin, source_id);
+  if (tileBin != NULL) {
+    this->_add_osd_probe(tileBin, source_id);
+    this->_add_trace_probe(tileBin, "sink_caps", "src", latencyTrace::SINK_CAPS, source_id);
+  }
+  gst_object_unref(tiledBin);
+  return tileBin != NULL;
+}
+
+/**
+ * @brief add the processing callback to the stub detector of a source (cpu profile)
+ * @param inferenceBin the cpu inference bin
+ * @param source_id global id of the source
+ */
+void Pipeline::_add_cpu_inference_probe(GstElement *inferenceBin, int source_id)
+{
+  std::string detector_name = (std::string) "stub_detector_" + std::to_string(source_id);
+  GstElement *cb_element = gst_bin_get_by_name(GST_BIN(inferenceBin), detector_name.c_str());
+  if(cb_element == NULL)
+    LOG(FATAL) << "Could not find " << detector_name << " in inferenceBin";
+  GstPad *probe_pad = gst_element_get_static_pad(cb_element, "src");
+  if(!gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::cpu_probe_callback, (gpointer)this->processor, NULL))
+    LOG(FATAL) << "Could not add pad probe to " << detector_name;
+  gst_object_unref(probe_pad);
+  gst_object_unref(cb_element);
+  // the stub detector stands for nvinfer + nvtracker on the cpu
+  this->_add_trace_probe(inferenceBin, detector_name, "src", latencyTrace::TRACKER, source_id);
+}
+
+/**
+ * @brief link srcBin<id> to the inference bin (input<id>) and the inference bin (output<id>) to sinkBin<id> (or to input<id> of sinkBinTiled)
+ * @param shard the shard whose pipeline holds the bins
+ * @param source_id global id of the source
+ * @return true if linked
+ */
+bool Pipeline::_link_source(PipelineShard *shard, int source_id)
+{
+  // the sources of a tiled sink share sinkBinTiled, where the cpu tiles are exposed as input<id>
+  bool tiled = this->_configs.sink_type == "tiled";
+  std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+  std::string sink_name = tiled ? (std::string) "sinkBinTiled" : (std::string) "sinkBin" + std::to_string(source_id);
+  std::string inputPadName = (std::string) "input" + std::to_string(source_id);
+  std::string outputPadName = (std::string) "output" + std::to_string(source_id);
+  std::string sinkPadName = tiled ? inputPadName : (std::string) "input0";
+  // the gpu mosaic takes the whole batch from output0 (linked once in _create_pipeline)
+  bool link_output = !(tiled && this->_configs.profile == "gpu");
+
+  GstElement *srcBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), src_name.c_str());
+  GstElement *inferenceBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), "inferenceBin");
+  GstElement *sinkBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), sink_name.c_str());
+  if(srcBin == NULL || inferenceBin == NULL || sinkBin == NULL) {
+    LOG(ERROR) << "Could not find " << src_name << ", inferenceBin or " << sink_name << " in shard=" << shard->id;
+    return false;
+  }
+
+  GstPad* srcPad = gst_element_get_static_pad(srcBin, "output0");
+  GstPad* inferenceBinInputPad = gst_element_get_static_pad(inferenceBin, inputPadName.c_str());
+  if(srcPad == NULL)
+    LOG(FATAL) << "Could not get ghostPad from bin=" << src_name << " ,pad=output0";
+  if(inferenceBinInputPad == NULL)
+    LOG(FATAL) << "Could not get ghostPad from inferenceBin (pad=" << inputPadName << ")";
+
+  bool linked = true;
+  int ret = gst_pad_link (srcPad, inferenceBinInputPad);
+  if (ret != GST_PAD_LINK_OK)
+  {
+    LOG(ERROR) << "LINK ERROR:\t" << pipelineUtils::get_link_status(ret);
+    LOG(ERROR) << "Could not link srcPad to inferenceBinPad";
+    linked = false;
+  }
+  gst_object_unref (srcPad);
+  gst_object_unref (inferenceBinInputPad);
+
+  if (link_output) {
+    GstPad* inferenceBinOutputPad = gst_element_get_static_pad(inferenceBin, outputPadName.c_str());
+    GstPad* sinkBinPad = gst_element_get_static_pad(sinkBin, sinkPadName.c_str());
+    if(inferenceBinOutputPad == NULL)
+      LOG(FATAL) << "Could not get ghostPad from inferenceBin (pad=" << outputPadName << ")";
+    if(sinkBinPad == NULL)
+      LOG(FATAL) << "Could not get ghostPad from bin=" << sink_name << " ,pad=" << sinkPadName;
+    ret = gst_pad_link (inferenceBinOutputPad, sinkBinPad);
+    if (ret != GST_PAD_LINK_OK)
+    {
+      LOG(ERROR) << "LINK ERROR:\t" << pipelineUtils::get_link_status(ret);
+      LOG(ERROR) << "Could not link inferenceBinPad to sinkBinPad";
+      linked = false;
+    }
+    gst_object_unref (inferenceBinOutputPad);
+    gst_object_unref (sinkBinPad);
+  }
+  gst_object_unref (srcBin);
+  gst_object_unref (inferenceBin);
+  gst_object_unref (sinkBin);
+  return linked;
+}
+
+/**
+ * @brief runs a shard's main gstreamer thread, g_main_loop_run, which is the main thread on the shard's lifecycle
+ * @param shard the shard to run
+ */
+void Pipeline::_run_shard(PipelineShard *shard)
+{
+  // anything attached to the thread-default context from here on (timeouts, watches) belongs to this shard
+  g_main_context_push_thread_default(shard->context);
+
+  /* Set the pipeline to "playing" state*/
+  LOG(INFO) << "STARTING PIPELINE shard=" << shard->id;
+  VLOG(DEEP) << "[2]Reference count of pipeline: " << GST_OBJECT_REFCOUNT(shard->pipeline);
+
+  // profile every element of the shard, whichever way the pipeline was built (config.json or config.yml)
+  this->_add_profiler(shard);
+
+  core::StartupTimeline::get().mark("shard" + std::to_string(shard->id) + "_playing_requested");
+  gst_element_set_state(GST_ELEMENT(shard->pipeline), GST_STATE_PLAYING);
+#ifdef ENABLE_DOT
+    pipelineUtils::save_debug_dot(shard->pipeline, "/src/logs", "READY_PLAYING");
+#endif
+  this->_sources_lock.lock();
+  shard->running = true;
+  this->_sources_lock.unlock();
+
+  // the watchdog runs on the shard's context, like the bus callback
+  if (this->_configs.watchdog.enable) {
+    GSource *watchdog = g_timeout_source_new(this->_configs.watchdog.interval_ms);
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = -1, .stats = NULL};
+    g_source_set_callback(watchdog, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_check_sources(ctx->shard);
+          return G_SOURCE_CONTINUE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(watchdog, shard->context);
+    g_source_unref(watchdog);
+  }
+  if (this->_configs.latency.budget_ms > 0) {
+    GSource *report = g_timeout_source_new(this->_configs.latency.report_ms);
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = -1, .stats = NULL};
+    g_source_set_callback(report, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_report_latency(ctx->shard);
+          return G_SOURCE_CONTINUE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(report, shard->context);
+    g_source_unref(report);
+  }
+  if (shard->batcher != NULL) {
+    GSource *batching = g_timeout_source_new(this->_configs.batching.interval_ms);
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = -1, .stats = NULL};
+    g_source_set_callback(batching, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_update_batching(ctx->shard);
+          return G_SOURCE_CONTINUE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(batching, shard->context);
+    g_source_unref(batching);
+  }
+  if (shard->governor != NULL) {
+    shard->governed_us = g_get_monotonic_time();
+    GSource *governor = g_timeout_source_new(this->_configs.governor.interval_ms);
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = -1, .stats = NULL};
+    g_source_set_callback(governor, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_update_inference_interval(ctx->shard);
+          return G_SOURCE_CONTINUE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(governor, shard->context);
+    g_source_unref(governor);
+  }
+  if (shard->profiler != NULL) {
+    shard->profiled_us = g_get_monotonic_time();
+    GSource *profile = g_timeout_source_new_seconds(this->_configs.profiler.interval_s);
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = -1, .stats = NULL};
+    g_source_set_callback(profile, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_report_profile(ctx->shard);
+          return G_SOURCE_CONTINUE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(profile, shard->context);
+    g_source_unref(profile);
+
+    // kill -USR1 <pid> switches the profiler of every shard on/off
+    GSource *toggle = g_unix_signal_source_new(SIGUSR1);
+    g_source_set_callback(toggle, [](gpointer data) -> gboolean {
+          PipelineShard *shard = (PipelineShard *) data;
+          shard->profiler->set_enabled(!shard->profiler->enabled());
+          shard->profiled_us = g_get_monotonic_time();
+          LOG(INFO) << "Element profiler of shard=" << shard->id << (shard->profiler->enabled() ? " enabled" : " disabled");
+          return G_SOURCE_CONTINUE;
+        }, shard, NULL);
+    g_source_attach(toggle, shard->context);
+    g_source_unref(toggle);
+  }
+
+  if (this->_configs.qos.summary_s > 0) {
+    GSource *qos = g_timeout_source_new_seconds(this->_configs.qos.summary_s);
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = -1, .stats = NULL};
+    g_source_set_callback(qos, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_report_qos(ctx->shard);
+          return G_SOURCE_CONTINUE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(qos, shard->context);
+    g_source_unref(qos);
+  }
+
+  // kill <pid> (or ctrl-c) sends EOS through the shard so the muxers write their trailers, the bus quits the loop on EOS
+  for (int signum : {SIGTERM, SIGINT}) {
+    GSource *stop = g_unix_signal_source_new(signum);
+    // no source: source_id carries the signal
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = signum, .stats = NULL};
+    g_source_set_callback(stop, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_on_stop_signal(ctx->shard, ctx->source_id == SIGINT ? "SIGINT" : "SIGTERM");
+          return G_SOURCE_CONTINUE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(stop, shard->context);
+    g_source_unref(stop);
+  }
 
-  gst_element_set_state(GST_ELEMENT(this->pipeline), GST_STATE_PLAYING);
-#ifdef ENABLE_DOT
-    pipelineUtils::save_debug_dot(this->pipeline, "/src/logs", "READY_PLAYING");
-#endif
   /* Runs loop until completion */
-  g_main_loop_run(this->loop);
+  g_main_loop_run(shard->loop);
+  // an error on the bus stopped the shard (not the end of its streams, nor the stop of the pipeline): the supervisor decides its
+  // restart. A shard that finished on its own leaves the other shards supervised, the shutdown starts with the last one.
+  std::string failure = shard->bus_struct.failure;
+  bool failed = !failure.empty() && !this->_stopping;
+
+  // stop accepting runtime source changes before the context is torn down (keep dispatching a pending add/remove_source)
+  while (!this->_sources_lock.try_lock())
+    g_main_context_iteration(shard->context, FALSE);
+  shard->running = false;
+  this->_sources_lock.unlock();
 
   /* Out of the main loop, clean up nicely */
-  LOG(INFO) << "FINISHED PIPELINE";
-  gst_element_set_state(GST_ELEMENT(this->pipeline), GST_STATE_NULL);
+  LOG(INFO) << "FINISHED PIPELINE shard=" << shard->id;
+  if (shard->batcher != NULL)
+    LOG(INFO) << "Batching of shard=" << shard->id << ": " << shard->batcher->to_json().dump();
+  if (shard->governor != NULL)
+    LOG(INFO) << "Inference governor of shard=" << shard->id << ": " << shard->governor->to_json().dump();
+  if (shard->profiler != NULL && shard->profiler->enabled())
+    this->_report_profile(shard);
+  this->_report_qos(shard);
+  // the recording of an isolated source is kept out of the state of its bin (refer to recording::finishRecording)
+  for (int source_id : shard->source_ids) {
+    recording::Passthrough *record = this->_recordings.get(source_id);
+    std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+    GstElement *srcBin = record != NULL ? gst_bin_get_by_name(GST_BIN(shard->pipeline), src_name.c_str()) : NULL;
+    if (srcBin == NULL)
+      continue;
+    recording::resumeRecording(srcBin, record, 0);
+    gst_object_unref(srcBin);
+  }
+  gst_element_set_state(GST_ELEMENT(shard->pipeline), GST_STATE_NULL);
 #ifdef ENABLE_DOT
-    pipelineUtils::save_debug_dot(this->pipeline, "/src/logs", "PLAYING_NULL");
+    pipelineUtils::save_debug_dot(shard->pipeline, "/src/logs", "PLAYING_NULL");
 #endif
 
-  gst_object_unref(GST_OBJECT(this->pipeline));
-  g_source_remove(this->bus_watch_id);
-  g_main_loop_unref(this->loop);
+  if (this->_stopping)
+    core::ShutdownTimeline::get().mark("shard" + std::to_string(shard->id) + "_stopped");
+
+  gst_object_unref(GST_OBJECT(shard->pipeline));
+  g_source_destroy(shard->bus_watch);
+  g_source_unref(shard->bus_watch);
+  g_main_loop_unref(shard->loop);
+  g_main_context_pop_thread_default(shard->context);
+  g_main_context_unref(shard->context);
+  {
+    std::lock_guard<std::mutex> guard(this->_sources_lock);
+    this->_release_shard_state(shard);
+  }
 
+  // the shard still counts as running until the supervisor gave it up (retire_shard)
+  if (failed) {
+    LOG(ERROR) << "Pipeline shard=" << shard->id << " failed: " << failure;
+    this->_mediator->notify(new HealthEvent(events::Actions::MODULE_FAILED, events::Module::MODULE_PIPELINE, shard->id, failure,
+                                            events::Module::MODULE_PIPELINE));
+    return;
+  }
+  this->retire_shard(shard->id);
+}
+
+/**
+ * @brief free the batch controller, the inference governor and the element profiler of a shard once its pipeline is gone (they are
+ *  built again with the pipeline of a restart). The QoS table is kept (refer to _setup_pipeline_bus).
+ * @note call with _sources_lock held, set_profiling reads the profilers under it
+ * @param shard the shard, its main loop has returned
+ */
+void Pipeline::_release_shard_state(PipelineShard *shard)
+{
+  delete shard->batcher;
+  shard->batcher = NULL;
+  delete shard->governor;
+  shard->governor = NULL;
+  delete shard->profiler;
+  shard->profiler = NULL;
+}
+
+/**
+ * @brief a shard finished (end of its streams, a signal, or a failure the supervisor gave up): the module is finished once every
+ *  shard has finished
+ * @param shard_id the shard
+ */
+void Pipeline::retire_shard(int shard_id)
+{
+  if (--this->_running_shards > 0) {
+    LOG(WARNING) << "Pipeline shard=" << shard_id << " finished, shards still running=" << this->_running_shards;
+    return;
+  }
+
+  this->_stopping = true;
+  core::ShutdownTimeline::get().begin("pipeline finished");
+  core::ShutdownTimeline::get().mark("pipeline_drained");
   LOG(INFO) << "Module finished ... notifying mediator to shut down";
-  if(this->_configs.sink_type == "file")
+  LOG(INFO) << "Source statistics: " << this->get_source_stats().dump(2);
+  if (this->_configs.latency.budget_ms > 0)
+    LOG(INFO) << "Latency statistics: " << this->get_latency_stats().dump(2);
+  if (this->_configs.trace_latency)
+    LOG(INFO) << "Latency trace: " << this->get_latency_trace().dump(2);
+  if (this->_configs.motion_gate.enable)
+    LOG(INFO) << "Motion gate: " << this->get_motion_stats().dump(2);
+  if(this->_configs.sink_type == "file" || (this->_configs.sink_type == "tiled" && !this->_configs.sinks.empty() &&
+                                             !pipelineUtils::checkStringStartsWith(this->_configs.sinks[0].get<std::string>(), "rtmp://")))
     pipelineUtils::displayFilesSaved(this->_configs.sinks);
 
   this->_pipeline_finished();
-  return;
 }
 
 /**
- * @brief run pipeline threads
+ * @brief rebuild and run a shard that failed (from the supervisor of ApplicationContext, after its backoff). The other shards keep
+ *  running with their loaded engines; the shard gets its sources back, including the ones added at runtime.
+ * @param shard_id the shard
+ * @return false if the shard could not be rebuilt
+ */
+bool Pipeline::restart_shard(int shard_id)
+{
+  if (shard_id < 0 || shard_id >= (int) this->_shards.size())
+    return false;
+  // the pipeline is stopping: the shard is done, like the shards that drained
+  if (this->_stopping) {
+    this->retire_shard(shard_id);
+    return true;
+  }
+  std::lock_guard<std::mutex> guard(this->_sources_lock);
+  PipelineShard *shard = this->_shards[shard_id];
+  if (shard->running)
+    return false;
+
+  LOG(INFO) << "Restarting pipeline shard=" << shard->id << " (sources=" << shard->source_ids.size() << ")";
+  shard->eos_sent = false;
+  shard->stopping = false;
+  shard->recovering = true;
+  if (!this->_setup_pipeline_bus(shard)) {
+    shard->recovering = false;
+    return false;
+  }
+  bool built = false;
+#ifdef YAML_CONFIGS
+  if (this->_configs.src_type == "yaml")
+    built = this->_create_pipeline_from_yaml(shard, this->_yaml_configs);
+  else
+#endif
+    built = this->_create_pipeline(shard);
+  if (!built) {
+    LOG(ERROR) << "Could not rebuild pipeline shard=" << shard->id;
+    gst_element_set_state(GST_ELEMENT(shard->pipeline), GST_STATE_NULL);
+    gst_object_unref(GST_OBJECT(shard->pipeline));
+    g_source_destroy(shard->bus_watch);
+    g_source_unref(shard->bus_watch);
+    g_main_loop_unref(shard->loop);
+    g_main_context_unref(shard->context);
+    this->_release_shard_state(shard);
+    shard->recovering = false;
+    return false;
+  }
+  // the thread of the failed shard returned to the pool
+  this->_pool.push_task(&Pipeline::_run_shard, this, shard);
+  return true;
+}
+
+/**
+ * @brief stop the pipeline the way SIGTERM does: every running shard gets EOS (refer to _on_stop_signal) and the module notifies
+ *  STOP_MODULES once its shards drained. A failed shard waiting for its restart is retired instead (refer to restart_shard).
+ * @param reason what stops the pipeline (start of the shutdown timeline)
+ * @return false if no shard is left to finish, so STOP_MODULES will not be notified
+ */
+bool Pipeline::drain(const std::string &reason)
+{
+  this->_stopping = true;
+  core::ShutdownTimeline::get().begin(reason);
+  std::lock_guard<std::mutex> guard(this->_sources_lock);
+  for (PipelineShard *shard : this->_shards) {
+    if (!shard->running)
+      continue;
+    pipelineUtils::invokeOnContext(shard->context, [this, shard, &reason]() -> bool {
+      this->_on_stop_signal(shard, reason.c_str());
+      return true;
+    });
+  }
+  return this->_running_shards > 0;
+}
+
+/**
+ * @brief run pipeline threads (one per shard)
  */
 void Pipeline::start()
 {
@@ -515,7 +1537,1259 @@ void Pipeline::start()
   if (!this->_set_up())
     LOG(FATAL) << "Could not set up the pipeline module";
 
-  this->_pool.push_task(&Pipeline::_run_pipeline, this);
+  this->_pool.reset(this->_shards.size());
+  this->_running_shards = (int) this->_shards.size();
+  for (PipelineShard *shard : this->_shards)
+    this->_pool.push_task(&Pipeline::_run_shard, this, shard);
+}
+
+/**
+ * @brief add a source (and its sink) while the pipeline is running. The source is added to the running shard with the fewest
+ *  sources that still has room in its batch (refer to pipeline['max_sources']).
+ * @param uri the source, same format as pipeline['sources']
+ * @param sink the sink, same format as pipeline['sinks'] (ignored when pipeline['sink_type']=display or tiled)
+ * @return the global id of the new source, -1 if it could not be added
+ */
+int Pipeline::add_source(std::string uri, std::string sink)
+{
+  if(!this->_sanitize_source(uri)) {
+    LOG(WARNING) << "Cannot add invalid source=" << uri;
+    return -1;
+  }
+  // display and tiled sinks do not take a sink per source
+  bool own_sink = this->_configs.sink_type == "file" || this->_configs.sink_type == "rtmp";
+  bool tiled = this->_configs.sink_type == "tiled";
+  if(own_sink && !this->_sanitize_sink(sink)) {
+    LOG(WARNING) << "Cannot add source=" << uri << " with invalid sink=" << sink;
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> guard(this->_sources_lock);
+  for (const auto &source : this->_configs.sources) {
+    if (source == uri) {
+      LOG(WARNING) << "Cannot add source=" << uri << ", it is already running";
+      return -1;
+    }
+  }
+
+  // pick the running shard with the fewest sources that has room left in its batch
+  PipelineShard *shard = NULL;
+  for (PipelineShard *s : this->_shards) {
+    if (!s->running || (int) s->source_ids.size() >= s->batch_size)
+      continue;
+    if (shard == NULL || s->source_ids.size() < shard->source_ids.size())
+      shard = s;
+  }
+  if (shard == NULL) {
+    LOG(WARNING) << "Cannot add source=" << uri << ", no running shard has room (pipeline['max_sources']=" << this->_configs.max_sources << ")";
+    return -1;
+  }
+
+  // source ids are never reused, so the id stays an index into pipeline['sources'] and pipeline['sinks']
+  int source_id = (int) this->_configs.sources.size();
+  int x, y, width, height;
+  if (tiled && !pipelineUtils::tileRect(this->_configs.tiler, source_id, x, y, width, height)) {
+    LOG(WARNING) << "Cannot add source=" << uri << ", source id=" << source_id << " has no tile left in the " << this->_configs.tiler.rows << "x"
+                 << this->_configs.tiler.columns << " mosaic";
+    return -1;
+  }
+  this->processor->add_source(source_id);
+
+  bool added = pipelineUtils::invokeOnContext(shard->context, [this, shard, source_id, uri, sink, tiled]() -> bool {
+    GstElement *srcBin = this->_create_source_bin(shard, source_id, uri);
+    if (srcBin != NULL && this->_configs.record.passthrough)
+      this->_add_passthrough_recording(srcBin, source_id, sink);
+    if (srcBin != NULL && this->_configs.motion_gate.enable)
+      this->_add_motion_branch(srcBin, source_id);
+    GstElement *sinkBin = tiled ? NULL : this->_create_sink_bin(source_id, sink);
+    bool src_added = false, sink_added = false, pads_added = false;
+    // undo what was added before the failure, in reverse order: the tile, the inference bin pads, then the bins
+    auto undo = [&]() -> bool {
+      if (tiled) {
+        GstElement *tiledBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), "sinkBinTiled");
+        if (tiledBin != NULL) {
+          pipelineUtils::removeTiledSinkBinSource(tiledBin, source_id);
+          gst_object_unref(tiledBin);
+        }
+      }
+      if (pads_added) {
+        GstElement *inferenceBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), "inferenceBin");
+        pipelineUtils::removeInferenceBinSource(inferenceBin, source_id);
+        gst_object_unref(inferenceBin);
+      }
+      // the pipeline owns (and frees) the bins it removes, the bins never added are still ours
+      if (sinkBin != NULL) {
+        if (sink_added)
+          gst_bin_remove(GST_BIN(shard->pipeline), sinkBin);
+        else
+          gst_object_unref(sinkBin);
+      }
+      if (srcBin != NULL) {
+        if (src_added)
+          gst_bin_remove(GST_BIN(shard->pipeline), srcBin);
+        else
+          gst_object_unref(srcBin);
+      }
+      return false;
+    };
+    if (srcBin == NULL || (!tiled && sinkBin == NULL))
+      return undo();
+    if (!(src_added = gst_bin_add(GST_BIN(shard->pipeline), srcBin)))
+      return undo();
+    if (!tiled && !(sink_added = gst_bin_add(GST_BIN(shard->pipeline), sinkBin)))
+      return undo();
+
+    GstElement *inferenceBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), "inferenceBin");
+    pipelineUtils::addInferenceBinSource(inferenceBin, source_id);
+    pads_added = true;
+    if (this->_configs.profile == "cpu")
+      this->_add_cpu_inference_probe(inferenceBin, source_id);
+    gst_object_unref(inferenceBin);
+    if (tiled && !this->_add_tile(shard, source_id))
+      return undo();
+    if (!this->_link_source(shard, source_id))
+      return undo();
+    latencyBudget::applyLatencyBudget(shard->pipeline, this->_configs.latency);
+
+    // start downstream first so that the first buffers of the source are not refused
+    if (sinkBin != NULL)
+      gst_element_sync_state_with_parent(sinkBin);
+    gst_element_sync_state_with_parent(srcBin);
+    // the source list is only changed on the shard's context, where the bus callback reads it
+    shard->source_ids.push_back(source_id);
+    return true;
+  });
+
+  if (!added) {
+    LOG(ERROR) << "Failed to add source=" << uri << " to shard=" << shard->id;
+    this->processor->remove_source(source_id);
+    return -1;
+  }
+
+  this->_configs.sources[source_id] = uri;
+  if (own_sink)
+    this->_configs.sinks[source_id] = sink;
+  LOG(INFO) << "Added source=" << source_id << " (" << uri << ") to shard=" << shard->id << " (sources=" << shard->source_ids.size() << "/"
+            << shard->batch_size << ")";
+#ifdef ENABLE_DOT
+  pipelineUtils::save_debug_dot(shard->pipeline, "/src/logs", "ADD_SOURCE");
+#endif
+  return source_id;
+}
+
+/**
+ * @brief remove a source (and its sink) while the pipeline is running. The other sources of the shard keep streaming.
+ * @param source_id global id of the source
+ * @return true if the source was removed
+ */
+bool Pipeline::remove_source(int source_id)
+{
+  std::lock_guard<std::mutex> guard(this->_sources_lock);
+  PipelineShard *shard = NULL;
+  for (PipelineShard *s : this->_shards) {
+    if (std::find(s->source_ids.begin(), s->source_ids.end(), source_id) != s->source_ids.end())
+      shard = s;
+  }
+  if (shard == NULL || !shard->running) {
+    LOG(WARNING) << "Cannot remove source=" << source_id << ", it is not running";
+    return false;
+  }
+
+  bool tiled = this->_configs.sink_type == "tiled";
+  recording::Passthrough *record = this->_recordings.get(source_id);
+  bool removed = pipelineUtils::invokeOnContext(shard->context, [shard, source_id, tiled, record]() -> bool {
+    std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+    std::string sink_name = tiled ? (std::string) "sinkBinTiled" : (std::string) "sinkBin" + std::to_string(source_id);
+    GstElement *srcBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), src_name.c_str());
+    GstElement *sinkBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), sink_name.c_str());
+    GstElement *inferenceBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), "inferenceBin");
+    if (srcBin == NULL || sinkBin == NULL || inferenceBin == NULL)
+      return false;
+    // the source list is only changed on the shard's context, where the bus callback reads it
+    shard->source_ids.erase(std::find(shard->source_ids.begin(), shard->source_ids.end(), source_id));
+
+    // stop the source before releasing its mux pad so no buffer is pushed into a released pad (the recording of an isolated
+    // source follows the bin again)
+    if (record != NULL)
+      recording::resumeRecording(srcBin, record, 0);
+    gst_element_set_state(srcBin, GST_STATE_NULL);
+    pipelineUtils::removeInferenceBinSource(inferenceBin, source_id);
+    gst_bin_remove(GST_BIN(shard->pipeline), srcBin);
+    // the mosaic keeps running for the other sources, only the tile of this source goes away
+    if (tiled) {
+      pipelineUtils::removeTiledSinkBinSource(sinkBin, source_id);
+    } else {
+      gst_element_set_state(sinkBin, GST_STATE_NULL);
+      gst_bin_remove(GST_BIN(shard->pipeline), sinkBin);
+    }
+
+    gst_object_unref(srcBin);
+    gst_object_unref(sinkBin);
+    gst_object_unref(inferenceBin);
+    return true;
+  });
+
+  if (!removed) {
+    LOG(ERROR) << "Failed to remove source=" << source_id << " from shard=" << shard->id;
+    return false;
+  }
+
+  this->processor->remove_source(source_id);
+  // the clip of the source ends with the frames it has
+  if (this->_recorder != NULL && this->_recorder->get(source_id) != NULL)
+    clipRecorder::onReset(*this->_recorder->get(source_id));
+  // keep the entry so source ids stay indexes into pipeline['sources'], but allow the same uri to be added again
+  this->_configs.sources[source_id] = "";
+  LOG(INFO) << "Removed source=" << source_id << " from shard=" << shard->id << " (sources=" << shard->source_ids.size() << "/" << shard->batch_size << ")";
+  return true;
+}
+
+/**
+ * SOURCE HEALTH
+ */
+
+/**
+ * @brief connection statistics of every source (errors, reconnects, outage durations)
+ * @return json keyed by source id
+ */
+njson Pipeline::get_source_stats()
+{
+  std::lock_guard<std::mutex> guard(this->_stats_lock);
+  njson ret = njson::object();
+  for (const auto &[source_id, stats] : this->_source_stats)
+    ret[std::to_string(source_id)] = sourceHealth::statsToJson(*stats);
+  return ret;
+}
+
+/**
+ * @brief get (or create) the connection statistics of a source
+ * @param source_id global id of the source
+ * @return the statistics, owned by the Pipeline module
+ */
+sourceHealth::SourceStats *Pipeline::_get_source_stats(int source_id)
+{
+  std::lock_guard<std::mutex> guard(this->_stats_lock);
+  if (this->_source_stats.find(source_id) == this->_source_stats.end()) {
+    sourceHealth::SourceStats *stats = new sourceHealth::SourceStats();
+    this->_source_stats[source_id] = stats;
+    // the stats are never freed, the scrapes read their atomics
+    core::MetricLabels labels = {{"source", std::to_string(source_id)}};
+    core::Metrics &metrics = core::Metrics::get();
+    metrics.observe("iva_source_frames_total", "counter", "Frames output by the decoder of a source.", labels,
+                    [stats]() { return (double) stats->buffers.load(std::memory_order_relaxed); });
+    metrics.observe("iva_source_fps", "gauge", "Output frame rate of a source (moving average of the watchdog).", labels,
+                    [stats]() { return stats->fps.load(std::memory_order_relaxed); });
+    metrics.observe("iva_source_errors_total", "counter", "Errors (or unexpected EOS) raised by a source.", labels,
+                    [stats]() { return (double) stats->errors.load(std::memory_order_relaxed); });
+    metrics.observe("iva_source_reconnects_total", "counter", "Times a source came back after an outage.", labels,
+                    [stats]() { return (double) stats->reconnects.load(std::memory_order_relaxed); });
+    metrics.observe("iva_source_stalled", "gauge", "1 while the watchdog considers the source stalled.", labels,
+                    [stats]() { return stats->stalled.load(std::memory_order_relaxed) ? 1.0 : 0.0; });
+  }
+  return this->_source_stats[source_id];
+}
+
+/**
+ * @brief handle an error (or unexpected EOS) raised by srcBin<id>: isolate the source and schedule its restart.
+ *  File sources are not restarted since the same error would be raised again.
+ * @param shard the shard that runs the source
+ * @param source_id global id of the source
+ * @return true if the shard still has sources to run, false if it should stop
+ */
+bool Pipeline::_on_source_error(PipelineShard *shard, int source_id)
+{
+  sourceHealth::SourceStats *stats = this->_get_source_stats(source_id);
+  stats->errors++;
+  if (stats->failed)
+    return this->_has_live_sources(shard);
+
+  std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+  GstElement *srcBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), src_name.c_str());
+  if (srcBin == NULL)
+    return this->_has_live_sources(shard);
+  // the bin is already isolated and waiting for its restart, ignore the errors it raised on the way down
+  bool waiting = stats->outage_start_us != 0 && gst_element_is_locked_state(srcBin);
+  gst_object_unref(srcBin);
+  if (waiting)
+    return true;
+
+  this->_isolate_source(shard, source_id);
+  if (this->_configs.src_type == "file")
+    this->_give_up_source(shard, source_id);
+  else
+    this->_schedule_source_restart(shard, source_id);
+  return this->_has_live_sources(shard);
+}
+
+/**
+ * @brief take srcBin<id> out of the running pipeline without touching the other sources: block its output, stop it,
+ *  and flush what nvstreammux holds for it. The bin is left in the pipeline (locked in GST_STATE_NULL) so it can be restarted.
+ * @param shard the shard that runs the source
+ * @param source_id global id of the source
+ */
+void Pipeline::_isolate_source(PipelineShard *shard, int source_id)
+{
+  std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+  GstElement *srcBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), src_name.c_str());
+  if (srcBin == NULL)
+    return;
+
+  // keep the pipeline's state changes away from the bin while it is down
+  gst_element_set_locked_state(srcBin, TRUE);
+
+  // block the output while the bin shuts down, so no partial data or EOS reaches nvstreammux (deactivating the pad
+  // releases a streaming thread held in the probe)
+  GstPad *srcPad = gst_element_get_static_pad(srcBin, "output0");
+  gulong block_probe = gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+      [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn { return GST_PAD_PROBE_OK; }, NULL, NULL);
+  // the passthrough recording finishes its file while the rest of the bin goes down
+  recording::finishRecording(srcBin);
+  gst_element_set_state(srcBin, GST_STATE_NULL);
+
+  // flush what nvstreammux holds for this source, and reset its running time for the restart
+  GstPad *muxPad = gst_pad_get_peer(srcPad);
+  if (muxPad != NULL) {
+    gst_pad_send_event(muxPad, gst_event_new_flush_start());
+    gst_pad_send_event(muxPad, gst_event_new_flush_stop(TRUE));
+    gst_object_unref(muxPad);
+  }
+  gst_pad_remove_probe(srcPad, block_probe);
+  gst_object_unref(srcPad);
+  gst_object_unref(srcBin);
+
+  sourceHealth::SourceStats *stats = this->_get_source_stats(source_id);
+  int64_t expected = 0;
+  stats->outage_start_us.compare_exchange_strong(expected, g_get_monotonic_time());
+  LOG(WARNING) << "Isolated source=" << source_id << " on shard=" << shard->id << " (errors=" << stats->errors << ")";
+}
+
+/**
+ * @brief restart srcBin<id> after an exponential backoff with jitter (pipeline['reconnect']), or give it up once
+ *  pipeline['reconnect']['max_attempts'] is reached
+ * @param shard the shard that runs the source
+ * @param source_id global id of the source
+ */
+void Pipeline::_schedule_source_restart(PipelineShard *shard, int source_id)
+{
+  sourceHealth::SourceStats *stats = this->_get_source_stats(source_id);
+  int attempt = stats->attempt;
+  if (this->_configs.reconnect.max_attempts > 0 && attempt >= this->_configs.reconnect.max_attempts) {
+    this->_give_up_source(shard, source_id);
+    if (!this->_has_live_sources(shard)) {
+      LOG(ERROR) << "No source left on shard=" << shard->id << ", terminating pipeline shard";
+      g_main_loop_quit(shard->loop);
+    }
+    return;
+  }
+
+  int delay_ms = sourceHealth::computeBackoffMs(this->_configs.reconnect, attempt, g_random_double());
+  stats->attempt++;
+  LOG(WARNING) << "Restarting source=" << source_id << " in " << delay_ms << "ms (attempt=" << attempt + 1 << ")";
+
+  // the timer runs on the shard's context, like the bus callback
+  GSource *timer = g_timeout_source_new(delay_ms);
+  SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = source_id, .stats = stats};
+  g_source_set_callback(timer, [](gpointer data) -> gboolean {
+        SourceContext *ctx = (SourceContext *) data;
+        ctx->pipeline->_restart_source(ctx->shard, ctx->source_id);
+        return G_SOURCE_REMOVE;
+      }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+  g_source_attach(timer, shard->context);
+  g_source_unref(timer);
+}
+
+/**
+ * @brief bring an isolated srcBin<id> back to the pipeline's state. Success is recorded by the first buffer on src_queue,
+ *  a failure raises a new error on the bus which schedules the next attempt.
+ * @param shard the shard that runs the source
+ * @param source_id global id of the source
+ */
+void Pipeline::_restart_source(PipelineShard *shard, int source_id)
+{
+  std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+  GstElement *srcBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), src_name.c_str());
+  // the source was removed while it was down
+  if (srcBin == NULL)
+    return;
+
+  // the passthrough recording starts its next file once the previous one is finalized
+  recording::Passthrough *record = this->_recordings.get(source_id);
+  if (record != NULL && !recording::resumeRecording(srcBin, record, (int64_t) this->_configs.eos_timeout_ms * 1000)) {
+    VLOG(DEBUG) << "Source=" << source_id << " waits for its recording to be finalized";
+    GSource *timer = g_timeout_source_new(100);
+    SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = source_id, .stats = NULL};
+    g_source_set_callback(timer, [](gpointer data) -> gboolean {
+          SourceContext *ctx = (SourceContext *) data;
+          ctx->pipeline->_restart_source(ctx->shard, ctx->source_id);
+          return G_SOURCE_REMOVE;
+        }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+    g_source_attach(timer, shard->context);
+    g_source_unref(timer);
+    gst_object_unref(srcBin);
+    return;
+  }
+
+  LOG(INFO) << "Restarting source=" << source_id << " on shard=" << shard->id;
+  gst_element_set_locked_state(srcBin, FALSE);
+  if (!gst_element_sync_state_with_parent(srcBin)) {
+    LOG(WARNING) << "Could not restart source=" << source_id;
+    this->_isolate_source(shard, source_id);
+    this->_schedule_source_restart(shard, source_id);
+  }
+  gst_object_unref(srcBin);
+}
+
+/**
+ * @brief stop retrying srcBin<id>: it stays isolated and EOS is sent into its nvstreammux pad so the batch can still finish
+ * @param shard the shard that runs the source
+ * @param source_id global id of the source
+ */
+void Pipeline::_give_up_source(PipelineShard *shard, int source_id)
+{
+  sourceHealth::SourceStats *stats = this->_get_source_stats(source_id);
+  stats->failed = true;
+
+  std::string padName = (std::string) "input" + std::to_string(source_id);
+  GstElement *inferenceBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), "inferenceBin");
+  if (inferenceBin != NULL) {
+    GstPad *inferenceBinPad = gst_element_get_static_pad(inferenceBin, padName.c_str());
+    if (inferenceBinPad != NULL) {
+      gst_pad_send_event(inferenceBinPad, gst_event_new_eos());
+      gst_object_unref(inferenceBinPad);
+    }
+    gst_object_unref(inferenceBin);
+  }
+  LOG(ERROR) << "Gave up source=" << source_id << " on shard=" << shard->id << " after errors=" << stats->errors;
+}
+
+/**
+ * LATENCY BUDGET
+ */
+
+/**
+ * @brief latency measured at every sink against pipeline['latency_budget_ms']
+ * @return json keyed by sink bin name (sinkBin<id>, sinkBinTiled)
+ */
+njson Pipeline::get_latency_stats()
+{
+  std::lock_guard<std::mutex> guard(this->_stats_lock);
+  njson ret = njson::object();
+  for (const auto &[name, stats] : this->_latency_stats)
+    ret[name] = latencyBudget::statsToJson(*stats);
+  return ret;
+}
+
+/**
+ * @brief measure the latency of every frame that reaches the sink of a sink bin (only when a latency budget is configured)
+ * @param sinkBin the sink bin (its sink element is named sink)
+ */
+void Pipeline::_add_latency_probe(GstElement *sinkBin)
+{
+  if (this->_configs.latency.budget_ms <= 0)
+    return;
+  GstElement *sink = gst_bin_get_by_name(GST_BIN(sinkBin), "sink");
+  if (sink == NULL) {
+    LOG(WARNING) << "Could not find the sink of " << GST_ELEMENT_NAME(sinkBin) << ", its latency is not measured";
+    return;
+  }
+
+  latencyBudget::LatencyStats *stats;
+  {
+    std::lock_guard<std::mutex> guard(this->_stats_lock);
+    std::string name = GST_ELEMENT_NAME(sinkBin);
+    if (this->_latency_stats.find(name) == this->_latency_stats.end())
+      this->_latency_stats[name] = new latencyBudget::LatencyStats();
+    stats = this->_latency_stats[name];
+    stats->budget_ms = this->_configs.latency.budget_ms;
+  }
+  core::MetricLabels labels = {{"sink", GST_ELEMENT_NAME(sinkBin)}};
+  core::Metrics &metrics = core::Metrics::get();
+  metrics.observe("iva_sink_latency_seconds", "gauge", "Moving average of the latency of the frames reaching a sink.", labels,
+                  [stats]() { return stats->average_us.load(std::memory_order_relaxed) / 1e6; });
+  metrics.observe("iva_sink_latency_max_seconds", "gauge", "Highest latency of the frames reaching a sink.", labels,
+                  [stats]() { return stats->max_us.load(std::memory_order_relaxed) / 1e6; });
+  metrics.observe("iva_sink_frames_over_budget_total", "counter", "Frames that reached a sink over the latency budget.", labels,
+                  [stats]() { return (double) stats->over_budget.load(std::memory_order_relaxed); });
+  GstPad *probe_pad = gst_element_get_static_pad(sink, "sink");
+  gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        latencyBudget::recordLatency(*(latencyBudget::LatencyStats *) data, latencyBudget::bufferLatencyUs(pad, GST_PAD_PROBE_INFO_BUFFER(info)));
+        return GST_PAD_PROBE_OK;
+      }, stats, NULL);
+  gst_object_unref(probe_pad);
+  gst_object_unref(sink);
+}
+
+/**
+ * @brief periodic report (timer on the shard's context) of the latency of the shard's sinks against the budget.
+ *  Sinks that had frames over the budget since the previous report are logged as warnings.
+ * @param shard the shard to report
+ */
+void Pipeline::_report_latency(PipelineShard *shard)
+{
+  std::vector<std::string> names;
+  if (this->_configs.sink_type == "tiled")
+    names.push_back("sinkBinTiled");
+  for (int source_id : shard->source_ids)
+    names.push_back((std::string) "sinkBin" + std::to_string(source_id));
+
+  std::lock_guard<std::mutex> guard(this->_stats_lock);
+  for (const std::string &name : names) {
+    auto it = this->_latency_stats.find(name);
+    if (it == this->_latency_stats.end())
+      continue;
+    latencyBudget::LatencyStats *stats = it->second;
+    uint64_t over_budget = stats->over_budget.load();
+    uint64_t new_over_budget = over_budget - stats->reported_over_budget.exchange(over_budget);
+    if (new_over_budget > 0)
+      LOG(WARNING) << "Latency of " << name << " over budget=" << stats->budget_ms << "ms for " << new_over_budget << " frames: "
+                   << latencyBudget::statsToJson(*stats).dump();
+    else
+      VLOG(DEBUG) << "Latency of " << name << ": " << latencyBudget::statsToJson(*stats).dump();
+  }
+}
+
+/**
+ * ADAPTIVE BATCHING
+ */
+
+/**
+ * @brief count the batches pushed by nvstreammux and the frames they carry, to report the measured fill of the batches
+ *  (only when pipeline['batching']['adaptive'] is set on the gpu profile). Creates the shard's batch controller.
+ * @param shard the shard, its inference bin must be in the pipeline
+ */
+void Pipeline::_add_batch_probe(PipelineShard *shard)
+{
+#ifndef CPU_ONLY
+  if (!this->_configs.batching.adaptive || this->_configs.profile != "gpu")
+    return;
+  GstElement *nv_mux = gst_bin_get_by_name(GST_BIN(shard->pipeline), "nv_mux");
+  if (nv_mux == NULL) {
+    LOG(WARNING) << "Could not find nv_mux in shard=" << shard->id << ", batching is not adapted";
+    return;
+  }
+  shard->batcher = new batching::BatchController(this->_configs.batching);
+  GstPad *probe_pad = gst_element_get_static_pad(nv_mux, "src");
+  gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        PipelineShard *shard = (PipelineShard *) data;
+        NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+        if (batch_meta != NULL) {
+          shard->batches.fetch_add(1, std::memory_order_relaxed);
+          shard->batched_frames.fetch_add(batch_meta->num_frames_in_batch, std::memory_order_relaxed);
+        }
+        return GST_PAD_PROBE_OK;
+      }, shard, NULL);
+  gst_object_unref(probe_pad);
+  gst_object_unref(nv_mux);
+#endif
+}
+
+/**
+ * @brief adaptive batching (timer on the shard's context): measure the frame rate of the shard's sources and retune nvstreammux.
+ *  batch-size is only changed if the installed nvstreammux allows it in PLAYING, batched-push-timeout always is.
+ * @param shard the shard to tune
+ */
+void Pipeline::_update_batching(PipelineShard *shard)
+{
+  std::map<int, uint64_t> buffers;
+  for (int source_id : shard->source_ids)
+    buffers[source_id] = this->_get_source_stats(source_id)->buffers.load(std::memory_order_relaxed);
+  batching::BatchDecision decision = shard->batcher->update(buffers, g_get_monotonic_time());
+
+  uint64_t batches = shard->batches.exchange(0);
+  uint64_t frames = shard->batched_frames.exchange(0);
+  double fill = batches > 0 ? (double) frames / (double) (batches * std::max(1, decision.batch_size)) : 0.0;
+  VLOG(DEBUG) << "Batching of shard=" << shard->id << ": batches=" << batches << " measured fill=" << fill << " "
+              << shard->batcher->to_json().dump();
+  if (!decision.changed)
+    return;
+
+  GstElement *nv_mux = gst_bin_get_by_name(GST_BIN(shard->pipeline), "nv_mux");
+  if (nv_mux == NULL)
+    return;
+  g_object_set(nv_mux, "batched-push-timeout", decision.timeout_us, NULL);
+  GParamSpec *spec = g_object_class_find_property(G_OBJECT_GET_CLASS(nv_mux), "batch-size");
+  if (spec != NULL && (spec->flags & GST_PARAM_MUTABLE_PLAYING))
+    g_object_set(nv_mux, "batch-size", (guint) std::min(decision.batch_size, shard->batch_size), NULL);
+  gst_object_unref(nv_mux);
+  LOG(INFO) << "Retuned nvstreammux of shard=" << shard->id << ": batched-push-timeout=" << decision.timeout_us
+            << "us batch-size=" << decision.batch_size << " expected fill=" << decision.expected_fill << " measured fill=" << fill;
+}
+
+/**
+ * INFERENCE GOVERNOR
+ */
+
+/**
+ * @brief time the batches spend in nvinfer (only when pipeline['inference_governor']['adaptive'] is set on the gpu profile).
+ *  Creates the shard's governor, starting from the interval of detection.yml.
+ * @param shard the shard, its inference bin must be in the pipeline
+ */
+void Pipeline::_add_governor_probes(PipelineShard *shard)
+{
+  if (!this->_configs.governor.adaptive || this->_configs.profile != "gpu")
+    return;
+  GstElement *nv_detection = gst_bin_get_by_name(GST_BIN(shard->pipeline), "nv_detection");
+  if (nv_detection == NULL) {
+    LOG(WARNING) << "Could not find nv_detection in shard=" << shard->id << ", the inference interval is not governed";
+    return;
+  }
+  GParamSpec *spec = g_object_class_find_property(G_OBJECT_GET_CLASS(nv_detection), "interval");
+  if (spec == NULL || !(spec->flags & GST_PARAM_MUTABLE_PLAYING)) {
+    LOG(WARNING) << "nvinfer cannot change its interval while playing, the inference interval of shard=" << shard->id << " is not governed";
+    gst_object_unref(nv_detection);
+    return;
+  }
+  guint interval = 0;
+  g_object_get(nv_detection, "interval", &interval, NULL);
+  shard->governor = new inferenceGovernor::InferenceGovernor(this->_configs.governor, (int) interval);
+
+  GstPad *sink_pad = gst_element_get_static_pad(nv_detection, "sink");
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        inferenceGovernor::enterElement(*(inferenceGovernor::ElementTiming *) data, GST_PAD_PROBE_INFO_BUFFER(info), g_get_monotonic_time());
+        return GST_PAD_PROBE_OK;
+      }, &shard->inference_timing, NULL);
+  gst_object_unref(sink_pad);
+  GstPad *src_pad = gst_element_get_static_pad(nv_detection, "src");
+  gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        inferenceGovernor::leaveElement(*(inferenceGovernor::ElementTiming *) data, GST_PAD_PROBE_INFO_BUFFER(info), g_get_monotonic_time());
+        return GST_PAD_PROBE_OK;
+      }, &shard->inference_timing, NULL);
+  gst_object_unref(src_pad);
+  gst_object_unref(nv_detection);
+}
+
+/**
+ * @brief inference governor (timer on the shard's context): measure the load of the shard from the QoS messages of its bus, the
+ *  fill of the source queues and the time spent in nvinfer, and set the nvinfer interval the governor decides
+ * @param shard the shard to govern
+ */
+void Pipeline::_update_inference_interval(PipelineShard *shard)
+{
+  int64_t now = g_get_monotonic_time();
+  inferenceGovernor::LoadSignals signals;
+  // the bus watch runs on this context, no lock needed
+  signals.qos_messages = shard->bus_struct.qos_messages;
+  shard->bus_struct.qos_messages = 0;
+  int64_t elapsed = now - shard->governed_us;
+  shard->governed_us = now;
+  int64_t busy = inferenceGovernor::takeBusyUs(shard->inference_timing);
+  signals.busy = elapsed > 0 ? (double) busy / (double) elapsed : 0.0;
+  for (int source_id : shard->source_ids) {
+    std::string binName = (std::string) "srcBin" + std::to_string(source_id);
+    GstElement *srcBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), binName.c_str());
+    if (srcBin == NULL)
+      continue;
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(srcBin), "src_queue");
+    if (queue != NULL) {
+      signals.queue_fill = std::max(signals.queue_fill, inferenceGovernor::queueFill(queue));
+      gst_object_unref(queue);
+    }
+    gst_object_unref(srcBin);
+  }
+
+  int previous = shard->governor->interval();
+  int interval = shard->governor->update(signals);
+  VLOG(DEBUG) << "Inference governor of shard=" << shard->id << ": qos=" << signals.qos_messages << " queue_fill=" << signals.queue_fill
+              << " busy=" << signals.busy << " " << shard->governor->to_json().dump();
+  if (interval == previous)
+    return;
+
+  // a gated shard applies the interval on its next batch with motion
+  if (shard->base_interval.load() >= 0) {
+    shard->base_interval = interval;
+  }
+  else {
+    GstElement *nv_detection = gst_bin_get_by_name(GST_BIN(shard->pipeline), "nv_detection");
+    if (nv_detection == NULL)
+      return;
+    g_object_set(nv_detection, "interval", (guint) interval, NULL);
+    gst_object_unref(nv_detection);
+  }
+  LOG(INFO) << "Inference interval of shard=" << shard->id << " " << previous << " -> " << interval << " (load="
+            << inferenceGovernor::loadLevel(signals) << ", the tracker fills the skipped batches)";
+}
+
+/**
+ * LATENCY TRACE
+ */
+
+/**
+ * @struct TraceProbe
+ * @brief data handed to the latency trace probes
+ *
+ * @var tracer
+ * the traces of every source (batched stages find the source of every frame)
+ * @var trace
+ * the trace of the source (per-source stages), NULL on batched stages
+ * @var stage
+ * the stage measured by the probe
+ */
+struct TraceProbe {
+  latencyTrace::Tracer *tracer;
+  latencyTrace::SourceTrace *trace;
+  int stage;
+};
+
+/**
+ * @brief latency percentiles from the decoder to every stage of every source (pipeline['trace_latency'])
+ * @return json keyed by source id then stage (mux, tracker, sink_caps, sink), empty if tracing is off
+ */
+njson Pipeline::get_latency_trace()
+{
+  return this->_tracer.to_json();
+}
+
+/**
+ * @brief frames that reached nvinfer and the fraction that skipped inference for lack of motion, by source
+ * @return {"<source_id>": {"frames": n, "skipped": n, "skipped_fraction": f}}, empty without pipeline['motion_gate']
+ */
+njson Pipeline::get_motion_stats()
+{
+  return this->_motion.to_json();
+}
+
+/**
+ * @brief stamp the frames of a source as they leave its decoder (only when pipeline['trace_latency'] is set)
+ * @param pad the src pad of the source's src_queue
+ * @param source_id global id of the source
+ */
+void Pipeline::_add_trace_stamp(GstPad *pad, int source_id)
+{
+  if (!this->_configs.trace_latency)
+    return;
+  latencyTrace::SourceTrace *trace = this->_tracer.add(source_id);
+  if (trace == NULL) {
+    LOG(WARNING) << "Source=" << source_id << " shares its trace slot with another source, its latency is not traced";
+    return;
+  }
+  // mux is the decode latency, tracker the inference latency and sink the end to end latency
+  for (int stage = 0; stage < latencyTrace::STAGES; stage++) {
+    latencyTrace::Histogram *histogram = &trace->stages[stage];
+    core::MetricLabels labels = {{"source", std::to_string(source_id)}, {"stage", latencyTrace::stageName(stage)}};
+    for (double quantile : {0.5, 0.95, 0.99}) {
+      core::MetricLabels quantile_labels = labels;
+      quantile_labels.emplace_back("quantile", quantile == 0.5 ? "0.5" : quantile == 0.95 ? "0.95" : "0.99");
+      core::Metrics::get().observe("iva_frame_latency_seconds", "gauge", "Latency of the frames from the decoder to a stage.", quantile_labels,
+                                   [histogram, quantile]() { return latencyTrace::percentile(*histogram, quantile) / 1e6; });
+    }
+    core::Metrics::get().observe("iva_frame_latency_max_seconds", "gauge", "Highest latency of the frames from the decoder to a stage.",
+                                 labels, [histogram]() { return histogram->max_us.load(std::memory_order_relaxed) / 1e6; });
+  }
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (GST_BUFFER_PTS_IS_VALID(buffer))
+          latencyTrace::stamp(*(latencyTrace::SourceTrace *) data, GST_BUFFER_PTS(buffer), g_get_monotonic_time());
+        return GST_PAD_PROBE_OK;
+      }, trace, NULL);
+}
+
+/**
+ * @brief measure the latency of the frames of a single source at a stage (only when pipeline['trace_latency'] is set)
+ * @param bin the bin that holds the element
+ * @param element name of the element in the bin
+ * @param pad name of the static pad of the element
+ * @param stage the stage measured
+ * @param source_id global id of the source
+ */
+void Pipeline::_add_trace_probe(GstElement *bin, const std::string &element, const std::string &pad, int stage, int source_id)
+{
+  if (!this->_configs.trace_latency)
+    return;
+  latencyTrace::SourceTrace *trace = this->_tracer.add(source_id);
+  GstElement *traced = gst_bin_get_by_name(GST_BIN(bin), element.c_str());
+  if (trace == NULL || traced == NULL) {
+    VLOG(DEBUG) << "No " << latencyTrace::stageName(stage) << " latency for source=" << source_id << " in " << GST_ELEMENT_NAME(bin);
+    if (traced != NULL)
+      gst_object_unref(traced);
+    return;
+  }
+  GstPad *probe_pad = gst_element_get_static_pad(traced, pad.c_str());
+  gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        TraceProbe *probe = (TraceProbe *) data;
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (GST_BUFFER_PTS_IS_VALID(buffer))
+          latencyTrace::reach(*probe->trace, probe->stage, GST_BUFFER_PTS(buffer), g_get_monotonic_time());
+        return GST_PAD_PROBE_OK;
+      }, new TraceProbe{.tracer = &this->_tracer, .trace = trace, .stage = stage}, [](gpointer data) { delete (TraceProbe *) data; });
+  gst_object_unref(probe_pad);
+  gst_object_unref(traced);
+}
+
+/**
+ * @brief measure the latency of the batched frames at nv_mux and nv_tracker (gpu profile, only when pipeline['trace_latency'] is set).
+ *  The batch buffers are new buffers, every frame is found by the source id and timestamp of its frame meta.
+ * @param shard the shard, its inference bin must be in the pipeline
+ */
+void Pipeline::_add_batch_trace_probes(PipelineShard *shard)
+{
+#ifndef CPU_ONLY
+  if (!this->_configs.trace_latency || this->_configs.profile != "gpu")
+    return;
+  const std::vector<std::pair<std::string, int>> stages = {{"nv_mux", latencyTrace::MUX}, {"nv_tracker", latencyTrace::TRACKER}};
+  for (const auto &[name, stage] : stages) {
+    GstElement *element = gst_bin_get_by_name(GST_BIN(shard->pipeline), name.c_str());
+    if (element == NULL) {
+      LOG(WARNING) << "Could not find " << name << " in shard=" << shard->id << ", its latency is not traced";
+      continue;
+    }
+    GstPad *probe_pad = gst_element_get_static_pad(element, "src");
+    gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+          TraceProbe *probe = (TraceProbe *) data;
+          NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+          if (batch_meta == NULL)
+            return GST_PAD_PROBE_OK;
+          int64_t now = g_get_monotonic_time();
+          for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+            NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+            latencyTrace::SourceTrace *trace = probe->tracer->get((int) frame_meta->source_id);
+            if (trace != NULL)
+              latencyTrace::reach(*trace, probe->stage, frame_meta->buf_pts, now);
+          }
+          return GST_PAD_PROBE_OK;
+        }, new TraceProbe{.tracer = &this->_tracer, .trace = NULL, .stage = stage}, [](gpointer data) { delete (TraceProbe *) data; });
+    gst_object_unref(probe_pad);
+    gst_object_unref(element);
+  }
+#endif
+}
+
+/**
+ * ELEMENT PROFILER
+ */
+
+/**
+ * @brief switch the element profiler of every shard on/off (only when pipeline['profiler'] is set, the probes stay installed)
+ * @param enabled true to profile
+ */
+void Pipeline::set_profiling(bool enabled)
+{
+  if (!this->_configs.profiler.installed) {
+    LOG(WARNING) << "The element profiler is not installed, set pipeline['profiler'] in config.json";
+    return;
+  }
+  // a shard that stops frees its profiler under the lock
+  std::lock_guard<std::mutex> guard(this->_sources_lock);
+  for (PipelineShard *shard : this->_shards) {
+    if (shard->profiler != NULL)
+      shard->profiler->set_enabled(enabled);
+  }
+  LOG(INFO) << "Element profiler " << (enabled ? "enabled" : "disabled");
+}
+
+/**
+ * @brief profile every element of a shard (only when pipeline['profiler'] is set): the elements already in the pipeline, and the
+ *  elements added later (source bins added at runtime, decoders created by parsebin/decodebin)
+ * @param shard the shard, its pipeline must be built
+ */
+void Pipeline::_add_profiler(PipelineShard *shard)
+{
+  if (!this->_configs.profiler.installed)
+    return;
+  shard->profiler = new elementProfiler::Profiler(this->_configs.profiler);
+
+  int profiled = 0;
+  GstIterator *it = gst_bin_iterate_recurse(GST_BIN(shard->pipeline));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+    if (elementProfiler::profileElement(shard->profiler, GST_ELEMENT(g_value_get_object(&item))))
+      profiled++;
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+
+  g_signal_connect(shard->pipeline, "element-added",
+                   G_CALLBACK(+[](GstBin *bin, GstElement *element, gpointer data) {
+                     elementProfiler::profileElement((elementProfiler::Profiler *) data, element);
+                   }), shard->profiler);
+  g_signal_connect(shard->pipeline, "deep-element-added",
+                   G_CALLBACK(+[](GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer data) {
+                     elementProfiler::profileElement((elementProfiler::Profiler *) data, element);
+                   }), shard->profiler);
+  LOG(INFO) << "Element profiler of shard=" << shard->id << " installed on " << profiled << " elements ("
+            << (shard->profiler->enabled() ? "enabled" : "disabled, kill -USR1 to enable") << ")";
+}
+
+/**
+ * @brief log the hot elements of a shard since the previous table (timer on the shard's context)
+ * @param shard the shard to report
+ */
+void Pipeline::_report_profile(PipelineShard *shard)
+{
+  if (!shard->profiler->enabled())
+    return;
+  int64_t now = g_get_monotonic_time();
+  njson report = shard->profiler->report(now - shard->profiled_us);
+  shard->profiled_us = now;
+  LOG(INFO) << "Hot elements of shard=" << shard->id << " (last " << this->_configs.profiler.interval_s << "s):\n"
+            << elementProfiler::Profiler::table(report);
+}
+
+/**
+ * @brief log the elements that dropped or processed late buffers since the previous summary, with the drops of every stage
+ *  (timer on the shard's context, like the bus callback that counts the QoS messages)
+ * @param shard the shard to report
+ */
+void Pipeline::_report_qos(PipelineShard *shard)
+{
+  njson summary = shard->bus_struct.qos->summary();
+  if (summary["elements"].empty()) {
+    VLOG(DEBUG) << "QoS of shard=" << shard->id << ": no late or dropped buffers";
+    return;
+  }
+  LOG(INFO) << "QoS of shard=" << shard->id << ": dropped=" << summary["dropped"] << " by stage " << summary["stages"].dump() << "\n"
+            << qosStats::ShardQos::table(summary);
+}
+
+/**
+ * @brief SIGTERM/SIGINT on the shard's context: the first one sends EOS to the shard and gives it pipeline['eos_timeout_ms'] to
+ *  reach the bus (which quits the loop), the next one or the timeout quits the loop at once
+ * @param shard the shard to stop
+ * @param signal name of the signal (or what stops the pipeline, refer to drain)
+ */
+void Pipeline::_on_stop_signal(PipelineShard *shard, const char *signal)
+{
+  if (shard->eos_sent) {
+    LOG(WARNING) << signal << " received again, stopping shard=" << shard->id << " without waiting for EOS";
+    g_main_loop_quit(shard->loop);
+    return;
+  }
+  shard->eos_sent = true;
+  this->_stopping = true;
+  core::ShutdownTimeline::get().begin(signal);
+  LOG(INFO) << signal << " received, sending EOS to shard=" << shard->id << " (timeout=" << this->_configs.eos_timeout_ms << "ms)";
+  // live sources and looping files let the EOS through instead of restarting or seeking back to their start
+  shard->stopping = true;
+  for (int source_id : shard->source_ids) {
+    std::string src_name = (std::string) "srcBin" + std::to_string(source_id);
+    GstElement *srcBin = gst_bin_get_by_name(GST_BIN(shard->pipeline), src_name.c_str());
+    if (srcBin == NULL)
+      continue;
+    fileLoop::LoopState *loop_state = (fileLoop::LoopState *) g_object_get_data(G_OBJECT(srcBin), "loop_state");
+    if (loop_state != NULL)
+      loop_state->stop = true;
+    gst_object_unref(srcBin);
+  }
+  gst_element_send_event(GST_ELEMENT(shard->pipeline), gst_event_new_eos());
+
+  GSource *timeout = g_timeout_source_new(this->_configs.eos_timeout_ms);
+  SourceContext *ctx = new SourceContext{.pipeline = this, .shard = shard, .source_id = -1, .stats = NULL};
+  g_source_set_callback(timeout, [](gpointer data) -> gboolean {
+        SourceContext *ctx = (SourceContext *) data;
+        LOG(WARNING) << "EOS did not reach the bus of shard=" << ctx->shard->id << " in " << ctx->pipeline->_configs.eos_timeout_ms
+                     << "ms, stopping it (files may not be finalized)";
+        g_main_loop_quit(ctx->shard->loop);
+        return G_SOURCE_REMOVE;
+      }, ctx, [](gpointer data) { delete (SourceContext *) data; });
+  g_source_attach(timeout, shard->context);
+  g_source_unref(timeout);
+}
+
+/**
+ * @brief record the encoded stream of a source as received (only when pipeline['record']=passthrough): the stream is teed in front
+ *  of the decoder into splitmuxsink, and the detections of the source are written to the sidecar of the recording
+ * @param srcBin the source bin (refer to _create_source_bin)
+ * @param source_id global id of the source
+ * @param sink the sanitized file sink of the source
+ */
+void Pipeline::_add_passthrough_recording(GstElement *srcBin, int source_id, const std::string &sink)
+{
+  recording::Passthrough *record = this->_recordings.add(source_id, sink, this->_configs.record.segment_s);
+  if (record == NULL) {
+    LOG(WARNING) << "Source=" << source_id << " shares its recording slot with another source, it is not recorded";
+    return;
+  }
+  LOG(INFO) << "Recording source=" << source_id << " in passthrough to " << record->sink << " (detections in " << record->sidecar.path << ")";
+  GstElement *decoder = gst_bin_get_by_name(GST_BIN(srcBin), "src_decoder");
+  if (decoder == NULL) {
+    // file sources: the branch is added once parsebin exposes the codec (refer to on_parsebin_pad_added)
+    g_object_set_data(G_OBJECT(srcBin), "recording", record);
+    return;
+  }
+  // rtsp sources: src_parse -> tee -> (src_decoder, recording)
+  GstElement *parser = gst_bin_get_by_name(GST_BIN(srcBin), "src_parse");
+  gst_element_unlink(parser, decoder);
+  GstElement *tee = recording::teeToRecording(srcBin, decoder, "video/x-h264", record);
+  if (tee == NULL || !gst_element_link(parser, tee))
+    LOG(FATAL) << "Failed to link the recording of source=" << source_id;
+  gst_object_unref(parser);
+  gst_object_unref(decoder);
+}
+
+/**
+ * MOTION GATE
+ */
+
+/**
+ * @brief add the grey branch of a source (pipeline['motion_gate']): src_queue -> motion_tee -> (output0, motion_queue ->
+ *  motion_convert -> motion_caps -> motion_sink). nvvideoconvert scales the frames down to grey in system memory, the detector
+ *  compares them on the CPU. The queue keeps a single frame and drops the older ones, the source never waits for the detector.
+ * @param srcBin the source bin (refer to _create_source_bin), not linked yet
+ * @param source_id global id of the source
+ */
+void Pipeline::_add_motion_branch(GstElement *srcBin, int source_id)
+{
+  motionGate::SourceMotion *source = this->_motion.add(source_id);
+  if (source == NULL) {
+    LOG(WARNING) << "Source=" << source_id << " shares its motion slot with another source, its inference is not gated";
+    return;
+  }
+  int width = this->_configs.motion_gate.width;
+  int height = std::max(2, (width * this->_configs.img_height / std::max(1, this->_configs.img_width)) & ~1);
+
+  GstElement *src_queue = gst_bin_get_by_name(GST_BIN(srcBin), "src_queue");
+  GstPad *ghost = gst_element_get_static_pad(srcBin, "output0");
+  GstElement *tee = gst_element_factory_make("tee", "motion_tee");
+  GstElement *queue = gst_element_factory_make("queue", "motion_queue");
+  GstElement *convert = gst_element_factory_make("nvvideoconvert", "motion_convert");
+  GstElement *caps = gst_element_factory_make("capsfilter", "motion_caps");
+  GstElement *sink = gst_element_factory_make("fakesink", "motion_sink");
+  g_object_set(queue, "leaky", 2, "max-size-buffers", 1, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+  std::string grey = "video/x-raw,format=(string)GRAY8,width=(int)" + std::to_string(width) + ",height=(int)" + std::to_string(height);
+  GstCaps *grey_caps = gst_caps_from_string(grey.c_str());
+  g_object_set(caps, "caps", grey_caps, NULL);
+  gst_caps_unref(grey_caps);
+  g_object_set(sink, "sync", FALSE, "async", FALSE, "enable-last-sample", FALSE, NULL);
+
+  gst_bin_add_many(GST_BIN(srcBin), tee, queue, convert, caps, sink, NULL);
+  gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), NULL);
+  if (!gst_element_link(src_queue, tee) || !gst_element_link_many(tee, queue, convert, caps, sink, NULL))
+    LOG(FATAL) << "Failed to link the motion branch of source=" << source_id;
+  GstPad *tee_pad = gst_element_request_pad_simple(tee, "src_%u");
+  gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), tee_pad);
+  gst_object_unref(tee_pad);
+  gst_object_unref(ghost);
+  gst_object_unref(src_queue);
+
+  GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        motionGate::Gates *gates = (motionGate::Gates *) g_object_get_data(G_OBJECT(pad), "gates");
+        motionGate::SourceMotion *source = (motionGate::SourceMotion *) data;
+        GstVideoInfo video_info;
+        GstVideoFrame frame;
+        GstCaps *caps = gst_pad_get_current_caps(pad);
+        if (caps == NULL)
+          return GST_PAD_PROBE_OK;
+        if (gst_video_info_from_caps(&video_info, caps) && gst_video_frame_map(&frame, &video_info, GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ)) {
+          bool motion = source->detector.update((const uint8_t *) GST_VIDEO_FRAME_PLANE_DATA(&frame, 0), GST_VIDEO_FRAME_WIDTH(&frame),
+                                                GST_VIDEO_FRAME_HEIGHT(&frame), GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0));
+          motionGate::onGreyFrame(*source, motion, g_get_monotonic_time(), gates->policy);
+          gst_video_frame_unmap(&frame);
+        }
+        gst_caps_unref(caps);
+        return GST_PAD_PROBE_OK;
+      }, source, NULL);
+  g_object_set_data(G_OBJECT(sink_pad), "gates", &this->_motion);
+  gst_object_unref(sink_pad);
+  VLOG(DEBUG) << "Added motion branch to source=" << source_id << " (" << width << "x" << height << " grey)";
+}
+
+/**
+ * @brief gate nvinfer of a shard (pipeline['motion_gate']): a batch whose sources have no motion (and no keep-alive due) is pushed
+ *  with the nvinfer interval at motionGate::SKIP_INTERVAL, so nvinfer passes it without inference; the next batch with motion gets
+ *  the interval back (the one of detection.yml, or the one of the inference governor).
+ * @param shard the shard, its inference bin must be in the pipeline
+ */
+void Pipeline::_add_motion_gate_probe(PipelineShard *shard)
+{
+#ifndef CPU_ONLY
+  if (!this->_configs.motion_gate.enable)
+    return;
+  GstElement *nv_detection = gst_bin_get_by_name(GST_BIN(shard->pipeline), "nv_detection");
+  if (nv_detection == NULL) {
+    LOG(WARNING) << "Could not find nv_detection in shard=" << shard->id << ", the inference is not gated by motion";
+    return;
+  }
+  GParamSpec *spec = g_object_class_find_property(G_OBJECT_GET_CLASS(nv_detection), "interval");
+  if (spec == NULL || !(spec->flags & GST_PARAM_MUTABLE_PLAYING)) {
+    LOG(WARNING) << "nvinfer cannot change its interval while playing, the inference of shard=" << shard->id << " is not gated by motion";
+    gst_object_unref(nv_detection);
+    return;
+  }
+  guint interval = 0;
+  g_object_get(nv_detection, "interval", &interval, NULL);
+  shard->base_interval = (int) interval;
+  shard->gate_interval = (int) interval;
+  // the payloads report the base interval and whether the batch was gated (refer to Processing::_get_inference_interval)
+  g_object_set_data(G_OBJECT(nv_detection), "base_interval", &shard->base_interval);
+  g_object_set_data(G_OBJECT(nv_detection), "gated", GINT_TO_POINTER(0));
+
+  GstPad *sink_pad = gst_element_get_static_pad(nv_detection, "sink");
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        PipelineShard *shard = (PipelineShard *) data;
+        motionGate::Gates *gates = (motionGate::Gates *) g_object_get_data(G_OBJECT(pad), "gates");
+        NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+        if (batch_meta == NULL)
+          return GST_PAD_PROBE_OK;
+        std::vector<motionGate::SourceMotion *> sources;
+        for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next)
+          sources.push_back(gates->get((int) ((NvDsFrameMeta *) l_frame->data)->source_id));
+        bool infer = motionGate::decideBatch(sources, g_get_monotonic_time(), gates->policy);
+        int interval = infer ? shard->base_interval.load() : (int) motionGate::SKIP_INTERVAL;
+        if (interval != shard->gate_interval) {
+          // nvinfer reads its interval when the batch reaches its chain function, right after this probe
+          GstElement *nv_detection = gst_pad_get_parent_element(pad);
+          g_object_set(nv_detection, "interval", (guint) interval, NULL);
+          g_object_set_data(G_OBJECT(nv_detection), "gated", GINT_TO_POINTER(!infer));
+          gst_object_unref(nv_detection);
+          shard->gate_interval = interval;
+          VLOG(DEBUG) << "Motion gate of shard=" << shard->id << (infer ? " opened" : " closed");
+        }
+        return GST_PAD_PROBE_OK;
+      }, shard, NULL);
+  g_object_set_data(G_OBJECT(sink_pad), "gates", &this->_motion);
+  gst_object_unref(sink_pad);
+  gst_object_unref(nv_detection);
+  LOG(INFO) << "Inference of shard=" << shard->id << " is gated by motion (keep alive every " << this->_configs.motion_gate.keep_alive_s << "s)";
+#endif
+}
+
+/**
+ * @brief create the clip recorder (only when pipeline['clips'] is enabled): the rules are evaluated on every detection payload, and a
+ *  payload that starts or extends a clip carries its path
+ */
+void Pipeline::_add_clip_recorder()
+{
+  if (!this->_configs.clips.enable)
+    return;
+  clipRecorder::Recorder *recorder = new clipRecorder::Recorder(this->_configs.clips);
+  recorder->directory = BASE_DIR + (std::string) "/outputs/clips";
+  core::Metrics::get().observe("iva_clips_skipped_total", "counter", "Clips not recorded because every clip writer was busy.", {},
+                               [recorder]() { return (double) recorder->skipped.load(std::memory_order_relaxed); });
+  this->processor->add_payload_hook([recorder](int source_id, njson &payload) {
+    std::string clip = recorder->on_payload(source_id, payload);
+    if (!clip.empty())
+      payload["clip"] = clip;
+  });
+  this->_recorder = recorder;
+  LOG(INFO) << "Recording clips to " << recorder->directory << " (pre_roll=" << this->_configs.clips.pre_roll_s << "s, post_roll="
+            << this->_configs.clips.post_roll_s << "s, max " << (this->_configs.clips.max_bytes >> 20) << "MB per source, rules="
+            << this->_configs.clips.rules.size() << ")";
+}
+
+/**
+ * @brief keep the encoded frames of a source in its pre-roll (only when pipeline['clips'] is enabled). The tap is on the sink pad of
+ *  the decoder: rtsp sources have it from the start, the decoder of file sources is added once parsebin exposes the video stream.
+ * @param srcBin the source bin (refer to _create_source_bin)
+ * @param source_id global id of the source
+ */
+void Pipeline::_add_clip_tap(GstElement *srcBin, int source_id)
+{
+  if (this->_recorder == NULL)
+    return;
+  clipRecorder::SourceRecorder *source = this->_recorder->add(source_id);
+  if (source == NULL) {
+    LOG(WARNING) << "Source=" << source_id << " shares its clip slot with another source, it is not recorded";
+    return;
+  }
+  // the decoder of file sources is added once parsebin exposes the video stream (refer to on_parsebin_pad_added)
+  auto on_decoder = +[](GstBin *bin, GstElement *element, gpointer data) {
+    if (g_strcmp0(GST_ELEMENT_NAME(element), "src_decoder") != 0)
+      return;
+    GstPad *pad = gst_element_get_static_pad(element, "sink");
+    gst_pad_add_probe(pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                      clipRecorder::tapProbe, data, NULL);
+    gst_object_unref(pad);
+  };
+  GstElement *decoder = gst_bin_get_by_name(GST_BIN(srcBin), "src_decoder");
+  if (decoder == NULL) {
+    g_signal_connect(srcBin, "element-added", G_CALLBACK(on_decoder), source);
+    return;
+  }
+  // a clip starts on any keyframe of the pre-roll: the parser repeats the stream headers (SPS/PPS) before every keyframe
+  GstElement *parser = gst_bin_get_by_name(GST_BIN(srcBin), "src_parse");
+  if (parser != NULL) {
+    g_object_set(parser, "config-interval", -1, NULL);
+    gst_object_unref(parser);
+  }
+  on_decoder(GST_BIN(srcBin), decoder, source);
+  gst_object_unref(decoder);
+}
+
+/**
+ * @brief buffer-flow watchdog (timer on the shard's context): update the moving FPS of every source and fire the configured
+ *  actions (pipeline['watchdog']['actions']) on sources that stopped producing buffers without raising an error.
+ *  BusStruct::timeout_counter counts the consecutive checks where every source of the shard is silently stalled; the shard is
+ *  terminated once it reaches BusStruct::timeout_counter_max.
+ * @param shard the shard to check
+ */
+void Pipeline::_check_sources(PipelineShard *shard)
+{
+  int64_t now = g_get_monotonic_time();
+  int silent = 0;
+  // copy: a restart action may change the source list
+  std::vector<int> source_ids = shard->source_ids;
+  for (int source_id : source_ids) {
+    sourceHealth::SourceStats *stats = this->_get_source_stats(source_id);
+    uint64_t buffers = stats->buffers.load(std::memory_order_relaxed);
+    int64_t checked = stats->checked_us.exchange(now);
+    if (checked == 0) {
+      stats->watch_start_us = now;
+    } else {
+      stats->fps = sourceHealth::updateFps(stats->fps, buffers - stats->checked_buffers, now - checked);
+    }
+    stats->checked_buffers = buffers;
+
+    // failed sources are given up, finished sources reached EOS, sources in an outage are already being restarted
+    if (stats->failed || stats->finished || stats->outage_start_us != 0)
+      continue;
+
+    bool stalled = sourceHealth::isStalled(now, stats->last_buffer_us.load(std::memory_order_relaxed), stats->watch_start_us, this->_configs.watchdog.stall_ms);
+    if (stalled)
+      silent++;
+    if (stalled == stats->stalled)
+      continue;
+    stats->stalled = stalled;
+
+    njson health;
+    health["source_id"] = source_id;
+    health["shard"] = shard->id;
+    health["state"] = stalled ? "stalled" : "recovered";
+    health["stats"] = sourceHealth::statsToJson(*stats);
+    if (stalled) {
+      stats->stalls++;
+      int64_t last = stats->last_buffer_us != 0 ? (int64_t) stats->last_buffer_us : (int64_t) stats->watch_start_us;
+      health["since_last_buffer_ms"] = (now - last) / 1000;
+    }
+
+    if (this->_configs.watchdog.log) {
+      if (stalled)
+        LOG(WARNING) << "Watchdog: source=" << source_id << " on shard=" << shard->id << " stalled (no buffer for " << health["since_last_buffer_ms"] << "ms)";
+      else
+        LOG(INFO) << "Watchdog: source=" << source_id << " on shard=" << shard->id << " recovered (fps=" << stats->fps << ")";
+    }
+    if (this->_configs.watchdog.event)
+      this->processor->publish_health(health);
+    if (stalled && this->_configs.watchdog.restart) {
+      stats->stalled = false;
+      this->_isolate_source(shard, source_id);
+      this->_schedule_source_restart(shard, source_id);
+    }
+  }
+
+  // every source of the shard is silent and none is being restarted
+  if (!source_ids.empty() && silent == (int) source_ids.size())
+    shard->bus_struct.timeout_counter++;
+  else
+    shard->bus_struct.timeout_counter = 0;
+  if (shard->bus_struct.timeout_counter >= shard->bus_struct.timeout_counter_max) {
+    LOG(ERROR) << "Watchdog: every source on shard=" << shard->id << " stalled for " << shard->bus_struct.timeout_counter << " checks, terminating pipeline shard";
+    g_main_loop_quit(shard->loop);
+  }
+}
+
+/**
+ * @brief check if a shard still has sources that were not given up
+ * @param shard the shard
+ * @return true if at least one source can still stream
+ */
+bool Pipeline::_has_live_sources(PipelineShard *shard)
+{
+  for (int source_id : shard->source_ids) {
+    if (!this->_get_source_stats(source_id)->failed)
+      return true;
+  }
+  return false;
 }
 
 /**
@@ -542,7 +2816,6 @@ void Pipeline::_pipeline_finished()
   PipelineEvent *event = new PipelineEvent(core::events::Actions::STOP_MODULES, core::events::Module::MODULE_PIPELINE);
   this->_mediator->notify(event);
   LOG(WARNING) << "Pipeline is finished, trigger safe application exit";
-  VLOG(DEEP) << "[3]Reference count of pipeline: " << GST_OBJECT_REFCOUNT(this->pipeline);
 }
 
 /// YAML PARSER IF ENABLED WITH CMAKE
@@ -550,14 +2823,17 @@ void Pipeline::_pipeline_finished()
 #ifdef YAML_CONFIGS
 /**
  * @brief parse a yaml file and create gstreamer pipeline elements
+ * @param shard the shard whose pipeline receives the elements (the yaml builder always uses a single shard)
  * @param str std::string path to the iou_file_display.yml or config.yaml file
  * @return bool true is success
  */
-bool Pipeline::_create_pipeline_from_yaml(std::string file_path)
+bool Pipeline::_create_pipeline_from_yaml(PipelineShard *shard, std::string file_path)
 {
   // Load the YAML file
   YAML::Node config = YAML::LoadFile(file_path.c_str());
   std::string last_element;
+  if (config["nodes"])
+    return this->_create_graph_from_yaml(shard, config);
 
   // configure multiple sources if necessary, and keep track of their element properties
   int bins = 1;
@@ -605,7 +2881,7 @@ bool Pipeline::_create_pipeline_from_yaml(std::string file_path)
 
     VLOG(DEBUG) << "Creating Element: " << element_name << " : " << name;
     GstElement *new_element = gst_element_factory_make(element_name.c_str(), name.c_str());
-    if(!gst_bin_add(GST_BIN(this->pipeline), new_element))
+    if(!gst_bin_add(GST_BIN(shard->pipeline), new_element))
     {
       LOG(ERROR) << "Could not add element to bin: name=" << element_name << ", alias=" << name;
       return false;
@@ -616,10 +2892,10 @@ bool Pipeline::_create_pipeline_from_yaml(std::string file_path)
       return false;
 
     // Iterate over the key-value pairs in the properties section
-    if(!yamlParser::link_pipeline_elements(this->pipeline, new_element, last_element, element, config))
+    if(!yamlParser::link_pipeline_elements(shard->pipeline, new_element, last_element, element, config))
       return false;
 
-    if(!this->_set_callbacks(new_element, element))
+    if(!this->_set_callbacks(shard, new_element, element))
       return false;
 
     // set the last element so that the next element can link to it
@@ -627,21 +2903,22 @@ bool Pipeline::_create_pipeline_from_yaml(std::string file_path)
   }
 
   // set element state to READY
-  gst_element_set_state(GST_ELEMENT(this->pipeline), GST_STATE_READY);
+  gst_element_set_state(GST_ELEMENT(shard->pipeline), GST_STATE_READY);
   // create picture diagram of the pipeline in its current state
 #ifdef ENABLE_DOT
-    pipelineUtils::save_debug_dot(this->pipeline, "/src/logs", "NULL_READY");
+    pipelineUtils::save_debug_dot(shard->pipeline, "/src/logs", "NULL_READY");
 #endif
   return true;
 }
 
 /**
  * @brief set callback functions for pipeline elements
+ * @param shard the shard that owns the element
  * @param new_element the new gstreamer element that was created
  * @param element the element field of the YAML file
  * @return true if successful
  */
-bool Pipeline::_set_callbacks(GstElement *new_element, YAML::Node element)
+bool Pipeline::_set_callbacks(PipelineShard *shard, GstElement *new_element, YAML::Node element)
 {
   std::string name;
   try {
@@ -665,23 +2942,15 @@ bool Pipeline::_set_callbacks(GstElement *new_element, YAML::Node element)
       std::string pad_name = element["callback"]["pad"].as<std::string>();
       std::string function_name = element["callback"]["function_name"].as<std::string>();
       VLOG(DEBUG) << "\t callback type= " << callback_type << ", pad_name=" << pad_name << ",function_name=" << function_name;
-      if (function_name == "probe_callback") {
-        // set callbacks on element probes
-        GstPad *probe_pad = gst_element_get_static_pad(new_element, pad_name.c_str());
-        gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::probe_callback, (gpointer)this->processor, NULL);
-        gst_object_unref(probe_pad);
-      }
-      else if (function_name == "osd_callback") {
-        // set callbacks on element probes
-        GstPad *probe_pad = gst_element_get_static_pad(new_element, pad_name.c_str());
-        gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::osd_callback, (gpointer)this->processor, NULL);
-        gst_object_unref(probe_pad);
-      }
-      else {
-        LOG(ERROR) << "Callback field `function_name` is not configured: " << function_name << "\t callback type= " << callback_type
-                   << ", pad_name=" << pad_name << ",function_name=" << function_name;
+      GstPad *probe_pad = gst_element_get_static_pad(new_element, pad_name.c_str());
+      if (probe_pad == NULL) {
+        LOG(ERROR) << "Element=" << name << " has no pad=" << pad_name << " for callback function_name=" << function_name;
         return false;
       }
+      bool added = this->_add_probe_callback(probe_pad, function_name);
+      gst_object_unref(probe_pad);
+      if (!added)
+        return false;
     }
     else if (callback_type == "signal") {
       if (!element["callback"]["element_signal"] || !element["callback"]["function_name"]) {
@@ -692,7 +2961,7 @@ bool Pipeline::_set_callbacks(GstElement *new_element, YAML::Node element)
       std::string function_name = element["callback"]["function_name"].as<std::string>();
       VLOG(DEBUG) << "\t callback type= " << callback_type << ", element_signal=" << element_signal << ",function_name=" << function_name;
       if (function_name == "on_pad_added") {
-        g_signal_connect(new_element, "pad-added", G_CALLBACK(pipelineUtils::on_pad_added), (gpointer)this->pipeline);
+        g_signal_connect(new_element, "pad-added", G_CALLBACK(pipelineUtils::on_pad_added), (gpointer)shard->pipeline);
       }
       else {
         LOG(ERROR) << "Link type is not configured: " << function_name << "\t callback type= " << callback_type << ", element_signal=" << element_signal
@@ -707,4 +2976,190 @@ bool Pipeline::_set_callbacks(GstElement *new_element, YAML::Node element)
   }
   return true;
 }
+
+/**
+ * @brief add a processing callback to the buffers of a pad
+ * @param pad the pad
+ * @param function_name probe_callback (inference metadata to payloads) or osd_callback (payloads drawn on the frames)
+ * @return false if the callback is unknown
+ */
+bool Pipeline::_add_probe_callback(GstPad *pad, const std::string &function_name)
+{
+  // without DeepStream the payloads come from the stub detections of the cpu profile
+#ifdef CPU_ONLY
+  if (function_name == "probe_callback")
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::cpu_probe_callback, (gpointer)this->processor, NULL);
+#else
+  if (function_name == "probe_callback")
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::probe_callback, (gpointer)this->processor, NULL);
+#endif
+  else if (function_name == "osd_callback")
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::osd_callback, (gpointer)this->processor, NULL);
+  else {
+    LOG(ERROR) << "Callback field `function_name` is not configured: " << function_name << " (probe_callback, osd_callback)";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief create a pipeline described as a graph (yaml `nodes` and `edges`): outputs that feed several branches are fanned out through
+ *  a tee, with a queue on every branch, and the probes of an edge are added to the first pad of its branch
+ * @param shard the shard whose pipeline receives the elements
+ * @param config the YAML file
+ * @return bool true is success
+ */
+bool Pipeline::_create_graph_from_yaml(PipelineShard *shard, const YAML::Node &config)
+{
+  std::vector<pipelineGraph::Node> nodes;
+  std::vector<pipelineGraph::Edge> edges;
+  pipelineGraph::Plan plan;
+  std::string error;
+  if (!yamlParser::parse_graph(config, nodes, edges))
+    return false;
+  if (!pipelineGraph::plan(nodes, edges, plan, error)) {
+    LOG(ERROR) << "Invalid yaml pipeline graph: " << error;
+    return false;
+  }
+  // branch callbacks of delayed links are only added once their pad exists, check them now
+  for (const pipelineGraph::Edge &edge : edges) {
+    for (const pipelineGraph::Probe &probe : edge.probes) {
+      if (probe.function_name != "probe_callback" && probe.function_name != "osd_callback") {
+        LOG(ERROR) << "Invalid yaml edge (" << edge.from << " -> " << edge.to << ") probe=" << probe.function_name << ". Must be one of the following (probe_callback, osd_callback)";
+        return false;
+      }
+    }
+  }
+  LOG(INFO) << "Creating pipeline graph with nodes=(" << nodes.size() << "), edges=(" << edges.size() << "), inserted elements=("
+            << plan.elements.size() << ")";
+
+  // the nodes of the file, with their properties and callbacks
+  for (const auto &element : config["nodes"]) {
+    std::string element_name = element["name"].as<std::string>();
+    std::string name = element["alias"].as<std::string>();
+    VLOG(DEBUG) << "Creating Element: " << element_name << " : " << name;
+    GstElement *new_element = gst_element_factory_make(element_name.c_str(), name.c_str());
+    if (new_element == NULL || !gst_bin_add(GST_BIN(shard->pipeline), new_element)) {
+      LOG(ERROR) << "Could not create element and add it to bin: name=" << element_name << ", alias=" << name;
+      return false;
+    }
+    if (!yamlParser::set_element_properties(new_element, element["property"]) || !this->_set_callbacks(shard, new_element, element))
+      return false;
+  }
+
+  // the tees and the queues of their branches
+  for (const pipelineGraph::Element &inserted : plan.elements) {
+    VLOG(DEBUG) << "Inserting Element: " << inserted.factory << " : " << inserted.alias;
+    GstElement *new_element = gst_element_factory_make(inserted.factory.c_str(), inserted.alias.c_str());
+    if (new_element == NULL || !gst_bin_add(GST_BIN(shard->pipeline), new_element)) {
+      LOG(ERROR) << "Could not insert element: name=" << inserted.factory << ", alias=" << inserted.alias;
+      return false;
+    }
+    for (const std::string &prop : inserted.properties)
+      yamlParser::set_element_property(new_element, prop);
+  }
+
+  for (const pipelineGraph::Link &link : plan.links) {
+    if (!this->_link_graph(shard, link))
+      return false;
+  }
+
+  // set element state to READY
+  gst_element_set_state(GST_ELEMENT(shard->pipeline), GST_STATE_READY);
+#ifdef ENABLE_DOT
+    pipelineUtils::save_debug_dot(shard->pipeline, "/src/logs", "NULL_READY");
+#endif
+  return true;
+}
+
+/**
+ * @brief make a link of a graph pipeline. Elements that create their src pads while running (e.g. decodebin) are linked on pad-added,
+ *  to the first pad that is compatible with the downstream element.
+ * @param shard the shard that owns the elements
+ * @param link the link
+ * @return true if linked (or waiting for its pad)
+ */
+bool Pipeline::_link_graph(PipelineShard *shard, const pipelineGraph::Link &link)
+{
+  struct DelayedLink {
+    Pipeline *pipeline;
+    pipelineGraph::Link link;
+    GstElement *sink;
+    std::atomic<bool> linked = false;
+  };
+
+  GstElement *src = gst_bin_get_by_name(GST_BIN(shard->pipeline), link.src.c_str());
+  GstElement *sink = gst_bin_get_by_name(GST_BIN(shard->pipeline), link.sink.c_str());
+  bool ret = false;
+  GstPad *src_pad = yamlParser::get_link_pad(src, link.src_pad, GST_PAD_SRC);
+  if (src_pad == NULL && yamlParser::has_sometimes_src_pads(src)) {
+    VLOG(DEBUG) << "Delayed linking elements (src=" << link.src << ": sink=" << link.sink << ") until the src pad is added";
+    g_signal_connect_data(src, "pad-added", G_CALLBACK(+[](GstElement *element, GstPad *pad, gpointer data) {
+          DelayedLink *delayed = (DelayedLink *) data;
+          if (delayed->linked || GST_PAD_DIRECTION(pad) != GST_PAD_SRC)
+            return;
+          GstPadTemplate *pad_template = GST_PAD_PAD_TEMPLATE(pad);
+          if (!delayed->link.src_pad.empty() && delayed->link.src_pad != GST_PAD_NAME(pad) &&
+              (pad_template == NULL || delayed->link.src_pad != GST_PAD_TEMPLATE_NAME_TEMPLATE(pad_template)))
+            return;
+          GstPad *sink_pad = yamlParser::get_link_pad(delayed->sink, delayed->link.sink_pad, GST_PAD_SINK);
+          if (sink_pad == NULL)
+            return;
+          if (gst_pad_is_linked(sink_pad) || !gst_pad_can_link(pad, sink_pad)) {
+            VLOG(DEBUG) << "[Ignore] pad=" << GST_PAD_NAME(pad) << " of " << delayed->link.src << " for " << delayed->link.sink;
+            if (GST_PAD_PAD_TEMPLATE(sink_pad) != NULL && GST_PAD_TEMPLATE_PRESENCE(GST_PAD_PAD_TEMPLATE(sink_pad)) == GST_PAD_REQUEST)
+              gst_element_release_request_pad(delayed->sink, sink_pad);
+            gst_object_unref(sink_pad);
+            return;
+          }
+          if (!delayed->linked.exchange(true))
+            delayed->pipeline->_link_graph_pads(pad, sink_pad, delayed->link);
+          gst_object_unref(sink_pad);
+        }), new DelayedLink{.pipeline = this, .link = link, .sink = sink}, [](gpointer data, GClosure *) {
+          DelayedLink *delayed = (DelayedLink *) data;
+          gst_object_unref(delayed->sink);
+          delete delayed;
+        }, (GConnectFlags) 0);
+    gst_object_unref(src);
+    return true;
+  }
+
+  GstPad *sink_pad = yamlParser::get_link_pad(sink, link.sink_pad, GST_PAD_SINK);
+  if (src_pad == NULL || sink_pad == NULL)
+    LOG(ERROR) << "Could not find the pads to link (src=" << link.src << "." << (link.src_pad.empty() ? "src" : link.src_pad) << ": sink="
+               << link.sink << "." << (link.sink_pad.empty() ? "sink" : link.sink_pad) << ")";
+  else
+    ret = this->_link_graph_pads(src_pad, sink_pad, link);
+  if (src_pad != NULL)
+    gst_object_unref(src_pad);
+  if (sink_pad != NULL)
+    gst_object_unref(sink_pad);
+  gst_object_unref(src);
+  gst_object_unref(sink);
+  return ret;
+}
+
+/**
+ * @brief link the pads of a graph link and add the probes of its branch to the sink pad
+ * @param src_pad the src pad
+ * @param sink_pad the sink pad
+ * @param link the link
+ * @return true if linked
+ */
+bool Pipeline::_link_graph_pads(GstPad *src_pad, GstPad *sink_pad, const pipelineGraph::Link &link)
+{
+  VLOG(DEBUG) << "Linking elements (src=" << link.src << "." << GST_PAD_NAME(src_pad) << ": sink=" << link.sink << "." << GST_PAD_NAME(sink_pad) << ")";
+  GstPadLinkReturn ret = gst_pad_link(src_pad, sink_pad);
+  if (GST_PAD_LINK_FAILED(ret)) {
+    LOG(ERROR) << "LINK ERROR (src=" << link.src << "." << GST_PAD_NAME(src_pad) << ": sink=" << link.sink << "." << GST_PAD_NAME(sink_pad)
+               << ") ErrMsg=" << pipelineUtils::get_link_status(ret);
+    return false;
+  }
+  for (const pipelineGraph::Probe &probe : link.probes) {
+    LOG(INFO) << "Setting up branch callback (function_name=" << probe.function_name << " on " << link.sink << "." << GST_PAD_NAME(sink_pad) << ")";
+    if (!this->_add_probe_callback(sink_pad, probe.function_name))
+      return false;
+  }
+  return true;
+}
 #endif
\ No newline at end of file
@@ -1,24 +1,47 @@
 #pragma once
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <gst/gst.h>
 #include <unistd.h>
 #include <yaml-cpp/yaml.h>
 
 #include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <string>
+#include <vector>
 
 // sleep
 #include <chrono>
 
 #include "BaseComponent.h"
 #include "Processing.h"
+#include "batchController.hpp"
 #include "callbacks.hpp"
+#include "clipRecorder.hpp"
+#include "elementProfiler.hpp"
+#include "encoding.hpp"
+#include "fileLoop.hpp"
+#include "inferenceCascade.hpp"
+#include "inferenceGovernor.hpp"
+#include "latencyBudget.hpp"
+#include "latencyTrace.hpp"
+#include "motionGate.hpp"
+#include "pipelineGraph.hpp"
 #include "pipelineUtils.hpp"
+#include "qosStats.hpp"
+#include "recording.hpp"
+#include "shutdownTimeline.hpp"
+#include "sourceHealth.hpp"
+#include "startupTimeline.hpp"
 
 // Declare the global variable from argv[1] in main.cpp
 extern std::string BASE_DIR;
@@ -44,6 +67,121 @@ struct PipelineConfigs {
   int img_width=0;
   bool live_source=false;
   bool sync=false;
+  bool loop=false;
+  int shards=1;
+  int max_sources=1;
+  sourceHealth::ReconnectPolicy reconnect;
+  sourceHealth::WatchdogPolicy watchdog;
+  std::string profile="gpu";
+  encoding::EncoderProfile encoder;
+  pipelineUtils::TileLayout tiler;
+  latencyBudget::LatencyBudget latency;
+  batching::BatchPolicy batching;
+  inferenceGovernor::GovernorPolicy governor;
+  bool trace_latency=false;
+  elementProfiler::ProfilerPolicy profiler;
+  clipRecorder::ClipPolicy clips;
+  recording::RecordPolicy record;
+  std::vector<inferenceCascade::InferenceStage> inference;
+  motionGate::MotionPolicy motion_gate;
+  qosStats::QosPolicy qos;
+  int eos_timeout_ms=5000;
+};
+
+/**
+ * @struct PipelineShard
+ * @brief an independent gstreamer pipeline that owns a subset of the configured sources
+ *
+ * @var id
+ * index of the shard (used to name the gstreamer pipeline: video-player<id>)
+ * @var source_ids
+ * the global source ids (index into pipeline['sources']) handled by this shard
+ * @var batch_size
+ * nvstreammux/nvinfer batch size, the maximum number of sources this shard can hold (including sources added at runtime)
+ * @var running
+ * true while the shard's main loop is running (sources can only be added/removed while running)
+ * @var context
+ * the main context that dispatches this shard's bus messages (one per shard)
+ * @var loop
+ * the loop that runs on this shard's context
+ * @var pipeline
+ * the gstreamer pipeline of this shard
+ * @var bus_watch
+ * the bus watch attached to this shard's context
+ * @var bus_struct
+ * data passed to the callback on the bus
+ * @var batcher
+ * adaptive batch controller of nvstreammux (pipeline['batching']['adaptive']), NULL otherwise
+ * @var batches
+ * batches pushed by nvstreammux since the last controller period (written by the nv_mux src pad probe)
+ * @var batched_frames
+ * frames carried by those batches
+ * @var governor
+ * load-adaptive nvinfer interval (pipeline['inference_governor']['adaptive']), NULL otherwise
+ * @var inference_timing
+ * time the batches spend in nvinfer (written by the nv_detection pad probes)
+ * @var governed_us
+ * time of the previous period of the governor
+ * @var profiler
+ * per-element throughput and processing time (pipeline['profiler']), NULL otherwise
+ * @var profiled_us
+ * time of the previous hot element table
+ * @var base_interval
+ * nvinfer interval of the batches with motion (pipeline['motion_gate'], set by the governor), -1 when the shard is not gated
+ * @var gate_interval
+ * nvinfer interval last set by the motion gate (written by the nv_detection sink probe)
+ * @var eos_sent
+ * a SIGTERM/SIGINT sent EOS to the shard, a second signal stops it without waiting for the EOS (shard's context only)
+ * @var stopping
+ * set before the stop EOS is sent (refer to _on_stop_signal), the live sources let it through instead of restarting
+ * @var recovering
+ * the shard was restarted after a failure, its recovery is notified once it plays again
+ */
+struct PipelineShard {
+  int id = 0;
+  std::vector<int> source_ids;
+  int batch_size = 1;
+  bool running = false;
+  GMainContext *context = NULL;
+  GMainLoop *loop = NULL;
+  GstElement *pipeline = NULL;
+  GSource *bus_watch = NULL;
+  pipelineUtils::BusStruct bus_struct;
+  batching::BatchController *batcher = NULL;
+  std::atomic<uint64_t> batches = 0;
+  std::atomic<uint64_t> batched_frames = 0;
+  inferenceGovernor::InferenceGovernor *governor = NULL;
+  inferenceGovernor::ElementTiming inference_timing;
+  int64_t governed_us = 0;
+  elementProfiler::Profiler *profiler = NULL;
+  int64_t profiled_us = 0;
+  std::atomic<int> base_interval = -1;
+  int gate_interval = -1;
+  bool eos_sent = false;
+  std::atomic<bool> stopping = false;
+  std::atomic<bool> recovering = false;
+};
+
+class Pipeline;
+
+/**
+ * @struct SourceContext
+ * @brief data handed to the pad probes and timers of a source (srcBin<id>)
+ *
+ * @var pipeline
+ * the module that owns the source
+ * @var shard
+ * the shard that runs the source
+ * @var source_id
+ * global id of the source
+ * @var stats
+ * the connection statistics of the source
+ */
+struct SourceContext {
+  Pipeline *pipeline;
+  PipelineShard *shard;
+  int source_id;
+  sourceHealth::SourceStats *stats;
 };
 
 /**
@@ -54,18 +192,30 @@ struct PipelineConfigs {
  * the Processing module that accesses all callbacks to perform processing operations
  * @var _configs
  * the modules config.yml that describes the gstreamer pipeline
- * @var loop
- * the loop (or thread) that runs the gstreamer pipeline
- * @var pipeline
- * the gstreamer pipeline
- * @var bus
- * a watcher to catch all messages sent from elements to the application bus
- * @var bus_watch_id
- * unique id for this pipeline's bus
- * @var bus_struct
- * data passed to the callback on the bus (updates application data when bus messages occur)
+ * @var _shards
+ * the independent gstreamer pipelines (each with its own main context, bus watch and batch), owned by the module (freed by the destructor)
+ * @var _running_shards
+ * number of shards whose main loop is still running
+ * @var _stopping
+ * the pipeline is stopping (a signal, drain, or the last shard finished): a shard that stops is retired instead of restarted
+ * @var _sources_lock
+ * protects the shards' source lists and pipeline['sources'] while sources are added/removed at runtime
+ * @var _source_stats
+ * connection statistics (errors, reconnects, outages) of every source, by source id
+ * @var _latency_stats
+ * latency measured at every sink (pipeline['latency_budget_ms']), by sink bin name
+ * @var _stats_lock
+ * protects _source_stats and _latency_stats (the stats themselves are atomic and updated without the lock)
+ * @var _tracer
+ * per-source, per-stage latency from the decoder to the sink (pipeline['trace_latency']), read without locks
+ * @var _recorder
+ * pre-roll of the encoded video of every source and the clips triggered by the detections (pipeline['clips']), NULL otherwise
+ * @var _recordings
+ * passthrough recordings of the file sinks and their sidecars (pipeline['record']=passthrough), read without locks
+ * @var _motion
+ * motion of every source (pipeline['motion_gate']), read without locks
  * @var _pool
- * a thead pool
+ * a thead pool (one thread per shard)
  */
 class Pipeline : public BaseComponent {
  public:
@@ -74,6 +224,27 @@ class Pipeline : public BaseComponent {
   void start();
   bool set_configs(njson conf);
 
+  // add/remove sources while the pipeline is running
+  int add_source(std::string uri, std::string sink = "");
+  bool remove_source(int source_id);
+
+  // connection statistics of every source
+  njson get_source_stats();
+  // latency measured at every sink against pipeline['latency_budget_ms']
+  njson get_latency_stats();
+  // latency percentiles from the decoder to every stage, by source (pipeline['trace_latency'])
+  njson get_latency_trace();
+  // switch the element profiler of every shard on/off (pipeline['profiler'], also toggled by SIGUSR1)
+  void set_profiling(bool enabled);
+  // frames and fraction of inference skipped by the motion gate, by source (pipeline['motion_gate'])
+  njson get_motion_stats();
+
+  // a shard that failed is rebuilt or retired (from the supervisor of ApplicationContext, through the mediator)
+  bool restart_shard(int shard_id);
+  void retire_shard(int shard_id);
+  // stop every running shard with EOS, like SIGTERM (another module failed for good)
+  bool drain(const std::string &reason);
+
   // create this->_store
   core::Processing *processor = new Processing();
   ~Pipeline();
@@ -86,11 +257,17 @@ class Pipeline : public BaseComponent {
 #endif
 
   // pipeline attributes
-  GMainLoop *loop = g_main_loop_new(NULL, FALSE);
-  GstElement *pipeline = NULL;
-  GstBus *bus;
-  guint bus_watch_id;
-  pipelineUtils::BusStruct bus_struct;
+  std::vector<PipelineShard *> _shards;
+  std::atomic<int> _running_shards = 0;
+  std::atomic<bool> _stopping = false;
+  std::mutex _sources_lock;
+  std::map<int, sourceHealth::SourceStats *> _source_stats;
+  std::map<std::string, latencyBudget::LatencyStats *> _latency_stats;
+  std::mutex _stats_lock;
+  latencyTrace::Tracer _tracer;
+  clipRecorder::Recorder *_recorder = NULL;
+  recording::Recordings _recordings;
+  motionGate::Gates _motion;
 
   // thread pool to run pipelines
   BS::thread_pool _pool = BS::thread_pool(1);
@@ -101,17 +278,83 @@ class Pipeline : public BaseComponent {
 
   bool _setup_pipeline();
 
-  bool _setup_pipeline_bus();
+  bool _setup_pipeline_bus(PipelineShard *shard);
 
   // create a pipeline (config.json or config.yml)
-  bool _create_pipeline();
+  bool _create_pipeline(PipelineShard *shard);
+
+  // source/sink bins of a single source (shared by _create_pipeline and add_source)
+  bool _sanitize_source(std::string &uri);
+  bool _sanitize_sink(std::string &sink);
+  GstElement *_create_source_bin(PipelineShard *shard, int source_id, std::string uri);
+  GstElement *_create_sink_bin(int source_id, std::string sink);
+  void _add_osd_probe(GstElement *bin, int source_id);
+  bool _add_tile(PipelineShard *shard, int source_id);
+  bool _link_source(PipelineShard *shard, int source_id);
+  void _add_cpu_inference_probe(GstElement *inferenceBin, int source_id);
+
+  // per-source error isolation and reconnection (runs on the shard's main context)
+  sourceHealth::SourceStats *_get_source_stats(int source_id);
+  bool _on_source_error(PipelineShard *shard, int source_id);
+  static GstPadProbeReturn _on_live_eos(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+  void _isolate_source(PipelineShard *shard, int source_id);
+  void _schedule_source_restart(PipelineShard *shard, int source_id);
+  void _restart_source(PipelineShard *shard, int source_id);
+  void _give_up_source(PipelineShard *shard, int source_id);
+  bool _has_live_sources(PipelineShard *shard);
+  void _check_sources(PipelineShard *shard);
+
+  // latency budget (pipeline['latency_budget_ms'])
+  void _add_latency_probe(GstElement *sinkBin);
+  void _report_latency(PipelineShard *shard);
+
+  // adaptive batching of nvstreammux (pipeline['batching'])
+  void _add_batch_probe(PipelineShard *shard);
+  void _update_batching(PipelineShard *shard);
+
+  // load-adaptive inference interval (pipeline['inference_governor'])
+  void _add_governor_probes(PipelineShard *shard);
+  void _update_inference_interval(PipelineShard *shard);
+
+  // per-buffer latency tracing (pipeline['trace_latency'])
+  void _add_trace_stamp(GstPad *pad, int source_id);
+  void _add_trace_probe(GstElement *bin, const std::string &element, const std::string &pad, int stage, int source_id);
+  void _add_batch_trace_probes(PipelineShard *shard);
+
+  // element profiler (pipeline['profiler'])
+  void _add_profiler(PipelineShard *shard);
+  void _report_profile(PipelineShard *shard);
+
+  // event-triggered clips (pipeline['clips'])
+  void _add_clip_recorder();
+  void _add_clip_tap(GstElement *srcBin, int source_id);
+
+  // passthrough recording of file sinks (pipeline['record'])
+  void _add_passthrough_recording(GstElement *srcBin, int source_id, const std::string &sink);
+
+  // motion gating of the inference (pipeline['motion_gate'])
+  void _add_motion_branch(GstElement *srcBin, int source_id);
+  void _add_motion_gate_probe(PipelineShard *shard);
+
+  // QoS analytics of the bus messages (pipeline['qos'])
+  void _report_qos(PipelineShard *shard);
+
+  // SIGTERM/SIGINT drain the shards with an EOS (pipeline['eos_timeout_ms'])
+  void _on_stop_signal(PipelineShard *shard, const char *signal);
+  // free what the shard built for its run (batcher, governor, profiler), a restart builds them again
+  void _release_shard_state(PipelineShard *shard);
 
 #ifdef YAML_CONFIGS
-  bool _create_pipeline_from_yaml(std::string file_path);
-  bool _set_callbacks(GstElement *new_element, YAML::Node element);
+  bool _create_pipeline_from_yaml(PipelineShard *shard, std::string file_path);
+  bool _set_callbacks(PipelineShard *shard, GstElement *new_element, YAML::Node element);
+  bool _add_probe_callback(GstPad *pad, const std::string &function_name);
+  // graph pipelines (yaml `nodes` and `edges`)
+  bool _create_graph_from_yaml(PipelineShard *shard, const YAML::Node &config);
+  bool _link_graph(PipelineShard *shard, const pipelineGraph::Link &link);
+  bool _link_graph_pads(GstPad *src_pad, GstPad *sink_pad, const pipelineGraph::Link &link);
 #endif
 
-  void _run_pipeline();
+  void _run_shard(PipelineShard *shard);
 
   void _pipeline_finished();
 
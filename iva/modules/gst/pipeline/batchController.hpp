@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+#include "sourceHealth.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace batching
+ * @brief adaptive batch formation of nvstreammux (config.json pipeline['batching']). The policy only sees frame counts and time, so it
+ *  is tested without the NVIDIA elements.
+ *
+ */
+namespace batching {
+
+/**
+ * @struct BatchPolicy
+ * @brief limits of the batch controller
+ *
+ * @var adaptive
+ * run the controller (otherwise nvstreammux keeps batched-push-timeout=40000)
+ * @var target_latency_ms
+ * the longest a frame may wait for the rest of its batch
+ * @var min_timeout_us
+ * lower bound of batched-push-timeout
+ * @var interval_ms
+ * period of the controller
+ * @var min_fps
+ * sources slower than this are considered stopped and are not waited for
+ * @var margin
+ * extra fraction of the slowest frame period added to the timeout to absorb jitter
+ * @var hysteresis
+ * relative change of the timeout below which the current value is kept (avoids retuning the mux every period)
+ */
+struct BatchPolicy {
+  bool adaptive = false;
+  int target_latency_ms = 40;
+  int min_timeout_us = 1000;
+  int interval_ms = 1000;
+  double min_fps = 0.5;
+  double margin = 0.2;
+  double hysteresis = 0.1;
+};
+
+/**
+ * @struct BatchDecision
+ * @brief settings of nvstreammux chosen by the controller
+ *
+ * @var timeout_us
+ * batched-push-timeout
+ * @var batch_size
+ * number of sources that deliver frames (applied only if the mux supports changing batch-size while playing)
+ * @var expected_fill
+ * expected fraction (0..1) of the batch filled when it is pushed
+ * @var changed
+ * true if the settings differ from the previous decision
+ */
+struct BatchDecision {
+  int timeout_us = 40000;
+  int batch_size = 1;
+  double expected_fill = 0;
+  bool changed = false;
+};
+
+/**
+ * @brief batch timeout that lets every active source deliver one frame (the period of the slowest source), bounded by the latency
+ *  target, and never shorter than the period of the fastest source (or the batch would go out with a single frame)
+ * @param fps arrival rate of every source of the batch
+ * @param policy the limits
+ * @return the timeout, batch size and expected fill (changed is not set)
+ */
+inline BatchDecision computeBatchDecision(const std::vector<double> &fps, const BatchPolicy &policy)
+{
+  BatchDecision decision;
+  double slowest = 0, fastest = 0;
+  int active = 0;
+  for (double rate : fps) {
+    if (rate < policy.min_fps)
+      continue;
+    slowest = active == 0 ? rate : std::min(slowest, rate);
+    fastest = std::max(fastest, rate);
+    active++;
+  }
+  int max_timeout_us = std::max(policy.min_timeout_us, policy.target_latency_ms * 1000);
+  if (active == 0) {
+    // nothing to wait for, push whatever arrives within the latency target
+    decision.timeout_us = max_timeout_us;
+    decision.batch_size = std::max(1, (int) fps.size());
+    return decision;
+  }
+
+  double slowest_period_us = 1e6 / slowest * (1.0 + policy.margin);
+  double fastest_period_us = 1e6 / fastest;
+  double timeout_us = std::max(slowest_period_us, fastest_period_us);
+  decision.timeout_us = (int) std::lround(std::clamp(timeout_us, (double) policy.min_timeout_us, (double) max_timeout_us));
+  decision.batch_size = active;
+
+  // a source fills its slot if it delivers a frame within the timeout
+  double fill = 0;
+  for (double rate : fps) {
+    if (rate >= policy.min_fps)
+      fill += std::min(1.0, rate * decision.timeout_us / 1e6);
+  }
+  decision.expected_fill = fill / active;
+  return decision;
+}
+
+/**
+ * @class BatchController
+ * @brief measures the arrival rate of every source of a batch from its frame counter and retunes the batch with hysteresis.
+ *  Called periodically from the shard's main context, never from streaming threads.
+ */
+class BatchController {
+ public:
+  explicit BatchController(BatchPolicy policy = BatchPolicy()) : _policy(policy) {}
+
+  /**
+   * @brief update the arrival rates and decide the batch settings
+   * @param buffers frames delivered so far by every source of the batch (by source id)
+   * @param now_us monotonic time
+   * @return the decision, changed is true if nvstreammux must be updated
+   */
+  BatchDecision update(const std::map<int, uint64_t> &buffers, int64_t now_us)
+  {
+    std::vector<double> rates;
+    std::map<int, double> fps;
+    for (const auto &[source_id, count] : buffers) {
+      auto previous = this->_buffers.find(source_id);
+      double rate = this->_fps.count(source_id) ? this->_fps[source_id] : 0.0;
+      if (previous != this->_buffers.end() && this->_checked_us != 0 && count >= previous->second)
+        rate = sourceHealth::updateFps(rate, count - previous->second, now_us - this->_checked_us, rate == 0 ? 1.0 : 0.5);
+      fps[source_id] = rate;
+      rates.push_back(rate);
+    }
+    // sources removed from the batch are forgotten
+    this->_buffers = buffers;
+    this->_fps = fps;
+    bool first = this->_checked_us == 0;
+    this->_checked_us = now_us;
+    if (first)
+      return this->_decision;
+
+    BatchDecision decision = computeBatchDecision(rates, this->_policy);
+    double relative = std::abs(decision.timeout_us - this->_decision.timeout_us) / (double) std::max(1, this->_decision.timeout_us);
+    decision.changed = relative > this->_policy.hysteresis || decision.batch_size != this->_decision.batch_size;
+    if (!decision.changed)
+      decision.timeout_us = this->_decision.timeout_us;
+    this->_decision = decision;
+    return decision;
+  }
+
+  /**
+   * @brief arrival rate of a source measured by the controller
+   * @param source_id global id of the source
+   * @return frames per second, 0 if unknown
+   */
+  double fps(int source_id) const
+  {
+    auto it = this->_fps.find(source_id);
+    return it == this->_fps.end() ? 0.0 : it->second;
+  }
+
+  /**
+   * @brief current decision for logging and reporting
+   * @return json with the timeout, batch size, expected fill and the rate of every source
+   */
+  njson to_json() const
+  {
+    njson ret;
+    ret["batched_push_timeout_us"] = this->_decision.timeout_us;
+    ret["batch_size"] = this->_decision.batch_size;
+    ret["expected_fill"] = this->_decision.expected_fill;
+    for (const auto &[source_id, rate] : this->_fps)
+      ret["fps"][std::to_string(source_id)] = rate;
+    return ret;
+  }
+
+ private:
+  BatchPolicy _policy;
+  BatchDecision _decision;
+  std::map<int, uint64_t> _buffers;
+  std::map<int, double> _fps;
+  int64_t _checked_us = 0;
+};
+
+}  // namespace batching
@@ -0,0 +1,587 @@
+#pragma once
+
+#include <gst/app/gstappsrc.h>
+#include <gst/gst.h>
+
+#include <BS_thread_pool.hpp>
+#include <array>
+#include <atomic>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "logging.hpp"
+#include "metrics.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace clipRecorder
+ * @brief event-triggered clips (config.json pipeline['clips']). Every source keeps its last seconds of encoded video (before the
+ *  decoder, no encoder is spent) in a ring of whole GOPs, bounded in bytes. When a detection rule fires, the pre-roll and the frames
+ *  that follow (post-roll) are muxed to an mp4 clip by a small pipeline of its own (appsrc -> parser -> mp4mux -> filesink), and the
+ *  clip path is published with the detection payload.
+ *
+ */
+namespace clipRecorder {
+
+/**
+ * @struct ClipRule
+ * @brief a detection that starts (or extends) a clip
+ *
+ * @var label
+ * label of the object, empty matches every label
+ * @var min_confidence
+ * minimum confidence of the object (0-100, as in the payload)
+ * @var min_duration_ms
+ * the object must be seen for this long (frames with detections less than gap_ms apart) before the rule fires
+ */
+struct ClipRule {
+  std::string label;
+  int min_confidence = 0;
+  int min_duration_ms = 0;
+};
+
+/**
+ * @struct ClipPolicy
+ * @brief clip recording settings (config.json pipeline['clips'])
+ *
+ * @var enable
+ * tap the sources and evaluate the rules
+ * @var pre_roll_s
+ * seconds kept before the detection (rounded up to the previous keyframe)
+ * @var post_roll_s
+ * seconds recorded after the last detection that matched a rule
+ * @var max_clip_s
+ * longest clip, detections do not extend a clip past it
+ * @var max_bytes
+ * memory bound of the pre-roll of every source (and of the frames waiting for a clip writer)
+ * @var max_active
+ * clips written at the same time, rules that fire while every writer is busy are skipped
+ * @var gap_ms
+ * detections further apart restart the min_duration of the rules
+ * @var rules
+ * the detection rules, any rule starts a clip
+ */
+struct ClipPolicy {
+  bool enable = false;
+  int pre_roll_s = 5;
+  int post_roll_s = 5;
+  int max_clip_s = 60;
+  int64_t max_bytes = 32 * 1024 * 1024;
+  int max_active = 2;
+  int gap_ms = 1000;
+  std::vector<ClipRule> rules;
+};
+
+/**
+ * @brief true if a payload has an object that matches a rule
+ * @param rule the rule
+ * @param payload detection payload (refer to Processing::_create_payload), objects are under `inference`
+ */
+inline bool matches(const ClipRule &rule, const njson &payload)
+{
+  if (!payload.contains("inference"))
+    return false;
+  for (const auto &object : payload["inference"]) {
+    if ((rule.label.empty() || object.value("label", std::string()) == rule.label) && object.value("confidence", 0) >= rule.min_confidence)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @struct RuleState
+ * @brief how long the object of a rule has been seen on a source
+ */
+struct RuleState {
+  int64_t first_us = 0;
+  int64_t last_us = 0;
+};
+
+/**
+ * @brief account for a payload of the source and check whether the rule fires
+ * @param state the state of the rule on the source
+ * @param rule the rule
+ * @param matched true if the payload matches the rule
+ * @param now_us monotonic time of the payload
+ * @param gap_ms detections further apart start a new sighting
+ * @return true if the object has been seen for min_duration_ms
+ */
+inline bool updateRule(RuleState &state, const ClipRule &rule, bool matched, int64_t now_us, int gap_ms)
+{
+  if (!matched)
+    return false;
+  if (state.first_us == 0 || now_us - state.last_us > (int64_t) gap_ms * 1000)
+    state.first_us = now_us;
+  state.last_us = now_us;
+  return now_us - state.first_us >= (int64_t) rule.min_duration_ms * 1000;
+}
+
+/**
+ * @brief decoding time of an encoded buffer (presentation time when the decoding time is unknown)
+ */
+inline GstClockTime bufferTime(GstBuffer *buffer)
+{
+  return GST_BUFFER_DTS_IS_VALID(buffer) ? GST_BUFFER_DTS(buffer) : GST_BUFFER_PTS(buffer);
+}
+
+/**
+ * @class PreRollRing
+ * @brief the last encoded frames of a source, in whole GOPs so that a clip always starts on a keyframe. The oldest GOP is dropped
+ *  once the newer GOPs cover the pre-roll, or when the ring holds more than max_bytes (a single GOP larger than max_bytes is dropped).
+ *  Not thread safe, owned by a SourceRecorder.
+ */
+class PreRollRing {
+ public:
+  PreRollRing(GstClockTime pre_roll, int64_t max_bytes) : _pre_roll(pre_roll), _max_bytes(max_bytes) {}
+  ~PreRollRing() { this->clear(); }
+
+  /**
+   * @brief add a frame (a reference is taken), frames before the first keyframe are ignored
+   * @param buffer the encoded frame
+   */
+  void push(GstBuffer *buffer)
+  {
+    GstClockTime time = bufferTime(buffer);
+    if (!GST_CLOCK_TIME_IS_VALID(time))
+      return;
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+      this->_gops.push_back({.start = time, .bytes = 0, .frames = {}});
+    else if (this->_gops.empty())
+      return;
+    Gop &gop = this->_gops.back();
+    gop.frames.push_back(gst_buffer_ref(buffer));
+    gop.bytes += gst_buffer_get_size(buffer);
+    this->_bytes += gst_buffer_get_size(buffer);
+    this->_newest = time;
+
+    while (this->_gops.size() > 1 && this->_newest >= this->_gops[1].start && this->_newest - this->_gops[1].start >= this->_pre_roll)
+      this->_drop_front();
+    while (this->_gops.size() > 1 && this->_bytes > this->_max_bytes)
+      this->_drop_front();
+    if (this->_bytes > this->_max_bytes)
+      this->clear();
+  }
+
+  /**
+   * @brief the frames of the ring, oldest first
+   * @return new references (unref them)
+   */
+  std::vector<GstBuffer *> snapshot() const
+  {
+    std::vector<GstBuffer *> ret;
+    for (const Gop &gop : this->_gops) {
+      for (GstBuffer *buffer : gop.frames)
+        ret.push_back(gst_buffer_ref(buffer));
+    }
+    return ret;
+  }
+
+  /**
+   * @brief drop every frame (flush, new stream)
+   */
+  void clear()
+  {
+    while (!this->_gops.empty())
+      this->_drop_front();
+  }
+
+  int64_t bytes() const { return this->_bytes; }
+  size_t gops() const { return this->_gops.size(); }
+
+  /**
+   * @brief time covered by the ring
+   */
+  GstClockTime duration() const { return this->_gops.empty() ? 0 : this->_newest - this->_gops.front().start; }
+
+ private:
+  struct Gop {
+    GstClockTime start;
+    int64_t bytes;
+    std::vector<GstBuffer *> frames;
+  };
+  GstClockTime _pre_roll;
+  int64_t _max_bytes;
+  std::deque<Gop> _gops;
+  int64_t _bytes = 0;
+  GstClockTime _newest = 0;
+
+  void _drop_front()
+  {
+    for (GstBuffer *buffer : this->_gops.front().frames)
+      gst_buffer_unref(buffer);
+    this->_bytes -= this->_gops.front().bytes;
+    this->_gops.pop_front();
+  }
+};
+
+/**
+ * @struct Clip
+ * @brief a clip being recorded, frames are pushed to its appsrc once its writer is ready (pending until then)
+ *
+ * @var path
+ * the mp4 file
+ * @var base
+ * time of its first frame (timestamps of the clip start at 0)
+ * @var end
+ * time of the last frame of the post-roll (moved by the detections that extend the clip)
+ * @var limit
+ * base + max_clip_s
+ * @var pending
+ * frames waiting for the writer (references)
+ * @var pending_bytes
+ * size of pending
+ * @var appsrc
+ * input of the clip pipeline, NULL until the writer is ready
+ * @var finished
+ * the post-roll is over (or the stream was flushed), EOS is sent to the clip pipeline
+ */
+struct Clip {
+  std::string path;
+  GstClockTime base = 0;
+  GstClockTime end = 0;
+  GstClockTime limit = 0;
+  std::deque<GstBuffer *> pending;
+  int64_t pending_bytes = 0;
+  GstElement *appsrc = NULL;
+  bool finished = false;
+};
+
+/**
+ * @brief a frame of a clip with its timestamps relative to the start of the clip
+ * @param buffer the encoded frame (not consumed)
+ * @param base time of the first frame of the clip
+ * @return a new buffer sharing the memory of the frame
+ */
+inline GstBuffer *rebase(GstBuffer *buffer, GstClockTime base)
+{
+  GstBuffer *out = gst_buffer_copy(buffer);
+  if (GST_BUFFER_PTS_IS_VALID(out))
+    GST_BUFFER_PTS(out) = GST_BUFFER_PTS(out) >= base ? GST_BUFFER_PTS(out) - base : 0;
+  if (GST_BUFFER_DTS_IS_VALID(out))
+    GST_BUFFER_DTS(out) = GST_BUFFER_DTS(out) >= base ? GST_BUFFER_DTS(out) - base : GST_CLOCK_TIME_NONE;
+  return out;
+}
+
+/**
+ * @struct SourceRecorder
+ * @brief the pre-roll, rule states and current clip of a source. The lock is shared by the tap (streaming thread of the source), the
+ *  rule evaluation (streaming thread of the inference) and the clip writer, never by the other sources.
+ */
+struct SourceRecorder {
+  int source_id = -1;
+  std::mutex lock;
+  PreRollRing ring;
+  GstCaps *caps = NULL;
+  GstClockTime newest = 0;
+  std::vector<RuleState> rules;
+  std::shared_ptr<Clip> clip;
+  int clips = 0;
+  int64_t max_bytes;
+  std::atomic<uint64_t> *recorded = NULL;
+
+  SourceRecorder(int id, const ClipPolicy &policy)
+      : source_id(id), ring(policy.pre_roll_s * GST_SECOND, policy.max_bytes), rules(policy.rules.size()), max_bytes(policy.max_bytes)
+  {
+  }
+  ~SourceRecorder()
+  {
+    if (this->caps != NULL)
+      gst_caps_unref(this->caps);
+  }
+};
+
+/**
+ * @brief send the end of the stream to a clip (lock of its source held)
+ */
+inline void finishClip(Clip &clip)
+{
+  clip.finished = true;
+  if (clip.appsrc != NULL)
+    gst_app_src_end_of_stream(GST_APP_SRC(clip.appsrc));
+}
+
+/**
+ * @brief add an encoded frame of the source to its pre-roll and to its clip
+ * @param source the source
+ * @param buffer the encoded frame (not consumed)
+ */
+inline void onFrame(SourceRecorder &source, GstBuffer *buffer)
+{
+  std::lock_guard<std::mutex> guard(source.lock);
+  source.ring.push(buffer);
+  GstClockTime time = bufferTime(buffer);
+  if (GST_CLOCK_TIME_IS_VALID(time))
+    source.newest = time;
+  Clip *clip = source.clip.get();
+  if (clip == NULL)
+    return;
+  if (clip->appsrc != NULL) {
+    gst_app_src_push_buffer(GST_APP_SRC(clip->appsrc), rebase(buffer, clip->base));
+  }
+  else {
+    clip->pending.push_back(gst_buffer_ref(buffer));
+    clip->pending_bytes += gst_buffer_get_size(buffer);
+  }
+  // the writer never came up (or is too slow): the clip ends with what it has
+  if ((GST_CLOCK_TIME_IS_VALID(time) && time >= clip->end) || clip->pending_bytes > source.max_bytes) {
+    finishClip(*clip);
+    source.clip.reset();
+  }
+}
+
+/**
+ * @brief the stream of the source was flushed or restarted: the pre-roll is dropped and the current clip ends
+ */
+inline void onReset(SourceRecorder &source)
+{
+  std::lock_guard<std::mutex> guard(source.lock);
+  source.ring.clear();
+  if (source.clip) {
+    finishClip(*source.clip);
+    source.clip.reset();
+  }
+}
+
+/**
+ * @brief tap on the sink pad of the decoder of a source (buffers and downstream events), only takes the lock of its source
+ * @param pad the sink pad of the decoder
+ * @param info the buffer or event
+ * @param u_data the SourceRecorder of the source
+ */
+inline GstPadProbeReturn tapProbe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data)
+{
+  SourceRecorder *source = (SourceRecorder *) u_data;
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    onFrame(*source, GST_PAD_PROBE_INFO_BUFFER(info));
+    return GST_PAD_PROBE_OK;
+  }
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+      GstCaps *caps;
+      gst_event_parse_caps(event, &caps);
+      std::lock_guard<std::mutex> guard(source->lock);
+      // a clip is written with the caps it started with
+      gst_caps_replace(&source->caps, caps);
+      break;
+    }
+    case GST_EVENT_FLUSH_STOP:
+    case GST_EVENT_STREAM_START:
+      onReset(*source);
+      break;
+    default:
+      break;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/**
+ * @brief the parser that puts an encoded stream in the format of mp4mux
+ * @param caps caps of the encoded stream
+ * @return the parser factory, empty if the stream can be muxed as is
+ */
+inline std::string clipParser(const GstCaps *caps)
+{
+  std::string media_type = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+  if (media_type == "video/x-h264")
+    return "h264parse";
+  if (media_type == "video/x-h265")
+    return "h265parse";
+  return "";
+}
+
+/**
+ * @class Recorder
+ * @brief the clip recorders of every source and the pool of clip writers
+ */
+class Recorder {
+ public:
+  static constexpr int TABLE = 256;
+
+  explicit Recorder(const ClipPolicy &policy) : _policy(policy), _pool(std::max(1, policy.max_active)) {}
+
+  const ClipPolicy &policy() const { return this->_policy; }
+
+  /**
+   * @brief the recorder of a source, created on first use (when its source bin is created, not from probes)
+   * @param source_id global id of the source
+   * @return the recorder (never freed, like the other source stats), NULL if its slot is taken by another source
+   */
+  SourceRecorder *add(int source_id)
+  {
+    SourceRecorder *source = this->get(source_id);
+    if (source != nullptr)
+      return source;
+    SourceRecorder *expected = nullptr;
+    source = new SourceRecorder(source_id, this->_policy);
+    source->recorded = &core::Metrics::get().counter("iva_clips_total", "Clips recorded from the detection rules.",
+                                                     {{"source", std::to_string(source_id)}});
+    if (!this->_table[source_id % TABLE].compare_exchange_strong(expected, source)) {
+      delete source;
+      return this->get(source_id);
+    }
+    return source;
+  }
+
+  /**
+   * @brief the recorder of a source
+   * @return NULL if the source is not recorded
+   */
+  SourceRecorder *get(int source_id) const
+  {
+    if (source_id < 0)
+      return nullptr;
+    SourceRecorder *source = this->_table[source_id % TABLE].load(std::memory_order_acquire);
+    return source != nullptr && source->source_id == source_id ? source : nullptr;
+  }
+
+  /**
+   * @brief evaluate the rules on a detection payload of a source, start a clip or extend the current one
+   * @param source_id global id of the source
+   * @param payload the detection payload
+   * @return path of the clip the payload belongs to, empty if no rule fired
+   */
+  std::string on_payload(int source_id, const njson &payload)
+  {
+    SourceRecorder *source = this->get(source_id);
+    if (source == nullptr)
+      return "";
+    int64_t now = g_get_monotonic_time();
+    std::lock_guard<std::mutex> guard(source->lock);
+    bool fired = false;
+    for (size_t r = 0; r < this->_policy.rules.size(); r++) {
+      const ClipRule &rule = this->_policy.rules[r];
+      fired = updateRule(source->rules[r], rule, matches(rule, payload), now, this->_policy.gap_ms) || fired;
+    }
+    if (!fired)
+      return "";
+    if (source->clip) {
+      source->clip->end = std::min(source->clip->limit, source->newest + this->_policy.post_roll_s * GST_SECOND);
+      return source->clip->path;
+    }
+    if (source->caps == NULL || source->ring.gops() == 0)
+      return "";
+    if (this->_active.fetch_add(1) >= this->_policy.max_active) {
+      this->_active--;
+      this->skipped++;
+      VLOG(DEBUG) << "Clip of source=" << source_id << " skipped, every clip writer is busy";
+      return "";
+    }
+
+    auto clip = std::make_shared<Clip>();
+    clip->path = this->_clip_path(source_id, ++source->clips);
+    for (GstBuffer *buffer : source->ring.snapshot()) {
+      clip->pending.push_back(buffer);
+      clip->pending_bytes += gst_buffer_get_size(buffer);
+    }
+    clip->base = bufferTime(clip->pending.front());
+    clip->limit = clip->base + this->_policy.max_clip_s * GST_SECOND;
+    clip->end = std::min(clip->limit, source->newest + this->_policy.post_roll_s * GST_SECOND);
+    source->clip = clip;
+    GstCaps *caps = gst_caps_ref(source->caps);
+    LOG(INFO) << "Recording clip of source=" << source_id << " to " << clip->path << " (pre-roll="
+              << (source->newest - clip->base) / GST_MSECOND << "ms)";
+    this->_pool.push_task([this, source, clip, caps]() {
+      this->_write(source, clip, caps);
+      gst_caps_unref(caps);
+      this->_active--;
+    });
+    return clip->path;
+  }
+
+  /**
+   * @brief directory of the clips (created when the recorder is configured)
+   */
+  std::string directory;
+  std::atomic<uint64_t> skipped = 0;
+
+ private:
+  ClipPolicy _policy;
+  std::atomic<int> _active = 0;
+  std::array<std::atomic<SourceRecorder *>, TABLE> _table{};
+  // last member: destroyed first, waits for the clip writers
+  BS::thread_pool _pool;
+
+  std::string _clip_path(int source_id, int count)
+  {
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+    localtime_r(&now, &local);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    return this->directory + "/clip_src" + std::to_string(source_id) + "_" + stamp + "_" + std::to_string(count) + ".mp4";
+  }
+
+  // runs on a writer thread: mux the clip until its end of stream
+  void _write(SourceRecorder *source, std::shared_ptr<Clip> clip, GstCaps *caps)
+  {
+    GstElement *pipeline = gst_pipeline_new(NULL);
+    GstElement *appsrc = gst_element_factory_make("appsrc", "clip_src");
+    std::string parser_name = clipParser(caps);
+    GstElement *parser = gst_element_factory_make(parser_name.empty() ? "identity" : parser_name.c_str(), "clip_parser");
+    GstElement *mux = gst_element_factory_make("mp4mux", "clip_mux");
+    GstElement *sink = gst_element_factory_make("filesink", "clip_sink");
+    g_object_set(appsrc, "caps", caps, "format", GST_FORMAT_TIME, "is-live", FALSE, "block", FALSE, "max-bytes",
+                 (guint64) this->_policy.max_bytes, NULL);
+    g_object_set(sink, "location", clip->path.c_str(), "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), appsrc, parser, mux, sink, NULL);
+    if (!gst_element_link_many(appsrc, parser, mux, sink, NULL) ||
+        gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+      LOG(ERROR) << "Could not start the clip writer of " << clip->path;
+      std::lock_guard<std::mutex> guard(source->lock);
+      for (GstBuffer *buffer : clip->pending)
+        gst_buffer_unref(buffer);
+      clip->pending.clear();
+      if (source->clip == clip)
+        source->clip.reset();
+      gst_element_set_state(pipeline, GST_STATE_NULL);
+      gst_object_unref(pipeline);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(source->lock);
+      for (GstBuffer *buffer : clip->pending) {
+        gst_app_src_push_buffer(GST_APP_SRC(appsrc), rebase(buffer, clip->base));
+        gst_buffer_unref(buffer);
+      }
+      clip->pending.clear();
+      clip->pending_bytes = 0;
+      clip->appsrc = appsrc;
+      if (clip->finished)
+        gst_app_src_end_of_stream(GST_APP_SRC(appsrc));
+    }
+
+    // the clip lasts at most max_clip_s of stream time, give the stream some slack before giving up on it
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, (this->_policy.max_clip_s + this->_policy.post_roll_s + 30) * GST_SECOND,
+                                                 (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    if (msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+      LOG(INFO) << "Clip of source=" << source->source_id << " saved to " << clip->path;
+      source->recorded->fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+      LOG(ERROR) << "Clip of source=" << source->source_id << " failed: " << clip->path;
+    }
+    if (msg != NULL)
+      gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    {
+      std::lock_guard<std::mutex> guard(source->lock);
+      clip->appsrc = NULL;
+      if (source->clip == clip)
+        source->clip.reset();
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+  }
+};
+
+}  // namespace clipRecorder
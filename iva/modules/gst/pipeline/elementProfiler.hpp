@@ -0,0 +1,349 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "inferenceGovernor.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace elementProfiler
+ * @brief in-process profiler of the elements of a shard (config.json pipeline['profiler']), in the spirit of the GstTracer hooks:
+ *  pad probes count the buffers and bytes every element pushes and time the chain of every element (from a buffer entering its sink
+ *  pad to the first buffer it pushes on the same thread). A sorted table of the hot elements is logged periodically.
+ *
+ */
+namespace elementProfiler {
+
+/**
+ * @struct ProfilerPolicy
+ * @brief settings of the profiler
+ *
+ * @var installed
+ * the probes are installed on every element (pipeline['profiler'] is set)
+ * @var enabled
+ * profile from the start (toggled at runtime with SIGUSR1 or Pipeline::set_profiling)
+ * @var interval_s
+ * period of the hot element table
+ * @var top
+ * number of elements in the table
+ */
+struct ProfilerPolicy {
+  bool installed = false;
+  bool enabled = false;
+  int interval_s = 10;
+  int top = 10;
+};
+
+/**
+ * @struct ElementStats
+ * @brief counters of an element, written from the streaming threads (atomics)
+ *
+ * @var name
+ * name of the element (with the bin it belongs to)
+ * @var factory
+ * factory of the element (nvvideoconvert, x264enc, ...)
+ * @var queue
+ * the element if it is a queue (its fill is reported, a reference is held), NULL otherwise
+ * @var buffers
+ * buffers pushed on the src pads
+ * @var bytes
+ * bytes pushed on the src pads
+ * @var proc_us
+ * time spent in the chain of the element
+ * @var chains
+ * chains timed
+ * @var reported
+ * counters at the previous report (only touched by the report)
+ */
+struct ElementStats {
+  std::string name;
+  std::string factory;
+  GstElement *queue = NULL;
+  std::atomic<uint64_t> buffers = 0;
+  std::atomic<uint64_t> bytes = 0;
+  std::atomic<int64_t> proc_us = 0;
+  std::atomic<uint64_t> chains = 0;
+  struct {
+    uint64_t buffers = 0;
+    uint64_t bytes = 0;
+    int64_t proc_us = 0;
+    uint64_t chains = 0;
+  } reported;
+};
+
+/**
+ * @struct ChainStack
+ * @brief the chains in progress on a streaming thread (a push runs the chain of the next element on the same thread)
+ */
+struct ChainStack {
+  static constexpr int DEPTH = 32;
+  std::array<ElementStats *, DEPTH> elements{};
+  std::array<int64_t, DEPTH> entered{};
+  int depth = 0;
+};
+
+/**
+ * @brief the chains in progress on the calling thread
+ */
+inline ChainStack &chainStack()
+{
+  static thread_local ChainStack stack;
+  return stack;
+}
+
+/**
+ * @brief a buffer enters an element (sink pad probe). An element already on the stack (queues and sinks never push on the same
+ *  thread) is replaced with everything above it.
+ * @param stack the chains of the thread
+ * @param stats the element
+ * @param now_us monotonic time
+ */
+inline void enterChain(ChainStack &stack, ElementStats *stats, int64_t now_us)
+{
+  for (int i = stack.depth - 1; i >= 0; i--) {
+    if (stack.elements[i] == stats) {
+      stack.depth = i;
+      break;
+    }
+  }
+  if (stack.depth == ChainStack::DEPTH) {
+    // stale entries at the bottom, keep the most recent chains
+    std::move(stack.elements.begin() + 1, stack.elements.end(), stack.elements.begin());
+    std::move(stack.entered.begin() + 1, stack.entered.end(), stack.entered.begin());
+    stack.depth--;
+  }
+  stack.elements[stack.depth] = stats;
+  stack.entered[stack.depth] = now_us;
+  stack.depth++;
+}
+
+/**
+ * @brief an element pushes a buffer (src pad probe): the chain of the element is over, the time of the downstream elements is not
+ *  counted. Pushes without a chain on the thread (sources, queues, aggregators) are not timed.
+ * @param stack the chains of the thread
+ * @param stats the element
+ * @param now_us monotonic time
+ * @return the time spent in the chain, -1 if the element had no chain on the thread
+ */
+inline int64_t leaveChain(ChainStack &stack, ElementStats *stats, int64_t now_us)
+{
+  for (int i = stack.depth - 1; i >= 0; i--) {
+    if (stack.elements[i] == stats) {
+      int64_t proc = std::max<int64_t>(0, now_us - stack.entered[i]);
+      stack.depth = i;
+      stats->proc_us.fetch_add(proc, std::memory_order_relaxed);
+      stats->chains.fetch_add(1, std::memory_order_relaxed);
+      return proc;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief count the buffers pushed by an element
+ * @param stats the element
+ * @param buffers number of buffers
+ * @param bytes size of the buffers
+ */
+inline void countPush(ElementStats *stats, uint64_t buffers, uint64_t bytes)
+{
+  stats->buffers.fetch_add(buffers, std::memory_order_relaxed);
+  stats->bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @class Profiler
+ * @brief the element counters of a shard. Elements are added when they join the pipeline (also from the streaming threads of the
+ *  dynamic source bins), the probes only touch the counters of their element.
+ */
+class Profiler {
+ public:
+  explicit Profiler(ProfilerPolicy policy = ProfilerPolicy()) : _policy(policy), _enabled(policy.enabled) {}
+
+  ~Profiler()
+  {
+    for (const auto &element : this->_elements) {
+      if (element->queue != NULL)
+        gst_object_unref(element->queue);
+    }
+  }
+
+  /**
+   * @brief counters of an element
+   * @param name name of the element
+   * @param factory factory of the element
+   * @param queue the element if it is a queue, NULL otherwise
+   * @return the counters, owned by the profiler
+   */
+  ElementStats *add(const std::string &name, const std::string &factory, GstElement *queue = NULL)
+  {
+    std::lock_guard<std::mutex> guard(this->_lock);
+    this->_elements.push_back(std::make_unique<ElementStats>());
+    ElementStats *stats = this->_elements.back().get();
+    stats->name = name;
+    stats->factory = factory;
+    stats->queue = queue != NULL ? (GstElement *) gst_object_ref(queue) : NULL;
+    return stats;
+  }
+
+  /**
+   * @brief switch profiling on/off, the probes stay installed and return at once while off
+   */
+  void set_enabled(bool enabled) { this->_enabled.store(enabled, std::memory_order_relaxed); }
+
+  bool enabled() const { return this->_enabled.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief the hot elements since the previous report
+   * @param elapsed_us length of the period
+   * @return json array sorted by the share of the period spent in the element (then by buffers/s), at most policy.top elements
+   */
+  njson report(int64_t elapsed_us)
+  {
+    double elapsed_s = std::max<int64_t>(1, elapsed_us) / 1e6;
+    std::vector<njson> rows;
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      for (const auto &element : this->_elements) {
+        ElementStats *stats = element.get();
+        uint64_t buffers = stats->buffers.load(std::memory_order_relaxed);
+        uint64_t bytes = stats->bytes.load(std::memory_order_relaxed);
+        int64_t proc_us = stats->proc_us.load(std::memory_order_relaxed);
+        uint64_t chains = stats->chains.load(std::memory_order_relaxed);
+        njson row;
+        row["element"] = stats->name;
+        row["factory"] = stats->factory;
+        row["buffers_per_s"] = (buffers - stats->reported.buffers) / elapsed_s;
+        row["bytes_per_s"] = (bytes - stats->reported.bytes) / elapsed_s;
+        row["busy"] = (proc_us - stats->reported.proc_us) / (elapsed_s * 1e6);
+        row["proc_ms"] = chains > stats->reported.chains ? (proc_us - stats->reported.proc_us) / 1000.0 / (chains - stats->reported.chains) : 0.0;
+        if (stats->queue != NULL)
+          row["queue_fill"] = inferenceGovernor::queueFill(stats->queue);
+        if (buffers > stats->reported.buffers || row.value("queue_fill", 0.0) > 0)
+          rows.push_back(row);
+        stats->reported = {buffers, bytes, proc_us, chains};
+      }
+    }
+    std::sort(rows.begin(), rows.end(), [](const njson &a, const njson &b) {
+      if (a["busy"].get<double>() != b["busy"].get<double>())
+        return a["busy"].get<double>() > b["busy"].get<double>();
+      return a["buffers_per_s"].get<double>() > b["buffers_per_s"].get<double>();
+    });
+    njson ret = njson::array();
+    for (size_t i = 0; i < rows.size() && (int) i < this->_policy.top; i++)
+      ret.push_back(rows[i]);
+    return ret;
+  }
+
+  /**
+   * @brief format a report as a table for the logs
+   * @param report the output of report()
+   * @return one line per element
+   */
+  inline static std::string table(const njson &report)
+  {
+    std::ostringstream oss;
+    oss << std::left << std::setw(40) << "element" << std::setw(20) << "factory" << std::right << std::setw(8) << "busy%" << std::setw(10)
+        << "proc_ms" << std::setw(10) << "buf/s" << std::setw(12) << "KB/s" << std::setw(8) << "fill%";
+    for (const auto &row : report) {
+      oss << "\n" << std::left << std::setw(40) << row["element"].get<std::string>() << std::setw(20) << row["factory"].get<std::string>()
+          << std::right << std::fixed << std::setprecision(1) << std::setw(8) << row["busy"].get<double>() * 100 << std::setprecision(3)
+          << std::setw(10) << row["proc_ms"].get<double>() << std::setprecision(1) << std::setw(10) << row["buffers_per_s"].get<double>()
+          << std::setw(12) << row["bytes_per_s"].get<double>() / 1024;
+      if (row.contains("queue_fill"))
+        oss << std::setw(8) << row["queue_fill"].get<double>() * 100;
+    }
+    return oss.str();
+  }
+
+ private:
+  ProfilerPolicy _policy;
+  std::atomic<bool> _enabled;
+  std::vector<std::unique_ptr<ElementStats>> _elements;
+  std::mutex _lock;
+};
+
+/**
+ * @struct ProbeData
+ * @brief data handed to the probes of an element
+ */
+struct ProbeData {
+  Profiler *profiler;
+  ElementStats *stats;
+};
+
+/**
+ * @brief sink pad probe: a buffer (or buffer list) enters the element
+ */
+inline GstPadProbeReturn sinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  ProbeData *probe = (ProbeData *) data;
+  if (probe->profiler->enabled())
+    enterChain(chainStack(), probe->stats, g_get_monotonic_time());
+  return GST_PAD_PROBE_OK;
+}
+
+/**
+ * @brief src pad probe: the element pushes a buffer (or buffer list)
+ */
+inline GstPadProbeReturn srcProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  ProbeData *probe = (ProbeData *) data;
+  if (!probe->profiler->enabled())
+    return GST_PAD_PROBE_OK;
+  leaveChain(chainStack(), probe->stats, g_get_monotonic_time());
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+    countPush(probe->stats, gst_buffer_list_length(list), gst_buffer_list_calculate_size(list));
+  }
+  else
+    countPush(probe->stats, 1, gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+  return GST_PAD_PROBE_OK;
+}
+
+/**
+ * @brief add the probes to the static pads of an element (bins are skipped, their children are profiled). An element is profiled once.
+ * @param profiler the profiler of the shard
+ * @param element the element
+ * @return true if the element is now profiled
+ */
+inline bool profileElement(Profiler *profiler, GstElement *element)
+{
+  if (GST_IS_BIN(element) || g_object_get_data(G_OBJECT(element), "profiled") != NULL)
+    return false;
+  g_object_set_data(G_OBJECT(element), "profiled", GINT_TO_POINTER(1));
+
+  GstElementFactory *factory = gst_element_get_factory(element);
+  std::string factory_name = factory != NULL ? GST_OBJECT_NAME(factory) : "";
+  gchar *path = gst_object_get_path_string(GST_OBJECT(element));
+  std::string name = path;
+  g_free(path);
+  // drop the pipeline name (/video-player0/srcBin0/src_queue -> srcBin0/src_queue)
+  size_t start = name.find('/', 1);
+  if (start != std::string::npos)
+    name = name.substr(start + 1);
+  ProbeData probe = {.profiler = profiler, .stats = profiler->add(name, factory_name, factory_name == "queue" ? element : NULL)};
+
+  gst_element_foreach_pad(element, [](GstElement *element, GstPad *pad, gpointer data) -> gboolean {
+        GstPadProbeType type = (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST);
+        gst_pad_add_probe(pad, type, GST_PAD_IS_SINK(pad) ? sinkProbe : srcProbe, new ProbeData(*(ProbeData *) data),
+                          [](gpointer data) { delete (ProbeData *) data; });
+        return TRUE;
+      }, &probe);
+  return true;
+}
+
+}  // namespace elementProfiler
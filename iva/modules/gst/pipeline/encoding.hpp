@@ -0,0 +1,186 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <filesystem>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "logging.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace encoding
+ * @brief encoder profiles and muxer selection of the RTMP and file sinks (config.json pipeline['encoder_profiles'])
+ *
+ */
+namespace encoding {
+
+/**
+ * @struct EncoderProfile
+ * @brief settings of the H.264 encoder of a sink bin
+ *
+ * @var name
+ * name of the profile in config.json
+ * @var preset
+ * x264enc speed-preset (ultrafast, superfast, veryfast, faster, fast, medium, slow, ...)
+ * @var tune
+ * x264enc tune flags (zerolatency, fastdecode, stillimage, none)
+ * @var bitrate
+ * target bitrate in kbit/s, 0 encodes with constant quality (crf)
+ * @var crf
+ * constant quality 0..51 (lower is better) used when bitrate is 0
+ * @var key_int
+ * maximum distance between two key frames, in frames
+ * @var threads
+ * encoder threads, 0 lets the encoder decide
+ * @var hardware
+ * use nvv4l2h264enc when the plugin is installed and the pipeline runs the gpu profile (falls back to x264enc otherwise)
+ */
+struct EncoderProfile {
+  std::string name = "realtime";
+  std::string preset = "ultrafast";
+  std::string tune = "zerolatency";
+  int bitrate = 2000;
+  int crf = 23;
+  int key_int = 60;
+  int threads = 2;
+  bool hardware = false;
+};
+
+/**
+ * @brief built-in encoder profiles, config.json can override them or add new ones
+ * @return map of profile name to profile
+ */
+inline std::map<std::string, EncoderProfile> defaultProfiles()
+{
+  std::map<std::string, EncoderProfile> profiles;
+  profiles["realtime"] = EncoderProfile();
+  profiles["balanced"] = EncoderProfile{.name = "balanced", .preset = "veryfast", .tune = "zerolatency", .bitrate = 4000, .crf = 23, .key_int = 60, .threads = 4, .hardware = false};
+  profiles["quality"] = EncoderProfile{.name = "quality", .preset = "medium", .tune = "none", .bitrate = 0, .crf = 20, .key_int = 120, .threads = 0, .hardware = false};
+  profiles["hardware"] = EncoderProfile{.name = "hardware", .preset = "ultrafast", .tune = "zerolatency", .bitrate = 4000, .crf = 23, .key_int = 60, .threads = 0, .hardware = true};
+  return profiles;
+}
+
+/**
+ * @brief parse an encoder profile from config.json, missing keys keep the value of profile
+ * @param name the name of the profile
+ * @param conf the profile object
+ * @param profile the profile to fill in
+ * @return false (and logs the reason) if a key has the wrong type or range
+ */
+inline bool parseProfile(const std::string &name, const njson &conf, EncoderProfile &profile)
+{
+  if (!conf.is_object()) {
+    LOG(ERROR) << "Invalid config.json element! pipeline['encoder_profiles']['" << name << "'] must be an object";
+    return false;
+  }
+  profile.name = name;
+  try {
+    if (conf.contains("preset"))
+      profile.preset = conf["preset"].get<std::string>();
+    if (conf.contains("tune"))
+      profile.tune = conf["tune"].get<std::string>();
+    if (conf.contains("bitrate"))
+      profile.bitrate = conf["bitrate"].get<int>();
+    if (conf.contains("crf"))
+      profile.crf = conf["crf"].get<int>();
+    if (conf.contains("key_int"))
+      profile.key_int = conf["key_int"].get<int>();
+    if (conf.contains("threads"))
+      profile.threads = conf["threads"].get<int>();
+    if (conf.contains("hardware"))
+      profile.hardware = conf["hardware"].get<bool>();
+  } catch (njson::type_error &e) {
+    LOG(ERROR) << "Invalid config.json element! pipeline['encoder_profiles']['" << name << "'] has a wrong type: " << e.what();
+    return false;
+  }
+  if (profile.bitrate < 0 || profile.crf < 0 || profile.crf > 51 || profile.key_int < 1 || profile.threads < 0) {
+    LOG(ERROR) << "Invalid config.json element! pipeline['encoder_profiles']['" << name
+               << "'] must have bitrate >= 0, crf in [0, 51], key_int >= 1 and threads >= 0";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief check if the hardware encoder can be used
+ * @param profile the encoder profile
+ * @param element_profile name of the pipeline element profile (gpu|cpu)
+ * @return true if the profile asks for it, the pipeline runs on the gpu and nvv4l2h264enc is installed
+ */
+inline bool useHardware(const EncoderProfile &profile, const std::string &element_profile)
+{
+  if (!profile.hardware || element_profile != "gpu")
+    return false;
+  GstElementFactory *factory = gst_element_factory_find("nvv4l2h264enc");
+  if (factory == NULL) {
+    LOG(WARNING) << "Encoder profile=" << profile.name << " asks for nvv4l2h264enc which is not installed, using x264enc";
+    return false;
+  }
+  gst_object_unref(factory);
+  return true;
+}
+
+/**
+ * @brief create the H.264 encoder of a profile
+ * @param name name of the element
+ * @param profile the encoder profile
+ * @param hardware create nvv4l2h264enc instead of x264enc (refer to useHardware)
+ * @return the configured encoder
+ */
+inline GstElement *createEncoder(const std::string &name, const EncoderProfile &profile, bool hardware)
+{
+  GstElement *encoder;
+  if (hardware) {
+    encoder = gst_element_factory_make("nvv4l2h264enc", name.c_str());
+    // nvv4l2h264enc has no constant quality mode, keep its default bitrate
+    if (profile.bitrate > 0)
+      g_object_set(encoder, "bitrate", (guint) profile.bitrate * 1000, NULL);
+    g_object_set(encoder, "iframeinterval", (guint) profile.key_int, NULL);
+    return encoder;
+  }
+
+  encoder = gst_element_factory_make("x264enc", name.c_str());
+  gst_util_set_object_arg(G_OBJECT(encoder), "speed-preset", profile.preset.c_str());
+  if (profile.tune != "none")
+    gst_util_set_object_arg(G_OBJECT(encoder), "tune", profile.tune.c_str());
+  if (profile.bitrate > 0) {
+    gst_util_set_object_arg(G_OBJECT(encoder), "pass", "cbr");
+    g_object_set(encoder, "bitrate", (guint) profile.bitrate, NULL);
+  } else {
+    // constant quality (x264 crf), pass=quant would fix the quantizer of every frame instead
+    gst_util_set_object_arg(G_OBJECT(encoder), "pass", "qual");
+    g_object_set(encoder, "quantizer", (guint) profile.crf, NULL);
+  }
+  g_object_set(encoder,
+               "key-int-max", (guint) profile.key_int,
+               "threads", (guint) profile.threads,
+               NULL);
+  return encoder;
+}
+
+/**
+ * @brief create the muxer matching the container of a sink location
+ * @param name name of the element
+ * @param location rtmp:// uri or output file (.mp4, .mkv or .flv)
+ * @return flvmux for rtmp and .flv, mp4mux for .mp4, matroskamux for .mkv
+ */
+inline GstElement *createMuxer(const std::string &name, const std::string &location)
+{
+  if (location.rfind("rtmp://", 0) == 0) {
+    GstElement *mux = gst_element_factory_make("flvmux", name.c_str());
+    g_object_set(mux, "streamable", true, NULL);
+    return mux;
+  }
+  std::string extension = std::filesystem::path(location).extension().string();
+  if (extension == ".mp4")
+    return gst_element_factory_make("mp4mux", name.c_str());
+  if (extension == ".mkv")
+    return gst_element_factory_make("matroskamux", name.c_str());
+  return gst_element_factory_make("flvmux", name.c_str());
+}
+
+}  // namespace encoding
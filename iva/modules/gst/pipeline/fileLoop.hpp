@@ -0,0 +1,134 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "logging.hpp"
+
+/**
+ * @namespace fileLoop
+ * @brief looping playback of file sources (config.json pipeline['loop']): the end of the file is hidden from the pipeline, the source
+ *  bin seeks back to the start and its timestamps keep increasing, so a few sample files can drive a sustained load
+ *
+ */
+namespace fileLoop {
+
+/**
+ * @struct LoopState
+ * @brief playback state of a looping source, written from the streaming thread of its src_queue (atomics)
+ *
+ * @var offset
+ * added to the timestamps of the current pass (sum of the durations of the previous passes)
+ * @var end
+ * end of the last buffer of the current pass, in the timestamps of the file
+ * @var seeking
+ * true from the end of a pass until the segment of the seek, the flush and segment events of the seek are dropped
+ * @var loops
+ * number of passes completed
+ * @var stop
+ * set when the pipeline stops (refer to Pipeline::_on_stop_signal), the next EOS ends the source instead of a new pass
+ */
+struct LoopState {
+  std::atomic<uint64_t> offset = 0;
+  std::atomic<uint64_t> end = 0;
+  std::atomic<bool> seeking = false;
+  std::atomic<uint64_t> loops = 0;
+  std::atomic<bool> stop = false;
+};
+
+/**
+ * @brief account for a buffer of the current pass
+ * @param state the loop state
+ * @param pts timestamp of the buffer in the file
+ * @param duration duration of the buffer (GST_CLOCK_TIME_NONE if unknown)
+ * @return the timestamp of the buffer in the pipeline
+ */
+inline uint64_t markBuffer(LoopState &state, uint64_t pts, uint64_t duration)
+{
+  uint64_t end = pts + (duration != GST_CLOCK_TIME_NONE ? duration : 0);
+  uint64_t previous = state.end.load(std::memory_order_relaxed);
+  while (end > previous && !state.end.compare_exchange_weak(previous, end)) {}
+  return pts + state.offset.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief end the current pass: the next pass starts where this one ended
+ * @param state the loop state
+ * @return the offset of the next pass
+ */
+inline uint64_t endPass(LoopState &state)
+{
+  state.loops++;
+  state.seeking = true;
+  uint64_t end = state.end.exchange(0);
+  return state.offset.fetch_add(end) + end;
+}
+
+/**
+ * @brief pad probe (src pad of src_queue, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH)
+ *  that replaces the EOS of the file by a seek to its start, unless the loop was stopped
+ * @param pad the src pad of src_queue
+ * @param info the buffer or event
+ * @param data the LoopState of the source
+ * @return GST_PAD_PROBE_DROP for the EOS (while looping) and the events of the seek
+ */
+inline GstPadProbeReturn loopProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  LoopState *state = (LoopState *) data;
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_PTS_IS_VALID(buffer))
+      return GST_PAD_PROBE_OK;
+    uint64_t offset = state->offset.load(std::memory_order_relaxed);
+    markBuffer(*state, GST_BUFFER_PTS(buffer), GST_BUFFER_DURATION(buffer));
+    // the first pass is left untouched
+    if (offset == 0)
+      return GST_PAD_PROBE_OK;
+    buffer = gst_buffer_make_writable(buffer);
+    GST_BUFFER_PTS(buffer) += offset;
+    if (GST_BUFFER_DTS_IS_VALID(buffer))
+      GST_BUFFER_DTS(buffer) += offset;
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_EOS: {
+      // the shutdown EOS drains the pipeline
+      if (state->stop)
+        return GST_PAD_PROBE_OK;
+      uint64_t offset = endPass(*state);
+      GstElement *queue = gst_pad_get_parent_element(pad);
+      VLOG(DEBUG) << "Looping " << (queue ? GST_ELEMENT_NAME(GST_ELEMENT_PARENT(queue)) : "source") << " (loops=" << state->loops
+                  << ", offset=" << offset / GST_MSECOND << "ms)";
+      if (queue != NULL) {
+        // the seek flushes the source bin, it cannot run on its streaming thread
+        gst_element_call_async(queue, [](GstElement *queue, gpointer data) {
+              GstPad *src = gst_element_get_static_pad(queue, "src");
+              if (!gst_pad_send_event(src, gst_event_new_seek(1.0, GST_FORMAT_TIME, (GstSeekFlags) (GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
+                                                              GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE)))
+                LOG(WARNING) << "Could not seek " << GST_ELEMENT_NAME(GST_ELEMENT_PARENT(queue)) << " back to its start";
+              gst_object_unref(src);
+            }, NULL, NULL);
+        gst_object_unref(queue);
+      }
+      return GST_PAD_PROBE_DROP;
+    }
+    case GST_EVENT_FLUSH_START:
+    case GST_EVENT_FLUSH_STOP:
+      return state->seeking ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+    case GST_EVENT_SEGMENT:
+      // the pipeline keeps the segment of the first pass, the timestamps are shifted instead
+      if (state->seeking.exchange(false))
+        return GST_PAD_PROBE_DROP;
+      return GST_PAD_PROBE_OK;
+    default:
+      return GST_PAD_PROBE_OK;
+  }
+}
+
+}  // namespace fileLoop
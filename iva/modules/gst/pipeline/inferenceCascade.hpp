@@ -0,0 +1,264 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "logging.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace inferenceCascade
+ * @brief the nvinfer stages of the gpu inference bin (config.json pipeline['inference']): a primary detector on the full frames,
+ *  then secondary stages (classifiers, landmarks, ...) that only run on the objects of the classes and size they need. The tracker
+ *  sits between the primary and the secondaries, so a secondary classifies a tracked object once instead of on every frame.
+ *
+ */
+namespace inferenceCascade {
+
+/**
+ * @struct InferenceStage
+ * @brief an nvinfer element of the cascade
+ *
+ * @var name
+ * name of the stage, secondary results are reported under it in the payload
+ * @var config
+ * nvinfer config file (absolute, or relative to the model directory)
+ * @var class_ids
+ * secondary: classes of the primary the stage runs on, empty runs on every class
+ * @var min_size
+ * secondary: objects smaller than min_size pixels (width or height) are skipped, 0 keeps the value of the config file
+ * @var interval
+ * primary: batches skipped between two inferences; secondary: frames before a tracked object is classified again. -1 keeps the
+ *  value of the config file
+ */
+struct InferenceStage {
+  std::string name;
+  std::string config;
+  std::vector<int> class_ids;
+  int min_size = 0;
+  int interval = -1;
+};
+
+/**
+ * @brief the cascade without pipeline['inference']: the detector of model/detection.yml
+ * @param model_dir the model directory
+ */
+inline std::vector<InferenceStage> defaultCascade(const std::string &model_dir)
+{
+  return {InferenceStage{.name = "detector", .config = model_dir + "/detection.yml"}};
+}
+
+/**
+ * @brief read pipeline['inference']
+ * @param conf the list of stages, the first is the primary detector
+ * @param model_dir directory of the relative config files
+ * @param stages set to the cascade
+ * @param error set to the reason the list is invalid
+ * @return false if the list is invalid
+ */
+inline bool parseCascade(const njson &conf, const std::string &model_dir, std::vector<InferenceStage> &stages, std::string &error)
+{
+  stages.clear();
+  if (!conf.is_array() || conf.empty()) {
+    error = " must be a non-empty list of stages (the primary detector first)";
+    return false;
+  }
+  for (size_t i = 0; i < conf.size(); i++) {
+    const njson &sc = conf[i];
+    std::string where = "[" + std::to_string(i) + "]";
+    if (!sc.is_object() || !sc.contains("config") || !sc["config"].is_string()) {
+      error = where + " must be an object with a config file";
+      return false;
+    }
+    InferenceStage stage;
+    stage.name = sc.value("name", i == 0 ? std::string("detector") : "secondary" + std::to_string(i));
+    stage.config = sc["config"].get<std::string>();
+    if (!stage.config.empty() && stage.config[0] != '/')
+      stage.config = model_dir + "/" + stage.config;
+    if (sc.contains("class_ids")) {
+      if (!sc["class_ids"].is_array()) {
+        error = where + "['class_ids'] must be a list of class ids";
+        return false;
+      }
+      for (const auto &id : sc["class_ids"]) {
+        if (!id.is_number_integer() || id.get<int>() < 0) {
+          error = where + "['class_ids'] must be a list of class ids";
+          return false;
+        }
+        stage.class_ids.push_back(id.get<int>());
+      }
+    }
+    for (const char *key : {"min_size", "interval"}) {
+      if (sc.contains(key) && (!sc[key].is_number_integer() || sc[key].get<int>() < 0)) {
+        error = where + "['" + key + "'] must be an integer >= 0";
+        return false;
+      }
+    }
+    stage.min_size = sc.value("min_size", 0);
+    stage.interval = sc.value("interval", -1);
+    if (i == 0 && (!stage.class_ids.empty() || stage.min_size > 0)) {
+      error = where + " is the primary detector, class_ids and min_size only apply to secondary stages";
+      return false;
+    }
+    for (const auto &other : stages) {
+      if (other.name == stage.name) {
+        error = where + " has the name of another stage (" + stage.name + ")";
+        return false;
+      }
+    }
+    stages.push_back(stage);
+  }
+  return true;
+}
+
+/**
+ * @brief the operate-on-class-ids of nvinfer
+ * @return the ids separated by ':' (e.g. 0:2)
+ */
+inline std::string classIds(const std::vector<int> &ids)
+{
+  std::string ret;
+  for (int id : ids)
+    ret += (ret.empty() ? "" : ":") + std::to_string(id);
+  return ret;
+}
+
+/**
+ * @brief set input-object-min-width/height in the text of an nvinfer config (yaml `property:` or ini `[property]`). These are
+ *  not properties of the nvinfer element, so they can only be set in its config file.
+ * @param text the config
+ * @param min_size minimum width and height of the objects
+ * @return the config with the minimum size, the text unchanged if it has no property group
+ */
+inline std::string withMinObjectSize(const std::string &text, int min_size)
+{
+  std::istringstream in(text);
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(in, line);)
+    lines.push_back(line);
+
+  auto key = [](const std::string &line) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#')
+      return std::string();
+    size_t end = line.find_first_of(":=", start);
+    std::string ret = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    return ret.substr(0, ret.find_last_not_of(" \t") + 1);
+  };
+  bool yaml = true;
+  size_t group = lines.size();
+  for (size_t i = 0; i < lines.size() && group == lines.size(); i++) {
+    if (lines[i].rfind("property:", 0) == 0)
+      group = i;
+    else if (lines[i].rfind("[property]", 0) == 0)
+      group = i, yaml = false;
+  }
+  if (group == lines.size())
+    return text;
+
+  // the group ends at the next top-level key (yaml) or section (ini)
+  size_t end = group + 1;
+  std::string indent = "  ";
+  for (; end < lines.size(); end++) {
+    const std::string &line = lines[end];
+    if (key(line).empty())
+      continue;
+    bool top = yaml ? (line[0] != ' ' && line[0] != '\t') : line[0] == '[';
+    if (top)
+      break;
+    if (yaml)
+      indent = line.substr(0, line.find_first_not_of(" \t"));
+  }
+  std::vector<std::string> ret(lines.begin(), lines.begin() + group + 1);
+  for (const std::string &name : {"input-object-min-width", "input-object-min-height"})
+    ret.push_back(yaml ? indent + name + ": " + std::to_string(min_size) : name + "=" + std::to_string(min_size));
+  for (size_t i = group + 1; i < lines.size(); i++) {
+    std::string name = key(lines[i]);
+    if (i < end && (name == "input-object-min-width" || name == "input-object-min-height"))
+      continue;
+    ret.push_back(lines[i]);
+  }
+  std::string out;
+  for (const auto &line : ret)
+    out += line + "\n";
+  return out;
+}
+
+/**
+ * @brief the config file nvinfer loads for a stage: the config of the stage, or a copy next to it (relative paths of the config
+ *  stay valid) with the minimum object size of the stage
+ * @return the path, empty if the copy could not be written
+ */
+inline std::string stageConfig(const InferenceStage &stage)
+{
+  if (stage.min_size <= 0)
+    return stage.config;
+  std::ifstream in(stage.config);
+  std::stringstream text;
+  text << in.rdbuf();
+  std::filesystem::path path(stage.config);
+  std::string derived = (path.parent_path() / ("." + stage.name + "_iva" + path.extension().string())).string();
+  std::ofstream out(derived, std::ios::out | std::ios::trunc);
+  out << withMinObjectSize(text.str(), stage.min_size);
+  if (!out.good()) {
+    LOG(ERROR) << "Could not write " << derived << " (min_size of the inference stage " << stage.name << ")";
+    return "";
+  }
+  return derived;
+}
+
+/**
+ * @brief name of the nvinfer element of a stage: nv_detection for the primary (refer to the inference governor), nv_secondary<i>
+ */
+inline std::string elementName(size_t index)
+{
+  return index == 0 ? "nv_detection" : "nv_secondary" + std::to_string(index);
+}
+
+/**
+ * @brief create the nvinfer element of a stage. The unique id of a stage is its position in the cascade (the primary is 1), the
+ *  secondaries run on the objects of the primary.
+ * @param stage the stage
+ * @param index position of the stage in the cascade
+ * @param batch_size batch size of the primary (the secondaries batch objects, their config file sets it)
+ * @return the element
+ */
+inline GstElement *createStage(const InferenceStage &stage, size_t index, int batch_size)
+{
+  std::string config = stageConfig(stage);
+  if (config.empty())
+    LOG(FATAL) << "Could not create the config of the inference stage " << stage.name;
+  GstElement *infer = gst_element_factory_make("nvinfer", elementName(index).c_str());
+  g_object_set(infer,
+               "config-file-path", config.c_str(),
+               "unique-id", (guint) index + 1,
+               "qos", 1,
+               NULL);
+  if (index == 0) {
+    g_object_set(infer, "batch-size", batch_size, NULL);
+    if (stage.interval >= 0)
+      g_object_set(infer, "interval", (guint) stage.interval, NULL);
+  }
+  else {
+    g_object_set(infer, "process-mode", 2, "infer-on-gie-id", 1, NULL);
+    if (!stage.class_ids.empty())
+      g_object_set(infer, "infer-on-class-ids", classIds(stage.class_ids).c_str(), NULL);
+    if (stage.interval >= 0) {
+      if (g_object_class_find_property(G_OBJECT_GET_CLASS(infer), "secondary-reinfer-interval") != NULL)
+        g_object_set(infer, "secondary-reinfer-interval", (guint) stage.interval, NULL);
+      else
+        LOG(WARNING) << "nvinfer has no secondary-reinfer-interval, the interval of the inference stage " << stage.name << " is ignored";
+    }
+  }
+  VLOG(DEBUG) << "Created inference stage " << stage.name << " (" << elementName(index) << ", config=" << config << ")";
+  return infer;
+}
+
+}  // namespace inferenceCascade
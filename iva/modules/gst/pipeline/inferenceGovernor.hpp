@@ -0,0 +1,241 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace inferenceGovernor
+ * @brief load-adaptive nvinfer interval (config.json pipeline['inference_governor']): under overload the detector skips batches
+ *  and the tracker fills the gaps instead of frames being dropped by QoS. The control loop only sees load signals, so it is tested
+ *  with synthetic loads.
+ *
+ */
+namespace inferenceGovernor {
+
+/**
+ * @struct GovernorPolicy
+ * @brief limits of the governor
+ *
+ * @var adaptive
+ * run the governor (otherwise nvinfer keeps the interval of detection.yml)
+ * @var min_interval
+ * lowest interval the governor sets (0 infers every batch)
+ * @var max_interval
+ * highest interval the governor sets
+ * @var interval_ms
+ * period of the governor
+ * @var high_load
+ * load above which the interval is raised
+ * @var low_load
+ * load below which the interval is lowered
+ * @var raise_after
+ * consecutive periods over high_load before the interval is raised
+ * @var lower_after
+ * consecutive periods under low_load before the interval is lowered
+ */
+struct GovernorPolicy {
+  bool adaptive = false;
+  int min_interval = 0;
+  int max_interval = 4;
+  int interval_ms = 1000;
+  double high_load = 0.9;
+  double low_load = 0.5;
+  int raise_after = 2;
+  int lower_after = 5;
+};
+
+/**
+ * @struct LoadSignals
+ * @brief load of a shard measured over one period of the governor
+ *
+ * @var qos_messages
+ * QoS messages (late or dropped buffers) posted on the shard's bus
+ * @var queue_fill
+ * fill (0..1) of the fullest queue in front of the inference
+ * @var busy
+ * time the batches spent in nvinfer over the length of the period (above 1 nvinfer falls behind)
+ */
+struct LoadSignals {
+  uint64_t qos_messages = 0;
+  double queue_fill = 0;
+  double busy = 0;
+};
+
+/**
+ * @brief combine the load signals into a single load level
+ * @param signals the signals of one period
+ * @return the load, at least 1 (overloaded) when frames were dropped by QoS
+ */
+inline double loadLevel(const LoadSignals &signals)
+{
+  double load = std::max(signals.queue_fill, signals.busy);
+  if (signals.qos_messages > 0)
+    load = std::max(load, 1.0);
+  return load;
+}
+
+/**
+ * @class InferenceGovernor
+ * @brief raises the interval when the load stays high and lowers it when the load stays low and would remain under high_load once
+ *  the detector runs more often. Called periodically from the shard's main context, never from streaming threads.
+ */
+class InferenceGovernor {
+ public:
+  /**
+   * @param policy the limits
+   * @param interval the interval nvinfer starts with (from detection.yml)
+   */
+  explicit InferenceGovernor(GovernorPolicy policy = GovernorPolicy(), int interval = 0) : _policy(policy), _interval(interval) {}
+
+  /**
+   * @brief update the governor with the load of the last period
+   * @param signals the load signals
+   * @return the interval nvinfer must run with
+   */
+  int update(const LoadSignals &signals)
+  {
+    this->_load = loadLevel(signals);
+    this->_overloaded = this->_load > this->_policy.high_load ? this->_overloaded + 1 : 0;
+    this->_underloaded = this->_load < this->_policy.low_load ? this->_underloaded + 1 : 0;
+
+    if (this->_overloaded >= this->_policy.raise_after && this->_interval < this->_policy.max_interval) {
+      this->_interval = std::max(this->_interval + 1, this->_policy.min_interval);
+      this->_overloaded = 0;
+      this->_raised++;
+    } else if (this->_underloaded >= this->_policy.lower_after && this->_interval > this->_policy.min_interval) {
+      // inferring 1 batch out of interval instead of interval + 1 costs (interval + 1) / interval more
+      double expected = this->_interval > 0 ? this->_load * (this->_interval + 1) / this->_interval : this->_load;
+      if (expected < this->_policy.high_load) {
+        this->_interval = std::min(this->_interval - 1, this->_policy.max_interval);
+        this->_lowered++;
+      }
+      this->_underloaded = 0;
+    }
+    return this->_interval;
+  }
+
+  /**
+   * @brief interval nvinfer must run with
+   * @return the number of batches skipped between two inferred batches
+   */
+  int interval() const { return this->_interval; }
+
+  /**
+   * @brief state of the governor for logging and reporting
+   * @return json with the interval, the last load and the number of changes
+   */
+  njson to_json() const
+  {
+    njson ret;
+    ret["interval"] = this->_interval;
+    ret["load"] = this->_load;
+    ret["raised"] = this->_raised;
+    ret["lowered"] = this->_lowered;
+    return ret;
+  }
+
+ private:
+  GovernorPolicy _policy;
+  int _interval;
+  double _load = 0;
+  int _overloaded = 0;
+  int _underloaded = 0;
+  uint64_t _raised = 0;
+  uint64_t _lowered = 0;
+};
+
+/**
+ * @struct ElementTiming
+ * @brief time buffers spend inside an element, written from its sink and src pad probes (atomics). Buffers are matched by address,
+ *  so buffers dropped inside the element only leave a stale slot.
+ *
+ * @var buffers
+ * address of the buffers in flight (ring)
+ * @var entered
+ * time every buffer of the ring entered the element
+ * @var next
+ * next slot of the ring
+ * @var busy_us
+ * time spent in the element by the buffers that left it since the last takeBusyUs
+ */
+struct ElementTiming {
+  static constexpr int SLOTS = 64;
+  std::array<std::atomic<const void *>, SLOTS> buffers{};
+  std::array<std::atomic<int64_t>, SLOTS> entered{};
+  std::atomic<uint64_t> next = 0;
+  std::atomic<int64_t> busy_us = 0;
+};
+
+/**
+ * @brief record a buffer entering the element (sink pad probe)
+ * @param timing the timing of the element
+ * @param buffer the buffer
+ * @param now_us monotonic time
+ */
+inline void enterElement(ElementTiming &timing, const void *buffer, int64_t now_us)
+{
+  int slot = (int) (timing.next.fetch_add(1, std::memory_order_relaxed) % ElementTiming::SLOTS);
+  timing.entered[slot].store(now_us, std::memory_order_relaxed);
+  timing.buffers[slot].store(buffer, std::memory_order_release);
+}
+
+/**
+ * @brief record a buffer leaving the element (src pad probe)
+ * @param timing the timing of the element
+ * @param buffer the buffer, the same as when it entered (in place elements like nvinfer)
+ * @param now_us monotonic time
+ */
+inline void leaveElement(ElementTiming &timing, const void *buffer, int64_t now_us)
+{
+  for (int slot = 0; slot < ElementTiming::SLOTS; slot++) {
+    const void *expected = buffer;
+    if (timing.buffers[slot].load(std::memory_order_acquire) == buffer &&
+        timing.buffers[slot].compare_exchange_strong(expected, nullptr)) {
+      timing.busy_us.fetch_add(std::max<int64_t>(0, now_us - timing.entered[slot].load(std::memory_order_relaxed)),
+                               std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+/**
+ * @brief time spent in the element since the previous call
+ * @param timing the timing of the element
+ * @return the time in microseconds
+ */
+inline int64_t takeBusyUs(ElementTiming &timing)
+{
+  return timing.busy_us.exchange(0);
+}
+
+/**
+ * @brief fill of a queue from its current level and limits
+ * @param queue a queue element
+ * @return the highest of the buffer and time fills (0..1), 0 if the queue has no limit
+ */
+inline double queueFill(GstElement *queue)
+{
+  guint level_buffers = 0, max_buffers = 0;
+  guint64 level_time = 0, max_time = 0;
+  g_object_get(queue,
+               "current-level-buffers", &level_buffers,
+               "max-size-buffers", &max_buffers,
+               "current-level-time", &level_time,
+               "max-size-time", &max_time,
+               NULL);
+  double fill = 0;
+  if (max_buffers > 0)
+    fill = std::max(fill, (double) level_buffers / max_buffers);
+  if (max_time > 0)
+    fill = std::max(fill, (double) level_time / max_time);
+  return std::min(fill, 1.0);
+}
+
+}  // namespace inferenceGovernor
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "logging.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace latencyBudget
+ * @brief bounds the end to end latency of live pipelines from a single budget (config.json pipeline['latency_budget_ms'])
+ *
+ */
+namespace latencyBudget {
+
+/**
+ * @struct LatencyBudget
+ * @brief share of the budget given to each element that can hold frames
+ *
+ * @var budget_ms
+ * end to end budget, 0 disables the budget (elements keep their defaults)
+ * @var jitterbuffer_ms
+ * rtspsrc jitterbuffer latency, late packets are dropped (drop-on-latency)
+ * @var queue_ms
+ * max-size-time of every queue, queues are leaky and drop their oldest frames when full
+ * @var mux_timeout_us
+ * nvstreammux batched-push-timeout, the longest a partial batch waits for the other sources
+ * @var max_lateness_ms
+ * frames that reach a raw video sink (display) later than this are dropped (sync=true, qos=true)
+ * @var report_ms
+ * period of the latency report of every shard
+ */
+struct LatencyBudget {
+  int budget_ms = 0;
+  int jitterbuffer_ms = 0;
+  int queue_ms = 0;
+  int mux_timeout_us = 40000;
+  int max_lateness_ms = 0;
+  int report_ms = 10000;
+};
+
+/**
+ * @struct LatencyStats
+ * @brief latency measured at a sink, written from its streaming thread (atomics)
+ *
+ * @var budget_ms
+ * the budget the measures are compared to
+ * @var samples
+ * number of frames measured
+ * @var last_us
+ * latency of the last frame
+ * @var average_us
+ * moving average of the latency
+ * @var max_us
+ * highest latency measured
+ * @var over_budget
+ * number of frames that reached the sink over the budget
+ * @var reported_over_budget
+ * over_budget at the previous report
+ */
+struct LatencyStats {
+  int budget_ms = 0;
+  std::atomic<uint64_t> samples = 0;
+  std::atomic<int64_t> last_us = 0;
+  std::atomic<double> average_us = 0;
+  std::atomic<int64_t> max_us = 0;
+  std::atomic<uint64_t> over_budget = 0;
+  std::atomic<uint64_t> reported_over_budget = 0;
+};
+
+/**
+ * @brief split an end to end budget across the jitterbuffer, the queues (one in the source bin, one in the inference branch and one
+ *  in the sink bin), the batching timeout and the sink
+ * @param budget_ms the end to end budget, <= 0 disables the budget
+ * @return the share of every element
+ */
+inline LatencyBudget splitLatencyBudget(int budget_ms)
+{
+  LatencyBudget budget;
+  if (budget_ms <= 0)
+    return budget;
+  budget.budget_ms = budget_ms;
+  budget.jitterbuffer_ms = budget_ms / 4;
+  budget.queue_ms = std::max(1, budget_ms * 3 / 20);
+  // never wait longer for a partial batch than the default timeout
+  budget.mux_timeout_us = std::min(40000, budget_ms * 100);
+  budget.max_lateness_ms = budget_ms / 5;
+  return budget;
+}
+
+/**
+ * @brief check if an element is fed with encoded data (by an encoder, parser or muxer, possibly through queues), which cannot be
+ *  dropped without corrupting the stream
+ * @param element a queue or a sink, already linked upstream
+ * @return true if the first upstream element that is not a queue is an encoder, parser or muxer
+ */
+inline bool isFedEncodedData(GstElement *element)
+{
+  GstElement *current = (GstElement *) gst_object_ref(element);
+  bool encoded = false;
+  while (current != NULL) {
+    GstPad *sinkPad = gst_element_get_static_pad(current, "sink");
+    GstPad *peer = sinkPad ? gst_pad_get_peer(sinkPad) : NULL;
+    GstElement *upstream = peer ? gst_pad_get_parent_element(peer) : NULL;
+    if (peer)
+      gst_object_unref(peer);
+    if (sinkPad)
+      gst_object_unref(sinkPad);
+    gst_object_unref(current);
+    current = NULL;
+    if (upstream == NULL || gst_element_get_factory(upstream) == NULL) {
+      if (upstream)
+        gst_object_unref(upstream);
+      break;
+    }
+    GstElementFactory *factory = gst_element_get_factory(upstream);
+    if (std::string(GST_OBJECT_NAME(factory)) == "queue") {
+      current = upstream;
+      continue;
+    }
+    std::string klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+    encoded = klass.find("Encoder") != std::string::npos || klass.find("Muxer") != std::string::npos ||
+              klass.find("Parser") != std::string::npos;
+    gst_object_unref(upstream);
+  }
+  return encoded;
+}
+
+/**
+ * @brief configure every element of a bin that can hold frames. Recurses into child bins, except rtspsrc which manages its own.
+ * @note idempotent, it is applied again on the whole pipeline when a source is added at runtime. Queues and sinks of encoded data are
+ *  left as is (stale frames are dropped before the encoder).
+ * @param bin the pipeline (or a bin)
+ * @param budget the budget (refer to splitLatencyBudget), nothing is changed when disabled
+ */
+inline void applyLatencyBudget(GstElement *bin, const LatencyBudget &budget)
+{
+  if (budget.budget_ms <= 0 || !GST_IS_BIN(bin))
+    return;
+  GstIterator *it = gst_bin_iterate_elements(GST_BIN(bin));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+    GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+    GstElementFactory *factory = gst_element_get_factory(element);
+    std::string factory_name = factory ? GST_OBJECT_NAME(factory) : "";
+    if (factory_name == "queue" && !isFedEncodedData(element)) {
+      // drop the oldest frames instead of building latency
+      gst_util_set_object_arg(G_OBJECT(element), "leaky", "downstream");
+      g_object_set(element,
+                   "max-size-time", (guint64) budget.queue_ms * GST_MSECOND,
+                   "max-size-buffers", 0,
+                   "max-size-bytes", 0,
+                   NULL);
+    } else if (factory_name == "rtspsrc") {
+      g_object_set(element,
+                   "latency", (guint) budget.jitterbuffer_ms,
+                   "drop-on-latency", TRUE,
+                   NULL);
+    } else if (factory_name == "nvstreammux") {
+      g_object_set(element, "batched-push-timeout", budget.mux_timeout_us, NULL);
+    } else if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK) && !isFedEncodedData(element) &&
+               g_object_class_find_property(G_OBJECT_GET_CLASS(element), "max-lateness") != NULL) {
+      g_object_set(element,
+                   "sync", TRUE,
+                   "qos", TRUE,
+                   "max-lateness", (gint64) budget.max_lateness_ms * GST_MSECOND,
+                   NULL);
+    } else if (GST_IS_BIN(element)) {
+      applyLatencyBudget(element, budget);
+    }
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+/**
+ * @brief latency of a buffer arriving on a pad: time elapsed since its timestamp (the arrival of the frame at the source for live
+ *  sources) on the pipeline clock
+ * @param pad the pad the buffer arrives on (sink pad of a sink)
+ * @param buffer the buffer
+ * @return the latency in microseconds, -1 if it cannot be measured (no clock, timestamp or segment yet)
+ */
+inline int64_t bufferLatencyUs(GstPad *pad, GstBuffer *buffer)
+{
+  if (!GST_BUFFER_PTS_IS_VALID(buffer))
+    return -1;
+  GstElement *element = gst_pad_get_parent_element(pad);
+  if (element == NULL)
+    return -1;
+  GstClock *clock = gst_element_get_clock(element);
+  if (clock == NULL) {
+    gst_object_unref(element);
+    return -1;
+  }
+  GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(element);
+  gst_object_unref(clock);
+  gst_object_unref(element);
+
+  GstEvent *event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+  if (event == NULL)
+    return -1;
+  const GstSegment *segment;
+  gst_event_parse_segment(event, &segment);
+  guint64 running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+  gst_event_unref(event);
+  if (running_time == GST_CLOCK_TIME_NONE)
+    return -1;
+  // a frame ahead of the clock waits in the sink until its running time
+  return now > running_time ? (int64_t) (now - running_time) / 1000 : 0;
+}
+
+/**
+ * @brief record the latency of a frame
+ * @param stats the statistics of the sink
+ * @param latency_us the latency (refer to bufferLatencyUs)
+ * @param alpha weight of the new sample in the moving average
+ */
+inline void recordLatency(LatencyStats &stats, int64_t latency_us, double alpha = 0.05)
+{
+  if (latency_us < 0)
+    return;
+  stats.last_us = latency_us;
+  double average = stats.average_us.load();
+  stats.average_us = stats.samples++ == 0 ? (double) latency_us : alpha * latency_us + (1.0 - alpha) * average;
+  int64_t max = stats.max_us.load();
+  while (latency_us > max && !stats.max_us.compare_exchange_weak(max, latency_us)) {}
+  if (stats.budget_ms > 0 && latency_us > (int64_t) stats.budget_ms * 1000)
+    stats.over_budget++;
+}
+
+/**
+ * @brief latency statistics of a sink for logging and reporting
+ * @param stats the statistics of the sink
+ * @return json with the budget, last/average/max latency (ms) and the fraction of frames over budget
+ */
+inline njson statsToJson(const LatencyStats &stats)
+{
+  njson ret;
+  uint64_t samples = stats.samples.load();
+  ret["budget_ms"] = stats.budget_ms;
+  ret["samples"] = samples;
+  ret["last_ms"] = stats.last_us.load() / 1000.0;
+  ret["average_ms"] = stats.average_us.load() / 1000.0;
+  ret["max_ms"] = stats.max_us.load() / 1000.0;
+  ret["over_budget"] = stats.over_budget.load();
+  ret["over_budget_ratio"] = samples > 0 ? (double) stats.over_budget.load() / (double) samples : 0.0;
+  return ret;
+}
+
+}  // namespace latencyBudget
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace latencyTrace
+ * @brief per-buffer latency of every source from its decoder to its sink (config.json pipeline['trace_latency']). Frames are
+ *  stamped when they leave the decoder and found again by source id and timestamp at the later stages (buffer metas do not survive
+ *  the batching of nvstreammux, the frame metas keep the source id and timestamp). Without the flag no probe is installed.
+ *
+ */
+namespace latencyTrace {
+
+/**
+ * @enum Stage
+ * @brief where the frames are measured, every latency is counted from the decoder output (src_queue sink pad)
+ */
+enum Stage {
+  MUX = 0,    // nv_mux src pad (gpu)
+  TRACKER,    // nv_tracker src pad (gpu), stub detector src pad (cpu)
+  SINK_CAPS,  // sink_caps src pad of the sink bin (overlay)
+  SINK,       // sink pad of the sink (after the encoder for file/rtmp sinks)
+  STAGES
+};
+
+/**
+ * @brief name of a stage in the reports
+ */
+inline std::string stageName(int stage)
+{
+  static const std::array<std::string, STAGES> names = {"mux", "tracker", "sink_caps", "sink"};
+  return stage >= 0 && stage < STAGES ? names[stage] : "unknown";
+}
+
+/**
+ * @struct Histogram
+ * @brief lock-free latency histogram, buckets are a quarter of an octave wide (about 19% resolution) from 1us to hours
+ *
+ * @var counts
+ * samples per bucket
+ * @var samples
+ * total number of samples
+ * @var max_us
+ * highest latency recorded
+ */
+struct Histogram {
+  static constexpr int BUCKETS = 128;
+  std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+  std::atomic<uint64_t> samples = 0;
+  std::atomic<int64_t> max_us = 0;
+};
+
+/**
+ * @brief bucket of a latency
+ * @param latency_us the latency
+ * @return index of the bucket, the upper edge of bucket i is 2^((i + 1) / 4) us
+ */
+inline int bucketOf(int64_t latency_us)
+{
+  if (latency_us <= 1)
+    return 0;
+  int bucket = (int) (std::log2((double) latency_us) * 4.0);
+  return bucket < Histogram::BUCKETS ? bucket : Histogram::BUCKETS - 1;
+}
+
+/**
+ * @brief record a latency
+ * @param histogram the histogram
+ * @param latency_us the latency, negative values are ignored
+ */
+inline void record(Histogram &histogram, int64_t latency_us)
+{
+  if (latency_us < 0)
+    return;
+  histogram.counts[bucketOf(latency_us)].fetch_add(1, std::memory_order_relaxed);
+  histogram.samples.fetch_add(1, std::memory_order_relaxed);
+  int64_t max = histogram.max_us.load(std::memory_order_relaxed);
+  while (latency_us > max && !histogram.max_us.compare_exchange_weak(max, latency_us)) {}
+}
+
+/**
+ * @brief percentile of the recorded latencies
+ * @param histogram the histogram
+ * @param quantile 0..1 (0.5 for the median)
+ * @return the upper edge of the bucket holding the percentile (never above the max), 0 without samples
+ */
+inline int64_t percentile(const Histogram &histogram, double quantile)
+{
+  uint64_t samples = histogram.samples.load(std::memory_order_relaxed);
+  if (samples == 0)
+    return 0;
+  uint64_t rank = (uint64_t) std::ceil(quantile * (double) samples);
+  uint64_t seen = 0;
+  for (int bucket = 0; bucket < Histogram::BUCKETS; bucket++) {
+    seen += histogram.counts[bucket].load(std::memory_order_relaxed);
+    if (seen >= rank && seen > 0) {
+      int64_t edge = (int64_t) std::ceil(std::pow(2.0, (bucket + 1) / 4.0));
+      return std::min(edge, histogram.max_us.load(std::memory_order_relaxed));
+    }
+  }
+  return histogram.max_us.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief percentiles of a histogram for the reports
+ * @return json with samples, p50/p95/p99/max in milliseconds
+ */
+inline njson histogramToJson(const Histogram &histogram)
+{
+  njson ret;
+  ret["samples"] = histogram.samples.load();
+  ret["p50_ms"] = percentile(histogram, 0.50) / 1000.0;
+  ret["p95_ms"] = percentile(histogram, 0.95) / 1000.0;
+  ret["p99_ms"] = percentile(histogram, 0.99) / 1000.0;
+  ret["max_ms"] = histogram.max_us.load() / 1000.0;
+  return ret;
+}
+
+/**
+ * @struct SourceTrace
+ * @brief decoder stamps and stage histograms of a source. The stamps are a table indexed by a hash of the frame timestamp: the decoder
+ *  thread writes, the later stages read, a frame overwritten before it reaches a stage is not measured at that stage.
+ *
+ * @var source_id
+ * global id of the source
+ * @var pts
+ * timestamp of the frame stamped in every slot
+ * @var stamped_us
+ * monotonic time the frame left the decoder
+ * @var stages
+ * latency from the decoder to every stage
+ */
+struct SourceTrace {
+  static constexpr int SLOTS = 256;
+  int source_id = -1;
+  std::array<std::atomic<uint64_t>, SLOTS> pts{};
+  std::array<std::atomic<int64_t>, SLOTS> stamped_us{};
+  std::array<Histogram, STAGES> stages;
+};
+
+/**
+ * @brief slot of a frame timestamp
+ */
+inline int slotOf(uint64_t pts)
+{
+  // frame timestamps are multiples of the frame duration, mix the bits before taking the modulo
+  uint64_t hash = pts * 0x9E3779B97F4A7C15ull;
+  return (int) ((hash >> 32) % SourceTrace::SLOTS);
+}
+
+/**
+ * @brief stamp a frame leaving the decoder
+ * @param trace the trace of the source
+ * @param pts timestamp of the frame
+ * @param now_us monotonic time
+ */
+inline void stamp(SourceTrace &trace, uint64_t pts, int64_t now_us)
+{
+  int slot = slotOf(pts);
+  // the slot is invalidated while it is rewritten
+  trace.pts[slot].store(UINT64_MAX, std::memory_order_relaxed);
+  trace.stamped_us[slot].store(now_us, std::memory_order_relaxed);
+  trace.pts[slot].store(pts, std::memory_order_release);
+}
+
+/**
+ * @brief record the latency of a frame reaching a stage
+ * @param trace the trace of the source
+ * @param stage the stage
+ * @param pts timestamp of the frame
+ * @param now_us monotonic time
+ * @return the latency since the decoder, -1 if the frame was not stamped (or its slot was reused)
+ */
+inline int64_t reach(SourceTrace &trace, int stage, uint64_t pts, int64_t now_us)
+{
+  int slot = slotOf(pts);
+  if (trace.pts[slot].load(std::memory_order_acquire) != pts)
+    return -1;
+  int64_t latency = now_us - trace.stamped_us[slot].load(std::memory_order_relaxed);
+  if (trace.pts[slot].load(std::memory_order_acquire) != pts)
+    return -1;
+  record(trace.stages[stage], latency);
+  return latency;
+}
+
+/**
+ * @class Tracer
+ * @brief the traces of every source, found by source id without locks from the streaming threads (batched stages)
+ */
+class Tracer {
+ public:
+  static constexpr int TABLE = 256;
+
+  /**
+   * @brief the trace of a source, created on first use. Called when the source bin is created (shard context), not from probes.
+   * @param source_id global id of the source
+   * @return the trace (never freed: the probes of a source that is restarted keep using it), NULL if its slot is taken
+   */
+  SourceTrace *add(int source_id)
+  {
+    SourceTrace *trace = this->get(source_id);
+    if (trace != nullptr)
+      return trace;
+    SourceTrace *expected = nullptr;
+    trace = new SourceTrace();
+    trace->source_id = source_id;
+    if (!this->_table[source_id % TABLE].compare_exchange_strong(expected, trace)) {
+      delete trace;
+      return this->get(source_id);
+    }
+    return trace;
+  }
+
+  /**
+   * @brief the trace of a source
+   * @param source_id global id of the source
+   * @return the trace, NULL if the source is not traced
+   */
+  SourceTrace *get(int source_id) const
+  {
+    if (source_id < 0)
+      return nullptr;
+    SourceTrace *trace = this->_table[source_id % TABLE].load(std::memory_order_acquire);
+    return trace != nullptr && trace->source_id == source_id ? trace : nullptr;
+  }
+
+  /**
+   * @brief latency percentiles of every source and stage
+   * @return json keyed by source id then stage name
+   */
+  njson to_json() const
+  {
+    njson ret = njson::object();
+    for (const auto &slot : this->_table) {
+      SourceTrace *trace = slot.load(std::memory_order_acquire);
+      if (trace == nullptr)
+        continue;
+      for (int stage = 0; stage < STAGES; stage++) {
+        if (trace->stages[stage].samples.load() > 0)
+          ret[std::to_string(trace->source_id)][stageName(stage)] = histogramToJson(trace->stages[stage]);
+      }
+    }
+    return ret;
+  }
+
+ private:
+  std::array<std::atomic<SourceTrace *>, TABLE> _table{};
+};
+
+}  // namespace latencyTrace
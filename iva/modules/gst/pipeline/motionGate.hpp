@@ -0,0 +1,275 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "metrics.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace motionGate
+ * @brief skip inference on static cameras (config.json pipeline['motion_gate']). A downscaled grey copy of every decoded frame is
+ *  compared with the previous one on the CPU, before the mux. A batch without motion in any of its sources skips nvinfer: the
+ *  tracker and the sinks still get every frame. A source is inferred at least every keep_alive_s, so objects that stopped moving
+ *  are still reported. The detector only sees grey frames, so it is tested with synthetic video.
+ *
+ */
+namespace motionGate {
+
+/**
+ * @struct MotionPolicy
+ * @brief thresholds of the gate
+ *
+ * @var enable
+ * gate the inference
+ * @var width
+ * width of the grey frames (the height follows the aspect ratio of the pipeline)
+ * @var pixel_threshold
+ * a pixel changed when its grey level moved by more than this (0-255), above the noise of the camera
+ * @var min_changed
+ * fraction of changed pixels that is motion
+ * @var hold_s
+ * seconds a source is inferred after its last motion
+ * @var keep_alive_s
+ * a source is inferred at least every keep_alive_s, even without motion
+ */
+struct MotionPolicy {
+  bool enable = false;
+  int width = 64;
+  int pixel_threshold = 20;
+  double min_changed = 0.005;
+  double hold_s = 1.0;
+  double keep_alive_s = 2.0;
+};
+
+// nvinfer interval of a batch that skips inference (the interval is reset before the next batch that needs it)
+constexpr guint SKIP_INTERVAL = 1u << 30;
+
+/**
+ * @brief number of pixels that differ by more than a threshold (SSE2 or NEON, 16 pixels at a time)
+ * @param a grey pixels
+ * @param b grey pixels
+ * @param n number of pixels
+ * @param threshold grey levels
+ */
+inline size_t countChanged(const uint8_t *a, const uint8_t *b, size_t n, uint8_t threshold)
+{
+  size_t count = 0, i = 0;
+#if defined(__SSE2__)
+  const __m128i limit = _mm_set1_epi8((char) threshold);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+    // |x - y| with saturating subtractions, then |x - y| - threshold saturates to 0 for unchanged pixels
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+    __m128i unchanged = _mm_cmpeq_epi8(_mm_subs_epu8(diff, limit), zero);
+    count += 16 - __builtin_popcount(_mm_movemask_epi8(unchanged));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t limit = vdupq_n_u8(threshold);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+    count += vaddvq_u8(vshrq_n_u8(vcgtq_u8(diff, limit), 7));
+  }
+#endif
+  for (; i < n; i++)
+    count += std::abs((int) a[i] - (int) b[i]) > threshold;
+  return count;
+}
+
+/**
+ * @class MotionDetector
+ * @brief frame differencing of the grey frames of a source
+ */
+class MotionDetector {
+ public:
+  explicit MotionDetector(const MotionPolicy &policy) : _policy(policy) {}
+
+  /**
+   * @brief compare a frame with the previous one
+   * @param grey the grey frame
+   * @param width width of the frame
+   * @param height height of the frame
+   * @param stride bytes per row
+   * @return true if the frame moved (the first frame and a change of size are motion)
+   */
+  bool update(const uint8_t *grey, int width, int height, int stride)
+  {
+    size_t size = (size_t) width * height;
+    this->_current.resize(size);
+    for (int row = 0; row < height; row++)
+      memcpy(this->_current.data() + (size_t) row * width, grey + (size_t) row * stride, width);
+    bool motion = true;
+    if (this->_previous.size() == size && size > 0) {
+      size_t changed = countChanged(this->_current.data(), this->_previous.data(), size, (uint8_t) this->_policy.pixel_threshold);
+      this->changed = (double) changed / (double) size;
+      motion = this->changed >= this->_policy.min_changed;
+    }
+    std::swap(this->_current, this->_previous);
+    return motion;
+  }
+
+  // fraction of changed pixels of the last frame
+  double changed = 1.0;
+
+ private:
+  MotionPolicy _policy;
+  std::vector<uint8_t> _previous;
+  std::vector<uint8_t> _current;
+};
+
+/**
+ * @struct SourceMotion
+ * @brief motion of a source: written by its grey branch, read by the batches before nvinfer
+ *
+ * @var detector
+ * frame differencing (grey branch thread)
+ * @var motion_until_us
+ * the source is inferred until then (last motion + hold_s)
+ * @var inferred_us
+ * last batch of the source that was inferred (nvinfer sink thread)
+ * @var frames
+ * frames of the source that reached nvinfer (iva_motion_frames_total)
+ * @var skipped
+ * frames of the source in batches that skipped nvinfer (iva_motion_skipped_total)
+ */
+struct SourceMotion {
+  int source_id;
+  MotionDetector detector;
+  std::atomic<int64_t> motion_until_us = 0;
+  int64_t inferred_us = 0;
+  std::atomic<uint64_t> *frames;
+  std::atomic<uint64_t> *skipped;
+
+  SourceMotion(int id, const MotionPolicy &policy) : source_id(id), detector(policy)
+  {
+    core::MetricLabels labels = {{"source", std::to_string(id)}};
+    this->frames = &core::Metrics::get().counter("iva_motion_frames_total", "Frames that reached the motion gate of nvinfer.", labels);
+    this->skipped = &core::Metrics::get().counter("iva_motion_skipped_total", "Frames that skipped nvinfer for lack of motion.", labels);
+  }
+};
+
+/**
+ * @brief a grey frame of a source went through the detector
+ * @param source the source
+ * @param motion the frame moved
+ * @param now_us monotonic time
+ * @param policy the thresholds
+ */
+inline void onGreyFrame(SourceMotion &source, bool motion, int64_t now_us, const MotionPolicy &policy)
+{
+  if (motion)
+    source.motion_until_us.store(now_us + (int64_t) (policy.hold_s * 1e6), std::memory_order_relaxed);
+}
+
+/**
+ * @brief the source needs inference: it moved recently, or it was not inferred for keep_alive_s
+ */
+inline bool wantsInference(const SourceMotion &source, int64_t now_us, const MotionPolicy &policy)
+{
+  return now_us < source.motion_until_us.load(std::memory_order_relaxed) ||
+         now_us - source.inferred_us >= (int64_t) (policy.keep_alive_s * 1e6);
+}
+
+/**
+ * @brief decide a batch: it is inferred if any of its sources needs it (nvinfer runs on whole batches)
+ * @param sources the sources of the frames of the batch (NULL for sources that are not gated, they are always inferred)
+ * @param now_us monotonic time
+ * @param policy the thresholds
+ * @return true if the batch goes through nvinfer
+ */
+inline bool decideBatch(const std::vector<SourceMotion *> &sources, int64_t now_us, const MotionPolicy &policy)
+{
+  bool infer = false;
+  for (SourceMotion *source : sources)
+    infer = infer || source == nullptr || wantsInference(*source, now_us, policy);
+  for (SourceMotion *source : sources) {
+    if (source == nullptr)
+      continue;
+    source->frames->fetch_add(1, std::memory_order_relaxed);
+    if (infer)
+      source->inferred_us = now_us;
+    else
+      source->skipped->fetch_add(1, std::memory_order_relaxed);
+  }
+  return infer;
+}
+
+/**
+ * @class Gates
+ * @brief motion of the sources by source id, read from the streaming threads without locks (never freed, like the source stats)
+ */
+class Gates {
+ public:
+  static constexpr int TABLE = 256;
+
+  explicit Gates(const MotionPolicy &policy = MotionPolicy()) : policy(policy) {}
+
+  /**
+   * @brief gate a source, a source id that is added again keeps its counters and starts a new reference frame
+   * @return the motion of the source, NULL if its slot is taken by another source
+   */
+  SourceMotion *add(int source_id)
+  {
+    SourceMotion *current = this->_table[source_id % TABLE].load(std::memory_order_acquire);
+    if (current != nullptr && current->source_id != source_id)
+      return nullptr;
+    SourceMotion *source = new SourceMotion(source_id, this->policy);
+    this->_table[source_id % TABLE].store(source, std::memory_order_release);
+    return source;
+  }
+
+  /**
+   * @brief the motion of a source
+   * @return NULL if the source is not gated
+   */
+  SourceMotion *get(int source_id) const
+  {
+    if (source_id < 0)
+      return nullptr;
+    SourceMotion *source = this->_table[source_id % TABLE].load(std::memory_order_acquire);
+    return source != nullptr && source->source_id == source_id ? source : nullptr;
+  }
+
+  /**
+   * @brief frames and fraction of inference skipped, by source
+   */
+  njson to_json() const
+  {
+    njson ret = njson::object();
+    for (const auto &slot : this->_table) {
+      SourceMotion *source = slot.load(std::memory_order_acquire);
+      if (source == nullptr)
+        continue;
+      uint64_t frames = source->frames->load(std::memory_order_relaxed);
+      uint64_t skipped = source->skipped->load(std::memory_order_relaxed);
+      ret[std::to_string(source->source_id)] = {{"frames", frames}, {"skipped", skipped},
+                                                {"skipped_fraction", frames > 0 ? (double) skipped / (double) frames : 0.0}};
+    }
+    return ret;
+  }
+
+  MotionPolicy policy;
+
+ private:
+  std::array<std::atomic<SourceMotion *>, TABLE> _table{};
+};
+
+}  // namespace motionGate
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @namespace pipelineGraph
+ * @brief plan of a pipeline described as a graph of named nodes and edges (yaml builder, `nodes` and `edges` keys). An output that
+ *  feeds several branches gets a tee, and every branch out of a tee gets its own queue (its own streaming thread), so one decoded
+ *  stream can feed inference, a recorder and a preview without decoding twice. The plan is independent of gstreamer: the yaml builder
+ *  creates the elements and links the pads in the order of the plan.
+ *
+ */
+namespace pipelineGraph {
+
+/**
+ * @struct Node
+ * @brief an element of the graph
+ *
+ * @var alias
+ * name of the element in the pipeline (unique)
+ * @var factory
+ * gstreamer factory of the element
+ */
+struct Node {
+  std::string alias;
+  std::string factory;
+};
+
+/**
+ * @struct Probe
+ * @brief a callback on the buffers of a branch
+ *
+ * @var function_name
+ * the processing callback (probe_callback, osd_callback)
+ */
+struct Probe {
+  std::string function_name;
+};
+
+/**
+ * @struct Edge
+ * @brief a link between two nodes
+ *
+ * @var from
+ * alias of the upstream node
+ * @var from_pad
+ * src pad (or request pad template, e.g. src_%u) of the upstream node, empty for its default src pad
+ * @var to
+ * alias of the downstream node
+ * @var to_pad
+ * sink pad (or request pad template, e.g. sink_%u) of the downstream node, empty for its default sink pad
+ * @var queue_properties
+ * properties (key=value) of the queue inserted on the branch when the edge leaves a tee
+ * @var probes
+ * callbacks on the buffers entering the branch
+ */
+struct Edge {
+  std::string from;
+  std::string from_pad;
+  std::string to;
+  std::string to_pad;
+  std::vector<std::string> queue_properties;
+  std::vector<Probe> probes;
+};
+
+/**
+ * @struct Element
+ * @brief an element inserted by the plan (tee or branch queue)
+ */
+struct Element {
+  std::string alias;
+  std::string factory;
+  std::vector<std::string> properties;
+};
+
+/**
+ * @struct Link
+ * @brief a pad link of the plan, the probes are added to the sink pad once it is linked
+ */
+struct Link {
+  std::string src;
+  std::string src_pad;
+  std::string sink;
+  std::string sink_pad;
+  std::vector<Probe> probes;
+};
+
+/**
+ * @struct Plan
+ * @brief elements to insert and links to make, in order
+ */
+struct Plan {
+  std::vector<Element> elements;
+  std::vector<Link> links;
+};
+
+/**
+ * @brief true if a pad name is a request pad template (e.g. src_%u), every link through it requests a new pad
+ */
+inline bool isTemplate(const std::string &pad)
+{
+  return pad.find('%') != std::string::npos;
+}
+
+/**
+ * @brief check that the edges form a directed acyclic graph of known nodes
+ * @param nodes the nodes
+ * @param edges the edges
+ * @param error set to the reason when the graph is invalid
+ * @return true if valid
+ */
+inline bool validate(const std::vector<Node> &nodes, const std::vector<Edge> &edges, std::string &error)
+{
+  std::map<std::string, int> in_degree;
+  for (const Node &node : nodes) {
+    if (node.alias.empty() || node.factory.empty()) {
+      error = "every node needs a name (factory) and an alias";
+      return false;
+    }
+    if (!in_degree.emplace(node.alias, 0).second) {
+      error = "node alias=" + node.alias + " is used twice";
+      return false;
+    }
+  }
+  std::map<std::string, std::vector<std::string>> next;
+  std::set<std::pair<std::string, std::string>> pads;
+  for (const Edge &edge : edges) {
+    if (!in_degree.count(edge.from) || !in_degree.count(edge.to)) {
+      error = "edge " + edge.from + " -> " + edge.to + " references an unknown node";
+      return false;
+    }
+    if (edge.from == edge.to) {
+      error = "edge " + edge.from + " -> " + edge.to + " links a node to itself";
+      return false;
+    }
+    // a named pad is linked once, templates and default pads can be fanned out
+    if (!edge.from_pad.empty() && !isTemplate(edge.from_pad) && !pads.emplace(edge.from, edge.from_pad).second) {
+      error = "pad " + edge.from + "." + edge.from_pad + " is linked twice, use a tee or omit the pad";
+      return false;
+    }
+    if (!edge.to_pad.empty() && !isTemplate(edge.to_pad) && !pads.emplace(edge.to, edge.to_pad).second) {
+      error = "pad " + edge.to + "." + edge.to_pad + " is linked twice";
+      return false;
+    }
+    next[edge.from].push_back(edge.to);
+    in_degree[edge.to]++;
+  }
+
+  // Kahn: every node is visited once its upstream nodes are, a cycle leaves nodes unvisited
+  std::vector<std::string> ready;
+  for (const auto &[alias, degree] : in_degree) {
+    if (degree == 0)
+      ready.push_back(alias);
+  }
+  size_t visited = 0;
+  while (!ready.empty()) {
+    std::string alias = ready.back();
+    ready.pop_back();
+    visited++;
+    for (const std::string &to : next[alias]) {
+      if (--in_degree[to] == 0)
+        ready.push_back(to);
+    }
+  }
+  if (visited != nodes.size()) {
+    error = "the edges form a cycle";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief plan the elements and links of a graph. An output (node and src pad) with several edges is fanned out through a tee named
+ *  <from>_tee, nodes that are tees already are not given another one. Every edge out of a tee goes through a queue named
+ *  <from>_<to>_queue, unless it goes to a queue (without queue_properties).
+ * @param nodes the nodes
+ * @param edges the edges
+ * @param plan the plan (filled when the graph is valid)
+ * @param error set to the reason when the graph is invalid
+ * @return true if valid
+ */
+inline bool plan(const std::vector<Node> &nodes, const std::vector<Edge> &edges, Plan &plan, std::string &error)
+{
+  if (!validate(nodes, edges, error))
+    return false;
+  std::map<std::string, std::string> factories;
+  for (const Node &node : nodes)
+    factories[node.alias] = node.factory;
+
+  // group the edges by output, in the order of the file
+  std::vector<std::pair<std::string, std::string>> outputs;
+  std::map<std::pair<std::string, std::string>, std::vector<const Edge *>> branches;
+  for (const Edge &edge : edges) {
+    std::pair<std::string, std::string> output = {edge.from, edge.from_pad};
+    if (!branches.count(output))
+      outputs.push_back(output);
+    branches[output].push_back(&edge);
+  }
+
+  plan = Plan();
+  for (const auto &output : outputs) {
+    const std::vector<const Edge *> &out = branches[output];
+    std::string tee = output.first;
+    std::string tee_pad = output.second;
+    bool fan_out = out.size() > 1 && !isTemplate(output.second);
+    if (fan_out && factories[output.first] != "tee") {
+      tee = output.first + "_tee";
+      tee_pad = "src_%u";
+      plan.elements.push_back({.alias = tee, .factory = "tee", .properties = {}});
+      plan.links.push_back({.src = output.first, .src_pad = output.second, .sink = tee, .sink_pad = "", .probes = {}});
+    }
+    else if (factories[output.first] == "tee" && tee_pad.empty()) {
+      tee_pad = "src_%u";
+    }
+    bool from_tee = factories[output.first] == "tee" || tee != output.first;
+    for (const Edge *edge : out) {
+      if (from_tee && (factories[edge->to] != "queue" || !edge->queue_properties.empty())) {
+        std::string queue = output.first + "_" + edge->to + "_queue";
+        plan.elements.push_back({.alias = queue, .factory = "queue", .properties = edge->queue_properties});
+        plan.links.push_back({.src = tee, .src_pad = tee_pad, .sink = queue, .sink_pad = "", .probes = edge->probes});
+        plan.links.push_back({.src = queue, .src_pad = "", .sink = edge->to, .sink_pad = edge->to_pad, .probes = {}});
+      }
+      else {
+        plan.links.push_back({.src = tee, .src_pad = tee_pad, .sink = edge->to, .sink_pad = edge->to_pad, .probes = edge->probes});
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace pipelineGraph
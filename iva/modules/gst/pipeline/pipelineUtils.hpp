@@ -1,15 +1,30 @@
 #pragma once
 
+#include <gst/video/video.h>
+
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <map>
 #include <regex>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 //#include "Application.h"
 #include "date/tz.h"
+#include "encoding.hpp"
+#include "inferenceCascade.hpp"
 #include "logging.hpp"
+#include "metrics.hpp"
+#include "qosStats.hpp"
+#include "recording.hpp"
+#include "sourceHealth.hpp"
+#include "startupTimeline.hpp"
 
 // Declare the global variable from argv[1] in main.cpp
 extern std::string BASE_DIR;
@@ -30,17 +45,66 @@ namespace pipelineUtils {
  * @brief holds application information for bus_call in pipeline
  * @var loop
  * the loop responsible to run the gstreamer pipeline
+ * @var shard_id
+ * the shard (independent pipeline) that owns this bus
  * @var timeout_counter
  * the number of cycles caught where the source was inactive
  * @var timeout_counter_max
  * the maximum number of cycles that can be caught with an inactive source before exiting
+ * @var on_source_error
+ * called with the source id when an error is raised inside a srcBin<id>; returns true if the shard keeps running without that source
+ * @var qos_messages
+ * QoS messages (late or dropped buffers) received since the last period of the inference governor
+ * @var dropped_frames
+ * frames dropped by the elements of the shard (iva_dropped_frames_total{shard}), NULL when not exported
+ * @var qos
+ * QoS of the elements of the shard, by element and stage (summarized every pipeline['qos']['summary_s'])
+ * @var failure
+ * the error that stopped the shard (empty when it stopped on EOS)
+ * @var on_playing
+ * called when the shard reaches PLAYING
  */
 struct BusStruct {
   GMainLoop *loop;
+  int shard_id = 0;
   int timeout_counter = 0;
   int timeout_counter_max = 5;
+  std::function<bool(int source_id)> on_source_error;
+  uint64_t qos_messages = 0;
+  std::atomic<uint64_t> *dropped_frames = NULL;
+  qosStats::ShardQos *qos = NULL;
+  std::string failure;
+  std::function<void()> on_playing;
+};
+
+/**
+ * @struct ElementProfile
+ * @brief the elements used to build the pipeline bins (config.json pipeline['profile'])
+ * @var name
+ * gpu (DeepStream elements) or cpu (software elements, no NVIDIA element is created)
+ * @var decoder
+ * h264 decoder of the source bins
+ * @var converter
+ * first converter of the sink bins (from the inference bin's memory to system memory)
+ */
+struct ElementProfile {
+  std::string name;
+  std::string decoder;
+  std::string converter;
 };
 
+/**
+ * @brief get the elements of a pipeline profile
+ * @param profile gpu or cpu
+ * @return the element profile (gpu if unknown)
+ */
+inline ElementProfile getElementProfile(const std::string &profile)
+{
+  if (profile == "cpu")
+    return {.name = "cpu", .decoder = "avdec_h264", .converter = "videoconvert"};
+  return {.name = "gpu", .decoder = "nvv4l2decoder", .converter = "nvvideoconvert"};
+}
+
 /**
  * @brief Translates link_pad() error code to a human readable error
  * @param status_code a numbered error code that describes the link
@@ -98,7 +162,7 @@ inline static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data)
 
   switch (GST_MESSAGE_TYPE(msg)) {
     case GST_MESSAGE_EOS: {
-      LOG(WARNING) << log_prefix << "EOS (end of stream) ... terminating pipeline";
+      LOG(WARNING) << log_prefix << "EOS (end of stream) ... terminating pipeline shard=" << bus_store->shard_id;
       g_main_loop_quit(loop);
       break;
     }
@@ -137,13 +201,57 @@ inline static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data)
         LOG(ERROR) << log_prefix << "Error: " << error->message;
       }
       g_error_free(error);
+
+      // an error inside a source bin only takes down that source, the other sources of the shard keep streaming
+      int source_id = sourceHealth::sourceIdFromObject(src);
+      if (source_id >= 0 && bus_store->on_source_error && bus_store->on_source_error(source_id)) {
+        LOG(WARNING) << log_prefix << "Isolated source=" << source_id << " on pipeline shard=" << bus_store->shard_id << " (element=" << GST_OBJECT_NAME(src) << ")";
+        break;
+      }
+      LOG(ERROR) << log_prefix << "Terminating pipeline shard=" << bus_store->shard_id << " (element=" << GST_OBJECT_NAME(src) << ")";
+      bus_store->failure = errMsg + " (element=" + GST_OBJECT_NAME(src) + ")";
       g_main_loop_quit(loop);
       break;
     }
+    case GST_MESSAGE_STATE_CHANGED: {
+      // READY -> PLAYING of the whole shard (live pipelines reach PLAYING once every source delivered its preroll)
+      if (GST_IS_PIPELINE(src)) {
+        GstState old_state, new_state;
+        gst_message_parse_state_changed(msg, &old_state, &new_state, NULL);
+        if (new_state == GST_STATE_PLAYING) {
+          core::StartupTimeline::get().mark("shard" + std::to_string(bus_store->shard_id) + "_playing");
+          if (bus_store->on_playing)
+            bus_store->on_playing();
+        }
+      }
+      break;
+    }
+    case GST_MESSAGE_QOS: {
+      // the inference governor reads the count on the same context
+      bus_store->qos_messages++;
+      GstFormat format;
+      guint64 processed, dropped;
+      gint64 jitter;
+      gdouble proportion;
+      gint quality;
+      gst_message_parse_qos_stats(msg, &format, &processed, &dropped);
+      gst_message_parse_qos_values(msg, &jitter, &proportion, &quality);
+      if (bus_store->qos != NULL) {
+        GstElementFactory *factory = GST_IS_ELEMENT(src) ? gst_element_get_factory(GST_ELEMENT(src)) : NULL;
+        uint64_t new_drops = bus_store->qos->record(qosStats::elementPath(src), factory != NULL ? GST_OBJECT_NAME(factory) : "",
+                                                    format == GST_FORMAT_BUFFERS, processed, dropped, jitter, proportion);
+        if (bus_store->dropped_frames != NULL)
+          bus_store->dropped_frames->fetch_add(new_drops, std::memory_order_relaxed);
+      }
+      VLOG(DEEP) << log_prefix << "QoS message from element (" << GST_MESSAGE_SRC_NAME(msg) << "): processed=" << processed
+                 << " dropped=" << dropped << " jitter=" << jitter << "ns proportion=" << proportion;
+      break;
+    }
     case GST_MESSAGE_ELEMENT: {
       const GstStructure *message_structure = gst_message_get_structure(msg);
       const gchar *gst_structure_name = gst_structure_get_name(message_structure);
       VLOG(DEBUG) << log_prefix << "Got message from element (" << GST_MESSAGE_SRC_NAME(msg) << ") message: " << gst_structure_name;
+      break;
     }
     case GST_MESSAGE_NEW_CLOCK: {
       VLOG(DEBUG) << log_prefix << "Starting pipeline clock, resetting connection timeout";
@@ -290,31 +398,115 @@ inline bool doesFileExist(const std::string &filepath)
   return f.good();
 }
 
-inline GstElement* createMp4SrcBin(std::string binName, std::string filesrcLocation)
+/**
+ * @brief the decoder of a parsed stream for a pipeline profile
+ * @param media_type media type of the parsed stream (video/x-h264, video/x-h265 or image/jpeg)
+ * @param profile the element profile (gpu decodes every codec with nvv4l2decoder)
+ * @return the decoder factory name, empty if the codec is not supported
+ */
+inline std::string selectDecoder(const std::string &media_type, const ElementProfile &profile)
+{
+  bool gpu = profile.name == "gpu";
+  if (media_type == "video/x-h264")
+    return profile.decoder;
+  if (media_type == "video/x-h265")
+    return gpu ? "nvv4l2decoder" : "avdec_h265";
+  if (media_type == "image/jpeg")
+    return gpu ? "nvv4l2decoder" : "jpegdec";
+  return "";
+}
+
+/**
+ * @brief dynamic callback of the parsebin of a file source bin: the first supported video stream is decoded into src_queue,
+ *  the other streams (audio, data, extra video) are discarded into a fakesink
+ *
+ * @param parsebin the parsebin on which a pad is being added
+ * @param src_pad the parsed stream
+ * @param data the file source bin (refer to createFileSrcBin)
+ */
+inline void on_parsebin_pad_added(GstElement *parsebin, GstPad *src_pad, gpointer data)
+{
+  GstElement *bin = (GstElement *)data;
+  std::string bin_name = GST_ELEMENT_NAME(bin);
+  GstCaps *caps = gst_pad_get_current_caps(src_pad);
+  if (caps == NULL)
+    caps = gst_pad_query_caps(src_pad, NULL);
+  std::string media_type = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+  gst_caps_unref(caps);
+
+  ElementProfile profile = getElementProfile((const char *) g_object_get_data(G_OBJECT(bin), "profile"));
+  std::string decoder_name = selectDecoder(media_type, profile);
+  GstElement *queue = gst_bin_get_by_name(GST_BIN(bin), "src_queue");
+  GstPad *queue_pad = gst_element_get_static_pad(queue, "sink");
+  bool video = g_str_has_prefix(media_type.c_str(), "video/") || media_type == "image/jpeg";
+  bool linked = gst_pad_is_linked(queue_pad);
+  gst_object_unref(queue_pad);
+
+  GstElement *sink_element;
+  if (video && !linked && !decoder_name.empty()) {
+    LOG(INFO) << "[on_parsebin_pad_added]\n -- decoding " << media_type << " with " << decoder_name << " (bin=" << bin_name << ")";
+    sink_element = gst_element_factory_make(decoder_name.c_str(), "src_decoder");
+    if (media_type == "image/jpeg" && g_object_class_find_property(G_OBJECT_GET_CLASS(sink_element), "mjpeg") != NULL)
+      g_object_set(sink_element, "mjpeg", TRUE, NULL);
+    gst_bin_add(GST_BIN(bin), sink_element);
+    if (!gst_element_link(sink_element, queue))
+      LOG(FATAL) << "[on_parsebin_pad_added]\n -- Failed to link elements in bin=" << bin_name << ": Elements=(" << decoder_name << ", queue)";
+    // passthrough recording: the encoded stream is teed in front of the decoder (refer to pipeline['record'])
+    recording::Passthrough *record = (recording::Passthrough *) g_object_get_data(G_OBJECT(bin), "recording");
+    GstElement *tee = record != NULL ? recording::teeToRecording(bin, sink_element, media_type, record) : NULL;
+    if (tee != NULL) {
+      gst_element_sync_state_with_parent(sink_element);
+      sink_element = tee;
+    }
+  } else {
+    if (video && decoder_name.empty())
+      LOG(ERROR) << "[on_parsebin_pad_added]\n -- unsupported codec " << media_type << " in bin=" << bin_name << " (supported: H.264, H.265, MJPEG)";
+    else
+      VLOG(DEBUG) << "[on_parsebin_pad_added]\n -- discarding stream " << media_type << " (bin=" << bin_name << ")";
+    sink_element = gst_element_factory_make("fakesink", NULL);
+    g_object_set(sink_element, "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add(GST_BIN(bin), sink_element);
+  }
+  gst_object_unref(queue);
+
+  gst_element_sync_state_with_parent(sink_element);
+  GstPad *sink_pad = gst_element_get_static_pad(sink_element, "sink");
+  GstPadLinkReturn ret = gst_pad_link(src_pad, sink_pad);
+  if (GST_PAD_LINK_FAILED(ret))
+    LOG(ERROR) << "[on_parsebin_pad_added]\n -- [FAILURE] dynamic link for bin=(" << bin_name << "): " << pipelineUtils::get_link_status(ret);
+  gst_object_unref(sink_pad);
+}
+
+/**
+ * @brief create a file source bin: filesrc -> parsebin -> decoder -> queue. parsebin detects the container (mp4, mkv, ts) and the
+ *  codec, the decoder is chosen when the stream is exposed (refer to selectDecoder)
+ * @param binName name of the bin (srcBin<id>)
+ * @param filesrcLocation absolute path to the video file
+ * @param profile the element profile
+ * @return the bin, its output is the ghost pad output0
+ */
+inline GstElement* createFileSrcBin(std::string binName, std::string filesrcLocation, const ElementProfile &profile = getElementProfile("gpu"))
 {
 	// create bin
 	GstElement* bin = gst_bin_new(binName.c_str());
-	// create elements
-	GstElement *filesrc, *qtdemux, *h264parse, *nvv4l2decoder, *queue;
+	g_object_set_data_full(G_OBJECT(bin), "profile", g_strdup(profile.name.c_str()), g_free);
+	// create elements (the decoder is added once parsebin exposes the video stream)
+	GstElement *filesrc, *parsebin, *queue;
 	filesrc = gst_element_factory_make("filesrc", "source");
-	qtdemux = gst_element_factory_make("qtdemux", "src_demux");
-	h264parse = gst_element_factory_make("h264parse", "src_parser");
-	nvv4l2decoder = gst_element_factory_make("nvv4l2decoder", "src_decoder");
+	parsebin = gst_element_factory_make("parsebin", "src_parsebin");
 	queue = gst_element_factory_make("queue", "src_queue");
 
 	// set properties
 	g_object_set(filesrc, "location", filesrcLocation.c_str(), NULL);
 	// set dynamic callback for 'sometimes' pad
-	g_signal_connect(qtdemux, "pad-added", G_CALLBACK(pipelineUtils::on_pad_added), (gpointer)bin);
+	g_signal_connect(parsebin, "pad-added", G_CALLBACK(pipelineUtils::on_parsebin_pad_added), (gpointer)bin);
 
 	// add elements to the bin
-	gst_bin_add_many(GST_BIN(bin), filesrc, qtdemux, h264parse, nvv4l2decoder, queue, NULL);
+	gst_bin_add_many(GST_BIN(bin), filesrc, parsebin, queue, NULL);
 
 	// link elements
-	if (!gst_element_link(filesrc, qtdemux))
-		LOG(FATAL) << "Failed to link elements in bin=" << binName << ": Elements=(filesrc, qtdemux)";
-	if(gst_element_link_many(h264parse, nvv4l2decoder, queue, NULL) != TRUE)
-		LOG(FATAL) << "Failed to link many elements in bin=" << binName << ": Elements=(h264parse, nvv4l2decoder, queue)";
+	if (!gst_element_link(filesrc, parsebin))
+		LOG(FATAL) << "Failed to link elements in bin=" << binName << ": Elements=(filesrc, parsebin)";
 
 	// Add ghost pads to access src in bin for future linking
 	std::string ghostPadName = "output0";
@@ -366,7 +558,7 @@ inline GstElement* createV4l2SrcBin(std::string binName, std::string deviceId)
 	return bin;
 }
 
-inline GstElement* createRtspSrcBin(std::string binName, std::string rtsp_url)
+inline GstElement* createRtspSrcBin(std::string binName, std::string rtsp_url, const ElementProfile &profile = getElementProfile("gpu"))
 {
     // create bin
     GstElement* bin = gst_bin_new(binName.c_str());
@@ -378,7 +570,7 @@ inline GstElement* createRtspSrcBin(std::string binName, std::string rtsp_url)
 
     source_depay = gst_element_factory_make("rtph264depay", "source_depay");
     src_parse = gst_element_factory_make("h264parse", "src_parse");
-    src_decoder = gst_element_factory_make("nvv4l2decoder", "src_decoder");
+    src_decoder = gst_element_factory_make(profile.decoder.c_str(), "src_decoder");
     src_queue = gst_element_factory_make("queue", "src_queue");
 
     // add elements to the bin
@@ -411,9 +603,274 @@ inline GstElement* createRtspSrcBin(std::string binName, std::string rtsp_url)
     return bin;
 }
 
-inline GstElement* createInferenceBinToStreamDemux(std::string binName, int num_src, int width, int height, bool live_source)
+/**
+ * @brief pad probe of the cpu profile stub detector: attaches one synthetic detection (GstVideoRegionOfInterestMeta, label=stub)
+ *  that sweeps across the frame, and numbers the frames (GST_BUFFER_OFFSET) like nvstreammux does
+ * @param pad sink pad of stub_detector_<id>
+ * @param info the buffer
+ * @param data frame counter of the source (guint64)
+ * @return GST_PAD_PROBE_OK
+ */
+inline GstPadProbeReturn stubDetectorProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  guint64 *frame = (guint64 *) data;
+  GstVideoInfo video_info;
+  GstCaps *caps = gst_pad_get_current_caps(pad);
+  if (caps == NULL || !gst_video_info_from_caps(&video_info, caps)) {
+    if (caps != NULL)
+      gst_caps_unref(caps);
+    return GST_PAD_PROBE_OK;
+  }
+  gst_caps_unref(caps);
+  int width = GST_VIDEO_INFO_WIDTH(&video_info);
+  int height = GST_VIDEO_INFO_HEIGHT(&video_info);
+
+  GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+  GST_PAD_PROBE_INFO_DATA(info) = buf;
+  GST_BUFFER_OFFSET(buf) = (*frame)++;
+
+  // one box of a fifth of the frame, moving 4 pixels per frame
+  guint w = width / 5, h = height / 5;
+  guint x = (guint) ((*frame * 4) % (guint64) std::max(1, width - (int) w));
+  guint y = (height - h) / 2;
+  GstVideoRegionOfInterestMeta *roi = gst_buffer_add_video_region_of_interest_meta(buf, "stub", x, y, w, h);
+  roi->id = 0;
+  gst_video_region_of_interest_meta_add_param(roi, gst_structure_new("detection", "confidence", G_TYPE_DOUBLE, 0.9, NULL));
+  return GST_PAD_PROBE_OK;
+}
+
+/**
+ * @brief add the branch of a source to a cpu inference bin: queue -> videoscale -> videoconvert -> capsfilter -> identity (stub detector),
+ *  exposed as ghost pads input<id> and output<id>. Can be called while the bin is PLAYING to add a source at runtime.
+ *
+ * @param bin the inference bin (from createCpuInferenceBin)
+ * @param source_id global id of the source
+ */
+inline void addCpuInferenceBinSource(GstElement *bin, int source_id)
+{
+  std::string binName = GST_ELEMENT_NAME(bin);
+  std::string id = std::to_string(source_id);
+  int width = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(bin), "width"));
+  int height = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(bin), "height"));
+
+  // create elements
+  GstElement *cpu_queue, *cpu_scale, *cpu_convert, *cpu_caps, *stub_detector;
+  cpu_queue = gst_element_factory_make("queue", ("cpu_queue_" + id).c_str());
+  cpu_scale = gst_element_factory_make("videoscale", ("cpu_scale_" + id).c_str());
+  cpu_convert = gst_element_factory_make("videoconvert", ("cpu_convert_" + id).c_str());
+  cpu_caps = gst_element_factory_make("capsfilter", ("cpu_caps_" + id).c_str());
+  std::string caps = "video/x-raw,width=(int)" + std::to_string(width) + ",height=(int)" + std::to_string(height);
+  g_object_set(cpu_caps,
+               "caps", gst_caps_from_string(caps.c_str()),
+               NULL);
+  stub_detector = gst_element_factory_make("identity", ("stub_detector_" + id).c_str());
+
+  // add elements to the bin
+  gst_bin_add_many(GST_BIN(bin), cpu_queue, cpu_scale, cpu_convert, cpu_caps, stub_detector, NULL);
+  if(!gst_element_link_many(cpu_queue, cpu_scale, cpu_convert, cpu_caps, stub_detector, NULL))
+    LOG(FATAL) << "Failed to add elements to bin=" << binName << " for source=" << source_id;
+
+  // synthetic detections
+  GstPad *detectorPad = gst_element_get_static_pad(stub_detector, "sink");
+  gst_pad_add_probe(detectorPad, GST_PAD_PROBE_TYPE_BUFFER, stubDetectorProbe, g_new0(guint64, 1), g_free);
+  gst_object_unref(detectorPad);
+
+  // create ghost pads for the input (queue sink) and output (stub detector src)
+  std::string inputGhostPadName = (std::string) "input" + id;
+  std::string outputGhostPadName = (std::string) "output" + id;
+  GstPad *inputBinPad = gst_element_get_static_pad(cpu_queue, "sink");
+  GstPad *outputBinPad = gst_element_get_static_pad(stub_detector, "src");
+  GstPad *inputGhostPad = gst_ghost_pad_new(inputGhostPadName.c_str(), inputBinPad);
+  GstPad *outputGhostPad = gst_ghost_pad_new(outputGhostPadName.c_str(), outputBinPad);
+  if (inputGhostPad == NULL || outputGhostPad == NULL)
+    LOG(FATAL) << "Could not create the ghostPads for bin=" << binName << ", ghostPadNames=(" << inputGhostPadName << ", " << outputGhostPadName << ")";
+  gst_pad_set_active (GST_PAD_CAST (inputGhostPad), 1);
+  gst_pad_set_active (GST_PAD_CAST (outputGhostPad), 1);
+  if (!gst_element_add_pad(bin, inputGhostPad) || !gst_element_add_pad(bin, outputGhostPad))
+    LOG(FATAL) << "Could not add the ghostPads to bin=" << binName << ", ghostPadNames=(" << inputGhostPadName << ", " << outputGhostPadName << ")";
+  gst_object_unref(inputBinPad);
+  gst_object_unref(outputBinPad);
+
+  // follow the bin's state when added at runtime
+  for (GstElement *element : {cpu_queue, cpu_scale, cpu_convert, cpu_caps, stub_detector})
+    gst_element_sync_state_with_parent(element);
+  VLOG(DEBUG) << "Added cpu inference branch to bin=" << binName << " for source=" << source_id;
+}
+
+/**
+ * @brief remove the branch of a source from a cpu inference bin (ghost pads input<id>/output<id> and its elements)
+ * @note the source bin must already be in GST_STATE_NULL (refer to Pipeline::remove_source)
+ *
+ * @param bin the inference bin (from createCpuInferenceBin)
+ * @param source_id global id of the source
+ */
+inline void removeCpuInferenceBinSource(GstElement *bin, int source_id)
+{
+  std::string id = std::to_string(source_id);
+  for (std::string padName : {"input" + id, "output" + id}) {
+    GstPad *ghostPad = gst_element_get_static_pad(bin, padName.c_str());
+    if (ghostPad != NULL) {
+      gst_element_remove_pad(bin, ghostPad);
+      gst_object_unref(ghostPad);
+    }
+  }
+  for (std::string name : {"cpu_queue_" + id, "cpu_scale_" + id, "cpu_convert_" + id, "cpu_caps_" + id, "stub_detector_" + id}) {
+    GstElement *element = gst_bin_get_by_name(GST_BIN(bin), name.c_str());
+    if (element == NULL)
+      continue;
+    gst_element_set_state(element, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(bin), element);
+    gst_object_unref(element);
+  }
+  VLOG(DEBUG) << "Removed cpu inference branch from bin=" << GST_ELEMENT_NAME(bin) << " for source=" << source_id;
+}
+
+/**
+ * @brief create the inference bin of the cpu profile: one branch per source (scale to the configured size, stub detector) instead of
+ *  nvstreammux -> nvinfer -> nvtracker -> nvstreamdemux. The ghost pads are named input<id> and output<id>, like the gpu inference bin.
+ *
+ * @param binName name of the bin
+ * @param source_ids global ids of the sources handled by this bin
+ * @param width output width of every branch
+ * @param height output height of every branch
+ * @return the bin
+ */
+inline GstElement* createCpuInferenceBin(std::string binName, const std::vector<int> &source_ids, int width, int height)
+{
+  GstElement* bin = gst_bin_new(binName.c_str());
+  g_object_set_data(G_OBJECT(bin), "width", GINT_TO_POINTER(width));
+  g_object_set_data(G_OBJECT(bin), "height", GINT_TO_POINTER(height));
+  for (int i : source_ids)
+    addCpuInferenceBinSource(bin, i);
+  return bin;
+}
+
+/**
+ * @brief request the nvstreammux sink_<id> and nvstreamdemux src_<id> pads of an inference bin and expose them as ghost pads
+ *  input<id> and output<id>. Can be called while the bin is PLAYING to add a source at runtime. Falls back to
+ *  addCpuInferenceBinSource for a cpu inference bin.
+ *
+ * @param bin the inference bin (from createInferenceBinToStreamDemux)
+ * @param source_id global id of the source
+ */
+inline void addInferenceBinSource(GstElement *bin, int source_id)
+{
+  std::string binName = GST_ELEMENT_NAME(bin);
+  GstElement *nv_mux = gst_bin_get_by_name(GST_BIN(bin), "nv_mux");
+  // cpu profile
+  if (nv_mux == NULL) {
+    addCpuInferenceBinSource(bin, source_id);
+    return;
+  }
+  GstElement *nv_demux = gst_bin_get_by_name(GST_BIN(bin), "nv_demux");
+
+  // create ghost pad for each input pad (sink)
+  std::string inputPadName = (std::string) "sink_" + std::to_string(source_id);
+  GstPad *inputBinPad = gst_element_get_request_pad(nv_mux, inputPadName.c_str());
+  // Check if the pad was created.
+  if (inputBinPad == NULL)
+    LOG(FATAL) << "Could not get the nvstreammux request pad=" << inputPadName;
+
+  std::string inputGhostPadName = (std::string) "input" + std::to_string(source_id);
+  GstPad *inputGhostPad = gst_ghost_pad_new(inputGhostPadName.c_str(), inputBinPad);
+  if (inputGhostPad == NULL)
+    LOG(FATAL) << "Could not create the ghostPad for bin=" << binName << ", ghostPadName=" << inputGhostPadName;
+
+  if (!gst_element_add_pad(bin, inputGhostPad))
+    LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=" << inputGhostPadName;
+  gst_object_unref(GST_OBJECT(inputBinPad));
+  gst_pad_set_active (GST_PAD_CAST (inputGhostPad), 1);
+  VLOG(DEBUG) << "Added ghost pad to bin=" << binName << " with pad=" << inputGhostPadName;
+  gst_object_unref(nv_mux);
+
+  // the batch goes out whole on output0 when the demux is bypassed (tiled output)
+  if (nv_demux == NULL)
+    return;
+
+  // create ghost pad for each output pad (src)
+  std::string outputPadName = (std::string) "src_" + std::to_string(source_id);
+  GstPad *outputBinPad = gst_element_get_request_pad(nv_demux, outputPadName.c_str());
+  // Check if the pad was created.
+  if (outputBinPad == NULL)
+    LOG(FATAL) << "Could not get the nvstreamdemux request pad=" << outputPadName;
+
+  std::string outputGhostPadName = (std::string) "output" + std::to_string(source_id);
+  GstPad *outputGhostPad = gst_ghost_pad_new(outputGhostPadName.c_str(), outputBinPad);
+  if (outputGhostPad == NULL)
+    LOG(FATAL) << "Could not create the ghostPad for bin=" << binName << ", ghostPadName=" << outputGhostPadName;
+
+  if (!gst_element_add_pad(bin, outputGhostPad))
+    LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=" << outputGhostPadName;
+  gst_object_unref(GST_OBJECT(outputBinPad));
+  gst_pad_set_active (GST_PAD_CAST (outputGhostPad), 1);
+  VLOG(DEBUG) << "Added ghost pad to bin=" << binName << " with pad=" << outputGhostPadName;
+  gst_object_unref(nv_demux);
+}
+
+/**
+ * @brief remove the ghost pads input<id>/output<id> of an inference bin and release the nvstreammux/nvstreamdemux request pads.
+ * @note the source bin must already be in GST_STATE_NULL (refer to Pipeline::remove_source)
+ *
+ * @param bin the inference bin (from createInferenceBinToStreamDemux)
+ * @param source_id global id of the source
+ */
+inline void removeInferenceBinSource(GstElement *bin, int source_id)
+{
+  GstElement *nv_mux = gst_bin_get_by_name(GST_BIN(bin), "nv_mux");
+  // cpu profile
+  if (nv_mux == NULL) {
+    removeCpuInferenceBinSource(bin, source_id);
+    return;
+  }
+  GstElement *nv_demux = gst_bin_get_by_name(GST_BIN(bin), "nv_demux");
+
+  std::string inputGhostPadName = (std::string) "input" + std::to_string(source_id);
+  std::string outputGhostPadName = (std::string) "output" + std::to_string(source_id);
+  GstPad *inputGhostPad = gst_element_get_static_pad(bin, inputGhostPadName.c_str());
+  GstPad *outputGhostPad = gst_element_get_static_pad(bin, outputGhostPadName.c_str());
+  if (inputGhostPad != NULL) {
+    // flush whatever nvstreammux holds for this source before releasing its pad
+    GstPad *muxPad = gst_ghost_pad_get_target(GST_GHOST_PAD(inputGhostPad));
+    gst_pad_send_event(muxPad, gst_event_new_flush_start());
+    gst_pad_send_event(muxPad, gst_event_new_flush_stop(FALSE));
+    gst_element_remove_pad(bin, inputGhostPad);
+    gst_element_release_request_pad(nv_mux, muxPad);
+    gst_object_unref(muxPad);
+    gst_object_unref(inputGhostPad);
+  }
+  if (outputGhostPad != NULL && nv_demux != NULL) {
+    GstPad *demuxPad = gst_ghost_pad_get_target(GST_GHOST_PAD(outputGhostPad));
+    gst_element_remove_pad(bin, outputGhostPad);
+    gst_element_release_request_pad(nv_demux, demuxPad);
+    gst_object_unref(demuxPad);
+    gst_object_unref(outputGhostPad);
+  }
+  gst_object_unref(nv_mux);
+  if (nv_demux != NULL)
+    gst_object_unref(nv_demux);
+  VLOG(DEBUG) << "Removed ghost pads from bin=" << GST_ELEMENT_NAME(bin) << " for source=" << source_id;
+}
+
+/**
+ * @brief create the batched inference bin (nvstreammux -> nvinfer (primary) -> nvtracker -> nvinfer (secondaries) -> nvvideoconvert ->
+ *  nvstreamdemux)
+ * @note mux and demux pads are requested with the global source id (sink_<id>, src_<id>) so that NvDsFrameMeta::source_id
+ *  stays unique across shards. The ghost pads are named input<id> and output<id>. The last element of the cascade is kept as the bin
+ *  data "inference_output" (where the payloads are read, refer to inferenceOutput).
+ *
+ * @param binName name of the bin
+ * @param source_ids global ids of the sources batched by this bin
+ * @param batch_size nvstreammux/nvinfer batch size (>= source_ids.size() to leave room for sources added at runtime)
+ * @param width nvstreammux output width
+ * @param height nvstreammux output height
+ * @param stages the nvinfer stages, the primary detector first (refer to inferenceCascade)
+ * @param live_source true if the sources are live (rtsp)
+ * @param demux false to bypass nvvideoconvert -> nvstreamdemux and output the whole batch on the ghost pad output0 (tiled output)
+ * @return the bin
+ */
+inline GstElement* createInferenceBinToStreamDemux(std::string binName, const std::vector<int> &source_ids, int batch_size, int width, int height,
+                                                   const std::vector<inferenceCascade::InferenceStage> &stages, bool live_source, bool demux = true)
 {
-  std::string detection_file = BASE_DIR + "/model/detection.yml";
   std::string tracker_file = BASE_DIR + "/model/tracker.yml";
 
   // create bin
@@ -428,7 +885,7 @@ inline GstElement* createInferenceBinToStreamDemux(std::string binName, int num_
 #endif
   g_object_set(nv_mux,
                "nvbuf-memory-type", mem_type,
-               "batch-size", num_src,
+               "batch-size", batch_size,
                "width", width,
                "height", height,
                "batched-push-timeout", 40000,
@@ -436,12 +893,7 @@ inline GstElement* createInferenceBinToStreamDemux(std::string binName, int num_
                "live-source", live_source,
                NULL);
 
-  nv_infer = gst_element_factory_make("nvinfer", "nv_detection");
-  g_object_set(nv_infer,
-               "config-file-path",detection_file.c_str(),
-               "batch-size", num_src,
-               "qos", 1,
-               NULL);
+  nv_infer = inferenceCascade::createStage(stages[0], 0, batch_size);
 
   nv_tracker = gst_element_factory_make("nvtracker", "nv_tracker");
   g_object_set(nv_tracker,
@@ -452,72 +904,63 @@ inline GstElement* createInferenceBinToStreamDemux(std::string binName, int num_
                "tracker-height", 480,
                NULL);
 
-//  nv_infer = gst_element_factory_make("nvinfer", "nv_classifier");
-//  g_object_set(nv_infer,
-//               "config-file-path",detection_file.c_str(),
-//               "batch-size", num_src,
-//               "qos", 1,
-//               NULL);
-
-
-  nv_convert = gst_element_factory_make("nvvideoconvert", "nv_convert");
-  nv_demux = gst_element_factory_make("nvstreamdemux", "nv_demux");
-
   // add elements to the bin
-  gst_bin_add_many(GST_BIN(bin), nv_mux, nv_infer, nv_tracker, nv_convert, nv_demux, NULL);
-  if(!gst_element_link_many(nv_mux, nv_infer, nv_tracker, nv_convert, nv_demux, NULL))
+  gst_bin_add_many(GST_BIN(bin), nv_mux, nv_infer, nv_tracker, NULL);
+  if(!gst_element_link_many(nv_mux, nv_infer, nv_tracker, NULL))
     LOG(FATAL) << "Failed to add elements to bin=" << binName;
 
-  // create ghost pad at output for future linking
-  for (int i = 0; i < num_src; i++) {
-    // create ghost pad for each input pad (sink)
-    std::string inputPadName = (std::string) "sink_" + std::to_string(i);
-    GstPad *inputBinPad = gst_element_get_request_pad(nv_mux, inputPadName.c_str());
-    // Check if the pad was created.
-    if (inputBinPad == NULL)
-      LOG(FATAL) << "Could not get the nvstreammux request pad=" << inputPadName;
-
-    std::string inputGhostPadName = (std::string) "input" + std::to_string(i);
-    GstPad *inputGhostPad = gst_ghost_pad_new(inputGhostPadName.c_str(), inputBinPad);
-    if (inputGhostPad == NULL)
-      LOG(FATAL) << "Could not create the ghostPad for bin=" << binName << ", ghostPadName=" << inputGhostPadName;
-
-    if (!gst_element_add_pad(bin, inputGhostPad))
-      LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=" << inputGhostPadName;
-    gst_object_unref(GST_OBJECT(inputBinPad));
-    gst_pad_set_active (GST_PAD_CAST (inputGhostPad), 1);
-    VLOG(DEBUG) << "Added ghost pad to bin=" << binName << " with pad=" << inputGhostPadName;
-
-    // create ghost pad for each output pad (src)
-    std::string outputPadName = (std::string) "src_" + std::to_string(i);
-    GstPad *outputBinPad = gst_element_get_request_pad(nv_demux, outputPadName.c_str());
-    // Check if the pad was created.
-    if (outputBinPad == NULL)
-      LOG(FATAL) << "Could not get the nvstreammux request pad=" << inputPadName;
-
-    std::string outputGhostPadName = (std::string) "output" + std::to_string(i);
-    GstPad *outputGhostPad = gst_ghost_pad_new(outputGhostPadName.c_str(), outputBinPad);
-    if (outputGhostPad == NULL)
-      LOG(FATAL) << "Could not create the ghostPad for bin=" << binName << ", ghostPadName=" << outputGhostPadName;
-
-    if (!gst_element_add_pad(bin, outputGhostPad))
-      LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=" << outputGhostPadName;
-    gst_object_unref(GST_OBJECT(outputBinPad));
+  // the secondary stages classify the tracked objects of the primary
+  GstElement *nv_output = nv_tracker;
+  for (size_t i = 1; i < stages.size(); i++) {
+    GstElement *nv_secondary = inferenceCascade::createStage(stages[i], i, batch_size);
+    gst_bin_add(GST_BIN(bin), nv_secondary);
+    if(!gst_element_link(nv_output, nv_secondary))
+      LOG(FATAL) << "Failed to add the inference stage " << stages[i].name << " to bin=" << binName;
+    nv_output = nv_secondary;
+  }
+  g_object_set_data(G_OBJECT(bin), "inference_output", nv_output);
+
+  if (demux) {
+    nv_convert = gst_element_factory_make("nvvideoconvert", "nv_convert");
+    nv_demux = gst_element_factory_make("nvstreamdemux", "nv_demux");
+    gst_bin_add_many(GST_BIN(bin), nv_convert, nv_demux, NULL);
+    if(!gst_element_link_many(nv_output, nv_convert, nv_demux, NULL))
+      LOG(FATAL) << "Failed to add elements to bin=" << binName;
+  } else {
+    GstPad *outputPad = gst_element_get_static_pad(nv_output, "src");
+    GstPad *outputGhostPad = gst_ghost_pad_new("output0", outputPad);
     gst_pad_set_active (GST_PAD_CAST (outputGhostPad), 1);
-    VLOG(DEBUG) << "Added ghost pad to bin=" << binName << " with pad=" << outputGhostPadName;
+    if (!gst_element_add_pad(bin, outputGhostPad))
+      LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=output0";
+    gst_object_unref(outputPad);
   }
+
+  // create ghost pad at output for future linking
+  for (int i : source_ids)
+    addInferenceBinSource(bin, i);
   return bin;
 }
 
-inline GstElement* createSinkBinToDisplay(std::string binName, bool sync) {
+/**
+ * @brief the last element of the cascade of an inference bin, the payloads are read from its src pad
+ * @param bin the inference bin (from createInferenceBinToStreamDemux)
+ * @return the element (not referenced), NULL for a cpu inference bin
+ */
+inline GstElement* inferenceOutput(GstElement *bin)
+{
+  return (GstElement *) g_object_get_data(G_OBJECT(bin), "inference_output");
+}
+
+inline GstElement* createSinkBinToDisplay(std::string binName, bool sync, const ElementProfile &profile = getElementProfile("gpu")) {
   // create bin
   GstElement* bin = gst_bin_new(binName.c_str());
   // create elements
   GstElement *sink_nvconvert, *sink_convert, *sink_caps, *sink_queue, *sink;
-  sink_nvconvert = gst_element_factory_make("nvvideoconvert", "sink_nvconvert");
-  g_object_set(sink_nvconvert,
-               "compute-hw", 1,
-               NULL);
+  sink_nvconvert = gst_element_factory_make(profile.converter.c_str(), "sink_nvconvert");
+  if (profile.name == "gpu")
+    g_object_set(sink_nvconvert,
+                 "compute-hw", 1,
+                 NULL);
   sink_convert = gst_element_factory_make("videoconvert", "sink_convert");
   sink_caps = gst_element_factory_make("capsfilter", "sink_caps");
   g_object_set(sink_caps,
@@ -553,35 +996,68 @@ inline GstElement* createSinkBinToDisplay(std::string binName, bool sync) {
   return bin;
 }
 
-inline GstElement* createSinkBinToRTMP(std::string binName, std::string uri, bool sync) {
+/**
+ * @brief create a sink bin that encodes to H.264, muxes and writes to a sink element
+ * @param binName name of the bin
+ * @param sinkFactory the sink element (rtmpsink, filesink)
+ * @param location the rtmp uri or output file, also selects the muxer (refer to encoding::createMuxer)
+ * @param sync sync the sink on the clock
+ * @param profile the element profile of the pipeline
+ * @param encoder the encoder profile
+ * @return the sink bin with the ghost pad input0
+ */
+inline GstElement* createEncodedSinkBin(std::string binName, std::string sinkFactory, std::string location, bool sync,
+                                        const ElementProfile &profile, const encoding::EncoderProfile &encoder) {
   // create bin
   GstElement* bin = gst_bin_new(binName.c_str());
+  bool hardware = encoding::useHardware(encoder, profile.name);
   // create elements
-  GstElement *sink_nvconvert, *sink_convert, *sink_caps, *sink_encode, *sink_mux, *sink_queue, *sink;
-  sink_nvconvert = gst_element_factory_make("nvvideoconvert", "sink_nvconvert");
-  g_object_set(sink_nvconvert,
-               "compute-hw", 1,
-               NULL);
+  GstElement *sink_nvconvert, *sink_convert, *sink_caps, *sink_hwconvert = NULL, *sink_hwcaps = NULL, *sink_encode, *sink_parse, *sink_mux, *sink_queue, *sink;
+  sink_nvconvert = gst_element_factory_make(profile.converter.c_str(), "sink_nvconvert");
+  if (profile.name == "gpu")
+    g_object_set(sink_nvconvert,
+                 "compute-hw", 1,
+                 NULL);
+  // the osd callback draws the detections on the YV12 frames of sink_caps
   sink_convert = gst_element_factory_make("videoconvert", "sink_convert");
   sink_caps = gst_element_factory_make("capsfilter", "sink_caps");
   g_object_set(sink_caps,
                "caps", gst_caps_from_string("video/x-raw,format=(string)YV12"),
                NULL);
-  sink_encode = gst_element_factory_make("x264enc", "sink_encode");
-  sink_mux = gst_element_factory_make("flvmux", "sink_mux");
+  if (hardware) {
+    // upload the annotated frames back to NVMM memory for the hardware encoder
+    sink_hwconvert = gst_element_factory_make("nvvideoconvert", "sink_hwconvert");
+    sink_hwcaps = gst_element_factory_make("capsfilter", "sink_hwcaps");
+    g_object_set(sink_hwcaps,
+                 "caps", gst_caps_from_string("video/x-raw(memory:NVMM),format=(string)I420"),
+                 NULL);
+  }
+  sink_encode = encoding::createEncoder("sink_encode", encoder, hardware);
+  sink_parse = gst_element_factory_make("h264parse", "sink_parse");
+  sink_mux = encoding::createMuxer("sink_mux", location);
 
   sink_queue = gst_element_factory_make("queue", "sink_queue");
-  sink = gst_element_factory_make("rtmpsink", "sink");
+  sink = gst_element_factory_make(sinkFactory.c_str(), "sink");
   g_object_set(sink,
                "sync", sync,
                "async", true,
-               "location", uri.c_str(),
+               "location", location.c_str(),
                NULL);
 
   // add elements to the bin
-  gst_bin_add_many(GST_BIN(bin), sink_nvconvert, sink_convert, sink_caps, sink_encode, sink_mux, sink_queue, sink, NULL);
-  if(!gst_element_link_many(sink_nvconvert, sink_convert, sink_caps, sink_encode, sink_mux, sink_queue, sink, NULL))
+  gst_bin_add_many(GST_BIN(bin), sink_nvconvert, sink_convert, sink_caps, sink_encode, sink_parse, sink_mux, sink_queue, sink, NULL);
+  bool linked;
+  if (hardware) {
+    gst_bin_add_many(GST_BIN(bin), sink_hwconvert, sink_hwcaps, NULL);
+    linked = gst_element_link_many(sink_nvconvert, sink_convert, sink_caps, sink_hwconvert, sink_hwcaps, sink_encode, sink_parse, sink_mux,
+                                   sink_queue, sink, NULL);
+  } else {
+    linked = gst_element_link_many(sink_nvconvert, sink_convert, sink_caps, sink_encode, sink_parse, sink_mux, sink_queue, sink, NULL);
+  }
+  if (!linked)
     LOG(FATAL) << "Failed to add elements to bin=" << binName;
+  VLOG(DEBUG) << "Created bin=" << binName << " with encoder profile=" << encoder.name << " (" << (hardware ? "nvv4l2h264enc" : "x264enc")
+              << ") and muxer=" << GST_OBJECT_NAME(gst_element_get_factory(sink_mux));
 
   // create ghost pad at output for future linking
   std::string inputPadName = "sink";
@@ -603,55 +1079,266 @@ inline GstElement* createSinkBinToRTMP(std::string binName, std::string uri, boo
   return bin;
 }
 
+inline GstElement* createSinkBinToRTMP(std::string binName, std::string uri, bool sync, const ElementProfile &profile = getElementProfile("gpu"),
+                                       const encoding::EncoderProfile &encoder = encoding::EncoderProfile()) {
+  return createEncodedSinkBin(binName, "rtmpsink", uri, sync, profile, encoder);
+}
 
-inline GstElement* createSinkBinToFile(std::string binName, std::string fileName, bool sync) {
-  // create bin
+inline GstElement* createSinkBinToFile(std::string binName, std::string fileName, bool sync, const ElementProfile &profile = getElementProfile("gpu"),
+                                       const encoding::EncoderProfile &encoder = encoding::EncoderProfile()) {
+  return createEncodedSinkBin(binName, "filesink", fileName, sync, profile, encoder);
+}
+
+/**
+ * @brief create a sink bin that drops the decoded frames of a source recorded in passthrough (refer to pipeline['record']), the
+ *  recording itself is in the source bin
+ * @param binName name of the bin
+ * @return the sink bin with the ghost pad input0
+ */
+inline GstElement* createSinkBinToFakesink(std::string binName) {
   GstElement* bin = gst_bin_new(binName.c_str());
-  // create elements
-  GstElement *sink_nvconvert, *sink_convert, *sink_caps, *sink_encode, *sink_mux, *sink_queue, *sink;
-  sink_nvconvert = gst_element_factory_make("nvvideoconvert", "sink_nvconvert");
-  g_object_set(sink_nvconvert,
-               "compute-hw", 1,
-               NULL);
-  sink_convert = gst_element_factory_make("videoconvert", "sink_convert");
+  GstElement *sink_queue = gst_element_factory_make("queue", "sink_queue");
+  GstElement *sink = gst_element_factory_make("fakesink", "sink");
+  g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+  gst_bin_add_many(GST_BIN(bin), sink_queue, sink, NULL);
+  if(!gst_element_link(sink_queue, sink))
+    LOG(FATAL) << "Failed to add elements to bin=" << binName;
+
+  GstPad *inputBinPad = gst_element_get_static_pad(sink_queue, "sink");
+  if (!gst_element_add_pad(bin, gst_ghost_pad_new("input0", inputBinPad)))
+    LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=input0";
+  gst_object_unref(GST_OBJECT(inputBinPad));
+  return bin;
+}
+
+/**
+ * @struct TileLayout
+ * @brief layout of the mosaic of a tiled sink (config.json pipeline['tiler'])
+ *
+ * @var rows
+ * rows of tiles, 0 picks a square grid that fits every source
+ * @var columns
+ * columns of tiles, 0 picks a square grid that fits every source
+ * @var width
+ * width of the mosaic
+ * @var height
+ * height of the mosaic
+ */
+struct TileLayout {
+  int rows = 0;
+  int columns = 0;
+  int width = 1920;
+  int height = 1080;
+};
+
+/**
+ * @brief fill in the rows/columns left to 0 so that the grid holds a number of tiles
+ * @param layout the configured layout
+ * @param tiles number of tiles to fit (pipeline['max_sources'])
+ * @return the layout with rows and columns >= 1
+ */
+inline TileLayout computeTileLayout(TileLayout layout, int tiles) {
+  tiles = std::max(tiles, 1);
+  if (layout.rows <= 0 && layout.columns <= 0)
+    layout.columns = (int) std::ceil(std::sqrt((double) tiles));
+  if (layout.columns <= 0)
+    layout.columns = (tiles + layout.rows - 1) / layout.rows;
+  if (layout.rows <= 0)
+    layout.rows = (tiles + layout.columns - 1) / layout.columns;
+  return layout;
+}
+
+/**
+ * @brief position of a tile in the mosaic, row major (same order as nvmultistreamtiler)
+ * @param layout the layout (from computeTileLayout)
+ * @param tile index of the tile (the source id)
+ * @param x left of the tile
+ * @param y top of the tile
+ * @param width width of the tile
+ * @param height height of the tile
+ * @return false if the tile is outside of the grid
+ */
+inline bool tileRect(const TileLayout &layout, int tile, int &x, int &y, int &width, int &height) {
+  width = layout.width / layout.columns;
+  height = layout.height / layout.rows;
+  x = (tile % layout.columns) * width;
+  y = (tile / layout.columns) * height;
+  return tile >= 0 && tile < layout.rows * layout.columns;
+}
+
+/**
+ * @brief create a tiled sink bin: all sources are composed into one mosaic that is annotated and encoded once.
+ *  gpu: nvmultistreamtiler -> nvvideoconvert -> nvdsosd on the batch of the inference bin (ghost pad input0, the demux is bypassed).
+ *  cpu: compositor fed by one tileBin<id> per source (refer to addTiledSinkBinSource).
+ *
+ * @param binName name of the bin
+ * @param output rtmp uri, output file (.mp4/.mkv) or empty to display the mosaic
+ * @param layout the layout (from computeTileLayout)
+ * @param sync sync the sink on the clock
+ * @param profile the element profile of the pipeline
+ * @param encoder the encoder profile (ignored for display)
+ * @return the bin
+ */
+inline GstElement* createTiledSinkBin(std::string binName, std::string output, const TileLayout &layout, bool sync,
+                                      const ElementProfile &profile, const encoding::EncoderProfile &encoder) {
+  GstElement* bin = gst_bin_new(binName.c_str());
+  g_object_set_data(G_OBJECT(bin), "columns", GINT_TO_POINTER(layout.columns));
+  g_object_set_data(G_OBJECT(bin), "rows", GINT_TO_POINTER(layout.rows));
+  g_object_set_data(G_OBJECT(bin), "width", GINT_TO_POINTER(layout.width));
+  g_object_set_data(G_OBJECT(bin), "height", GINT_TO_POINTER(layout.height));
+
+  // the mosaic is written by a single sink bin, whatever the number of sources
+  GstElement *outputBin;
+  if (output.empty())
+    outputBin = createSinkBinToDisplay("outputBin", sync, profile);
+  else if (output.rfind("rtmp://", 0) == 0)
+    outputBin = createEncodedSinkBin("outputBin", "rtmpsink", output, sync, profile, encoder);
+  else
+    outputBin = createEncodedSinkBin("outputBin", "filesink", output, sync, profile, encoder);
+
+  GstElement *sink_tiler, *sink_osd_convert, *sink_osd, *sink_tiler_caps;
+  if (profile.name == "gpu") {
+    sink_tiler = gst_element_factory_make("nvmultistreamtiler", "sink_tiler");
+    g_object_set(sink_tiler,
+                 "rows", layout.rows,
+                 "columns", layout.columns,
+                 "width", layout.width,
+                 "height", layout.height,
+                 NULL);
+    // nvdsosd draws on RGBA frames
+    sink_osd_convert = gst_element_factory_make("nvvideoconvert", "sink_osd_convert");
+    sink_osd = gst_element_factory_make("nvdsosd", "sink_osd");
+    gst_bin_add_many(GST_BIN(bin), sink_tiler, sink_osd_convert, sink_osd, outputBin, NULL);
+    if(!gst_element_link_many(sink_tiler, sink_osd_convert, sink_osd, outputBin, NULL))
+      LOG(FATAL) << "Failed to add elements to bin=" << binName;
+
+    GstPad *inputBinPad = gst_element_get_static_pad(sink_tiler, "sink");
+    GstPad *inputGhostPad = gst_ghost_pad_new("input0", inputBinPad);
+    gst_pad_set_active (GST_PAD_CAST (inputGhostPad), 1);
+    if (!gst_element_add_pad(bin, inputGhostPad))
+      LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=input0";
+    gst_object_unref(inputBinPad);
+  } else {
+    sink_tiler = gst_element_factory_make("compositor", "sink_tiler");
+    gst_util_set_object_arg(G_OBJECT(sink_tiler), "background", "black");
+    sink_tiler_caps = gst_element_factory_make("capsfilter", "sink_tiler_caps");
+    std::string caps = "video/x-raw,width=(int)" + std::to_string(layout.width) + ",height=(int)" + std::to_string(layout.height);
+    g_object_set(sink_tiler_caps,
+                 "caps", gst_caps_from_string(caps.c_str()),
+                 NULL);
+    gst_bin_add_many(GST_BIN(bin), sink_tiler, sink_tiler_caps, outputBin, NULL);
+    if(!gst_element_link_many(sink_tiler, sink_tiler_caps, outputBin, NULL))
+      LOG(FATAL) << "Failed to add elements to bin=" << binName;
+  }
+  VLOG(DEBUG) << "Created bin=" << binName << " with a " << layout.rows << "x" << layout.columns << " mosaic of " << layout.width << "x"
+              << layout.height << " to output=" << (output.empty() ? "display" : output);
+  return bin;
+}
+
+/**
+ * @brief add the tile of a source to a cpu tiled sink bin: tileBin<id> (videoconvert -> capsfilter YV12 -> videoscale -> capsfilter)
+ *  linked to a compositor pad placed at the tile of the source. Exposed as the ghost pad input<id>.
+ *  The osd callback is added on the sink_caps of tileBin<id>, so detections are drawn at the resolution of the source.
+ *
+ * @param bin the tiled sink bin (from createTiledSinkBin)
+ * @param source_id global id of the source, also the index of its tile
+ * @return the tile bin, NULL if the source has no tile in the layout
+ */
+inline GstElement* addTiledSinkBinSource(GstElement *bin, int source_id) {
+  std::string binName = GST_ELEMENT_NAME(bin);
+  TileLayout layout = {.rows = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(bin), "rows")),
+                       .columns = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(bin), "columns")),
+                       .width = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(bin), "width")),
+                       .height = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(bin), "height"))};
+  int x, y, width, height;
+  if (!tileRect(layout, source_id, x, y, width, height)) {
+    LOG(WARNING) << "Source=" << source_id << " has no tile in the " << layout.rows << "x" << layout.columns << " mosaic of bin=" << binName;
+    return NULL;
+  }
+
+  std::string tileName = (std::string) "tileBin" + std::to_string(source_id);
+  GstElement *tileBin = gst_bin_new(tileName.c_str());
+  GstElement *tile_convert, *sink_caps, *tile_scale, *tile_caps;
+  tile_convert = gst_element_factory_make("videoconvert", "tile_convert");
   sink_caps = gst_element_factory_make("capsfilter", "sink_caps");
   g_object_set(sink_caps,
                "caps", gst_caps_from_string("video/x-raw,format=(string)YV12"),
                NULL);
-  sink_encode = gst_element_factory_make("x264enc", "sink_encode");
-  sink_mux = gst_element_factory_make("flvmux", "sink_mux");
-
-  sink_queue = gst_element_factory_make("queue", "sink_queue");
-  sink = gst_element_factory_make("filesink", "sink");
-  g_object_set(sink,
-               "sync", sync,
-               "async", true,
-               "location", fileName.c_str(),
+  tile_scale = gst_element_factory_make("videoscale", "tile_scale");
+  tile_caps = gst_element_factory_make("capsfilter", "tile_caps");
+  std::string caps = "video/x-raw,width=(int)" + std::to_string(width) + ",height=(int)" + std::to_string(height);
+  g_object_set(tile_caps,
+               "caps", gst_caps_from_string(caps.c_str()),
                NULL);
+  gst_bin_add_many(GST_BIN(tileBin), tile_convert, sink_caps, tile_scale, tile_caps, NULL);
+  if(!gst_element_link_many(tile_convert, sink_caps, tile_scale, tile_caps, NULL))
+    LOG(FATAL) << "Failed to add elements to bin=" << tileName;
+
+  GstPad *convertPad = gst_element_get_static_pad(tile_convert, "sink");
+  GstPad *capsPad = gst_element_get_static_pad(tile_caps, "src");
+  GstPad *tileInputPad = gst_ghost_pad_new("input0", convertPad);
+  GstPad *tileOutputPad = gst_ghost_pad_new("output0", capsPad);
+  gst_pad_set_active (GST_PAD_CAST (tileInputPad), 1);
+  gst_pad_set_active (GST_PAD_CAST (tileOutputPad), 1);
+  gst_element_add_pad(tileBin, tileInputPad);
+  gst_element_add_pad(tileBin, tileOutputPad);
+  gst_object_unref(convertPad);
+  gst_object_unref(capsPad);
+  gst_bin_add(GST_BIN(bin), tileBin);
+
+  // place the tile on the mosaic
+  GstElement *sink_tiler = gst_bin_get_by_name(GST_BIN(bin), "sink_tiler");
+  GstPad *tilerPad = gst_element_get_request_pad(sink_tiler, "sink_%u");
+  g_object_set(tilerPad,
+               "xpos", x,
+               "ypos", y,
+               "width", width,
+               "height", height,
+               NULL);
+  if (gst_pad_link(tileOutputPad, tilerPad) != GST_PAD_LINK_OK)
+    LOG(FATAL) << "Could not link " << tileName << " to the compositor of bin=" << binName;
+  g_object_set_data(G_OBJECT(tileBin), "tiler_pad", tilerPad);
 
-  // add elements to the bin
-  gst_bin_add_many(GST_BIN(bin), sink_nvconvert, sink_convert, sink_caps, sink_encode, sink_mux, sink_queue, sink, NULL);
-  if(!gst_element_link_many(sink_nvconvert, sink_convert, sink_caps, sink_encode, sink_mux, sink_queue, sink, NULL))
-    LOG(FATAL) << "Failed to add elements to bin=" << binName;
-
-  // create ghost pad at output for future linking
-  std::string inputPadName = "sink";
-  GstPad *inputBinPad = gst_element_get_static_pad(sink_nvconvert, inputPadName.c_str());
-  // Check if the pad was created.
-  if (inputBinPad == NULL)
-    LOG(FATAL) << "Could not get the sink_convert static pad=" << inputPadName;
-
-  std::string inputGhostPadName = "input0";
-  GstPad *inputGhostPad = gst_ghost_pad_new(inputGhostPadName.c_str(), inputBinPad);
-  if (inputGhostPad == NULL)
-    LOG(FATAL) << "Could not create the ghostPad for bin=" << binName << ", ghostPadName=" << inputGhostPadName;
-
+  std::string inputGhostPadName = (std::string) "input" + std::to_string(source_id);
+  GstPad *inputGhostPad = gst_ghost_pad_new(inputGhostPadName.c_str(), tileInputPad);
+  gst_pad_set_active (GST_PAD_CAST (inputGhostPad), 1);
   if (!gst_element_add_pad(bin, inputGhostPad))
     LOG(FATAL) << "Could not add the ghostPad to bin=" << binName << ", ghostPadName=" << inputGhostPadName;
-  gst_object_unref(GST_OBJECT(inputBinPad));
-  gst_pad_set_active (GST_PAD_CAST (inputGhostPad), 1);
-  VLOG(DEBUG) << "Added ghost pad to bin=" << binName << " with pad=" << inputGhostPadName;
-  return bin;
+  gst_object_unref(sink_tiler);
+
+  // follow the bin's state when added at runtime
+  gst_element_sync_state_with_parent(tileBin);
+  VLOG(DEBUG) << "Added tile of source=" << source_id << " at (" << x << ", " << y << ") " << width << "x" << height << " to bin=" << binName;
+  return tileBin;
+}
+
+/**
+ * @brief remove the tile of a source from a cpu tiled sink bin and release its compositor pad
+ * @note the source bin must already be in GST_STATE_NULL (refer to Pipeline::remove_source)
+ *
+ * @param bin the tiled sink bin (from createTiledSinkBin)
+ * @param source_id global id of the source
+ */
+inline void removeTiledSinkBinSource(GstElement *bin, int source_id) {
+  std::string inputGhostPadName = (std::string) "input" + std::to_string(source_id);
+  GstPad *inputGhostPad = gst_element_get_static_pad(bin, inputGhostPadName.c_str());
+  if (inputGhostPad != NULL) {
+    gst_element_remove_pad(bin, inputGhostPad);
+    gst_object_unref(inputGhostPad);
+  }
+  std::string tileName = (std::string) "tileBin" + std::to_string(source_id);
+  GstElement *tileBin = gst_bin_get_by_name(GST_BIN(bin), tileName.c_str());
+  if (tileBin == NULL)
+    return;
+  GstElement *sink_tiler = gst_bin_get_by_name(GST_BIN(bin), "sink_tiler");
+  GstPad *tilerPad = (GstPad *) g_object_get_data(G_OBJECT(tileBin), "tiler_pad");
+  gst_element_set_state(tileBin, GST_STATE_NULL);
+  gst_bin_remove(GST_BIN(bin), tileBin);
+  gst_element_release_request_pad(sink_tiler, tilerPad);
+  gst_object_unref(tilerPad);
+  gst_object_unref(sink_tiler);
+  gst_object_unref(tileBin);
+  VLOG(DEBUG) << "Removed tile of source=" << source_id << " from bin=" << GST_ELEMENT_NAME(bin);
 }
 
 // todo: add this logic to a configuration sanitizer
@@ -696,6 +1383,42 @@ inline bool areAllElementsStrings(const njson& jsonArray) {
   return true; // All elements are strings
 }
 
+/**
+ * @brief split the global source ids (0..source_count-1) across shards in round-robin order
+ * @param source_count number of sources in pipeline['sources']
+ * @param shards number of shards (independent pipelines)
+ * @return the source ids of each shard
+ */
+inline std::vector<std::vector<int>> partitionSources(int source_count, int shards) {
+  std::vector<std::vector<int>> partitions(shards);
+  for (int s = 0; s < source_count; s++)
+    partitions[s % shards].push_back(s);
+  return partitions;
+}
+
+/**
+ * @brief run a task on the thread that dispatches a main context and wait for its result.
+ *  Used to change a PLAYING pipeline from outside its shard thread (pad requests, linking, state changes).
+ * @note runs the task in the calling thread if no thread currently owns the context
+ * @param context the main context of a pipeline shard
+ * @param task the task to run
+ * @return the value returned by the task
+ */
+inline bool invokeOnContext(GMainContext *context, std::function<bool()> task) {
+  struct ContextCall {
+    std::function<bool()> task;
+    std::promise<bool> done;
+  };
+  ContextCall call = {.task = task};
+  std::future<bool> result = call.done.get_future();
+  g_main_context_invoke(context, [](gpointer data) -> gboolean {
+        ContextCall *c = (ContextCall *) data;
+        c->done.set_value(c->task());
+        return G_SOURCE_REMOVE;
+      }, (gpointer) &call);
+  return result.get();
+}
+
 inline void displayFilesSaved(const njson& jsonArray) {
 
   for (size_t i = 0; i < jsonArray.size(); ++i) {
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace qosStats
+ * @brief the QoS messages of a shard by element (config.json pipeline['qos']). Elements with qos enabled (nvinfer qos=1, video sinks,
+ *  converters) post a message for every late buffer they drop or process late, with their cumulative processed/dropped counts, the
+ *  jitter of the buffer and their long-term proportion. The counts are kept per element and per stage (inference, conversion,
+ *  encoding, sink), so drops can be traced to the stage that is too slow.
+ *
+ */
+namespace qosStats {
+
+/**
+ * @struct QosPolicy
+ * @brief settings of the QoS analytics
+ *
+ * @var summary_s
+ * period of the summary log (only logged when elements dropped or were late), 0 disables it
+ */
+struct QosPolicy {
+  int summary_s = 60;
+};
+
+/**
+ * @brief the stage of an element: the elements of the source bins are the source, the others follow their factory (or their name
+ *  when the factory is unknown)
+ * @param factory factory of the element (nvinfer, x264enc, ...)
+ * @param name path of the element in the shard (srcBin0/src_queue)
+ * @return source, inference, encoding, conversion, sink or other
+ */
+inline std::string stageOf(const std::string &factory, const std::string &name)
+{
+  if (name.rfind("srcBin", 0) == 0)
+    return "source";
+  const std::string &key = factory.empty() ? name : factory;
+  auto has = [&](const char *part) { return key.find(part) != std::string::npos; };
+  if (has("infer") || has("tracker") || has("streammux") || has("streamdemux") || has("nv_detection") || has("nv_secondary"))
+    return "inference";
+  if (has("enc") || has("mux") || has("pay") || has("parse"))
+    return "encoding";
+  if (has("convert") || has("scale") || has("rate") || has("osd") || has("tiler") || has("caps"))
+    return "conversion";
+  if (has("sink"))
+    return "sink";
+  if (has("src") || has("dec"))
+    return "source";
+  return "other";
+}
+
+/**
+ * @struct ElementQos
+ * @brief QoS of an element (updated on the bus context, the atomics are read by the metrics scrape)
+ *
+ * @var processed
+ * last cumulative count of processed buffers reported by the element
+ * @var dropped
+ * last cumulative count of dropped buffers reported by the element
+ * @var window
+ * messages, processed, dropped and the highest jitter since the previous summary
+ * @var jitter_ns
+ * jitter of the last message (positive: the buffer was late)
+ * @var proportion_ppm
+ * long-term proportion of the last message in millionths (above 1e6 the element cannot keep up)
+ */
+struct ElementQos {
+  std::string name;
+  std::string factory;
+  std::string stage;
+  uint64_t processed = 0;
+  uint64_t dropped = 0;
+  struct {
+    uint64_t messages = 0;
+    uint64_t processed = 0;
+    uint64_t dropped = 0;
+    int64_t max_jitter_ns = 0;
+  } window;
+  std::atomic<uint64_t> *processed_total;
+  std::atomic<uint64_t> *dropped_total;
+  std::atomic<int64_t> jitter_ns = 0;
+  std::atomic<int64_t> proportion_ppm = 0;
+};
+
+/**
+ * @class ShardQos
+ * @brief QoS of the elements of a shard. The messages are recorded on the bus context of the shard and the summary is built on the
+ *  same context, so the table needs no lock; the elements are never freed (the metrics read them).
+ */
+class ShardQos {
+ public:
+  explicit ShardQos(int shard_id) : _shard(std::to_string(shard_id)) {}
+
+  /**
+   * @brief record a QoS message
+   * @param name path of the element in the shard (srcBin0/src_queue)
+   * @param factory factory of the element
+   * @param buffers the counts are in buffers (GST_FORMAT_BUFFERS), other formats only report jitter and proportion
+   * @param processed cumulative processed count, (guint64) -1 if unknown
+   * @param dropped cumulative dropped count, (guint64) -1 if unknown
+   * @param jitter_ns jitter of the buffer
+   * @param proportion long-term proportion of the element
+   * @return buffers dropped since the previous message of the element
+   */
+  uint64_t record(const std::string &name, const std::string &factory, bool buffers, uint64_t processed, uint64_t dropped, int64_t jitter_ns,
+                  double proportion)
+  {
+    ElementQos *element = this->_element(name, factory);
+    element->window.messages++;
+    element->window.max_jitter_ns = std::max(element->window.max_jitter_ns, jitter_ns);
+    element->jitter_ns.store(jitter_ns, std::memory_order_relaxed);
+    element->proportion_ppm.store((int64_t) (proportion * 1e6), std::memory_order_relaxed);
+    uint64_t new_drops = 0;
+    if (buffers && processed != (uint64_t) -1 && processed >= element->processed) {
+      element->window.processed += processed - element->processed;
+      element->processed_total->fetch_add(processed - element->processed, std::memory_order_relaxed);
+      element->processed = processed;
+    }
+    if (buffers && dropped != (uint64_t) -1 && dropped >= element->dropped) {
+      new_drops = dropped - element->dropped;
+      element->window.dropped += new_drops;
+      element->dropped_total->fetch_add(new_drops, std::memory_order_relaxed);
+      element->dropped = dropped;
+    }
+    return new_drops;
+  }
+
+  /**
+   * @brief the QoS since the previous summary, and start a new period
+   * @return {"elements": [{element, factory, stage, messages, processed, dropped, max_jitter_ms, proportion}] sorted by drops,
+   *  "stages": {stage: dropped}, "dropped": total}, empty element list when no message was received
+   */
+  njson summary()
+  {
+    std::vector<njson> rows;
+    njson stages = njson::object();
+    uint64_t total = 0;
+    for (const auto &[name, element] : this->_elements) {
+      if (element->window.messages == 0)
+        continue;
+      rows.push_back({{"element", name},
+                      {"factory", element->factory},
+                      {"stage", element->stage},
+                      {"messages", element->window.messages},
+                      {"processed", element->window.processed},
+                      {"dropped", element->window.dropped},
+                      {"max_jitter_ms", element->window.max_jitter_ns / 1e6},
+                      {"proportion", element->proportion_ppm.load(std::memory_order_relaxed) / 1e6}});
+      stages[element->stage] = stages.value(element->stage, (uint64_t) 0) + element->window.dropped;
+      total += element->window.dropped;
+      element->window = {};
+    }
+    std::sort(rows.begin(), rows.end(), [](const njson &a, const njson &b) {
+      if (a["dropped"].get<uint64_t>() != b["dropped"].get<uint64_t>())
+        return a["dropped"].get<uint64_t>() > b["dropped"].get<uint64_t>();
+      return a["max_jitter_ms"].get<double>() > b["max_jitter_ms"].get<double>();
+    });
+    return {{"elements", rows}, {"stages", stages}, {"dropped", total}};
+  }
+
+  /**
+   * @brief start over with the elements of a rebuilt pipeline (restarted shard): their cumulative counts start again from 0. The
+   *  elements and their metrics are kept, the totals keep counting.
+   */
+  void reset()
+  {
+    for (const auto &[name, element] : this->_elements) {
+      element->processed = 0;
+      element->dropped = 0;
+      element->window = {};
+      element->jitter_ns.store(0, std::memory_order_relaxed);
+      element->proportion_ppm.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief format a summary as a table for the logs
+   * @param summary the output of summary()
+   * @return one line per element
+   */
+  inline static std::string table(const njson &summary)
+  {
+    std::ostringstream oss;
+    oss << std::left << std::setw(40) << "element" << std::setw(12) << "stage" << std::right << std::setw(10) << "dropped" << std::setw(12)
+        << "processed" << std::setw(12) << "jitter_ms" << std::setw(12) << "proportion";
+    for (const auto &row : summary["elements"]) {
+      oss << "\n" << std::left << std::setw(40) << row["element"].get<std::string>() << std::setw(12) << row["stage"].get<std::string>()
+          << std::right << std::setw(10) << row["dropped"].get<uint64_t>() << std::setw(12) << row["processed"].get<uint64_t>() << std::fixed
+          << std::setprecision(2) << std::setw(12) << row["max_jitter_ms"].get<double>() << std::setprecision(3) << std::setw(12)
+          << row["proportion"].get<double>();
+    }
+    return oss.str();
+  }
+
+ private:
+  std::string _shard;
+  std::map<std::string, ElementQos *> _elements;
+
+  ElementQos *_element(const std::string &name, const std::string &factory)
+  {
+    auto it = this->_elements.find(name);
+    if (it != this->_elements.end())
+      return it->second;
+    ElementQos *element = new ElementQos();
+    element->name = name;
+    element->factory = factory;
+    element->stage = stageOf(factory, name);
+    core::MetricLabels labels = {{"shard", this->_shard}, {"element", name}, {"stage", element->stage}};
+    core::Metrics &metrics = core::Metrics::get();
+    element->processed_total = &metrics.counter("iva_qos_processed_total", "Buffers processed by an element (from its QoS messages).", labels);
+    element->dropped_total = &metrics.counter("iva_qos_dropped_total", "Buffers dropped by an element (from its QoS messages).", labels);
+    metrics.observe("iva_qos_jitter_seconds", "gauge", "Jitter of the last QoS message of an element (positive: late).", labels,
+                    [element]() { return element->jitter_ns.load(std::memory_order_relaxed) / 1e9; });
+    metrics.observe("iva_qos_proportion", "gauge", "Long-term proportion of the last QoS message of an element (above 1: too slow).", labels,
+                    [element]() { return element->proportion_ppm.load(std::memory_order_relaxed) / 1e6; });
+    this->_elements[name] = element;
+    return element;
+  }
+};
+
+/**
+ * @brief the name of an element in its shard: its path without the pipeline (/video-player0/srcBin0/src_queue -> srcBin0/src_queue)
+ */
+inline std::string elementPath(GstObject *object)
+{
+  gchar *path = gst_object_get_path_string(object);
+  std::string name = path;
+  g_free(path);
+  size_t start = name.find('/', 1);
+  return start != std::string::npos ? name.substr(start + 1) : name;
+}
+
+}  // namespace qosStats
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "logging.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace recording
+ * @brief passthrough recording of file sinks (config.json pipeline['record']=passthrough). The encoded stream of a source is teed
+ *  before its decoder and muxed as received (splitmuxsink), so a recording costs no decoder, converter or encoder. The detections
+ *  that the encoding sink would draw on the frames are written next to the video as a sidecar (one json payload per line).
+ *
+ */
+namespace recording {
+
+/**
+ * @struct RecordPolicy
+ * @brief how file sinks record (config.json pipeline['record'])
+ *
+ * @var passthrough
+ * mux the received stream instead of drawing the detections and encoding the frames
+ * @var segment_s
+ * start a new file every segment_s seconds (at the next keyframe), 0 records a single file
+ */
+struct RecordPolicy {
+  bool passthrough = false;
+  int segment_s = 0;
+};
+
+/**
+ * @brief location of a file of a recording. The sink is not used as a format (a '%' in the path is kept as is).
+ * @param sink the file sink (absolute path, .mp4 or .mkv)
+ * @param segment_s seconds per file
+ * @param fragment index of the file in the recording, counted across the restarts of the source
+ * @return the sink for the first file of a single file recording, <name>_<fragment:05>.<ext> otherwise (a restarted source never
+ *  overwrites its previous files)
+ */
+inline std::string fragmentLocation(const std::string &sink, int segment_s, unsigned fragment)
+{
+  if (segment_s <= 0 && fragment == 0)
+    return sink;
+  char index[16];
+  snprintf(index, sizeof(index), "_%05u", fragment);
+  size_t dot = sink.find_last_of('.');
+  return sink.substr(0, dot) + index + sink.substr(dot);
+}
+
+/**
+ * @brief path of the sidecar of a recording
+ * @param sink the file sink
+ * @return <name>.jsonl next to the video
+ */
+inline std::string sidecarPath(const std::string &sink)
+{
+  return sink.substr(0, sink.find_last_of('.')) + ".jsonl";
+}
+
+/**
+ * @brief the parser that puts a parsed stream in the format of the muxer (avc for mp4, codec data for both containers)
+ * @param media_type media type of the encoded stream
+ * @return the parser factory, empty if the codec cannot be recorded as is
+ */
+inline std::string recordParser(const std::string &media_type)
+{
+  if (media_type == "video/x-h264")
+    return "h264parse";
+  if (media_type == "video/x-h265")
+    return "h265parse";
+  if (media_type == "image/jpeg")
+    return "jpegparse";
+  return "";
+}
+
+/**
+ * @class Sidecar
+ * @brief the detections of a recording, one json object per line: {"segment": <file>, "pts": <ns>} when a file starts, then the
+ *  payloads of the source (meta.pts is the timestamp of the frame in the recorded stream). Written by the muxer and inference threads.
+ */
+class Sidecar {
+ public:
+  explicit Sidecar(const std::string &path, bool append = false)
+      : path(path), _file(path, std::ios::out | (append ? std::ios::app : std::ios::trunc))
+  {
+    if (!this->_file.is_open())
+      LOG(ERROR) << "Could not open the sidecar " << path;
+  }
+
+  /**
+   * @brief a file of the recording starts
+   * @param location path of the file
+   * @param pts timestamp of its first frame
+   */
+  void segment(const std::string &location, GstClockTime pts)
+  {
+    this->_write(njson({{"segment", location}, {"pts", GST_CLOCK_TIME_IS_VALID(pts) ? (int64_t) pts : -1}}));
+  }
+
+  /**
+   * @brief the detections of a frame
+   * @param payload the payload of the frame (refer to Processing::_create_payload)
+   */
+  void payload(const njson &payload) { this->_write(payload); }
+
+  std::string path;
+
+ private:
+  std::mutex _lock;
+  std::ofstream _file;
+
+  void _write(const njson &line)
+  {
+    std::string text = line.dump();
+    std::lock_guard<std::mutex> guard(this->_lock);
+    // a line per write: the sidecar is complete up to the last frame even if the process is killed
+    this->_file << text << '\n';
+    this->_file.flush();
+  }
+};
+
+/**
+ * @struct Passthrough
+ * @brief passthrough recording of a source
+ *
+ * @var source_id
+ * global id of the source
+ * @var sink
+ * the file sink, the files are named after it (refer to fragmentLocation)
+ * @var segment_s
+ * seconds per file
+ * @var sidecar
+ * the detections of the recording
+ * @var fragments
+ * index of the next file, kept across the restarts of the source (written from the muxer thread)
+ * @var closing_us
+ * time an EOS entered the recording branch, 0 once its file is finalized (refer to finishRecording)
+ */
+struct Passthrough {
+  int source_id;
+  std::string sink;
+  int segment_s;
+  Sidecar sidecar;
+  std::atomic<unsigned> fragments;
+  std::atomic<int64_t> closing_us = 0;
+
+  Passthrough(int id, const std::string &sink, int segment_s, unsigned first_fragment = 0)
+      : source_id(id), sink(sink), segment_s(segment_s), sidecar(sidecarPath(sink), first_fragment > 0), fragments(first_fragment)
+  {
+  }
+};
+
+/**
+ * @class Recordings
+ * @brief passthrough recordings by source id, read from the inference thread without locks (never freed, like the source stats)
+ */
+class Recordings {
+ public:
+  static constexpr int TABLE = 256;
+
+  /**
+   * @brief record a source, the files of a source id that is added again follow its previous files (and its sidecar is appended)
+   * @return the recording, NULL if its slot is taken by another source
+   */
+  Passthrough *add(int source_id, const std::string &sink, int segment_s)
+  {
+    Passthrough *current = this->_table[source_id % TABLE].load(std::memory_order_acquire);
+    if (current != nullptr && current->source_id != source_id)
+      return nullptr;
+    Passthrough *recording = new Passthrough(source_id, sink, segment_s, current != nullptr ? current->fragments.load() : 0);
+    this->_table[source_id % TABLE].store(recording, std::memory_order_release);
+    return recording;
+  }
+
+  /**
+   * @brief the recording of a source
+   * @return NULL if the source is not recorded
+   */
+  Passthrough *get(int source_id) const
+  {
+    if (source_id < 0)
+      return nullptr;
+    Passthrough *recording = this->_table[source_id % TABLE].load(std::memory_order_acquire);
+    return recording != nullptr && recording->source_id == source_id ? recording : nullptr;
+  }
+
+ private:
+  std::array<std::atomic<Passthrough *>, TABLE> _table{};
+};
+
+/**
+ * @brief insert the recording branch of a source in front of its decoder: tee -> (decoder, record_queue -> record_parse ->
+ *  record_sink). The queue is not leaky (the files stay decodable) and holds up to 10s, so a slow disk does not stall the decoder at once.
+ * @param bin the source bin
+ * @param decoder the decoder of the source, already in the bin and not linked upstream
+ * @param media_type media type of the encoded stream
+ * @param recording the recording of the source
+ * @return the tee (src_tee) to link the encoded stream to, NULL if the codec cannot be recorded (the decoder is left as is)
+ */
+inline GstElement *teeToRecording(GstElement *bin, GstElement *decoder, const std::string &media_type, Passthrough *recording)
+{
+  std::string parser_name = recordParser(media_type);
+  if (parser_name.empty()) {
+    LOG(WARNING) << "Cannot record " << media_type << " of source=" << recording->source_id << " without encoding it";
+    return NULL;
+  }
+  GstElement *tee = gst_element_factory_make("tee", "src_tee");
+  GstElement *queue = gst_element_factory_make("queue", "record_queue");
+  GstElement *parser = gst_element_factory_make(parser_name.c_str(), "record_parse");
+  GstElement *sink = gst_element_factory_make("splitmuxsink", "record_sink");
+  g_object_set(queue, "max-size-buffers", 0, "max-size-bytes", 0, "max-size-time", (guint64) 10 * GST_SECOND, NULL);
+  // the file sink is ours, so the end of a file is seen on its pad (refer to finishRecording)
+  GstElement *file = gst_element_factory_make("filesink", "record_file");
+  g_object_set(sink, "max-size-time", (guint64) recording->segment_s * GST_SECOND, "sink", file, NULL);
+  if (g_str_has_suffix(recording->sink.c_str(), ".mkv"))
+    g_object_set(sink, "muxer", gst_element_factory_make("matroskamux", NULL), NULL);
+  // name every file (and mark it in the sidecar) with the timestamp of its first frame, the index of splitmuxsink starts over
+  // when the source restarts
+  g_signal_connect(sink, "format-location-full",
+                   G_CALLBACK(+[](GstElement *splitmux, guint fragment_id, GstSample *first_sample, gpointer data) -> gchar * {
+                     Passthrough *recording = (Passthrough *) data;
+                     std::string location = fragmentLocation(recording->sink, recording->segment_s, recording->fragments++);
+                     GstBuffer *buffer = first_sample != NULL ? gst_sample_get_buffer(first_sample) : NULL;
+                     recording->sidecar.segment(location, buffer != NULL ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE);
+                     LOG(INFO) << "Recording source=" << recording->source_id << " to " << location;
+                     return g_strdup(location.c_str());
+                   }), recording);
+  // an EOS entering the branch closes the file, the file is finalized once the EOS reaches the file sink
+  GstPad *queue_pad = gst_element_get_static_pad(queue, "sink");
+  gst_pad_add_probe(queue_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        int64_t expected = 0;
+        if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS)
+          ((Passthrough *) data)->closing_us.compare_exchange_strong(expected, g_get_monotonic_time());
+        return GST_PAD_PROBE_OK;
+      }, recording, NULL);
+  gst_object_unref(queue_pad);
+  GstPad *file_pad = gst_element_get_static_pad(file, "sink");
+  gst_pad_add_probe(file_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, [](GstPad *pad, GstPadProbeInfo *info, gpointer data) -> GstPadProbeReturn {
+        if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS)
+          ((Passthrough *) data)->closing_us = 0;
+        return GST_PAD_PROBE_OK;
+      }, recording, NULL);
+  gst_object_unref(file_pad);
+
+  gst_bin_add_many(GST_BIN(bin), tee, queue, parser, sink, NULL);
+  if (!gst_element_link_many(tee, queue, parser, sink, NULL) || !gst_element_link(tee, decoder))
+    LOG(FATAL) << "Failed to link the recording of source=" << recording->source_id << " in bin=" << GST_ELEMENT_NAME(bin);
+  for (GstElement *element : {sink, parser, queue})
+    gst_element_sync_state_with_parent(element);
+  return tee;
+}
+
+/**
+ * @brief finish the file of a source that is taken down (refer to Pipeline::_isolate_source): the recording branch is detached from
+ *  the tee and kept playing (locked state) while the source bin goes to GST_STATE_NULL, and an EOS drains it so the muxer writes
+ *  its trailer. A live source that ended already sent its EOS through the tee.
+ * @param bin the source bin, still in its running state
+ */
+inline void finishRecording(GstElement *bin)
+{
+  GstElement *queue = gst_bin_get_by_name(GST_BIN(bin), "record_queue");
+  // not recorded, or a file source whose codec is not known yet
+  if (queue == NULL)
+    return;
+  for (const char *name : {"record_queue", "record_parse", "record_sink"}) {
+    GstElement *element = gst_bin_get_by_name(GST_BIN(bin), name);
+    gst_element_set_locked_state(element, TRUE);
+    gst_object_unref(element);
+  }
+  GstPad *queue_pad = gst_element_get_static_pad(queue, "sink");
+  GstPad *tee_pad = gst_pad_get_peer(queue_pad);
+  if (tee_pad != NULL) {
+    GstElement *tee = gst_pad_get_parent_element(tee_pad);
+    gst_pad_unlink(tee_pad, queue_pad);
+    gst_element_release_request_pad(tee, tee_pad);
+    gst_object_unref(tee);
+    gst_object_unref(tee_pad);
+  }
+  if (!GST_PAD_IS_EOS(queue_pad))
+    gst_pad_send_event(queue_pad, gst_event_new_eos());
+  gst_object_unref(queue_pad);
+  gst_object_unref(queue);
+}
+
+/**
+ * @brief attach the recording branch again for the restart of its source (refer to Pipeline::_restart_source): the branch is reset
+ *  and follows the state of the bin again, its next file follows the previous ones (refer to fragmentLocation)
+ * @param bin the source bin, in GST_STATE_NULL
+ * @param recording the recording of the source
+ * @param timeout_us time given to the previous file to be finalized, 0 resets the branch at once
+ * @return false while the previous file is being finalized (within timeout_us)
+ */
+inline bool resumeRecording(GstElement *bin, Passthrough *recording, int64_t timeout_us)
+{
+  GstElement *queue = gst_bin_get_by_name(GST_BIN(bin), "record_queue");
+  if (queue == NULL)
+    return true;
+  int64_t closing = recording->closing_us;
+  if (closing != 0 && g_get_monotonic_time() - closing < timeout_us) {
+    gst_object_unref(queue);
+    return false;
+  }
+  if (closing != 0)
+    LOG(WARNING) << "Recording of source=" << recording->source_id << " was not finalized in time, the file may not be playable";
+  recording->closing_us = 0;
+  for (const char *name : {"record_queue", "record_parse", "record_sink"}) {
+    GstElement *element = gst_bin_get_by_name(GST_BIN(bin), name);
+    gst_element_set_state(element, GST_STATE_NULL);
+    gst_element_set_locked_state(element, FALSE);
+    gst_object_unref(element);
+  }
+  GstPad *queue_pad = gst_element_get_static_pad(queue, "sink");
+  GstElement *tee = gst_bin_get_by_name(GST_BIN(bin), "src_tee");
+  if (tee != NULL && !gst_pad_is_linked(queue_pad) && !gst_element_link(tee, queue))
+    LOG(ERROR) << "Could not attach the recording of source=" << recording->source_id << " again";
+  if (tee != NULL)
+    gst_object_unref(tee);
+  gst_object_unref(queue_pad);
+  gst_object_unref(queue);
+  return true;
+}
+
+}  // namespace recording
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "logging.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace sourceHealth
+ * @brief per-source error isolation and reconnection bookkeeping for the Pipeline module
+ *
+ */
+namespace sourceHealth {
+
+/**
+ * @struct ReconnectPolicy
+ * @brief exponential backoff used to restart a failed source (config.json pipeline['reconnect'])
+ *
+ * @var base_ms
+ * delay before the first restart attempt
+ * @var max_ms
+ * upper bound of the delay between two restart attempts
+ * @var jitter
+ * fraction (0..1) of the delay that is randomized so cameras that dropped together do not reconnect together
+ * @var max_attempts
+ * number of consecutive failed attempts before the source is given up (0 retries forever)
+ */
+struct ReconnectPolicy {
+  int base_ms = 500;
+  int max_ms = 30000;
+  double jitter = 0.2;
+  int max_attempts = 0;
+};
+
+/**
+ * @struct WatchdogPolicy
+ * @brief buffer-flow watchdog of the sources (config.json pipeline['watchdog'])
+ *
+ * @var enable
+ * run the watchdog timer on every shard (opt-in)
+ * @var interval_ms
+ * period of the watchdog check
+ * @var stall_ms
+ * a source that did not output a buffer for this long is stalled
+ * @var log
+ * log stalled sources
+ * @var event
+ * publish a health payload (through the processing module) when a source stalls or recovers
+ * @var restart
+ * restart stalled sources (refer to ReconnectPolicy)
+ */
+struct WatchdogPolicy {
+  bool enable = false;
+  int interval_ms = 1000;
+  int stall_ms = 5000;
+  bool log = true;
+  bool event = false;
+  bool restart = false;
+};
+
+/**
+ * @struct SourceStats
+ * @brief connection statistics of a source. Written from the shard's main context and from streaming threads, so all fields are atomic.
+ *
+ * @var errors
+ * number of errors (or unexpected EOS) raised by the source bin
+ * @var reconnects
+ * number of times the source came back after an outage
+ * @var attempt
+ * consecutive restart attempts of the current outage
+ * @var outage_start_us
+ * monotonic time (g_get_monotonic_time) the current outage started, 0 when the source is streaming
+ * @var last_outage_us
+ * duration of the last outage
+ * @var total_outage_us
+ * accumulated duration of all outages
+ * @var failed
+ * true once the source has been given up (max_attempts reached, or a file source failed)
+ * @var finished
+ * true once a (non-live) source output EOS
+ * @var buffers
+ * number of buffers output by the source bin (src_queue)
+ * @var last_buffer_us
+ * monotonic time of the last buffer output by the source bin, 0 before the first buffer
+ * @var fps
+ * moving average of the output frame rate, updated by the watchdog
+ * @var stalled
+ * true while the watchdog considers the source stalled
+ * @var stalls
+ * number of times the source stalled
+ * @var checked_buffers
+ * buffers counted at the previous watchdog check
+ * @var checked_us
+ * monotonic time of the previous watchdog check, 0 before the first check
+ * @var watch_start_us
+ * monotonic time of the first watchdog check (stall reference until the first buffer)
+ */
+struct SourceStats {
+  std::atomic<int> errors = 0;
+  std::atomic<int> reconnects = 0;
+  std::atomic<int> attempt = 0;
+  std::atomic<int64_t> outage_start_us = 0;
+  std::atomic<int64_t> last_outage_us = 0;
+  std::atomic<int64_t> total_outage_us = 0;
+  std::atomic<bool> failed = false;
+  std::atomic<bool> finished = false;
+  std::atomic<uint64_t> buffers = 0;
+  std::atomic<int64_t> last_buffer_us = 0;
+  std::atomic<double> fps = 0;
+  std::atomic<bool> stalled = false;
+  std::atomic<int> stalls = 0;
+  std::atomic<uint64_t> checked_buffers = 0;
+  std::atomic<int64_t> checked_us = 0;
+  std::atomic<int64_t> watch_start_us = 0;
+};
+
+/**
+ * @brief delay before the next restart attempt: base_ms * 2^attempt, capped at max_ms, +/- jitter
+ * @param policy the reconnect policy
+ * @param attempt zero based restart attempt of the current outage
+ * @param random a uniformly distributed number in [0, 1)
+ * @return the delay in milliseconds
+ */
+inline int computeBackoffMs(const ReconnectPolicy &policy, int attempt, double random)
+{
+  double delay = policy.base_ms * std::pow(2.0, std::min(attempt, 30));
+  delay = std::min(delay, (double) policy.max_ms);
+  delay *= 1.0 + policy.jitter * (2.0 * random - 1.0);
+  return std::max(0, (int) std::lround(delay));
+}
+
+/**
+ * @brief exponential moving average of the frame rate between two watchdog checks
+ * @param fps the previous average
+ * @param frames buffers output since the previous check
+ * @param elapsed_us time since the previous check
+ * @param alpha weight of the new sample (0..1]
+ * @return the new average
+ */
+inline double updateFps(double fps, uint64_t frames, int64_t elapsed_us, double alpha = 0.5)
+{
+  if (elapsed_us <= 0)
+    return fps;
+  double sample = (double) frames * 1e6 / (double) elapsed_us;
+  return alpha * sample + (1.0 - alpha) * fps;
+}
+
+/**
+ * @brief check if a source stopped producing buffers
+ * @param now_us current monotonic time
+ * @param last_buffer_us time of the last buffer (0 if none yet)
+ * @param watch_start_us time the watchdog started watching the source (used until the first buffer)
+ * @param stall_ms allowed time without buffers
+ * @return true if stalled
+ */
+inline bool isStalled(int64_t now_us, int64_t last_buffer_us, int64_t watch_start_us, int stall_ms)
+{
+  int64_t reference = last_buffer_us != 0 ? last_buffer_us : watch_start_us;
+  return now_us - reference > (int64_t) stall_ms * 1000;
+}
+
+/**
+ * @brief find the source id of the srcBin<id> that contains an object (an element, or the bin itself)
+ * @param object the object that posted a bus message
+ * @return the source id, -1 if the object is not inside a source bin
+ */
+inline int sourceIdFromObject(GstObject *object)
+{
+  GstObject *current = object ? (GstObject *) gst_object_ref(object) : NULL;
+  int source_id = -1;
+  while (current != NULL) {
+    std::string name = GST_OBJECT_NAME(current);
+    if (name.rfind("srcBin", 0) == 0 && name.size() > 6) {
+      source_id = std::stoi(name.substr(6));
+      gst_object_unref(current);
+      break;
+    }
+    GstObject *parent = gst_object_get_parent(current);
+    gst_object_unref(current);
+    current = parent;
+  }
+  return source_id;
+}
+
+/**
+ * @brief statistics of a source for logging and reporting
+ * @param stats the statistics of the source
+ * @return json with errors, reconnects, outage durations (ms) and state
+ */
+inline njson statsToJson(const SourceStats &stats)
+{
+  njson ret;
+  ret["errors"] = stats.errors.load();
+  ret["reconnects"] = stats.reconnects.load();
+  ret["last_outage_ms"] = stats.last_outage_us.load() / 1000;
+  ret["total_outage_ms"] = stats.total_outage_us.load() / 1000;
+  ret["in_outage"] = stats.outage_start_us.load() != 0;
+  ret["failed"] = stats.failed.load();
+  ret["fps"] = stats.fps.load();
+  ret["stalls"] = stats.stalls.load();
+  ret["stalled"] = stats.stalled.load();
+  return ret;
+}
+
+}  // namespace sourceHealth
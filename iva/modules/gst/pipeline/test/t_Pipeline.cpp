@@ -83,6 +83,729 @@ TEST_F(PipelineTest, member_set_up_NoConfig)
   }
 }
 
+TEST_F(PipelineTest, finished_shard_keeps_the_others_supervised)
+{
+  for (int s = 0; s < 3; s++) {
+    this->pipeline->_shards.push_back(new core::PipelineShard());
+    this->pipeline->_shards[s]->id = s;
+  }
+  this->pipeline->_running_shards = 3;
+  this->pipeline->retire_shard(0);
+  EXPECT_FALSE(this->pipeline->_stopping) << "Validate a shard that finished on its own does not stop the pipeline";
+  this->pipeline->_stopping = true;
+  EXPECT_TRUE(this->pipeline->restart_shard(1)) << "Validate a failed shard of a stopping pipeline is retired";
+  EXPECT_EQ(this->pipeline->_running_shards, 1);
+}
+
+TEST(SourceHealthTest, backoff_grows_and_is_capped)
+{
+  sourceHealth::ReconnectPolicy policy = {.base_ms = 500, .max_ms = 4000, .jitter = 0.0, .max_attempts = 0};
+  EXPECT_EQ(sourceHealth::computeBackoffMs(policy, 0, 0.5), 500) << "Validate first attempt waits base_ms";
+  EXPECT_EQ(sourceHealth::computeBackoffMs(policy, 2, 0.5), 2000) << "Validate delay doubles per attempt";
+  EXPECT_EQ(sourceHealth::computeBackoffMs(policy, 10, 0.5), 4000) << "Validate delay is capped at max_ms";
+  EXPECT_EQ(sourceHealth::computeBackoffMs(policy, 1000, 0.5), 4000) << "Validate large attempts do not overflow";
+}
+
+TEST(SourceHealthTest, backoff_jitter_is_bounded)
+{
+  sourceHealth::ReconnectPolicy policy = {.base_ms = 1000, .max_ms = 30000, .jitter = 0.2, .max_attempts = 0};
+  EXPECT_EQ(sourceHealth::computeBackoffMs(policy, 0, 0.0), 800) << "Validate lowest jitter";
+  EXPECT_EQ(sourceHealth::computeBackoffMs(policy, 0, 0.5), 1000) << "Validate centered jitter";
+  EXPECT_LE(sourceHealth::computeBackoffMs(policy, 0, 0.999), 1200) << "Validate highest jitter";
+}
+
+TEST(SourceHealthTest, watchdog_fps_and_stall)
+{
+  EXPECT_DOUBLE_EQ(sourceHealth::updateFps(0.0, 30, 1000000, 1.0), 30.0) << "Validate fps sample";
+  EXPECT_DOUBLE_EQ(sourceHealth::updateFps(20.0, 30, 1000000, 0.5), 25.0) << "Validate moving average";
+  EXPECT_DOUBLE_EQ(sourceHealth::updateFps(20.0, 30, 0), 20.0) << "Validate no elapsed time keeps the average";
+  EXPECT_FALSE(sourceHealth::isStalled(10000000, 9000000, 0, 5000)) << "Validate recent buffer is not stalled";
+  EXPECT_TRUE(sourceHealth::isStalled(10000000, 4000000, 0, 5000)) << "Validate old buffer is stalled";
+  EXPECT_TRUE(sourceHealth::isStalled(10000000, 0, 1000000, 5000)) << "Validate no buffer since the watch started is stalled";
+  EXPECT_FALSE(sourceHealth::isStalled(10000000, 0, 9000000, 5000)) << "Validate a new source gets stall_ms for its first buffer";
+}
+
+TEST(SourceHealthTest, source_id_from_nested_element)
+{
+  gst_init(NULL, NULL);
+  GstElement *pipeline = gst_pipeline_new("video-player0");
+  GstElement *srcBin = gst_bin_new("srcBin12");
+  GstElement *queue = gst_element_factory_make("queue", "src_queue");
+  gst_bin_add(GST_BIN(srcBin), queue);
+  gst_bin_add(GST_BIN(pipeline), srcBin);
+  EXPECT_EQ(sourceHealth::sourceIdFromObject(GST_OBJECT(queue)), 12) << "Validate element maps to its srcBin";
+  EXPECT_EQ(sourceHealth::sourceIdFromObject(GST_OBJECT(srcBin)), 12) << "Validate bin maps to itself";
+  EXPECT_EQ(sourceHealth::sourceIdFromObject(GST_OBJECT(pipeline)), -1) << "Validate pipeline is not a source";
+  gst_object_unref(pipeline);
+}
+
+TEST(EncodingTest, parse_profile_overrides_defaults)
+{
+  encoding::EncoderProfile profile = encoding::defaultProfiles()["quality"];
+  njson conf = {{"crf", 18}, {"threads", 3}};
+  EXPECT_TRUE(encoding::parseProfile("archive", conf, profile)) << "Validate partial profile";
+  EXPECT_EQ(profile.name, "archive") << "Validate profile takes its config name";
+  EXPECT_EQ(profile.crf, 18) << "Validate crf override";
+  EXPECT_EQ(profile.threads, 3) << "Validate threads override";
+  EXPECT_EQ(profile.preset, "medium") << "Validate missing keys keep the base profile";
+  EXPECT_EQ(profile.bitrate, 0) << "Validate missing keys keep the base profile";
+
+  EXPECT_FALSE(encoding::parseProfile("bad", njson{{"crf", 60}}, profile)) << "Validate crf range";
+  EXPECT_FALSE(encoding::parseProfile("bad", njson{{"key_int", 0}}, profile)) << "Validate key_int range";
+  EXPECT_FALSE(encoding::parseProfile("bad", njson{{"bitrate", "fast"}}, profile)) << "Validate wrong type";
+  EXPECT_FALSE(encoding::parseProfile("bad", njson::array(), profile)) << "Validate profile must be an object";
+}
+
+TEST(EncodingTest, muxer_follows_container)
+{
+  gst_init(NULL, NULL);
+  auto factoryName = [](GstElement *element) {
+    std::string name = element ? GST_OBJECT_NAME(gst_element_get_factory(element)) : "";
+    if (element)
+      gst_object_unref(element);
+    return name;
+  };
+  if (gst_element_factory_find("mp4mux") != NULL)
+    EXPECT_EQ(factoryName(encoding::createMuxer("mux", "/outputs/video/out.mp4")), "mp4mux") << "Validate mp4 container";
+  if (gst_element_factory_find("matroskamux") != NULL)
+    EXPECT_EQ(factoryName(encoding::createMuxer("mux", "/outputs/video/out.mkv")), "matroskamux") << "Validate mkv container";
+  if (gst_element_factory_find("flvmux") != NULL)
+    EXPECT_EQ(factoryName(encoding::createMuxer("mux", "rtmp://0.0.0.0:1935/live")), "flvmux") << "Validate rtmp container";
+}
+
+TEST(TilingTest, layout_fits_every_tile)
+{
+  pipelineUtils::TileLayout layout = pipelineUtils::computeTileLayout(pipelineUtils::TileLayout(), 5);
+  EXPECT_EQ(layout.columns, 3) << "Validate square grid columns";
+  EXPECT_EQ(layout.rows, 2) << "Validate square grid rows";
+  layout = pipelineUtils::computeTileLayout(pipelineUtils::TileLayout{.rows = 1}, 4);
+  EXPECT_EQ(layout.columns, 4) << "Validate columns follow the configured rows";
+  layout = pipelineUtils::computeTileLayout(pipelineUtils::TileLayout{.columns = 2}, 5);
+  EXPECT_EQ(layout.rows, 3) << "Validate rows follow the configured columns";
+  layout = pipelineUtils::computeTileLayout(pipelineUtils::TileLayout(), 0);
+  EXPECT_EQ(layout.rows * layout.columns, 1) << "Validate at least one tile";
+}
+
+TEST(TilingTest, tile_positions_are_row_major)
+{
+  pipelineUtils::TileLayout layout = {.rows = 2, .columns = 2, .width = 1920, .height = 1080};
+  int x, y, width, height;
+  EXPECT_TRUE(pipelineUtils::tileRect(layout, 3, x, y, width, height)) << "Validate last tile is in the grid";
+  EXPECT_EQ(x, 960) << "Validate tile x";
+  EXPECT_EQ(y, 540) << "Validate tile y";
+  EXPECT_EQ(width, 960) << "Validate tile width";
+  EXPECT_EQ(height, 540) << "Validate tile height";
+  EXPECT_TRUE(pipelineUtils::tileRect(layout, 1, x, y, width, height)) << "Validate second tile is in the grid";
+  EXPECT_EQ(x, 960) << "Validate second tile is on the first row";
+  EXPECT_EQ(y, 0) << "Validate second tile is on the first row";
+  EXPECT_FALSE(pipelineUtils::tileRect(layout, 4, x, y, width, height)) << "Validate tile outside of the grid";
+}
+
+TEST(LatencyBudgetTest, split_fits_in_budget)
+{
+  latencyBudget::LatencyBudget off = latencyBudget::splitLatencyBudget(0);
+  EXPECT_EQ(off.budget_ms, 0) << "Validate budget disabled";
+  EXPECT_EQ(off.mux_timeout_us, 40000) << "Validate default mux timeout when disabled";
+
+  latencyBudget::LatencyBudget budget = latencyBudget::splitLatencyBudget(500);
+  EXPECT_EQ(budget.jitterbuffer_ms, 125) << "Validate jitterbuffer share";
+  EXPECT_EQ(budget.queue_ms, 75) << "Validate queue share";
+  EXPECT_EQ(budget.mux_timeout_us, 40000) << "Validate mux timeout is capped at the default";
+  EXPECT_EQ(budget.max_lateness_ms, 100) << "Validate sink share";
+  int total_ms = budget.jitterbuffer_ms + 3 * budget.queue_ms + budget.mux_timeout_us / 1000 + budget.max_lateness_ms;
+  EXPECT_LE(total_ms, budget.budget_ms) << "Validate the shares fit in the budget";
+
+  EXPECT_EQ(latencyBudget::splitLatencyBudget(100).mux_timeout_us, 10000) << "Validate mux timeout follows a small budget";
+}
+
+TEST(LatencyBudgetTest, record_latency_against_budget)
+{
+  latencyBudget::LatencyStats stats;
+  stats.budget_ms = 100;
+  latencyBudget::recordLatency(stats, -1);
+  EXPECT_EQ(stats.samples, 0u) << "Validate unmeasured frames are skipped";
+  latencyBudget::recordLatency(stats, 50000);
+  EXPECT_DOUBLE_EQ(stats.average_us, 50000.0) << "Validate first sample is the average";
+  latencyBudget::recordLatency(stats, 150000, 0.5);
+  EXPECT_DOUBLE_EQ(stats.average_us, 100000.0) << "Validate moving average";
+  EXPECT_EQ(stats.max_us, 150000) << "Validate max latency";
+  EXPECT_EQ(stats.over_budget, 1u) << "Validate frames over budget";
+  EXPECT_DOUBLE_EQ(latencyBudget::statsToJson(stats)["over_budget_ratio"].get<double>(), 0.5) << "Validate over budget ratio";
+}
+
+TEST(BatchingTest, decision_waits_for_slowest_source_within_target)
+{
+  batching::BatchPolicy policy;
+  batching::BatchDecision capped = batching::computeBatchDecision({30.0, 10.0}, policy);
+  EXPECT_EQ(capped.timeout_us, 40000) << "Validate timeout is capped by the latency target";
+  EXPECT_EQ(capped.batch_size, 2) << "Validate batch size of active sources";
+
+  policy.target_latency_ms = 200;
+  batching::BatchDecision mixed = batching::computeBatchDecision({30.0, 10.0}, policy);
+  EXPECT_EQ(mixed.timeout_us, 120000) << "Validate timeout covers the period of the slowest source plus margin";
+  EXPECT_DOUBLE_EQ(mixed.expected_fill, 1.0) << "Validate every source fills its slot";
+
+  batching::BatchDecision stalled = batching::computeBatchDecision({30.0, 0.1}, policy);
+  EXPECT_EQ(stalled.batch_size, 1) << "Validate stalled sources are not waited for";
+  EXPECT_EQ(stalled.timeout_us, 40000) << "Validate timeout follows the remaining source";
+
+  batching::BatchDecision idle = batching::computeBatchDecision({0.0, 0.0}, policy);
+  EXPECT_EQ(idle.timeout_us, 200000) << "Validate idle batch waits up to the latency target";
+  EXPECT_EQ(idle.batch_size, 2) << "Validate idle batch keeps its size";
+}
+
+TEST(BatchingTest, controller_applies_hysteresis)
+{
+  batching::BatchController controller(batching::BatchPolicy{.adaptive = true, .target_latency_ms = 200});
+  EXPECT_FALSE(controller.update({{0, 0}, {1, 0}}, 1000000).changed) << "Validate first period only measures";
+  batching::BatchDecision decision = controller.update({{0, 30}, {1, 10}}, 2000000);
+  EXPECT_TRUE(decision.changed) << "Validate mux is retuned for the measured rates";
+  EXPECT_EQ(decision.timeout_us, 120000) << "Validate timeout for the measured rates";
+  EXPECT_DOUBLE_EQ(controller.fps(1), 10.0) << "Validate measured rate";
+
+  decision = controller.update({{0, 60}, {1, 19}}, 3000000);
+  EXPECT_FALSE(decision.changed) << "Validate small rate changes keep the timeout";
+  EXPECT_EQ(decision.timeout_us, 120000) << "Validate timeout is kept";
+
+  decision = controller.update({{0, 90}}, 4000000);
+  EXPECT_TRUE(decision.changed) << "Validate removed source retunes the mux";
+  EXPECT_EQ(decision.batch_size, 1) << "Validate batch size follows the sources";
+  EXPECT_DOUBLE_EQ(controller.fps(1), 0.0) << "Validate removed source is forgotten";
+}
+
+TEST(InferenceGovernorTest, load_combines_signals)
+{
+  EXPECT_DOUBLE_EQ(inferenceGovernor::loadLevel({.qos_messages = 0, .queue_fill = 0.3, .busy = 0.6}), 0.6) << "Validate highest signal";
+  EXPECT_DOUBLE_EQ(inferenceGovernor::loadLevel({.qos_messages = 3, .queue_fill = 0.3, .busy = 0.6}), 1.0) << "Validate QoS drops overload";
+}
+
+TEST(InferenceGovernorTest, interval_follows_load_with_hysteresis)
+{
+  inferenceGovernor::InferenceGovernor governor(inferenceGovernor::GovernorPolicy{.adaptive = true, .max_interval = 2}, 0);
+  inferenceGovernor::LoadSignals overload{.busy = 1.2}, light{.busy = 0.3}, moderate{.busy = 0.48};
+  EXPECT_EQ(governor.update(overload), 0) << "Validate a single overloaded period is ignored";
+  EXPECT_EQ(governor.update(overload), 1) << "Validate sustained overload raises the interval";
+  for (int i = 0; i < 4; i++)
+    governor.update(overload);
+  EXPECT_EQ(governor.interval(), 2) << "Validate interval is capped";
+
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ(governor.update(moderate), 2) << "Validate interval is kept before lower_after periods";
+  EXPECT_EQ(governor.update(moderate), 1) << "Validate interval is lowered when the load stays under high_load";
+  for (int i = 0; i < 5; i++)
+    governor.update(moderate);
+  EXPECT_EQ(governor.interval(), 1) << "Validate interval is kept when inferring more often would overload";
+  for (int i = 0; i < 5; i++)
+    governor.update(light);
+  EXPECT_EQ(governor.interval(), 0) << "Validate light load infers every batch";
+  EXPECT_EQ(governor.to_json()["raised"].get<int>(), 2) << "Validate raises are counted";
+  EXPECT_EQ(governor.to_json()["lowered"].get<int>(), 2) << "Validate lowers are counted";
+}
+
+TEST(InferenceGovernorTest, element_timing_matches_buffers)
+{
+  inferenceGovernor::ElementTiming timing;
+  int first, second, unknown;
+  inferenceGovernor::enterElement(timing, &first, 100);
+  inferenceGovernor::enterElement(timing, &second, 150);
+  inferenceGovernor::leaveElement(timing, &second, 250);
+  inferenceGovernor::leaveElement(timing, &first, 400);
+  inferenceGovernor::leaveElement(timing, &unknown, 500);
+  EXPECT_EQ(inferenceGovernor::takeBusyUs(timing), 400) << "Validate time of every buffer in the element";
+  EXPECT_EQ(inferenceGovernor::takeBusyUs(timing), 0) << "Validate busy time is reset";
+}
+
+TEST(FileSourceTest, decoder_follows_codec_and_profile)
+{
+  pipelineUtils::ElementProfile gpu = pipelineUtils::getElementProfile("gpu");
+  pipelineUtils::ElementProfile cpu = pipelineUtils::getElementProfile("cpu");
+  EXPECT_EQ(pipelineUtils::selectDecoder("video/x-h264", cpu), "avdec_h264") << "Validate H.264 on cpu";
+  EXPECT_EQ(pipelineUtils::selectDecoder("video/x-h265", cpu), "avdec_h265") << "Validate H.265 on cpu";
+  EXPECT_EQ(pipelineUtils::selectDecoder("image/jpeg", cpu), "jpegdec") << "Validate MJPEG on cpu";
+  EXPECT_EQ(pipelineUtils::selectDecoder("video/x-h265", gpu), "nvv4l2decoder") << "Validate H.265 on gpu";
+  EXPECT_EQ(pipelineUtils::selectDecoder("video/x-vp9", gpu), "") << "Validate unsupported codec";
+}
+
+TEST(FileSourceTest, loop_keeps_timestamps_increasing)
+{
+  fileLoop::LoopState state;
+  EXPECT_EQ(fileLoop::markBuffer(state, 0, 40 * GST_MSECOND), 0u) << "Validate first pass is untouched";
+  EXPECT_EQ(fileLoop::markBuffer(state, 960 * GST_MSECOND, 40 * GST_MSECOND), 960 * GST_MSECOND) << "Validate first pass is untouched";
+  EXPECT_EQ(fileLoop::endPass(state), 1000 * GST_MSECOND) << "Validate next pass starts at the end of the file";
+  EXPECT_TRUE(state.seeking) << "Validate events of the seek are dropped";
+  EXPECT_EQ(fileLoop::markBuffer(state, 0, 40 * GST_MSECOND), 1000 * GST_MSECOND) << "Validate second pass is shifted";
+  EXPECT_EQ(fileLoop::endPass(state), 1040 * GST_MSECOND) << "Validate offsets accumulate";
+  EXPECT_EQ(state.loops, 2u) << "Validate passes are counted";
+}
+
+TEST(FileSourceTest, stopped_loop_lets_eos_through)
+{
+  gst_init(NULL, NULL);
+  fileLoop::LoopState state;
+  state.stop = true;
+  GstPadProbeInfo info = {};
+  info.type = GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM;
+  info.data = gst_event_new_eos();
+  EXPECT_EQ(fileLoop::loopProbe(NULL, &info, &state), GST_PAD_PROBE_OK) << "Validate the shutdown EOS reaches the pipeline";
+  EXPECT_EQ(state.loops, 0u) << "Validate no new pass is started";
+  EXPECT_FALSE(state.seeking) << "Validate no seek is pending";
+  gst_event_unref((GstEvent *) info.data);
+}
+
+TEST(FileSourceTest, stopping_live_source_lets_eos_through)
+{
+  gst_init(NULL, NULL);
+  core::PipelineShard shard;
+  shard.stopping = true;
+  sourceHealth::SourceStats stats;
+  core::SourceContext ctx = {.pipeline = NULL, .shard = &shard, .source_id = 0, .stats = &stats};
+  GstPadProbeInfo info = {};
+  info.type = GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM;
+  info.data = gst_event_new_eos();
+  EXPECT_EQ(core::Pipeline::_on_live_eos(NULL, &info, &ctx), GST_PAD_PROBE_OK) << "Validate the stop EOS reaches the sinks";
+  EXPECT_FALSE(g_main_context_pending(NULL)) << "Validate no restart of the source was scheduled";
+  gst_event_unref((GstEvent *) info.data);
+}
+
+TEST(LatencyTraceTest, histogram_percentiles)
+{
+  latencyTrace::Histogram histogram;
+  EXPECT_EQ(latencyTrace::percentile(histogram, 0.5), 0) << "Validate empty histogram";
+  for (int ms = 1; ms <= 100; ms++)
+    latencyTrace::record(histogram, ms * 1000);
+  latencyTrace::record(histogram, -1);
+  EXPECT_EQ(histogram.samples, 100u) << "Validate negative latencies are ignored";
+  EXPECT_NEAR(latencyTrace::percentile(histogram, 0.50), 50000, 0.2 * 50000) << "Validate p50 within the bucket resolution";
+  EXPECT_NEAR(latencyTrace::percentile(histogram, 0.95), 95000, 0.2 * 95000) << "Validate p95 within the bucket resolution";
+  EXPECT_LE(latencyTrace::percentile(histogram, 0.99), 100000) << "Validate percentiles never exceed the max";
+  njson json = latencyTrace::histogramToJson(histogram);
+  EXPECT_DOUBLE_EQ(json["max_ms"].get<double>(), 100.0) << "Validate max";
+}
+
+TEST(LatencyTraceTest, frames_found_by_source_and_timestamp)
+{
+  latencyTrace::Tracer tracer;
+  latencyTrace::SourceTrace *trace = tracer.add(3);
+  ASSERT_NE(trace, nullptr);
+  EXPECT_EQ(tracer.add(3), trace) << "Validate a source keeps its trace";
+  EXPECT_EQ(tracer.get(3 + latencyTrace::Tracer::TABLE), nullptr) << "Validate sources sharing a slot are told apart";
+
+  uint64_t pts = 40 * GST_MSECOND;
+  latencyTrace::stamp(*trace, pts, 1000);
+  EXPECT_EQ(latencyTrace::reach(*trace, latencyTrace::MUX, pts, 6000), 5000) << "Validate latency since the decoder";
+  EXPECT_EQ(latencyTrace::reach(*trace, latencyTrace::SINK, pts, 21000), 20000) << "Validate every stage counts from the decoder";
+  EXPECT_EQ(latencyTrace::reach(*trace, latencyTrace::SINK, pts + 1, 21000), -1) << "Validate frames not stamped are ignored";
+
+  // a frame whose slot was reused before it reached the stage is not measured
+  uint64_t other = pts + GST_MSECOND;
+  while (latencyTrace::slotOf(other) != latencyTrace::slotOf(pts))
+    other += GST_MSECOND;
+  latencyTrace::stamp(*trace, other, 30000);
+  EXPECT_EQ(latencyTrace::reach(*trace, latencyTrace::TRACKER, pts, 31000), -1) << "Validate overwritten stamps are ignored";
+
+  njson json = tracer.to_json();
+  EXPECT_EQ(json["3"]["mux"]["samples"].get<int>(), 1) << "Validate per-source, per-stage report";
+  EXPECT_EQ(json["3"]["sink"]["samples"].get<int>(), 1) << "Validate per-source, per-stage report";
+  EXPECT_FALSE(json["3"].contains("tracker")) << "Validate stages without samples are not reported";
+}
+
+TEST(ElementProfilerTest, chain_time_excludes_downstream)
+{
+  elementProfiler::Profiler profiler;
+  elementProfiler::ElementStats *convert = profiler.add("sinkBin0/convert", "nvvideoconvert");
+  elementProfiler::ElementStats *encoder = profiler.add("sinkBin0/encoder", "x264enc");
+  elementProfiler::ElementStats *queue = profiler.add("srcBin0/src_queue", "queue");
+  elementProfiler::ChainStack stack;
+  elementProfiler::enterChain(stack, convert, 0);
+  EXPECT_EQ(elementProfiler::leaveChain(stack, convert, 2000), 2000) << "Validate time until the element pushes";
+  elementProfiler::enterChain(stack, encoder, 2100);
+  EXPECT_EQ(elementProfiler::leaveChain(stack, encoder, 10100), 8000) << "Validate downstream chain timed separately";
+  EXPECT_EQ(elementProfiler::leaveChain(stack, convert, 11000), -1) << "Validate pushes without a chain are not timed";
+  EXPECT_EQ(stack.depth, 0);
+  EXPECT_EQ(convert->chains, 1u);
+
+  // a queue pushes from its own thread, its chain is replaced by the next one
+  elementProfiler::enterChain(stack, queue, 0);
+  elementProfiler::enterChain(stack, queue, 100);
+  EXPECT_EQ(stack.depth, 1) << "Validate stale chains do not pile up";
+}
+
+TEST(ElementProfilerTest, report_sorts_hot_elements)
+{
+  elementProfiler::ProfilerPolicy policy;
+  policy.top = 2;
+  elementProfiler::Profiler profiler(policy);
+  elementProfiler::ElementStats *convert = profiler.add("convert", "videoconvert");
+  elementProfiler::ElementStats *encoder = profiler.add("encoder", "x264enc");
+  elementProfiler::ElementStats *sink = profiler.add("sink", "fakesink");
+  profiler.add("idle", "identity");
+  elementProfiler::countPush(convert, 100, 1000);
+  convert->proc_us = 100000;
+  convert->chains = 100;
+  elementProfiler::countPush(encoder, 50, 5000);
+  encoder->proc_us = 600000;
+  encoder->chains = 50;
+  elementProfiler::countPush(sink, 200, 100);
+
+  njson report = profiler.report(1000000);
+  ASSERT_EQ(report.size(), 2u) << "Validate the table is limited to the top elements";
+  EXPECT_EQ(report[0]["element"].get<std::string>(), "encoder") << "Validate the busiest element comes first";
+  EXPECT_EQ(report[1]["element"].get<std::string>(), "convert");
+  EXPECT_DOUBLE_EQ(report[0]["busy"].get<double>(), 0.6) << "Validate share of the period";
+  EXPECT_DOUBLE_EQ(report[0]["proc_ms"].get<double>(), 12.0) << "Validate time per chain";
+  EXPECT_DOUBLE_EQ(report[0]["buffers_per_s"].get<double>(), 50.0) << "Validate throughput";
+  EXPECT_DOUBLE_EQ(report[0]["bytes_per_s"].get<double>(), 5000.0) << "Validate throughput";
+  EXPECT_TRUE(profiler.report(1000000).empty()) << "Validate rates are per period";
+}
+
+TEST(PipelineGraphTest, fan_out_inserts_tee_and_branch_queues)
+{
+  std::vector<pipelineGraph::Node> nodes = {{"decoder", "nvvideoconvert"}, {"infer_queue", "queue"}, {"recorder", "x264enc"},
+                                            {"preview", "xvimagesink"}};
+  std::vector<pipelineGraph::Edge> edges = {
+      {.from = "decoder", .to = "infer_queue"},
+      {.from = "decoder", .to = "recorder", .queue_properties = {"leaky=2"}},
+      {.from = "decoder", .to = "preview", .probes = {{.function_name = "osd_callback"}}}};
+  pipelineGraph::Plan plan;
+  std::string error;
+  ASSERT_TRUE(pipelineGraph::plan(nodes, edges, plan, error)) << error;
+
+  ASSERT_EQ(plan.elements.size(), 3u) << "Validate a tee and a queue per branch that does not start with one";
+  EXPECT_EQ(plan.elements[0].alias, "decoder_tee");
+  EXPECT_EQ(plan.elements[1].alias, "decoder_recorder_queue");
+  EXPECT_EQ(plan.elements[1].properties, std::vector<std::string>{"leaky=2"}) << "Validate branch queue properties";
+  ASSERT_EQ(plan.links.size(), 6u);
+  EXPECT_EQ(plan.links[0].src, "decoder");
+  EXPECT_EQ(plan.links[0].sink, "decoder_tee") << "Validate the output is decoded once";
+  EXPECT_EQ(plan.links[1].src_pad, "src_%u") << "Validate every branch requests a tee pad";
+  EXPECT_EQ(plan.links[1].sink, "infer_queue") << "Validate queues are not doubled";
+  EXPECT_EQ(plan.links[4].sink, "decoder_preview_queue");
+  ASSERT_EQ(plan.links[4].probes.size(), 1u) << "Validate the probe is on the branch";
+  EXPECT_EQ(plan.links[4].probes[0].function_name, "osd_callback");
+  EXPECT_EQ(plan.links[5].sink, "preview");
+}
+
+TEST(PipelineGraphTest, invalid_graphs_are_rejected)
+{
+  std::vector<pipelineGraph::Node> nodes = {{"a", "queue"}, {"b", "queue"}, {"c", "queue"}};
+  pipelineGraph::Plan plan;
+  std::string error;
+  EXPECT_FALSE(pipelineGraph::plan(nodes, {{.from = "a", .to = "d"}}, plan, error)) << "Validate unknown nodes";
+  EXPECT_FALSE(pipelineGraph::plan(nodes, {{.from = "a", .to = "b"}, {.from = "b", .to = "c"}, {.from = "c", .to = "a"}}, plan, error))
+      << "Validate cycles";
+  EXPECT_NE(error.find("cycle"), std::string::npos);
+  EXPECT_FALSE(pipelineGraph::plan(nodes, {{.from = "a", .from_pad = "src", .to = "b"}, {.from = "a", .from_pad = "src", .to = "c"}}, plan,
+                                   error)) << "Validate a named pad is linked once";
+  EXPECT_FALSE(pipelineGraph::plan({{"a", "queue"}, {"a", "tee"}}, {}, plan, error)) << "Validate unique aliases";
+
+  // a linear chain is linked as is
+  ASSERT_TRUE(pipelineGraph::plan(nodes, {{.from = "a", .to = "b"}, {.from = "b", .to = "c", .to_pad = "sink"}}, plan, error)) << error;
+  EXPECT_TRUE(plan.elements.empty()) << "Validate nothing is inserted without fan-out";
+  EXPECT_EQ(plan.links.size(), 2u);
+}
+
+// an encoded frame of 1000 bytes at time ms, keyframes start a GOP
+GstBuffer *encodedFrame(int ms, bool keyframe)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate(NULL, 1000, NULL);
+  GST_BUFFER_PTS(buffer) = ms * GST_MSECOND;
+  GST_BUFFER_DTS(buffer) = ms * GST_MSECOND;
+  if (!keyframe)
+    GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  return buffer;
+}
+
+TEST(ClipRecorderTest, pre_roll_keeps_whole_gops_within_bounds)
+{
+  gst_init(NULL, NULL);
+  // 2s of pre-roll, 1 GOP per second at 10 fps
+  clipRecorder::PreRollRing ring(2 * GST_SECOND, 100 * 1000);
+  GstBuffer *delta = encodedFrame(0, false);
+  ring.push(delta);
+  gst_buffer_unref(delta);
+  EXPECT_EQ(ring.gops(), 0u) << "Validate frames before the first keyframe are skipped";
+
+  for (int ms = 1000; ms < 6000; ms += 100) {
+    GstBuffer *buffer = encodedFrame(ms, ms % 1000 == 0);
+    ring.push(buffer);
+    gst_buffer_unref(buffer);
+  }
+  EXPECT_EQ(ring.gops(), 3u) << "Validate the oldest GOPs are dropped once the newer ones cover the pre-roll";
+  EXPECT_GE(ring.duration(), 2 * GST_SECOND) << "Validate the pre-roll is covered";
+  EXPECT_EQ(ring.bytes(), 30 * 1000);
+  std::vector<GstBuffer *> frames = ring.snapshot();
+  ASSERT_EQ(frames.size(), 30u);
+  EXPECT_FALSE(GST_BUFFER_FLAG_IS_SET(frames[0], GST_BUFFER_FLAG_DELTA_UNIT)) << "Validate a clip starts on a keyframe";
+  EXPECT_EQ(GST_BUFFER_DTS(frames[0]), 3 * GST_SECOND);
+  GstBuffer *rebased = clipRecorder::rebase(frames[5], GST_BUFFER_DTS(frames[0]));
+  EXPECT_EQ(GST_BUFFER_PTS(rebased), 500 * GST_MSECOND) << "Validate clip timestamps start at 0";
+  gst_buffer_unref(rebased);
+  for (GstBuffer *frame : frames)
+    gst_buffer_unref(frame);
+
+  // 25 frames per GOP: the byte bound drops the GOPs the time bound would keep
+  clipRecorder::PreRollRing bounded(10 * GST_SECOND, 60 * 1000);
+  for (int ms = 0; ms < 5000; ms += 40) {
+    GstBuffer *buffer = encodedFrame(ms, ms % 1000 == 0);
+    bounded.push(buffer);
+    gst_buffer_unref(buffer);
+  }
+  EXPECT_LE(bounded.bytes(), 60 * 1000) << "Validate memory is bounded";
+  EXPECT_EQ(bounded.gops(), 2u);
+  bounded.clear();
+  EXPECT_EQ(bounded.bytes(), 0);
+}
+
+TEST(ClipRecorderTest, rules_fire_after_their_duration)
+{
+  njson payload = {{"inference", {{{"label", "person"}, {"confidence", 80}, {"tracking_id", 1}}}}};
+  clipRecorder::ClipRule person = {.label = "person", .min_confidence = 50, .min_duration_ms = 1000};
+  EXPECT_TRUE(clipRecorder::matches(person, payload));
+  EXPECT_FALSE(clipRecorder::matches({.label = "car"}, payload)) << "Validate the label";
+  EXPECT_FALSE(clipRecorder::matches({.label = "person", .min_confidence = 90}, payload)) << "Validate the confidence";
+  EXPECT_TRUE(clipRecorder::matches({.label = ""}, payload)) << "Validate an empty label matches every object";
+  EXPECT_FALSE(clipRecorder::matches(person, njson::object())) << "Validate payloads without detections";
+
+  clipRecorder::RuleState state;
+  int64_t s = 1000000;
+  EXPECT_FALSE(clipRecorder::updateRule(state, person, true, 10 * s, 1000)) << "Validate a new sighting does not fire";
+  EXPECT_FALSE(clipRecorder::updateRule(state, person, true, 10 * s + s / 2, 1000));
+  EXPECT_FALSE(clipRecorder::updateRule(state, person, false, 11 * s, 1000));
+  EXPECT_TRUE(clipRecorder::updateRule(state, person, true, 11 * s, 1000)) << "Validate the rule fires after min_duration_ms";
+  EXPECT_FALSE(clipRecorder::updateRule(state, person, true, 13 * s, 1000)) << "Validate a gap restarts the sighting";
+  EXPECT_TRUE(clipRecorder::updateRule(state, {.label = "person"}, true, 13 * s, 1000)) << "Validate rules without duration fire at once";
+}
+
+TEST(RecordingTest, passthrough_files_and_sidecar)
+{
+  EXPECT_EQ(recording::fragmentLocation("/out/video/cam.mp4", 0, 0), "/out/video/cam.mp4") << "Validate a single file";
+  EXPECT_EQ(recording::fragmentLocation("/out/video/cam.mp4", 0, 1), "/out/video/cam_00001.mp4") << "Validate a restart does not overwrite it";
+  EXPECT_EQ(recording::fragmentLocation("/out/video/cam.mkv", 60, 12), "/out/video/cam_00012.mkv") << "Validate segments are numbered";
+  EXPECT_EQ(recording::fragmentLocation("/out/100%d/cam.mp4", 60, 3), "/out/100%d/cam_00003.mp4") << "Validate the path is not a format";
+  recording::Recordings recordings;
+  recording::Passthrough *first = recordings.add(7, "/tmp/t_recording_cam.mp4", 60);
+  first->fragments = 3;
+  EXPECT_EQ(recordings.add(7, "/tmp/t_recording_cam.mp4", 60)->fragments, 3u) << "Validate a source added again follows its files";
+  EXPECT_EQ(recording::sidecarPath("/out/video/cam.mp4"), "/out/video/cam.jsonl");
+  EXPECT_EQ(recording::recordParser("video/x-h265"), "h265parse");
+  EXPECT_EQ(recording::recordParser("video/x-vp9"), "") << "Validate codecs that cannot be recorded as is";
+
+  std::string path = "/tmp/t_recording_sidecar.jsonl";
+  {
+    recording::Sidecar sidecar(path);
+    sidecar.segment("/out/video/cam_00000.mp4", 2 * GST_SECOND);
+    sidecar.payload({{"meta", {{"pts", 2040000000}}}, {"inference", {{{"label", "person"}}}}});
+  }
+  std::ifstream file(path);
+  std::string line;
+  ASSERT_TRUE(std::getline(file, line));
+  EXPECT_EQ(njson::parse(line)["pts"].get<int64_t>(), 2000000000) << "Validate segments carry the timestamp of their first frame";
+  ASSERT_TRUE(std::getline(file, line));
+  EXPECT_EQ(njson::parse(line)["inference"][0]["label"], "person") << "Validate a payload per line";
+  EXPECT_FALSE(std::getline(file, line));
+}
+
+TEST(InferenceCascadeTest, stages_from_config)
+{
+  std::vector<inferenceCascade::InferenceStage> stages;
+  std::string error;
+  njson conf = njson::parse(R"([
+    {"config": "detection.yml", "interval": 1},
+    {"name": "landmarks", "config": "faciallandmark/classifier.yml", "class_ids": [0, 2], "min_size": 32},
+    {"config": "/opt/models/color.yml"}
+  ])");
+  ASSERT_TRUE(inferenceCascade::parseCascade(conf, "/src/configs/model", stages, error)) << error;
+  ASSERT_EQ(stages.size(), 3);
+  EXPECT_EQ(stages[0].name, "detector");
+  EXPECT_EQ(stages[0].interval, 1);
+  EXPECT_EQ(stages[1].config, "/src/configs/model/faciallandmark/classifier.yml") << "Validate configs are relative to the model directory";
+  EXPECT_EQ(inferenceCascade::classIds(stages[1].class_ids), "0:2");
+  EXPECT_EQ(stages[2].name, "secondary2");
+  EXPECT_EQ(stages[2].interval, -1) << "Validate the config file keeps its interval";
+  EXPECT_EQ(inferenceCascade::elementName(0), "nv_detection") << "Validate the governor finds the primary";
+
+  EXPECT_FALSE(inferenceCascade::parseCascade(njson::array(), "/m", stages, error));
+  EXPECT_FALSE(inferenceCascade::parseCascade(njson::parse(R"([{"config": "d.yml", "class_ids": [0]}])"), "/m", stages, error))
+      << "Validate the primary runs on full frames";
+  EXPECT_FALSE(inferenceCascade::parseCascade(njson::parse(R"([{"config": "d.yml"}, {"config": "c.yml", "min_size": -1}])"), "/m", stages, error));
+  EXPECT_FALSE(inferenceCascade::parseCascade(njson::parse(R"([{"config": "d.yml", "name": "a"}, {"config": "c.yml", "name": "a"}])"), "/m", stages, error));
+}
+
+TEST(InferenceCascadeTest, min_object_size_in_config)
+{
+  std::string yaml = "property:\n  gpu-id: 0\n  input-object-min-width: 5\n  process-mode: 2\n\nclass-attrs-all:\n  threshold: 0.2\n";
+  std::string ret = inferenceCascade::withMinObjectSize(yaml, 32);
+  EXPECT_NE(ret.find("property:\n  input-object-min-width: 32\n  input-object-min-height: 32\n  gpu-id: 0\n"), std::string::npos) << ret;
+  EXPECT_EQ(ret.find("input-object-min-width: 5"), std::string::npos) << "Validate the value of the config is replaced";
+  EXPECT_NE(ret.find("class-attrs-all:\n  threshold: 0.2"), std::string::npos) << "Validate other groups are kept";
+
+  std::string ini = "[property]\ngpu-id=0\n[class-attrs-all]\nthreshold=0.2\n";
+  EXPECT_EQ(inferenceCascade::withMinObjectSize(ini, 16),
+            "[property]\ninput-object-min-width=16\ninput-object-min-height=16\ngpu-id=0\n[class-attrs-all]\nthreshold=0.2\n");
+  EXPECT_EQ(inferenceCascade::withMinObjectSize("other: 1\n", 16), "other: 1\n") << "Validate configs without properties are kept";
+}
+
+TEST(MotionGateTest, synthetic_motion_and_noise)
+{
+  const int width = 64, height = 36, stride = 80;
+  std::vector<uint8_t> frame(stride * height, 100);
+  auto square = [&](int x0) {
+    std::fill(frame.begin(), frame.end(), 100);
+    for (int y = 10; y < 20; y++)
+      for (int x = x0; x < x0 + 10; x++)
+        frame[y * stride + x] = 200;
+  };
+  motionGate::MotionPolicy policy;
+  motionGate::MotionDetector detector(policy);
+  square(0);
+  EXPECT_TRUE(detector.update(frame.data(), width, height, stride)) << "Validate the first frame is motion";
+  EXPECT_FALSE(detector.update(frame.data(), width, height, stride)) << "Validate a still frame";
+  square(8);
+  EXPECT_TRUE(detector.update(frame.data(), width, height, stride)) << "Validate a moving square";
+
+  // noise below the pixel threshold
+  std::srand(7);
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      frame[y * stride + x] = (uint8_t) (frame[y * stride + x] + std::rand() % 11 - 5);
+  EXPECT_FALSE(detector.update(frame.data(), width, height, stride)) << "Validate noise is not motion";
+  EXPECT_LT(detector.changed, policy.min_changed);
+
+  std::vector<uint8_t> a(1000), b(1000);
+  for (size_t i = 0; i < a.size(); i++)
+    a[i] = (uint8_t) std::rand(), b[i] = (uint8_t) std::rand();
+  size_t expected = 0;
+  for (size_t i = 0; i < a.size(); i++)
+    expected += std::abs((int) a[i] - (int) b[i]) > 20;
+  EXPECT_EQ(motionGate::countChanged(a.data(), b.data(), a.size(), 20), expected) << "Validate the SIMD count matches the scalar one";
+}
+
+TEST(MotionGateTest, batches_skip_still_sources_with_keep_alive)
+{
+  motionGate::MotionPolicy policy{.enable = true, .hold_s = 1.0, .keep_alive_s = 2.0};
+  motionGate::Gates gates(policy);
+  motionGate::SourceMotion *still = gates.add(0);
+  motionGate::SourceMotion *moving = gates.add(1);
+  ASSERT_NE(still, nullptr);
+  EXPECT_EQ(gates.add(256), nullptr) << "Validate a slot is not shared";
+
+  int64_t now = 10000000;
+  EXPECT_TRUE(motionGate::decideBatch({still}, now, policy)) << "Validate a source is inferred first";
+  EXPECT_FALSE(motionGate::decideBatch({still}, now + 500000, policy)) << "Validate a still source skips inference";
+  EXPECT_TRUE(motionGate::decideBatch({still}, now + 2000000, policy)) << "Validate the keep-alive";
+  motionGate::onGreyFrame(*moving, true, now + 2000000, policy);
+  EXPECT_TRUE(motionGate::decideBatch({still, moving}, now + 2500000, policy)) << "Validate a batch is inferred for any source";
+  EXPECT_FALSE(motionGate::decideBatch({still, moving}, now + 3500000, policy)) << "Validate motion is held for hold_s";
+  EXPECT_TRUE(motionGate::decideBatch({still, nullptr}, now + 3600000, policy)) << "Validate sources without gate are inferred";
+
+  njson stats = gates.to_json();
+  EXPECT_EQ(stats["0"]["frames"], 6);
+  EXPECT_EQ(stats["0"]["skipped"], 2);
+  EXPECT_DOUBLE_EQ(stats["1"]["skipped_fraction"].get<double>(), 0.5);
+}
+
+TEST(QosStatsTest, elements_are_grouped_by_stage)
+{
+  EXPECT_EQ(qosStats::stageOf("nvinfer", "inferenceBin/nv_detection"), "inference");
+  EXPECT_EQ(qosStats::stageOf("nvstreammux", "inferenceBin/nv_mux"), "inference");
+  EXPECT_EQ(qosStats::stageOf("nvvideoconvert", "sinkBin0/sink_convert"), "conversion");
+  EXPECT_EQ(qosStats::stageOf("x264enc", "sinkBin0/sink_encoder"), "encoding");
+  EXPECT_EQ(qosStats::stageOf("rtmpsink", "sinkBin0/sink"), "sink");
+  EXPECT_EQ(qosStats::stageOf("h264parse", "srcBin0/src_parser"), "source") << "Validate the elements of a source bin are the source";
+  EXPECT_EQ(qosStats::stageOf("", "nv_tracker"), "inference") << "Validate the name is used without factory";
+}
+
+TEST(QosStatsTest, cumulative_counts_and_summary)
+{
+  qosStats::ShardQos qos(90);
+  EXPECT_EQ(qos.record("inferenceBin/nv_detection", "nvinfer", true, 100, 4, 20000000, 1.2), 4);
+  EXPECT_EQ(qos.record("inferenceBin/nv_detection", "nvinfer", true, 150, 10, 5000000, 1.1), 6) << "Validate the counts are cumulative";
+  EXPECT_EQ(qos.record("sinkBin0/sink_encoder", "x264enc", true, 40, 1, 1000000, 1.0), 1);
+  EXPECT_EQ(qos.record("sinkBin0/sink", "fakesink", false, 10, 10, 2000000, 0.9), 0) << "Validate other formats only report jitter";
+
+  njson summary = qos.summary();
+  ASSERT_EQ(summary["elements"].size(), 3);
+  EXPECT_EQ(summary["elements"][0]["element"], "inferenceBin/nv_detection") << "Validate the elements are sorted by drops";
+  EXPECT_EQ(summary["elements"][0]["dropped"], 10);
+  EXPECT_EQ(summary["elements"][0]["processed"], 150);
+  EXPECT_DOUBLE_EQ(summary["elements"][0]["max_jitter_ms"].get<double>(), 20.0);
+  EXPECT_EQ(summary["stages"]["inference"], 10);
+  EXPECT_EQ(summary["stages"]["encoding"], 1);
+  EXPECT_EQ(summary["dropped"], 11);
+  EXPECT_NE(qosStats::ShardQos::table(summary).find("inferenceBin/nv_detection"), std::string::npos);
+
+  EXPECT_TRUE(qos.summary()["elements"].empty()) << "Validate a summary starts a new period";
+  EXPECT_EQ(qos.record("inferenceBin/nv_detection", "nvinfer", true, 160, 12, 0, 1.0), 2);
+  EXPECT_EQ(qos.summary()["elements"][0]["processed"], 10);
+  std::string metrics = core::Metrics::get().render();
+  EXPECT_NE(metrics.find("iva_qos_dropped_total{shard=\"90\",element=\"inferenceBin/nv_detection\",stage=\"inference\"} 12"), std::string::npos);
+}
+
+TEST(QosStatsTest, reset_keeps_elements_of_a_restarted_shard)
+{
+  qosStats::ShardQos qos(91);
+  EXPECT_EQ(qos.record("inferenceBin/nv_detection", "nvinfer", true, 500, 20, 0, 1.0), 20);
+  qos.reset();
+  EXPECT_EQ(qos.record("inferenceBin/nv_detection", "nvinfer", true, 10, 2, 0, 1.0), 2) << "Validate the counts of the rebuilt element start over";
+  njson summary = qos.summary();
+  ASSERT_EQ(summary["elements"].size(), 1);
+  EXPECT_EQ(summary["elements"][0]["processed"], 10) << "Validate the window was cleared by the reset";
+  std::string metrics = core::Metrics::get().render();
+  EXPECT_NE(metrics.find("iva_qos_dropped_total{shard=\"91\",element=\"inferenceBin/nv_detection\",stage=\"inference\"} 22"), std::string::npos)
+      << "Validate the totals keep counting across the restart";
+}
+
+TEST(CpuProfileTest, stub_detections_become_payloads)
+{
+  gst_init(NULL, NULL);
+  core::Processing processor;
+  njson conf = {{"topic", "cpu-profile"}, {"device_id", "cpu-profile"}, {"model", "stub"}, {"model_type", "stub"}, {"publish", false},
+                {"save", false}, {"display_detections", false}, {"bbox_line_thickness", 2}, {"min_confidence_to_display", 40}, {"font_size", 1}};
+  ASSERT_TRUE(processor.set_configs(conf));
+  processor.set_up(3);
+  std::vector<njson> payloads;
+  processor.add_payload_hook([&payloads](int source_id, njson &payload) { payloads.push_back(payload); });
+
+  // source 2 through the cpu inference bin, scaled from 320x240 to 160x120 before the stub detector
+  GstElement *pipeline = gst_pipeline_new("cpu_profile");
+  GstElement *srcBin = gst_parse_bin_from_description("videotestsrc num-buffers=3 ! video/x-raw,format=I420,width=320,height=240", TRUE, NULL);
+  GstElement *inferenceBin = pipelineUtils::createCpuInferenceBin("inferenceBin", {2}, 160, 120);
+  GstElement *sink = gst_element_factory_make("fakesink", "sink");
+  ASSERT_NE(srcBin, nullptr);
+  gst_bin_add_many(GST_BIN(pipeline), srcBin, inferenceBin, sink, NULL);
+  ASSERT_TRUE(gst_element_link_pads(srcBin, NULL, inferenceBin, "input2"));
+  ASSERT_TRUE(gst_element_link_pads(inferenceBin, "output2", sink, "sink"));
+  GstElement *detector = gst_bin_get_by_name(GST_BIN(inferenceBin), "stub_detector_2");
+  ASSERT_NE(detector, nullptr) << "Validate the branch has a stub detector named by the source id";
+  GstPad *probe_pad = gst_element_get_static_pad(detector, "src");
+  gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::cpu_probe_callback, (gpointer) &processor, NULL);
+  gst_object_unref(probe_pad);
+  gst_object_unref(detector);
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  GstBus *bus = gst_element_get_bus(pipeline);
+  GstMessage *msg = gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND, (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+  ASSERT_NE(msg, nullptr) << "Validate the pipeline finished";
+  EXPECT_EQ(GST_MESSAGE_TYPE(msg), GST_MESSAGE_EOS);
+  gst_message_unref(msg);
+  gst_object_unref(bus);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  ASSERT_EQ(payloads.size(), 3) << "Validate one payload per frame";
+  for (size_t i = 0; i < payloads.size(); i++) {
+    const njson &payload = payloads[i];
+    EXPECT_EQ(payload["meta"]["frame"], i) << "Validate the frames are numbered like nvstreammux does";
+    EXPECT_EQ(payload["meta"]["resolution"]["width"], 160) << "Validate the detections refer to the scaled frame";
+    EXPECT_EQ(payload["meta"]["resolution"]["height"], 120);
+    ASSERT_EQ(payload["inference"].size(), 1);
+    EXPECT_EQ(payload["inference"][0]["label"], "stub");
+    EXPECT_EQ(payload["inference"][0]["camera_id"], 2);
+    EXPECT_EQ(payload["inference"][0]["confidence"], 90);
+    EXPECT_EQ(payload["inference"][0]["bbox"]["x_max"].get<int>() - payload["inference"][0]["bbox"]["x_min"].get<int>(), 32);
+    EXPECT_EQ(payload["inference"][0]["bbox"]["y_min"], 48);
+  }
+}
 
 }  // namespace
 }  // namespace pipeline_test
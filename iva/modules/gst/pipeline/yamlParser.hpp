@@ -4,6 +4,8 @@
 #include <string>
 
 #include "logging.hpp"
+#include "pipelineGraph.hpp"
+#include "pipelineUtils.hpp"
 
 
 namespace yamlParser {
@@ -54,6 +56,46 @@ inline bool link_static_pad_elements(GstElement *pipeline, GstElement *new_eleme
   return true;
 }
 
+/**
+ * @brief sets an element property from a `key=value` string, the value type is guessed from its text
+ * @param new_element the element
+ * @param prop the property (e.g. caps=video/x-raw, leaky=2)
+ */
+inline void set_element_property(GstElement *new_element, const std::string &prop)
+{
+  // Split the fruit item by "=" sign
+  std::istringstream iss(prop);
+  std::string key, value;
+  std::getline(iss, key, '=');
+  std::getline(iss, value);
+
+  // set element property based on its type
+  if (isInt(value)) {
+    VLOG(DEBUG) << "\t\tprop[int]: " << key << "," << value;
+    g_object_set(G_OBJECT(new_element), key.c_str(), std::stoi(value), NULL);
+  }
+  else if (key == "caps") {
+    VLOG(DEBUG) << "\t\tprop[caps]: " << key << "," << value;
+    g_object_set(G_OBJECT(new_element), key.c_str(), gst_caps_from_string(value.c_str()), NULL);
+  }
+  else if (value == "true") {
+    VLOG(DEBUG) << "\t\tprop[true]: " << key << "," << true;
+    g_object_set(G_OBJECT(new_element), key.c_str(), true, NULL);
+  }
+  else if (value == "false") {
+    VLOG(DEBUG) << "\t\tprop[false]: " << key << "," << false;
+    g_object_set(G_OBJECT(new_element), key.c_str(), false, NULL);
+  }
+  else if (isFloat(value)) {
+    VLOG(DEBUG) << "\t\tprop[float]: " << key << "," << value;
+    g_object_set(G_OBJECT(new_element), key.c_str(), std::stof(value), NULL);
+  }
+  else {
+    VLOG(DEBUG) << "\t\tprop[str]: " << key << "," << value;
+    g_object_set(G_OBJECT(new_element), key.c_str(), value.c_str(), NULL);
+  }
+}
+
 /**
  * @brief sets element property field by parsing through `property` key list in YAML file
  * @param property_key the `property` key in the YAML file
@@ -70,37 +112,7 @@ inline bool set_element_properties(GstElement *new_element, const YAML::Node &pr
       LOG(ERROR) << "ERROR getting YAML field from property=" << property << ": ErrMsg=" << e.what();
       return false;
     }
-    // Split the fruit item by "=" sign
-    std::istringstream iss(prop);
-    std::string key, value;
-    std::getline(iss, key, '=');
-    std::getline(iss, value);
-
-    // set element property based on its type
-    if (isInt(value)) {
-      VLOG(DEBUG) << "\t\tprop[int]: " << key << "," << value;
-      g_object_set(G_OBJECT(new_element), key.c_str(), std::stoi(value), NULL);
-    }
-    else if (key == "caps") {
-      VLOG(DEBUG) << "\t\tprop[caps]: " << key << "," << value;
-      g_object_set(G_OBJECT(new_element), key.c_str(), gst_caps_from_string(value.c_str()), NULL);
-    }
-    else if (value == "true") {
-      VLOG(DEBUG) << "\t\tprop[true]: " << key << "," << true;
-      g_object_set(G_OBJECT(new_element), key.c_str(), true, NULL);
-    }
-    else if (value == "false") {
-      VLOG(DEBUG) << "\t\tprop[false]: " << key << "," << false;
-      g_object_set(G_OBJECT(new_element), key.c_str(), false, NULL);
-    }
-    else if (isFloat(value)) {
-      VLOG(DEBUG) << "\t\tprop[float]: " << key << "," << value;
-      g_object_set(G_OBJECT(new_element), key.c_str(), std::stof(value), NULL);
-    }
-    else {
-      VLOG(DEBUG) << "\t\tprop[str]: " << key << "," << value;
-      g_object_set(G_OBJECT(new_element), key.c_str(), value.c_str(), NULL);
-    }
+    set_element_property(new_element, prop);
   }
   return true;
 }
@@ -173,4 +185,107 @@ inline bool link_pipeline_elements(GstElement *pipeline, GstElement *new_element
   return true;
 }
 
+/**
+ * @brief a YAML field that is a single string or a list of strings
+ * @param field the field
+ * @return the strings, empty if the field is missing
+ */
+inline std::vector<std::string> as_string_list(const YAML::Node &field)
+{
+  std::vector<std::string> ret;
+  if (!field)
+    return ret;
+  if (field.IsSequence()) {
+    for (const auto &item : field)
+      ret.push_back(item.as<std::string>());
+  }
+  else {
+    ret.push_back(field.as<std::string>());
+  }
+  return ret;
+}
+
+/**
+ * @brief parse the `nodes` and `edges` of a graph pipeline
+ *
+ *    nodes:                            # elements, same fields as the `source` list (name, alias, property, callback)
+ *      - name: nvvideoconvert
+ *        alias: decoder
+ *    edges:
+ *      - from: decoder                 # alias of the upstream node (from_pad: optional src pad or request template)
+ *        to: [infer_queue, recorder]   # one or more downstream aliases (to_pad: optional, single target only)
+ *        queue: [leaky=2]              # optional properties of the queues added on the branches of a tee
+ *        probe: probe_callback         # optional callbacks on the buffers entering every branch
+ *
+ * @param config the YAML file
+ * @param nodes the nodes, in the order of the file
+ * @param edges the edges, one per target
+ * @return true if the fields are valid
+ */
+inline bool parse_graph(const YAML::Node &config, std::vector<pipelineGraph::Node> &nodes, std::vector<pipelineGraph::Edge> &edges)
+{
+  try {
+    for (const auto &node : config["nodes"])
+      nodes.push_back({.alias = node["alias"].as<std::string>(), .factory = node["name"].as<std::string>()});
+    for (const auto &edge : config["edges"]) {
+      std::vector<std::string> targets = as_string_list(edge["to"]);
+      if (targets.empty() || !edge["from"]) {
+        LOG(ERROR) << "Invalid yaml edge, expects the fields `from` and `to`: " << edge;
+        return false;
+      }
+      if (targets.size() > 1 && edge["to_pad"]) {
+        LOG(ERROR) << "Invalid yaml edge, `to_pad` needs a single target: " << edge;
+        return false;
+      }
+      std::vector<pipelineGraph::Probe> probes;
+      for (const std::string &function_name : as_string_list(edge["probe"]))
+        probes.push_back({.function_name = function_name});
+      for (const std::string &to : targets) {
+        edges.push_back({.from = edge["from"].as<std::string>(),
+                         .from_pad = edge["from_pad"] ? edge["from_pad"].as<std::string>() : "",
+                         .to = to,
+                         .to_pad = edge["to_pad"] ? edge["to_pad"].as<std::string>() : "",
+                         .queue_properties = as_string_list(edge["queue"]),
+                         .probes = probes});
+      }
+    }
+  }
+  catch (const std::exception &e) {
+    LOG(ERROR) << "ERROR getting YAML fields of the graph (nodes: name, alias; edges: from, to) ErrMsg=" << e.what();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief a pad of an element to link: the default pad (src or sink) when no name is given, a static pad, or a new request pad
+ * @param element the element
+ * @param name name of the pad or request template, empty for the default pad
+ * @param direction GST_PAD_SRC or GST_PAD_SINK
+ * @return the pad (unref it), NULL if the element does not have it (yet)
+ */
+inline GstPad *get_link_pad(GstElement *element, const std::string &name, GstPadDirection direction)
+{
+  std::string pad_name = !name.empty() ? name : direction == GST_PAD_SRC ? "src" : "sink";
+  if (!pipelineGraph::isTemplate(pad_name)) {
+    GstPad *pad = gst_element_get_static_pad(element, pad_name.c_str());
+    if (pad != NULL)
+      return pad;
+  }
+  return gst_element_get_request_pad(element, pad_name.c_str());
+}
+
+/**
+ * @brief true if an element creates src pads while it runs (e.g. demuxers, decodebin), its links are made on pad-added
+ */
+inline bool has_sometimes_src_pads(GstElement *element)
+{
+  for (const GList *t = gst_element_class_get_pad_template_list(GST_ELEMENT_GET_CLASS(element)); t != NULL; t = t->next) {
+    GstPadTemplate *pad_template = (GstPadTemplate *) t->data;
+    if (GST_PAD_TEMPLATE_DIRECTION(pad_template) == GST_PAD_SRC && GST_PAD_TEMPLATE_PRESENCE(pad_template) == GST_PAD_SOMETIMES)
+      return true;
+  }
+  return false;
+}
+
 } // namespace yamlParser
\ No newline at end of file
@@ -12,12 +12,17 @@ core::Processing::Processing()
   LOG(INFO) << "CREATED: " << *this << " with ID=" << core::Module::GST_PROCESSOR;
 }
 
-core::Processing::~Processing() {}
+core::Processing::~Processing()
+{
+  // waits for the thumbnails being encoded
+  delete this->_snapshots;
+}
 
 /**
- * @brief loads modules settings from config.json
+ * @brief loads modules settings from config.json, and again when config.json changes while running: the settings are published
+ *  as a new snapshot that the probes pick up with their next frame (settings used by set_up need a restart)
  *
- * @return bool true if successful
+ * @return bool true if successful, false keeps the current settings
  */
 bool Processing::set_configs(njson conf)
 {
@@ -64,6 +69,45 @@ bool Processing::set_configs(njson conf)
       return false;
     }
 
+    snapshots::SnapshotPolicy snapshot_policy;
+    if(conf.contains("snapshots")) {
+      const njson &sc = conf["snapshots"];
+      if(!sc.is_object()) {
+        LOG(WARNING) << "Invalid config.json element! processing['snapshots'] must be an object";
+        return false;
+      }
+      if(sc.contains("labels") && !sc["labels"].is_array()) {
+        LOG(WARNING) << "Invalid config.json element! processing['snapshots']['labels'] must be an array of labels";
+        return false;
+      }
+      for(const char *key : {"min_confidence", "min_size", "quality", "workers", "max_pending"}) {
+        if(sc.contains(key) && !sc[key].is_number_integer()) {
+          LOG(WARNING) << "Invalid config.json element! processing['snapshots']['" << key << "'] must be an integer";
+          return false;
+        }
+      }
+      if(sc.contains("padding") && !(sc["padding"].is_number() && sc["padding"] >= 0)) {
+        LOG(WARNING) << "Invalid config.json element! processing['snapshots']['padding'] must be a number >= 0";
+        return false;
+      }
+      std::string output = sc.value("output", "file");
+      if(output != "file" && output != "inline") {
+        LOG(WARNING) << "Invalid config.json element! processing['snapshots']['output'] must be 'file' or 'inline'";
+        return false;
+      }
+      snapshot_policy.enable = sc.value("enable", true);
+      for(const auto &label : sc.value("labels", njson::array()))
+        snapshot_policy.labels.insert(label.get<std::string>());
+      snapshot_policy.min_confidence = sc.value("min_confidence", snapshot_policy.min_confidence);
+      snapshot_policy.min_size = sc.value("min_size", snapshot_policy.min_size);
+      snapshot_policy.padding = sc.value("padding", snapshot_policy.padding);
+      snapshot_policy.once_per_track = sc.value("once_per_track", snapshot_policy.once_per_track);
+      snapshot_policy.inline_bytes = output == "inline";
+      snapshot_policy.quality = std::clamp(sc.value("quality", snapshot_policy.quality), 1, 100);
+      snapshot_policy.workers = std::max(1, sc.value("workers", snapshot_policy.workers));
+      snapshot_policy.max_pending = std::max(1, sc.value("max_pending", snapshot_policy.max_pending));
+    }
+
     core::ProcessingSettings configs = {
         .topic = conf["topic"],
         .device_id = conf["device_id"],
@@ -75,17 +119,29 @@ bool Processing::set_configs(njson conf)
         .bbox_line_thickness = conf["bbox_line_thickness"],
         .min_confidence_to_display = conf["min_confidence_to_display"],
         .font_size = conf["font_size"],
+        .snapshots = snapshot_policy,
     };
-    this->_configs = configs;
+    // a reload (config.json changed while running) keeps what set_up built from the previous settings
+    std::shared_ptr<const core::ProcessingSettings> current = this->_configs.get();
+    if (current != nullptr && !(configs.snapshots == current->snapshots)) {
+      LOG(WARNING) << "config.json processing['snapshots'] changed, restart the application to apply it";
+      configs.snapshots = current->snapshots;
+    }
+    if (this->_overlay_disabled)
+      configs.display_detections = false;
+    if (current == nullptr) {
+      // read timezone from /etc/timezone
+      this->_tz = processUtils::read_timezone_from_system();
+    }
+    this->_configs.publish(configs);
+    if (current != nullptr)
+      LOG(INFO) << "Processing configs reloaded (version " << this->_configs.version() << ")";
     VLOG(DEBUG) << "Processing configs: " << conf.dump(4);
   }
   catch (const std::exception &e) {
     LOG(ERROR) << "Error setting Processing configs: " << e.what();
     return false;
   }
-
-  // read timezone from /etc/timezone
-  this->_tz = processUtils::read_timezone_from_system();
   return true;
 }
 
@@ -97,23 +153,122 @@ void core::Processing::set_up(int source_count)
 {
   this->_processor = (core::VideoSourceData){
       .lock = new std::mutex(),
-      .meta_queue = new std::queue<njson>()};
+      .meta_queue = new std::queue<njson>(),
+      .meta_depth = &core::Metrics::get().gauge("iva_queue_depth", "Payloads waiting in a queue.", {{"queue", "meta"}})};
 
   // instantiate callback data (for each stream)
   this->_display_lock.lock();
   this->_display_queue.resize(source_count);
+  this->_display_depth.resize(source_count, nullptr);
   for (int q=0; q< source_count; q++)
   {
     this->_display_queue[q] = new std::queue<njson>();
+    this->_export_display_depth(q);
   }
   this->_display_lock.unlock();
 
+  if (this->_configs.get() != nullptr && this->_configs->snapshots.enable) {
+    this->_snapshots = new snapshots::Snapshotter(this->_configs->snapshots, BASE_DIR + "/outputs/image", [this](njson message) {
+      // inline thumbnails are published on their own, next to the payload that references them
+      std::shared_ptr<const core::ProcessingSettings> configs = this->_configs.get();
+      if (!configs->publish)
+        return;
+      message["topic"] = configs->topic;
+      message["meta"]["device_id"] = configs->device_id;
+      message["meta"]["utc"] = processUtils::generate_ts_epoch();
+      message["meta"]["uuid"] = processUtils::generate_uuid();
+      this->_add_meta_queue(message);
+      this->_create_kafka_publish_event();
+    });
+    LOG(INFO) << "Processing captures thumbnails (" << (this->_configs->snapshots.inline_bytes ? "inline" : "outputs/image") << ")";
+  }
+
   LOG(INFO) << "Processing set up for source=(" << this->_display_queue.size() << ")";
 }
 
+/**
+ * @brief creates the data structure of a source that was added while the pipeline is running
+ * @param source_id global id of the source (same as NvDsFrameMeta::source_id)
+ */
+void core::Processing::add_source(int source_id)
+{
+  this->_display_lock.lock();
+  if (source_id >= (int) this->_display_queue.size()) {
+    this->_display_queue.resize(source_id + 1, nullptr);
+    this->_display_depth.resize(source_id + 1, nullptr);
+  }
+  if (this->_display_queue[source_id] == nullptr) {
+    this->_display_queue[source_id] = new std::queue<njson>();
+    this->_export_display_depth(source_id);
+  }
+  this->_display_lock.unlock();
+  LOG(INFO) << "Processing added source=" << source_id;
+}
+
+/**
+ * @brief frees the data structure of a source that was removed while the pipeline is running
+ * @param source_id global id of the source (same as NvDsFrameMeta::source_id)
+ */
+void core::Processing::remove_source(int source_id)
+{
+  this->_display_lock.lock();
+  if (source_id >= 0 && source_id < (int) this->_display_queue.size()) {
+    delete this->_display_queue[source_id];
+    this->_display_queue[source_id] = nullptr;
+    this->_display_depth[source_id]->store(0, std::memory_order_relaxed);
+  }
+  this->_display_lock.unlock();
+  LOG(INFO) << "Processing removed source=" << source_id;
+}
+
+/**
+ * @brief register the depth of the display queue of a source (the gauge is kept when the source is removed and reused if it comes back)
+ * @param source_id global id of the source
+ */
+void core::Processing::_export_display_depth(int source_id)
+{
+  this->_display_depth[source_id] = &core::Metrics::get().gauge("iva_queue_depth", "Payloads waiting in a queue.",
+                                                                {{"queue", "display"}, {"source", std::to_string(source_id)}});
+}
+
+/**
+ * @brief stop queuing payloads for the osd callback, used when no osd callback consumes them (nvdsosd draws the gpu mosaic)
+ */
+void core::Processing::disable_overlay()
+{
+  this->_overlay_disabled = true;
+  if (this->_configs.get() != nullptr) {
+    core::ProcessingSettings configs = *this->_configs.get();
+    configs.display_detections = false;
+    this->_configs.publish(configs);
+  }
+  LOG(INFO) << "Processing overlay disabled, detections are drawn by the pipeline";
+}
+
+/**
+ * @brief act on every payload before it is published, in the order the hooks were added (e.g. the clip rules add the path of the
+ *  clip, passthrough recordings write the payload to their sidecar)
+ * @note add the hooks before the pipeline starts, they run on the streaming thread of the inference
+ * @param hook called with the source id and the payload, which it may extend
+ */
+void core::Processing::add_payload_hook(std::function<void(int, njson &)> hook)
+{
+  this->_payload_hooks.push_back(std::move(hook));
+}
+
+/**
+ * @brief name the nvinfer stages of the pipeline, the labels of the secondary stages are added to the items of the payloads
+ * @param stages names of the stages, the stage with the nvinfer unique-id i is stages[i - 1]
+ */
+void core::Processing::set_inference_stages(std::vector<std::string> stages)
+{
+  this->_inference_stages = std::move(stages);
+}
+
 
 /// PROCESSING CALLBACKS TO UNPACK GSTREAMER BUFFER
 
+#ifndef CPU_ONLY
 /**
  * @brief extracts metadata from src pad of NvInfer, NvTracker, or NvDsOSD elements and creates a kafka payload with its items
  * @copydoc configure the application config (/src/configs/config.json) fields processing['save'] to save images and processing['publish'] to publish results
@@ -122,6 +277,7 @@ void core::Processing::set_up(int source_count)
  */
 bool core::Processing::probe_callback(GstPad *pad, GstPadProbeInfo *info)
 {
+  core::StartupTimeline::get().mark_first(core::Milestone::FIRST_INFERENCE);
 
   GstVideoInfo video_info;
   GstCaps *caps = gst_pad_get_current_caps(pad);
@@ -158,6 +314,9 @@ bool core::Processing::probe_callback(GstPad *pad, GstPadProbeInfo *info)
 
   // EXTRACT FRAMES: deconstruct the NvDsFrameMeta
   NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
+  // the interval changes at runtime with pipeline['inference_governor'], and pipeline['motion_gate'] skips the batches without motion
+  int gated = -1;
+  int inference_interval = this->_get_inference_interval(pad, &gated);
 
   // loop over sources (a batch_meta exists for each video source)
   for (frame_list = batch_meta->frame_meta_list; frame_list != NULL; frame_list = frame_list->next)
@@ -166,16 +325,15 @@ bool core::Processing::probe_callback(GstPad *pad, GstPadProbeInfo *info)
     NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)(frame_list->data);
 
     // save meta information for all objects detected
-    payload["topic"] = this->_configs.topic;
-    payload["meta"]["device_id"] = this->_configs.device_id;
-    payload["meta"]["frame"] = frame_meta->frame_num;
-    payload["meta"]["utc"] = processUtils::generate_ts_epoch();
-    payload["meta"]["timestamp"] = processUtils::generate_timestamp(this->_tz);
-    payload["meta"]["model"] = this->_configs.model;
-    payload["meta"]["detection_type"] = this->_configs.model_type;
-    payload["meta"]["uuid"] = processUtils::generate_uuid();
-    payload["meta"]["resolution"]["height"] = height;
-    payload["meta"]["resolution"]["width"] = width;
+    payload = this->_create_payload(frame_meta->frame_num, width, height);
+    payload["meta"]["pts"] = frame_meta->buf_pts;
+    if (inference_interval >= 0) {
+      payload["meta"]["inference_interval"] = inference_interval;
+      // false: the detector skipped this frame and the objects come from the tracker
+      payload["meta"]["inferred"] = (bool) frame_meta->bInferDone;
+    }
+    if (gated >= 0)
+      payload["meta"]["gated"] = (bool) gated;
 
     // loop through detected objects
     int objects_detected = 0;
@@ -216,48 +374,111 @@ bool core::Processing::probe_callback(GstPad *pad, GstPadProbeInfo *info)
       payload["inference"][objects_detected]["label"] = (std::string) obj_meta->obj_label;
       payload["inference"][objects_detected]["tracking_id"] = (int) obj_meta->object_id;
       payload["inference"][objects_detected]["camera_id"] = (int) frame_meta->source_id;
+
+      // labels of the secondary stages that classified this object
+      for (NvDsMetaList *classifier_list = obj_meta->classifier_meta_list; classifier_list != NULL; classifier_list = classifier_list->next) {
+        NvDsClassifierMeta *classifier_meta = (NvDsClassifierMeta *) classifier_list->data;
+        int stage = classifier_meta->unique_component_id;
+        std::string stage_name = stage >= 1 && stage <= (int) this->_inference_stages.size() ? this->_inference_stages[stage - 1]
+                                                                                             : std::to_string(stage);
+        for (NvDsMetaList *label_list = classifier_meta->label_info_list; label_list != NULL; label_list = label_list->next) {
+          NvDsLabelInfo *label_info = (NvDsLabelInfo *) label_list->data;
+          std::string label = label_info->pResult_label != NULL ? label_info->pResult_label : label_info->result_label;
+          payload["inference"][objects_detected]["secondary"].push_back(
+              {{"stage", stage_name}, {"label", label}, {"confidence", (int) (label_info->result_prob * 100)}});
+        }
+      }
       objects_detected += 1;
 
     } // parse next detection for this streamId
 
+    // crop the objects to capture from an RGBA copy of the frame (the conversion resources are reused, refer to SurfaceConverter)
+    if (this->_snapshots != nullptr) {
+      std::vector<size_t> objects = this->_snapshots->select((int) frame_meta->source_id, payload);
+      snapshots::FrameView frame;
+      if (!objects.empty() && SurfaceConverter::forThread().convert((NvBufSurface *) map.data, frame_meta->batch_id, frame))
+        this->_snapshots->capture((int) frame_meta->source_id, payload, frame, objects);
+    }
+
     // if this source has inference detections, act on it
     if (payload.contains("inference"))
-    {
-      // send payload to kafka producer
-      if (this->_configs.publish)
-      {
-        this->_add_meta_queue(payload);
-        this->_create_kafka_publish_event();
-      }
-
-      // save detection data to json (for debugging)
-      if (this->_configs.save) {
-        std::stringstream ss;
-        ss << BASE_DIR << "/payload/frame_" << std::setw(4) << std::setfill('0') << payload["meta"]["frame"] << ".json";
-        std::string file_name = ss.str();
-        std::ofstream o(file_name.c_str());
-        o << std::setw(4) << payload << std::endl;
-      }
-
-      // add data to display queue (which writes data onto the screen)
-      if(this->_configs.display_detections)
-      {
-        this->_display_lock.lock();
-        try {
-          VLOG(DEEP) << "[probe_callback] payload" << payload.dump(4);
-          this->_display_queue[(int)frame_meta->source_id]->push(payload);
-        } catch (const std::exception &e) {
-          LOG(ERROR) << "Error adding to queue: " << e.what();
-        }
-        this->_display_lock.unlock();
-      }
-    }
+      this->_handle_payload(payload, (int) frame_meta->source_id);
 
   } // parse next stream_id
   gst_buffer_unmap(buf, &map);
   return true;
 };
+#endif
+
+/**
+ * @brief extracts the synthetic detections (GstVideoRegionOfInterestMeta) of the cpu profile stub detector and creates a kafka
+ *  payload with its items, the same way probe_callback does for NvDsBatchMeta (refer to pipeline['profile']=cpu)
+ * @param pad the src pad of stub_detector_<source_id>
+ * @param *info the GstBuffer wrapped when taken from Probe callback on a pad
+ */
+bool core::Processing::cpu_probe_callback(GstPad *pad, GstPadProbeInfo *info)
+{
+  core::StartupTimeline::get().mark_first(core::Milestone::FIRST_INFERENCE);
+  std::string video_format;
+  int width, height;
+  this->get_pad_video_caps(pad, video_format, width, height);
 
+  // get streamId from the digits after the element prefix: name schema={stub_detector_0, stub_detector_1, stub_detector_N}
+  GstElement *parent_element = GST_ELEMENT(gst_pad_get_parent(pad));
+  std::string elementName = GST_ELEMENT_NAME(parent_element);
+  gst_object_unref(parent_element);
+  int source_id = std::stoi(elementName.substr(elementName.find_first_of("0123456789")));
+
+  GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+  njson payload = this->_create_payload(GST_BUFFER_OFFSET(buf), width, height);
+  payload["meta"]["pts"] = GST_BUFFER_PTS(buf);
+
+  int objects_detected = 0;
+  gpointer state = NULL;
+  GstMeta *meta;
+  while ((meta = gst_buffer_iterate_meta_filtered(buf, &state, GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE)) != NULL) {
+    GstVideoRegionOfInterestMeta *roi = (GstVideoRegionOfInterestMeta *) meta;
+    double confidence = 0;
+    GstStructure *detection = gst_video_region_of_interest_meta_get_param(roi, "detection");
+    if (detection != NULL)
+      gst_structure_get_double(detection, "confidence", &confidence);
+
+    payload["inference"][objects_detected]["bbox"] = {{"x_max", (int)(roi->x + roi->w)}, {"x_min", (int)roi->x}, {"y_max", (int)(roi->y + roi->h)}, {"y_min", (int)roi->y}};
+    payload["inference"][objects_detected]["confidence"] = (int)(confidence * 100);
+    payload["inference"][objects_detected]["label"] = (std::string) g_quark_to_string(roi->roi_type);
+    payload["inference"][objects_detected]["tracking_id"] = roi->id;
+    payload["inference"][objects_detected]["camera_id"] = source_id;
+    objects_detected += 1;
+  }
+
+  // the frame is already in system memory: crop the objects to capture from it
+  if (this->_snapshots != nullptr) {
+    std::vector<size_t> objects = this->_snapshots->select(source_id, payload);
+    GstVideoInfo video_info;
+    GstVideoFrame video_frame;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!objects.empty() && caps != NULL && gst_video_info_from_caps(&video_info, caps) &&
+        gst_video_frame_map(&video_frame, &video_info, buf, GST_MAP_READ)) {
+      snapshots::FrameView frame;
+      frame.format = gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&video_info));
+      frame.width = GST_VIDEO_INFO_WIDTH(&video_info);
+      frame.height = GST_VIDEO_INFO_HEIGHT(&video_info);
+      for (guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&video_frame) && plane < 3; plane++) {
+        frame.planes[plane] = (const uint8_t *) GST_VIDEO_FRAME_PLANE_DATA(&video_frame, plane);
+        frame.strides[plane] = GST_VIDEO_FRAME_PLANE_STRIDE(&video_frame, plane);
+      }
+      this->_snapshots->capture(source_id, payload, frame, objects);
+      gst_video_frame_unmap(&video_frame);
+    }
+    if (caps != NULL)
+      gst_caps_unref(caps);
+  }
+
+  // if this source has inference detections, act on it
+  if (payload.contains("inference"))
+    this->_handle_payload(payload, source_id);
+  return true;
+}
 
 bool core::Processing::osd_callback(GstPad *pad, GstPadProbeInfo *info)
 {
@@ -276,18 +497,23 @@ bool core::Processing::osd_callback(GstPad *pad, GstPadProbeInfo *info)
   } else {
     LOG(FATAL) << "GST_IS_BIN(bin_element) is not true";
   }
-  // get streamId from the last character in the bin: name schema={sink0, sink1, sinkN}
-  int sourceStreamId = std::stoi(binName.substr(binName.length() - 1));
+  // get streamId from the digits after the bin prefix: name schema={sinkBin0, sinkBin1, sinkBinN}
+  int sourceStreamId = std::stoi(binName.substr(binName.find_first_of("0123456789")));
 //  LOG(WARNING) << "The pad belongs to GStElement=" << parent_name << " and GstBin=" << binName << " (sourceStreamId=" << sourceStreamId << ")";
 
   // check if data is available on the queue
   njson detection;
   this->_display_lock.lock();
+  if (sourceStreamId >= (int) this->_display_queue.size() || this->_display_queue[sourceStreamId] == nullptr) {
+    this->_display_lock.unlock();
+    return true;
+  }
   int size = this->_display_queue[sourceStreamId]->size();
   if(size > 0)
   {
     detection = this->_display_queue[sourceStreamId]->front();
     this->_display_queue[sourceStreamId]->pop();
+    this->_display_depth[sourceStreamId]->store(size - 1, std::memory_order_relaxed);
   } else {
     this->_display_lock.unlock();
     return true;
@@ -366,6 +592,7 @@ void core::Processing::_write_detections_to_image(cv::Mat frame, njson payload)
     LOG(FATAL) << "[_write_detections_to_image] Payload entered function when it shouldn't!";
 
   njson detection = payload["inference"];
+  std::shared_ptr<const core::ProcessingSettings> configs = this->_configs.get();
   // LOG(INFO) << "[_write_detections_to_image] " << detection.dump(4);
 
   for (int d = 0; d < detection.size(); d++)
@@ -390,14 +617,14 @@ void core::Processing::_write_detections_to_image(cv::Mat frame, njson payload)
                   (std::string) " % " + std::to_string(confidence);
 
     // if detected confidence is greater than out desired confidence to display, write bbox on the image with text
-    if(confidence > this->_configs.min_confidence_to_display)
+    if(confidence > configs->min_confidence_to_display)
     {
       cv::rectangle(
           frame,
           cv::Point(xmin, ymin),
           cv::Point(xmax, ymax),
           cv::Scalar(DISPLAY_RED, DISPLAY_GREEN, DISPLAY_BLUE),
-          this->_configs.bbox_line_thickness,
+          configs->bbox_line_thickness,
           cv::LINE_8
       );
 
@@ -408,9 +635,9 @@ void core::Processing::_write_detections_to_image(cv::Mat frame, njson payload)
           description.c_str(),
           text_position,
           cv::FONT_HERSHEY_COMPLEX,
-          this->_configs.font_size,
+          configs->font_size,
           CV_RGB(DISPLAY_RED, DISPLAY_GREEN, DISPLAY_BLUE),
-          this->_configs.bbox_line_thickness,
+          configs->bbox_line_thickness,
           cv::LINE_AA
       );
     }
@@ -432,6 +659,7 @@ void core::Processing::_add_meta_queue(njson payload)
   // safely access struct to push data into output_queue
   this->_processor.lock->lock();
   this->_processor.meta_queue->push(payload);
+  this->_processor.meta_depth->store(this->_processor.meta_queue->size(), std::memory_order_relaxed);
   this->_processor.lock->unlock();
 }
 
@@ -463,6 +691,7 @@ njson core::Processing::get_meta_queue()
   this->_processor.lock->lock();
   payload = this->_processor.meta_queue->front();
   this->_processor.meta_queue->pop();
+  this->_processor.meta_depth->store(this->_processor.meta_queue->size(), std::memory_order_relaxed);
   this->_processor.lock->unlock();
 
   // error out if no payload is available
@@ -473,6 +702,141 @@ njson core::Processing::get_meta_queue()
   return payload;
 }
 
+/**
+ * @brief create a payload with the meta information shared by all detections of a frame
+ * @param frame frame number
+ * @param width width of the frame the detections refer to
+ * @param height height of the frame the detections refer to
+ * @return the payload (add detections under `inference`)
+ */
+njson core::Processing::_create_payload(guint64 frame, int width, int height)
+{
+  std::shared_ptr<const core::ProcessingSettings> configs = this->_configs.get();
+  njson payload;
+  payload["topic"] = configs->topic;
+  payload["meta"]["device_id"] = configs->device_id;
+  payload["meta"]["frame"] = frame;
+  payload["meta"]["utc"] = processUtils::generate_ts_epoch();
+  payload["meta"]["timestamp"] = processUtils::generate_timestamp(this->_tz);
+  payload["meta"]["model"] = configs->model;
+  payload["meta"]["detection_type"] = configs->model_type;
+  payload["meta"]["uuid"] = processUtils::generate_uuid();
+  payload["meta"]["resolution"]["height"] = height;
+  payload["meta"]["resolution"]["width"] = width;
+  return payload;
+}
+
+/**
+ * @brief interval of the primary nvinfer (nv_detection) of the inference bin of a pad, or of the nvinfer feeding the element of the
+ *  pad (yaml pipelines)
+ * @param pad a pad of an element of the inference bin (src of the last stage of the cascade)
+ * @param gated set to 1 when the motion gate skips the batches of nvinfer, 0 when it lets them through, left as is without motion gate
+ * @return the number of batches nvinfer skips between two inferences (the configured one while the motion gate skips the batches),
+ *  -1 if the element is not fed by nvinfer
+ */
+int core::Processing::_get_inference_interval(GstPad *pad, int *gated)
+{
+  GstElement *element = gst_pad_get_parent_element(pad);
+  if (element == NULL)
+    return -1;
+  GstObject *bin = gst_element_get_parent(element);
+  GstElement *detection = (bin != NULL && GST_IS_BIN(bin)) ? gst_bin_get_by_name(GST_BIN(bin), "nv_detection") : NULL;
+  if (detection == NULL) {
+    GstPad *sink_pad = gst_element_get_static_pad(element, "sink");
+    GstPad *peer = sink_pad ? gst_pad_get_peer(sink_pad) : NULL;
+    detection = peer ? gst_pad_get_parent_element(peer) : NULL;
+    if (peer)
+      gst_object_unref(peer);
+    if (sink_pad)
+      gst_object_unref(sink_pad);
+  }
+  int interval = -1;
+  if (detection != NULL && g_object_class_find_property(G_OBJECT_GET_CLASS(detection), "interval") != NULL) {
+    guint value = 0;
+    g_object_get(detection, "interval", &value, NULL);
+    interval = (int) value;
+    // set by the motion gate of the pipeline, which writes its skip interval into the property
+    std::atomic<int> *base_interval = (std::atomic<int> *) g_object_get_data(G_OBJECT(detection), "base_interval");
+    if (base_interval != NULL) {
+      *gated = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(detection), "gated"));
+      if (*gated)
+        interval = base_interval->load();
+    }
+  }
+  if (detection)
+    gst_object_unref(detection);
+  if (bin)
+    gst_object_unref(bin);
+  gst_object_unref(element);
+  return interval;
+}
+
+/**
+ * @brief act on a payload with detections: publish it to kafka, save it and/or queue it for the overlay (refer to config.json processing)
+ * @param payload the payload with detections
+ * @param source_id global id of the source the detections belong to
+ */
+void core::Processing::_handle_payload(njson payload, int source_id)
+{
+  for (const auto &hook : this->_payload_hooks)
+    hook(source_id, payload);
+  std::shared_ptr<const core::ProcessingSettings> configs = this->_configs.get();
+
+  // send payload to kafka producer
+  if (configs->publish)
+  {
+    this->_add_meta_queue(payload);
+    this->_create_kafka_publish_event();
+  }
+
+  // save detection data to json (for debugging)
+  if (configs->save) {
+    std::stringstream ss;
+    ss << BASE_DIR << "/payload/frame_" << std::setw(4) << std::setfill('0') << payload["meta"]["frame"] << ".json";
+    std::string file_name = ss.str();
+    std::ofstream o(file_name.c_str());
+    o << std::setw(4) << payload << std::endl;
+  }
+
+  // add data to display queue (which writes data onto the screen)
+  if(configs->display_detections)
+  {
+    this->_display_lock.lock();
+    try {
+      VLOG(DEEP) << "[probe_callback] payload" << payload.dump(4);
+      // the source may have been removed at runtime while its last frames were in the batch
+      if (source_id < (int) this->_display_queue.size() && this->_display_queue[source_id] != nullptr) {
+        this->_display_queue[source_id]->push(payload);
+        this->_display_depth[source_id]->store(this->_display_queue[source_id]->size(), std::memory_order_relaxed);
+      }
+    } catch (const std::exception &e) {
+      LOG(ERROR) << "Error adding to queue: " << e.what();
+    }
+    this->_display_lock.unlock();
+  }
+}
+
+/**
+ * @brief publish a source health report (e.g. from the pipeline watchdog) on the processing topic
+ * @note only published when processing['publish']=true
+ * @param health the health report, added to the payload under `health`
+ */
+void core::Processing::publish_health(njson health)
+{
+  std::shared_ptr<const core::ProcessingSettings> configs = this->_configs.get();
+  if (!configs->publish)
+    return;
+  njson payload;
+  payload["topic"] = configs->topic;
+  payload["meta"]["device_id"] = configs->device_id;
+  payload["meta"]["utc"] = processUtils::generate_ts_epoch();
+  payload["meta"]["timestamp"] = processUtils::generate_timestamp(this->_tz);
+  payload["meta"]["uuid"] = processUtils::generate_uuid();
+  payload["health"] = health;
+  this->_add_meta_queue(payload);
+  this->_create_kafka_publish_event();
+}
+
 /// PROCESSING EVENTS (used in mediator.cpp)
 
 /**
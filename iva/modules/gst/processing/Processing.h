@@ -1,18 +1,23 @@
 #pragma once
+#ifndef CPU_ONLY
 #include <cuda.h>
 #include <cuda_runtime.h>
 #include <cuda_runtime_api.h>
+#endif
 #include <glib.h>
 #include <gst/base/gstbasetransform.h>
 #include <gst/gst.h>
 #include <gst/video/video.h>
 #include <gst/video/video-info.h>
 
+#ifndef CPU_ONLY
 #include "nvbufsurftransform.h"
 #include <gstnvdsmeta.h>
+#endif
 
 #include <algorithm>
 #include <array>
+#include <functional>
 #include <map>
 #include <mutex>
 #include <queue>
@@ -20,15 +25,24 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/opencv.hpp>
 
+#ifndef CPU_ONLY
 #include "gstnvdsmeta.h"
 #include "nvbufsurface.h"
+#endif
 
 #include "BaseComponent.h"
+#include "configReload.hpp"
 #include "Mediator.h"
 #include "Event.h"
 #include "errors.hpp"
 #include "logging.hpp"
+#include "metrics.hpp"
 #include "processUtils.hpp"
+#include "snapshots.hpp"
+#include "startupTimeline.hpp"
+#ifndef CPU_ONLY
+#include "surfaceConverter.hpp"
+#endif
 
 using njson = nlohmann::json;
 
@@ -68,6 +82,8 @@ class Event;
  * when writing to cv::Mat, do not display detections with confidence less than this
  * @var font_size
  * cv::Mat font size for descriptors above bounding box
+ * @var snapshots
+ * thumbnails of the detected objects (optional processing['snapshots'])
  */
 struct ProcessingSettings
 {
@@ -81,6 +97,7 @@ struct ProcessingSettings
     int bbox_line_thickness;
     int min_confidence_to_display;
 	int font_size;
+    snapshots::SnapshotPolicy snapshots;
 };
 
 struct CbStore
@@ -105,6 +122,8 @@ struct CbStore
  * all processed metadata is added to this queue
  * @var input_queue
  * all data received from spyder (distance data) is added to this queue by the kafka consumer
+ * @var meta_depth
+ * size of meta_queue (iva_queue_depth{queue="meta"}), updated under lock
  */
 struct VideoSourceData
 {
@@ -112,6 +131,7 @@ struct VideoSourceData
     std::mutex *lock;
     // data to be sent off-board via kafka consumer
     std::queue <njson> *meta_queue;
+    std::atomic<int64_t> *meta_depth;
 };
 
 /**
@@ -134,12 +154,25 @@ public:
 
     // class setup
     void set_up(int source_count);
+    // sources added/removed while the pipeline is running
+    void add_source(int source_id);
+    void remove_source(int source_id);
+    // the pipeline draws the detections itself (gpu tiled output)
+    void disable_overlay();
+    // called with every payload before it is published (pipeline['clips'], pipeline['record'])
+    void add_payload_hook(std::function<void(int, njson &)> hook);
+    // names of the nvinfer stages by unique id - 1 (pipeline['inference'])
+    void set_inference_stages(std::vector<std::string> stages);
 
     /// PROCESSING METADATA
+#ifndef CPU_ONLY
     bool probe_callback(GstPad *pad, GstPadProbeInfo *info);
+#endif
+    bool cpu_probe_callback(GstPad *pad, GstPadProbeInfo *info);
     bool osd_callback(GstPad *pad, GstPadProbeInfo *info);
     void get_pad_video_caps(GstPad *pad, std::string &video_format, int &width, int &height);
     /// MANAGING DATA FLOW
+    void publish_health(njson health);
     njson get_meta_queue();
     bool check_meta_queue();
 
@@ -161,11 +194,26 @@ private:
     VideoSourceData _processor;
     std::mutex _display_lock = std::mutex();
     std::vector<std::queue<njson>*> _display_queue;
-
+    // sizes of the display queues (iva_queue_depth{queue="display"}), updated under _display_lock
+    std::vector<std::atomic<int64_t>*> _display_depth;
+    // hooks of the pipeline on the payloads (added before the pipeline starts)
+    std::vector<std::function<void(int, njson &)>> _payload_hooks;
+    // names of the nvinfer stages, the results of the secondary stages are reported under them
+    std::vector<std::string> _inference_stages;
+    // thumbnails of the detected objects, NULL when processing['snapshots'] is off
+    snapshots::Snapshotter *_snapshots = nullptr;
+
+    njson _create_payload(guint64 frame, int width, int height);
+    int _get_inference_interval(GstPad *pad, int *gated);
+    void _handle_payload(njson payload, int source_id);
     void _add_meta_queue(njson payload);
+    void _export_display_depth(int source_id);
     void _create_kafka_publish_event();
 
     /// MODULE SETTINGS
-    ProcessingSettings _configs;
+    // read by the probes without locks, replaced as a whole when config.json is reloaded
+    core::Snapshot<ProcessingSettings> _configs;
+    // the pipeline draws the detections (disable_overlay), reloads keep display_detections off
+    std::atomic<bool> _overlay_disabled = false;
 };
 }  // namespace core
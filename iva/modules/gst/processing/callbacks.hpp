@@ -1,8 +1,10 @@
 #pragma once
 
+#ifndef CPU_ONLY
 #include <cuda.h>
 #include <cuda_runtime.h>
 #include <cuda_runtime_api.h>
+#endif
 #include <glib.h>
 #include <gst/base/gstbasetransform.h>
 #include <gst/gst.h>
@@ -12,9 +14,12 @@
 #include <opencv2/opencv.hpp>
 
 #include "Processing.h"
+#ifndef CPU_ONLY
 #include "gstnvdsmeta.h"
 #include "nvbufsurface.h"
 #include "nvbufsurftransform.h"
+#include "surfaceConverter.hpp"
+#endif
 #include "pipelineUtils.hpp"
 
 
@@ -30,90 +35,23 @@ using namespace processUtils;
 namespace core {
 
 
+#ifndef CPU_ONLY
+/**
+ * @brief copy a frame of a batched NvBufSurface to a BGR image (refer to SurfaceConverter, the conversion resources are reused)
+ * @param in_map_info the mapped GstBuffer of the batch
+ * @param idx index of the frame in the batch
+ * @return the frame, empty if the conversion failed
+ */
 inline cv::Mat getRGBFrame(GstMapInfo in_map_info, gint idx) {
-
-  // To access the frame
-  NvBufSurface *surface = NULL;
-  NvBufSurface surface_idx;
-  NvBufSurfTransformRect src_rect, dst_rect;
-
-  surface = (NvBufSurface *) in_map_info.data;
-  surface_idx = *surface;
-  surface_idx.surfaceList = &(surface->surfaceList[idx]);
-  surface_idx.numFilled = surface_idx.batchSize = 1;
-
-  int batch_size = surface_idx.batchSize;
-  src_rect.top   = 0;
-  src_rect.left  = 0;
-  src_rect.width = (guint) surface->surfaceList[idx].width;
-  src_rect.height= (guint) surface->surfaceList[idx].height;
-
-  dst_rect.top   = 0;
-  dst_rect.left  = 0;
-  dst_rect.width = (guint) surface->surfaceList[idx].width;
-  dst_rect.height= (guint) surface->surfaceList[idx].height;
-
-  NvBufSurfTransformParams nvbufsurface_params;
-  nvbufsurface_params.src_rect = &src_rect;
-  nvbufsurface_params.dst_rect = &dst_rect;
-  nvbufsurface_params.transform_flag =  NVBUFSURF_TRANSFORM_CROP_SRC | NVBUFSURF_TRANSFORM_CROP_DST;
-  nvbufsurface_params.transform_filter = NvBufSurfTransformInter_Default;
-
-  NvBufSurface *dst_surface = NULL;
-  NvBufSurfaceCreateParams nvbufsurface_create_params;
-
-  nvbufsurface_create_params.gpuId  = surface->gpuId;
-  nvbufsurface_create_params.width  = (guint) surface->surfaceList[idx].width;
-  nvbufsurface_create_params.height = (guint) surface->surfaceList[idx].height;
-  nvbufsurface_create_params.size = 0;
-  // nvbufsurface_create_params.isContiguous = true;
-  nvbufsurface_create_params.colorFormat = NVBUF_COLOR_FORMAT_RGBA;
-  nvbufsurface_create_params.layout = NVBUF_LAYOUT_PITCH;
-
-  // THE memType PARAM IS SET TO CUDA UNIFIED IN dGPU DEVICES COMMENT IT out
-  // AND USE THE IMMEDIATE NEXT LINE TO SET THE memType PARAM FOR JETSON DEVICES
-#ifdef PLATFORM_TEGRA
-  LOG(WARNING) << "Setting nvbufsurface_create_params.memType = NVBUF_MEM_DEFAULT";
-  nvbufsurface_create_params.memType = NVBUF_MEM_DEFAULT;
-#else
-  LOG(WARNING) << "Setting nvbufsurface_create_params.memType = NVBUF_MEM_CUDA_UNIFIED";
-  nvbufsurface_create_params.memType = NVBUF_MEM_CUDA_UNIFIED;
-#endif
-
-  cudaError_t cuda_err = cudaSetDevice (surface->gpuId);
-  cudaStream_t cuda_stream;
-  cuda_err = cudaStreamCreate(&cuda_stream);
-  int create_result = NvBufSurfaceCreate(&dst_surface, batch_size, &nvbufsurface_create_params);
-
-  NvBufSurfTransformConfigParams transform_config_params;
-  NvBufSurfTransform_Error err;
-  transform_config_params.compute_mode = NvBufSurfTransformCompute_Default;
-  transform_config_params.gpu_id = surface->gpuId;
-  transform_config_params.cuda_stream = cuda_stream;
-  err = NvBufSurfTransformSetSessionParams (&transform_config_params);
-
-  NvBufSurfaceMemSet (dst_surface, 0, 0, 0);
-
-  err = NvBufSurfTransform (&surface_idx, dst_surface, &nvbufsurface_params);
-
-  if (err != NvBufSurfTransformError_Success) {
-    g_print ("NvBufSurfTransform failed with error %d while converting buffer\n", err);
-  }
-
-  NvBufSurfaceMap (dst_surface, 0, 0, NVBUF_MAP_READ);
-  NvBufSurfaceSyncForCpu (dst_surface, 0, 0);
-
-  cv::Mat bgr_frame = cv::Mat (cv::Size(nvbufsurface_create_params.width, nvbufsurface_create_params.height), CV_8UC3);
-
-  cv::Mat in_mat = cv::Mat (nvbufsurface_create_params.height, nvbufsurface_create_params.width, CV_8UC4, dst_surface->surfaceList[0].mappedAddr.addr[0], dst_surface->surfaceList[0].pitch);
-
-  cv::cvtColor (in_mat, bgr_frame, cv::COLOR_RGBA2BGR);
-  NvBufSurfaceUnMap(dst_surface, 0 , 0);
-  NvBufSurfaceDestroy(dst_surface);
-  cudaStreamDestroy (cuda_stream);
-
+  snapshots::FrameView frame;
+  if (!SurfaceConverter::forThread().convert((NvBufSurface *) in_map_info.data, idx, frame))
+    return cv::Mat();
+  cv::Mat bgr_frame;
+  cv::Mat in_mat = cv::Mat(frame.height, frame.width, CV_8UC4, (void *) frame.planes[0], frame.strides[0]);
+  cv::cvtColor(in_mat, bgr_frame, cv::COLOR_RGBA2BGR);
   return bgr_frame;
 }
+#endif
 
 /**
  * @brief static callbacks to be used in Pipeline module
@@ -128,6 +66,7 @@ inline cv::Mat getRGBFrame(GstMapInfo in_map_info, gint idx) {
  */
 namespace GstCallbacks {
 
+#ifndef CPU_ONLY
 /**
  * @brief callback for nvidia element pad (sink of nvtracker) that extracts metadata from pipeline and adds processes it
  * and creates a kafka payload with its items
@@ -152,6 +91,28 @@ inline GstPadProbeReturn probe_callback(GstPad *pad, GstPadProbeInfo *info, gpoi
 
   return GST_PAD_PROBE_OK;
 }
+#endif
+
+/**
+ * @brief callback for the cpu profile stub detector pad (src of stub_detector_<id>) that extracts the synthetic detections
+ * and creates a kafka payload with its items
+ * @copydoc adds to meta_queue and display_queue if enabled in config.json
+ *
+ * @param pad               the pad to which the callback is attached
+ * @param info              the data component of the gstreamer buffer
+ * @param u_data            user data pointer passed into the callback
+ * @return GstFlowReturn    return handle behaviour
+ */
+inline GstPadProbeReturn cpu_probe_callback(GstPad *pad, GstPadProbeInfo *info, gpointer u_data)
+{
+  // unpack pointer
+  auto processor = (core::Processing *)u_data;
+  bool ret = processor->cpu_probe_callback(pad, info);
+  if (!ret)
+    LOG(ERROR) << "Processing failed";
+
+  return GST_PAD_PROBE_OK;
+}
 
 /**
  * @brief callback to write on display for element pad that has caps="video/x-raw,format=YV12"
@@ -270,6 +231,7 @@ inline GstPadProbeReturn save_image_to_disk(GstPad *pad, GstPadProbeInfo *info,
   return GST_PAD_PROBE_OK;
 }
 
+#ifndef CPU_ONLY
 /**
  * @brief An EXAMPLE callback for nvidia element pad (sink of nvtracker) that extracts metadata
  *
@@ -327,6 +289,7 @@ inline GstPadProbeReturn unpack_dsMeta_example(GstPad *pad, GstPadProbeInfo *inf
 
   return GST_PAD_PROBE_OK;
 }
+#endif
 
 }  // namespace GstCallbacks
 }  // namespace core
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/opencv.hpp>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "logging.hpp"
+#include "metrics.hpp"
+
+using njson = nlohmann::json;
+
+/**
+ * @namespace snapshots
+ * @brief thumbnails of the detected objects (config.json processing['snapshots']). The objects of a payload are cropped from a
+ *  frame in system memory (the cpu frame, or the pooled RGBA copy of the gpu surface) on the streaming thread, and encoded to JPEG
+ *  on a bounded worker pool. Each tracked object is captured once; the payload carries the path of its thumbnail (or the id of
+ *  the message that carries the JPEG bytes).
+ *
+ */
+namespace snapshots {
+
+/**
+ * @struct SnapshotPolicy
+ * @brief which objects are captured and how (config.json processing['snapshots'])
+ *
+ * @var enable
+ * capture thumbnails
+ * @var labels
+ * labels to capture, empty captures every label
+ * @var min_confidence
+ * minimum confidence of the objects (0-100, as in the payload)
+ * @var min_size
+ * objects smaller than min_size pixels (width or height) are not captured
+ * @var padding
+ * margin around the bounding box, as a fraction of its size
+ * @var once_per_track
+ * capture a tracked object once (untracked objects are never captured)
+ * @var inline_bytes
+ * publish the JPEG (base64) in a message of its own instead of writing it to outputs/image
+ * @var quality
+ * JPEG quality (1-100)
+ * @var workers
+ * threads that encode the thumbnails
+ * @var max_pending
+ * thumbnails waiting for a worker, objects are skipped (and captured on a later frame) while the pool is full
+ * @var max_tracks
+ * tracks remembered per source (the oldest are forgotten first)
+ */
+struct SnapshotPolicy {
+  bool enable = false;
+  std::set<std::string> labels;
+  int min_confidence = 0;
+  int min_size = 16;
+  double padding = 0.1;
+  bool once_per_track = true;
+  bool inline_bytes = false;
+  int quality = 90;
+  int workers = 2;
+  int max_pending = 32;
+  size_t max_tracks = 4096;
+
+  bool operator==(const SnapshotPolicy &) const = default;
+};
+
+/**
+ * @struct FrameView
+ * @brief a video frame in system memory, planes in the order of GstVideoFormat (refer to GST_VIDEO_FRAME_PLANE_DATA)
+ *
+ * @var format
+ * RGB, BGR, RGBA, BGRA, RGBx, BGRx, I420, YV12 or NV12
+ */
+struct FrameView {
+  std::string format;
+  int width = 0;
+  int height = 0;
+  const uint8_t *planes[3] = {NULL, NULL, NULL};
+  int strides[3] = {0, 0, 0};
+};
+
+/**
+ * @brief the region of an object in its frame, with padding, clamped to the frame and aligned to even pixels (chroma of 4:2:0)
+ * @param bbox the bounding box of the payload (x_min, y_min, x_max, y_max)
+ * @param width width of the frame
+ * @param height height of the frame
+ * @param padding margin as a fraction of the bounding box
+ * @return the region, empty if it is outside the frame
+ */
+inline cv::Rect cropRect(const njson &bbox, int width, int height, double padding)
+{
+  int x_min = bbox.value("x_min", 0), y_min = bbox.value("y_min", 0), x_max = bbox.value("x_max", 0), y_max = bbox.value("y_max", 0);
+  int pad_x = (int) ((x_max - x_min) * padding), pad_y = (int) ((y_max - y_min) * padding);
+  int left = std::max(0, x_min - pad_x) & ~1, top = std::max(0, y_min - pad_y) & ~1;
+  int right = std::min(width, x_max + pad_x) & ~1, bottom = std::min(height, y_max + pad_y) & ~1;
+  if (right <= left || bottom <= top)
+    return cv::Rect();
+  return cv::Rect(left, top, right - left, bottom - top);
+}
+
+/**
+ * @brief copy a region of a frame to a BGR image, only the pixels of the region are converted
+ * @param frame the frame
+ * @param rect the region (refer to cropRect)
+ * @param bgr the image
+ * @return false if the format is not supported
+ */
+inline bool extractCrop(const FrameView &frame, const cv::Rect &rect, cv::Mat &bgr)
+{
+  static const std::map<std::string, std::pair<int, int>> packed = {
+      {"RGB", {CV_8UC3, cv::COLOR_RGB2BGR}},   {"BGR", {CV_8UC3, -1}},  {"RGBA", {CV_8UC4, cv::COLOR_RGBA2BGR}},
+      {"RGBx", {CV_8UC4, cv::COLOR_RGBA2BGR}}, {"BGRA", {CV_8UC4, cv::COLOR_BGRA2BGR}}, {"BGRx", {CV_8UC4, cv::COLOR_BGRA2BGR}}};
+  auto it = packed.find(frame.format);
+  if (it != packed.end()) {
+    cv::Mat region = cv::Mat(frame.height, frame.width, it->second.first, (void *) frame.planes[0], frame.strides[0])(rect);
+    if (it->second.second < 0)
+      region.copyTo(bgr);
+    else
+      cv::cvtColor(region, bgr, it->second.second);
+    return true;
+  }
+
+  // 4:2:0: gather the region of every plane into a small contiguous image and convert it
+  int w = rect.width, h = rect.height;
+  if (frame.format == "I420" || frame.format == "YV12") {
+    cv::Mat yuv(h + h / 2, w, CV_8UC1);
+    for (int r = 0; r < h; r++)
+      memcpy(yuv.ptr(r), frame.planes[0] + (size_t) (rect.y + r) * frame.strides[0] + rect.x, w);
+    // I420 keeps U then V, plane 1 of YV12 is V
+    uint8_t *chroma = yuv.ptr(h);
+    for (int p = 1; p <= 2; p++) {
+      for (int r = 0; r < h / 2; r++) {
+        memcpy(chroma, frame.planes[p] + (size_t) (rect.y / 2 + r) * frame.strides[p] + rect.x / 2, w / 2);
+        chroma += w / 2;
+      }
+    }
+    cv::cvtColor(yuv, bgr, frame.format == "I420" ? cv::COLOR_YUV2BGR_I420 : cv::COLOR_YUV2BGR_YV12);
+    return true;
+  }
+  if (frame.format == "NV12") {
+    cv::Mat yuv(h + h / 2, w, CV_8UC1);
+    for (int r = 0; r < h; r++)
+      memcpy(yuv.ptr(r), frame.planes[0] + (size_t) (rect.y + r) * frame.strides[0] + rect.x, w);
+    for (int r = 0; r < h / 2; r++)
+      memcpy(yuv.ptr(h + r), frame.planes[1] + (size_t) (rect.y / 2 + r) * frame.strides[1] + rect.x, w);
+    cv::cvtColor(yuv, bgr, cv::COLOR_YUV2BGR_NV12);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief base64 of binary data (inline thumbnails)
+ */
+inline std::string base64(const std::vector<uchar> &data)
+{
+  static const char *table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string ret;
+  ret.reserve((data.size() + 2) / 3 * 4);
+  for (size_t i = 0; i < data.size(); i += 3) {
+    uint32_t n = data[i] << 16 | (i + 1 < data.size() ? data[i + 1] << 8 : 0) | (i + 2 < data.size() ? data[i + 2] : 0);
+    ret += table[n >> 18 & 63];
+    ret += table[n >> 12 & 63];
+    ret += i + 1 < data.size() ? table[n >> 6 & 63] : '=';
+    ret += i + 2 < data.size() ? table[n & 63] : '=';
+  }
+  return ret;
+}
+
+/**
+ * @class TrackMemory
+ * @brief the tracks of a source that were captured, bounded (the oldest tracks are forgotten first)
+ */
+class TrackMemory {
+ public:
+  explicit TrackMemory(size_t capacity = 4096) : _capacity(capacity) {}
+
+  bool seen(int64_t track) const { return this->_tracks.count(track) > 0; }
+
+  void mark(int64_t track)
+  {
+    if (!this->_tracks.insert(track).second)
+      return;
+    this->_order.push_back(track);
+    if (this->_order.size() > this->_capacity) {
+      this->_tracks.erase(this->_order.front());
+      this->_order.pop_front();
+    }
+  }
+
+ private:
+  size_t _capacity;
+  std::unordered_set<int64_t> _tracks;
+  std::deque<int64_t> _order;
+};
+
+/**
+ * @class Snapshotter
+ * @brief selects the objects to capture, crops them on the calling (streaming) thread and encodes them on its worker pool
+ *
+ * @var written
+ * thumbnails encoded (iva_snapshots_total)
+ * @var dropped
+ * objects skipped because every worker was busy (iva_snapshots_dropped_total)
+ */
+class Snapshotter {
+ public:
+  /**
+   * @param policy which objects are captured
+   * @param directory where thumbnails are written (outputs/image)
+   * @param publish called on a worker with the message of an inline thumbnail
+   */
+  Snapshotter(const SnapshotPolicy &policy, const std::string &directory, std::function<void(njson)> publish = nullptr)
+      : _policy(policy), _directory(directory), _publish(std::move(publish)), _pool(std::max(1, policy.workers))
+  {
+    this->written = &core::Metrics::get().counter("iva_snapshots_total", "Thumbnails of detected objects encoded.");
+    this->dropped = &core::Metrics::get().counter("iva_snapshots_dropped_total", "Thumbnails skipped because every encoder was busy.");
+  }
+
+  /**
+   * @brief the objects of a payload that should be captured (label, confidence, size and tracks not captured yet)
+   * @param source_id global id of the source
+   * @param payload the payload of the frame
+   * @return indexes into payload['inference'], empty if the frame is not needed
+   */
+  std::vector<size_t> select(int source_id, const njson &payload)
+  {
+    std::vector<size_t> ret;
+    if (!payload.contains("inference"))
+      return ret;
+    std::lock_guard<std::mutex> guard(this->_lock);
+    TrackMemory &tracks = this->_tracks.try_emplace(source_id, this->_policy.max_tracks).first->second;
+    const njson &objects = payload["inference"];
+    for (size_t i = 0; i < objects.size(); i++) {
+      const njson &object = objects[i];
+      const njson &bbox = object.value("bbox", njson::object());
+      int64_t track = object.value("tracking_id", (int64_t) -1);
+      if (!this->_policy.labels.empty() && !this->_policy.labels.count(object.value("label", std::string())))
+        continue;
+      if (object.value("confidence", 0) < this->_policy.min_confidence)
+        continue;
+      if (bbox.value("x_max", 0) - bbox.value("x_min", 0) < this->_policy.min_size ||
+          bbox.value("y_max", 0) - bbox.value("y_min", 0) < this->_policy.min_size)
+        continue;
+      if (this->_policy.once_per_track && (track < 0 || tracks.seen(track)))
+        continue;
+      ret.push_back(i);
+    }
+    return ret;
+  }
+
+  /**
+   * @brief crop the selected objects from their frame and queue their encoding, the payload items get `snapshot` (path of the
+   *  thumbnail, or id of the inline message)
+   * @param source_id global id of the source
+   * @param payload the payload of the frame
+   * @param frame the frame, only read during the call
+   * @param objects the objects to capture (refer to select)
+   * @return number of thumbnails queued
+   */
+  int capture(int source_id, njson &payload, const FrameView &frame, const std::vector<size_t> &objects)
+  {
+    int queued = 0;
+    for (size_t i : objects) {
+      njson &object = payload["inference"][i];
+      cv::Rect rect = cropRect(object["bbox"], frame.width, frame.height, this->_policy.padding);
+      if (rect.empty())
+        continue;
+      if (this->_pending.fetch_add(1) >= this->_policy.max_pending) {
+        // not marked: the object is captured on a later frame
+        this->_pending--;
+        this->dropped->fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      cv::Mat crop;
+      if (!extractCrop(frame, rect, crop)) {
+        this->_pending--;
+        LOG(WARNING) << "Cannot capture thumbnails from " << frame.format << " frames";
+        return queued;
+      }
+      int64_t track = object.value("tracking_id", (int64_t) -1);
+      if (this->_policy.once_per_track) {
+        std::lock_guard<std::mutex> guard(this->_lock);
+        this->_tracks.try_emplace(source_id, this->_policy.max_tracks).first->second.mark(track);
+      }
+      std::string label = object.value("label", std::string("object"));
+      std::replace_if(label.begin(), label.end(), [](char c) { return !isalnum(c) && c != '-'; }, '_');
+      std::string id = "src" + std::to_string(source_id) + "_" + label + "_" + std::to_string(track) + "_" +
+                       std::to_string(payload["meta"].value("frame", (uint64_t) 0));
+      object["snapshot"] = this->_policy.inline_bytes ? id : this->_directory + "/" + id + ".jpg";
+
+      njson message = {{"snapshot", id}, {"source_id", source_id}, {"label", object.value("label", std::string())}, {"tracking_id", track}};
+      this->_pool.push_task([this, crop, id, message]() mutable {
+        this->_encode(crop, id, message);
+        this->_pending--;
+      });
+      queued++;
+    }
+    return queued;
+  }
+
+  /**
+   * @brief wait for the queued thumbnails
+   */
+  void wait() { this->_pool.wait_for_tasks(); }
+
+  std::atomic<uint64_t> *written;
+  std::atomic<uint64_t> *dropped;
+
+ private:
+  SnapshotPolicy _policy;
+  std::string _directory;
+  std::function<void(njson)> _publish;
+  std::mutex _lock;
+  std::map<int, TrackMemory> _tracks;
+  std::atomic<int> _pending = 0;
+  // last member: destroyed first, waits for the workers
+  BS::thread_pool _pool;
+
+  void _encode(const cv::Mat &crop, const std::string &id, njson &message)
+  {
+    std::vector<uchar> jpeg;
+    if (!cv::imencode(".jpg", crop, jpeg, {cv::IMWRITE_JPEG_QUALITY, this->_policy.quality})) {
+      LOG(ERROR) << "Could not encode the thumbnail " << id;
+      return;
+    }
+    if (this->_policy.inline_bytes) {
+      message["jpeg"] = base64(jpeg);
+      if (this->_publish)
+        this->_publish(message);
+    }
+    else {
+      // written aside and renamed: a reader of the payload never sees a partial file
+      std::string path = this->_directory + "/" + id + ".jpg";
+      std::FILE *file = std::fopen((path + ".tmp").c_str(), "wb");
+      bool saved = file != NULL && std::fwrite(jpeg.data(), 1, jpeg.size(), file) == jpeg.size();
+      if (file != NULL)
+        saved = std::fclose(file) == 0 && saved;
+      if (!saved || std::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+        LOG(ERROR) << "Could not write the thumbnail " << path;
+        return;
+      }
+    }
+    this->written->fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+}  // namespace snapshots
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cuda_runtime.h>
+#include <cuda_runtime_api.h>
+
+#include "logging.hpp"
+#include "nvbufsurface.h"
+#include "nvbufsurftransform.h"
+#include "snapshots.hpp"
+
+namespace core {
+
+/**
+ * @class SurfaceConverter
+ * @brief converts a frame of a batched NvBufSurface to RGBA in system-visible memory. The CUDA stream, the transform session and the
+ *  destination surface are created on first use and reused (the surface is only recreated when the frame size changes), instead of
+ *  being created and destroyed for every frame. The transform session is per thread, so every streaming thread has its own converter.
+ *
+ * @var _stream
+ * CUDA stream of the transforms
+ * @var _surface
+ * destination surface (RGBA, pitch layout), mapped for the CPU
+ * @var _gpu_id
+ * GPU of the stream and surface
+ */
+class SurfaceConverter {
+ public:
+  /**
+   * @brief the converter of the calling thread
+   */
+  static SurfaceConverter &forThread()
+  {
+    thread_local SurfaceConverter converter;
+    return converter;
+  }
+
+  ~SurfaceConverter() { this->_release(); }
+
+  /**
+   * @brief convert a frame of a batch
+   * @param batch the batched surface (mapped GstBuffer of the batch)
+   * @param idx index of the frame in the batch (NvDsFrameMeta::batch_id)
+   * @param frame set to the RGBA frame, valid until the next conversion on this thread
+   * @return false if the conversion failed
+   */
+  bool convert(NvBufSurface *batch, int idx, snapshots::FrameView &frame)
+  {
+    const NvBufSurfaceParams &params = batch->surfaceList[idx];
+    if (!this->_prepare(batch->gpuId, params.width, params.height))
+      return false;
+
+    NvBufSurface source = *batch;
+    source.surfaceList = &batch->surfaceList[idx];
+    source.numFilled = source.batchSize = 1;
+    NvBufSurfTransformRect rect = {.top = 0, .left = 0, .width = params.width, .height = params.height};
+    NvBufSurfTransformParams transform = {};
+    transform.src_rect = &rect;
+    transform.dst_rect = &rect;
+    transform.transform_flag = NVBUFSURF_TRANSFORM_CROP_SRC | NVBUFSURF_TRANSFORM_CROP_DST;
+    transform.transform_filter = NvBufSurfTransformInter_Default;
+    NvBufSurfTransform_Error err = NvBufSurfTransform(&source, this->_surface, &transform);
+    if (err != NvBufSurfTransformError_Success) {
+      LOG(ERROR) << "NvBufSurfTransform failed with error " << err << " while converting a frame";
+      return false;
+    }
+    NvBufSurfaceSyncForCpu(this->_surface, 0, 0);
+
+    frame.format = "RGBA";
+    frame.width = (int) params.width;
+    frame.height = (int) params.height;
+    frame.planes[0] = (const uint8_t *) this->_surface->surfaceList[0].mappedAddr.addr[0];
+    frame.strides[0] = (int) this->_surface->surfaceList[0].pitch;
+    return true;
+  }
+
+ private:
+  cudaStream_t _stream = NULL;
+  NvBufSurface *_surface = NULL;
+  int _gpu_id = -1;
+  uint32_t _width = 0;
+  uint32_t _height = 0;
+
+  SurfaceConverter() = default;
+
+  // (re)create the stream and session for the gpu, and the surface for the frame size
+  bool _prepare(int gpu_id, uint32_t width, uint32_t height)
+  {
+    if (this->_gpu_id != gpu_id) {
+      this->_release();
+      cudaSetDevice(gpu_id);
+      if (cudaStreamCreate(&this->_stream) != cudaSuccess) {
+        LOG(ERROR) << "Could not create the CUDA stream of the frame converter (gpu=" << gpu_id << ")";
+        this->_stream = NULL;
+        return false;
+      }
+      NvBufSurfTransformConfigParams session = {};
+      session.compute_mode = NvBufSurfTransformCompute_Default;
+      session.gpu_id = gpu_id;
+      session.cuda_stream = this->_stream;
+      NvBufSurfTransformSetSessionParams(&session);
+      this->_gpu_id = gpu_id;
+    }
+    if (this->_surface != NULL && this->_width == width && this->_height == height)
+      return true;
+
+    if (this->_surface != NULL) {
+      NvBufSurfaceUnMap(this->_surface, 0, 0);
+      NvBufSurfaceDestroy(this->_surface);
+      this->_surface = NULL;
+    }
+    NvBufSurfaceCreateParams create = {};
+    create.gpuId = gpu_id;
+    create.width = width;
+    create.height = height;
+    create.colorFormat = NVBUF_COLOR_FORMAT_RGBA;
+    create.layout = NVBUF_LAYOUT_PITCH;
+#ifdef PLATFORM_TEGRA
+    create.memType = NVBUF_MEM_DEFAULT;
+#else
+    create.memType = NVBUF_MEM_CUDA_UNIFIED;
+#endif
+    if (NvBufSurfaceCreate(&this->_surface, 1, &create) != 0 || NvBufSurfaceMap(this->_surface, 0, 0, NVBUF_MAP_READ) != 0) {
+      LOG(ERROR) << "Could not create the surface of the frame converter (" << width << "x" << height << ")";
+      if (this->_surface != NULL)
+        NvBufSurfaceDestroy(this->_surface);
+      this->_surface = NULL;
+      return false;
+    }
+    this->_surface->numFilled = 1;
+    this->_width = width;
+    this->_height = height;
+    VLOG(DEBUG) << "Frame converter surface created (" << width << "x" << height << ", gpu=" << gpu_id << ")";
+    return true;
+  }
+
+  void _release()
+  {
+    if (this->_surface != NULL) {
+      NvBufSurfaceUnMap(this->_surface, 0, 0);
+      NvBufSurfaceDestroy(this->_surface);
+      this->_surface = NULL;
+    }
+    if (this->_stream != NULL) {
+      cudaStreamDestroy(this->_stream);
+      this->_stream = NULL;
+    }
+    this->_gpu_id = -1;
+  }
+};
+
+}  // namespace core
@@ -2,6 +2,7 @@
 // define private as public so that we can make unit tests on private class members and attributes
 #define private public
 #include "Processing.h"
+#include "callbacks.hpp"
 
 namespace test_suite {
 namespace processing_test {
@@ -55,17 +56,17 @@ TEST_F(ProcessingTest, member_set_configs)
   EXPECT_TRUE(this->processing->set_configs(this->settings)) << "Validate can set configs";
 
   // validate initial configs are loaded correctly
-  EXPECT_EQ(this->processing->_configs.topic, "overlay-bbox") << "Validate _configs.topic=overlay-bbox";
-  EXPECT_EQ(this->processing->_configs.device_id, "overlay-bbox") << "Validate _configs.device_id=overlay-bbox";
-  EXPECT_EQ(this->processing->_configs.paired_device_id, "spyder-1001") << "Validate _configs.device_id=spyder-1001";
-  EXPECT_EQ(this->processing->_configs.model, "facenet") << "Validate _configs.model=facenet";
-  EXPECT_EQ(this->processing->_configs.model_type, "face-detection") << "Validate _configs.model_type=face-detection";
-  EXPECT_EQ(this->processing->_configs.publish, false) << "Validate _configs.device_id=false";
-  EXPECT_EQ(this->processing->_configs.save, false) << "Validate _configs.device_id=false";
-  EXPECT_EQ(this->processing->_configs.bbox_line_thickness, 4) << "Validate _configs.device_id=4";
-  EXPECT_EQ(this->processing->_configs.minimum_iou_score, 60) << "Validate _configs.device_id=60";
-  EXPECT_EQ(this->processing->_configs.min_confidence_to_display, 40) << "Validate _configs.device_id=40";
-  EXPECT_EQ(this->processing->_configs.font_size, 2) << "Validate _configs.device_id=2";
+  EXPECT_EQ(this->processing->_configs->topic, "overlay-bbox") << "Validate _configs.topic=overlay-bbox";
+  EXPECT_EQ(this->processing->_configs->device_id, "overlay-bbox") << "Validate _configs.device_id=overlay-bbox";
+  EXPECT_EQ(this->processing->_configs->paired_device_id, "spyder-1001") << "Validate _configs.device_id=spyder-1001";
+  EXPECT_EQ(this->processing->_configs->model, "facenet") << "Validate _configs.model=facenet";
+  EXPECT_EQ(this->processing->_configs->model_type, "face-detection") << "Validate _configs.model_type=face-detection";
+  EXPECT_EQ(this->processing->_configs->publish, false) << "Validate _configs.device_id=false";
+  EXPECT_EQ(this->processing->_configs->save, false) << "Validate _configs.device_id=false";
+  EXPECT_EQ(this->processing->_configs->bbox_line_thickness, 4) << "Validate _configs.device_id=4";
+  EXPECT_EQ(this->processing->_configs->minimum_iou_score, 60) << "Validate _configs.device_id=60";
+  EXPECT_EQ(this->processing->_configs->min_confidence_to_display, 40) << "Validate _configs.device_id=40";
+  EXPECT_EQ(this->processing->_configs->font_size, 2) << "Validate _configs.device_id=2";
 }
 
 TEST_F(ProcessingTest, member_set_up)
@@ -92,6 +93,127 @@ TEST_F(ProcessingTest, validate_output_queue)
   EXPECT_FALSE(this->processing->check_meta_queue()) << "Validate the meta queue is empty";
 }
 
+TEST(SnapshotTest, crop_synthetic_frames)
+{
+  // I420 64x48 frame: luma is the row number, U=100, V=200
+  std::vector<uint8_t> y(64 * 48), u(32 * 24, 100), v(32 * 24, 200);
+  for (int row = 0; row < 48; row++)
+    memset(&y[row * 64], row, 64);
+  snapshots::FrameView frame;
+  frame.format = "I420";
+  frame.width = 64;
+  frame.height = 48;
+  frame.planes[0] = y.data(), frame.planes[1] = u.data(), frame.planes[2] = v.data();
+  frame.strides[0] = 64, frame.strides[1] = frame.strides[2] = 32;
+
+  cv::Rect rect = snapshots::cropRect({{"x_min", 11}, {"y_min", 9}, {"x_max", 51}, {"y_max", 49}}, 64, 48, 0.1);
+  EXPECT_EQ(rect.x % 2 + rect.y % 2, 0) << "Validate the region is aligned to the chroma";
+  EXPECT_LE(rect.y + rect.height, 48) << "Validate the region is clamped to the frame";
+  EXPECT_TRUE(snapshots::cropRect({{"x_min", 70}, {"y_min", 0}, {"x_max", 80}, {"y_max", 10}}, 64, 48, 0).empty());
+
+  cv::Mat bgr;
+  ASSERT_TRUE(snapshots::extractCrop(frame, rect, bgr));
+  EXPECT_EQ(bgr.size(), rect.size()) << "Validate only the region is converted";
+  frame.format = "GRAY8";
+  EXPECT_FALSE(snapshots::extractCrop(frame, rect, bgr)) << "Validate unsupported formats are refused";
+
+  // packed RGBA frame of a single color
+  std::vector<uint8_t> rgba(64 * 48 * 4, 0);
+  for (size_t i = 0; i < rgba.size(); i += 4)
+    rgba[i] = 255;
+  frame.format = "RGBA";
+  frame.planes[0] = rgba.data();
+  frame.strides[0] = 64 * 4;
+  ASSERT_TRUE(snapshots::extractCrop(frame, rect, bgr));
+  EXPECT_EQ(bgr.at<cv::Vec3b>(0, 0), cv::Vec3b(0, 0, 255)) << "Validate the crop is BGR";
+  EXPECT_EQ(snapshots::base64({'M', 'a'}), "TWE=");
+}
+
+TEST(SnapshotTest, capture_once_per_track)
+{
+  snapshots::SnapshotPolicy policy;
+  policy.enable = true;
+  policy.labels = {"person"};
+  policy.min_confidence = 50;
+  njson bbox = {{"x_min", 8}, {"y_min", 8}, {"x_max", 40}, {"y_max", 40}};
+  njson payload = {{"meta", {{"frame", 7}}},
+                   {"inference",
+                    {{{"label", "person"}, {"confidence", 90}, {"tracking_id", 4}, {"bbox", bbox}},
+                     {{"label", "car"}, {"confidence", 90}, {"tracking_id", 5}, {"bbox", bbox}},
+                     {{"label", "person"}, {"confidence", 20}, {"tracking_id", 6}, {"bbox", bbox}},
+                     {{"label", "person"}, {"confidence", 90}, {"tracking_id", 7}, {"bbox", {{"x_min", 0}, {"y_min", 0}, {"x_max", 4}, {"y_max", 4}}}}}}};
+  std::vector<uint8_t> bgr(64 * 48 * 3, 128);
+  snapshots::FrameView frame;
+  frame.format = "BGR";
+  frame.width = 64;
+  frame.height = 48;
+  frame.planes[0] = bgr.data();
+  frame.strides[0] = 64 * 3;
+
+  snapshots::Snapshotter snapshotter(policy, "/tmp");
+  std::vector<size_t> objects = snapshotter.select(0, payload);
+  ASSERT_EQ(objects, std::vector<size_t>{0}) << "Validate the label, confidence and size filters";
+  EXPECT_EQ(snapshotter.capture(0, payload, frame, objects), 1);
+  snapshotter.wait();
+  std::string path = payload["inference"][0]["snapshot"];
+  EXPECT_EQ(path, "/tmp/src0_person_4_7.jpg");
+  EXPECT_FALSE(cv::imread(path).empty()) << "Validate the thumbnail is a jpeg";
+  EXPECT_TRUE(snapshotter.select(0, payload).empty()) << "Validate a track is captured once";
+  EXPECT_EQ(snapshotter.select(1, payload).size(), 1) << "Validate tracks are per source";
+  std::remove(path.c_str());
+}
+
+TEST(CpuProbeTest, payload_from_stub_detector)
+{
+  gst_init(NULL, NULL);
+  core::Processing processor;
+  njson conf = {{"topic", "cpu-probe"}, {"device_id", "cpu-probe"}, {"model", "stub"}, {"model_type", "stub"}, {"publish", false},
+                {"save", false}, {"display_detections", false}, {"bbox_line_thickness", 2}, {"min_confidence_to_display", 40}, {"font_size", 1}};
+  ASSERT_TRUE(processor.set_configs(conf));
+  processor.set_up(6);
+  std::vector<std::pair<int, njson>> payloads;
+  processor.add_payload_hook([&payloads](int source_id, njson &payload) { payloads.push_back({source_id, payload}); });
+
+  // the stub detector of source 5 on a 64x48 stream, probes set like Pipeline::_add_cpu_inference_probe
+  GstElement *pipeline = gst_parse_launch("videotestsrc num-buffers=2 ! video/x-raw,format=I420,width=64,height=48 ! identity name=stub_detector_5 ! fakesink", NULL);
+  ASSERT_NE(pipeline, nullptr);
+  GstElement *detector = gst_bin_get_by_name(GST_BIN(pipeline), "stub_detector_5");
+  GstPad *sink_pad = gst_element_get_static_pad(detector, "sink");
+  GstPad *src_pad = gst_element_get_static_pad(detector, "src");
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, pipelineUtils::stubDetectorProbe, g_new0(guint64, 1), g_free);
+  gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, core::GstCallbacks::cpu_probe_callback, (gpointer) &processor, NULL);
+  gst_object_unref(sink_pad);
+  gst_object_unref(src_pad);
+  gst_object_unref(detector);
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  GstBus *bus = gst_element_get_bus(pipeline);
+  GstMessage *msg = gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND, (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+  ASSERT_NE(msg, nullptr) << "Validate the pipeline finished";
+  EXPECT_EQ(GST_MESSAGE_TYPE(msg), GST_MESSAGE_EOS);
+  gst_message_unref(msg);
+  gst_object_unref(bus);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  // one box of a fifth of the frame, centered vertically and moving 4 pixels per frame
+  ASSERT_EQ(payloads.size(), 2) << "Validate one payload per frame";
+  for (size_t i = 0; i < payloads.size(); i++) {
+    const auto &[source_id, payload] = payloads[i];
+    EXPECT_EQ(source_id, 5) << "Validate the source id is read from the name of the stub detector";
+    EXPECT_EQ(payload["topic"], "cpu-probe");
+    EXPECT_EQ(payload["meta"]["frame"], i);
+    EXPECT_EQ(payload["meta"]["resolution"]["width"], 64);
+    EXPECT_EQ(payload["meta"]["resolution"]["height"], 48);
+    ASSERT_EQ(payload["inference"].size(), 1);
+    const njson &detection = payload["inference"][0];
+    EXPECT_EQ(detection["label"], "stub");
+    EXPECT_EQ(detection["tracking_id"], 0);
+    EXPECT_EQ(detection["confidence"], 90);
+    EXPECT_EQ(detection["bbox"], njson({{"x_max", (int) (i + 1) * 4 + 12}, {"x_min", (int) (i + 1) * 4}, {"y_max", 28}, {"y_min", 19}}));
+  }
+}
+
 }  // namespace
 }  // namespace processing_test
 }  // namespace test_suite
\ No newline at end of file
@@ -80,6 +80,10 @@ bool KafkaBroker::set_configs(njson conf)
       LOG(WARNING) << "Invalid config.json element! messaging['enable'] must be a boolean";
       return false;
     }
+    if (conf.contains("flush_timeout_ms") && (!conf["flush_timeout_ms"].is_number_integer() || conf["flush_timeout_ms"].get<int>() < 0)) {
+      LOG(WARNING) << "Invalid config.json element! messaging['flush_timeout_ms'] must be a positive integer";
+      return false;
+    }
 
     // unpack array of topics from config.json
     std::set<std::string> topics;
@@ -87,6 +91,7 @@ bool KafkaBroker::set_configs(njson conf)
     ProducerSettings producerSettings = {
         .topic = "test",
         .kafka_server_ip = conf["kafka_server_ip"],
+        .flush_timeout_ms = conf.value("flush_timeout_ms", 5000),
     };
 
     KafkaSettings configs = {.producer = producerSettings};
@@ -108,8 +113,13 @@ void KafkaBroker::_validate_broker_connection()
   if (!this->_producer_enable)
     return;
 
+  core::StartupTimeline::get().mark("kafka_validation_started");
   this->_broker_connected = false;
   while (!this->_broker_connected) {
+    if (this->_stopping) {
+      LOG(INFO) << "Stopped before connecting to the kafka server";
+      return;
+    }
     kafka::Properties props;
     props.put("bootstrap.servers", this->_configs.producer.kafka_server_ip);
     AdminClient adminClient(props);
@@ -127,11 +137,14 @@ void KafkaBroker::_validate_broker_connection()
     LOG(INFO) << "The following topics are available: " << found_topics;
     this->_broker_connected = true;
   }
+  core::StartupTimeline::get().mark("kafka_connected");
+  if (this->_restarting.exchange(false))
+    this->_mediator->notify(new HealthEvent(events::Actions::MODULE_RECOVERED, events::Module::MODULE_KAFKA, -1, "", events::Module::MODULE_KAFKA));
   // Log start up diagnostics
   VLOG(DEBUG) << "Started thread pool (threads = " << this->_pool.get_thread_count() << ")";
 
   // if the producer is not running, then start it up
-  if (!this->_producer_run) {
+  if (!this->_producer_run && !this->_stopping) {
     this->_pool.push_task(&KafkaBroker::_poll_producer, this);
   }
 }
@@ -145,13 +158,17 @@ void KafkaBroker::publish(njson payload)
   VLOG(DEEP) << "Payload added to producer queue: " << payload.dump();
   this->producer_lock.lock();
   this->producer_q.push(payload);
+  this->_metrics.queue_depth.store(this->producer_q.size(), std::memory_order_relaxed);
   this->producer_lock.unlock();
+  this->producer_ready.notify_one();
 }
 
 /**
  *  @brief the main producer thread that reads from this->producer_q and publishes messages
  *
  *  @warning the topics in this->producer_q must include a "topic" the payload will be dropped!
+ *  @note the thread sleeps on producer_ready while the queue is empty. Once stop() was called it sends what is queued until the
+ *      flush deadline, then flushes and closes the producer with the time left.
  *
  */
 void KafkaBroker::_poll_producer()
@@ -166,22 +183,21 @@ void KafkaBroker::_poll_producer()
   KafkaProducer publisher(props);
   try {
     while (this->_producer_run) {
-      // check for available data
-      this->producer_lock.lock();
-      njson payload;
-      int num_payloads = this->producer_q.size();
-      this->producer_lock.unlock();
-      if (num_payloads == 0)
-        continue;
+      // wait for available data (or stop)
+      std::unique_lock<std::mutex> lock(this->producer_lock);
+      this->producer_ready.wait(lock, [this]() { return !this->producer_q.empty() || this->_stopping; });
+      if (this->producer_q.empty() || (this->_stopping && std::chrono::steady_clock::now() >= this->_stop_deadline))
+        break;
 
       // pull the first item off the queue
-      this->producer_lock.lock();
-      payload = this->producer_q.front();
+      njson payload = this->producer_q.front();
       this->producer_q.pop();
-      this->producer_lock.unlock();
+      this->_metrics.queue_depth.store(this->producer_q.size(), std::memory_order_relaxed);
+      lock.unlock();
 
       // ensure the payload contains a topic field
       if (!payload.contains("topic")) {
+        this->_metrics.dropped.fetch_add(1, std::memory_order_relaxed);
         LOG(ERROR) << "Payload does not include a topic";
         LOG(ERROR) << "Dropped payload: " << payload.dump();
         continue;
@@ -198,22 +214,46 @@ void KafkaBroker::_poll_producer()
       producer::ProducerRecord record = producer::ProducerRecord(send_topic, kafka::NullKey, kafka::Value(str.c_str(), str.size()));
 
       // publish the record
+      ProducerMetrics *metrics = &this->_metrics;
+      metrics->produced.fetch_add(1, std::memory_order_relaxed);
       publisher.send(
           record,
-          [](const producer::RecordMetadata &metadata, const kafka::Error &error) {
-            if (error)
+          [metrics](const producer::RecordMetadata &metadata, const kafka::Error &error) {
+            if (error) {
+              metrics->delivery_errors.fetch_add(1, std::memory_order_relaxed);
               throw error;
+            }
+            metrics->delivered.fetch_add(1, std::memory_order_relaxed);
+            core::StartupTimeline::get().mark_first(core::Milestone::FIRST_KAFKA_ACK);
           },
           KafkaProducer::SendOption::ToCopyRecordValue);
     }
   }
   catch (const std::exception &e) {
     LOG(ERROR) << "Kafka Producer Subscribe Error [exit thread] : " << e.what();
-    publisher.close();
-    this->_producer_run = false;
-    this->_pool.push_task(&KafkaBroker::_validate_broker_connection, this);
+    if (!this->_stopping) {
+      // the supervisor reconnects the producer (restart), the payloads published meanwhile stay queued
+      publisher.close();
+      this->producer_lock.lock();
+      this->_producer_run = false;
+      this->producer_lock.unlock();
+      this->producer_stopped.notify_all();
+      this->_mediator->notify(new HealthEvent(events::Actions::MODULE_FAILED, events::Module::MODULE_KAFKA, -1, e.what(), events::Module::MODULE_KAFKA));
+      return;
+    }
+  }
+  if (this->_stopping) {
+    // close() waits for the acks of the payloads sent, with the time left before the deadline
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(this->_stop_deadline - std::chrono::steady_clock::now());
+    publisher.close(std::max(remaining, std::chrono::milliseconds(0)));
   }
-  publisher.close();
+  else
+    publisher.close();
+
+  this->producer_lock.lock();
+  this->_producer_run = false;
+  this->producer_lock.unlock();
+  this->producer_stopped.notify_all();
   LOG(INFO) << "Kafka Producer thread inactive, ready to join.";
 }
 
@@ -229,26 +269,47 @@ void KafkaBroker::start()
 }
 
 /**
- *  @brief set run flags to FALSE.  Class run flags are in main threads (for consumer and producer)
- *      to continually poll kafka's internal message queue. Setting this to false means that the
- *      thread will no longer loop over while(this->flag) which reads from the kafka internal message queue.
+ *  @brief reconnect to the kafka server and start a new producer after the producer failed (its queue is kept)
+ *  @return false if the module is stopping or the producer still runs
+ */
+bool KafkaBroker::restart()
+{
+  if (this->_stopping || this->_producer_run)
+    return false;
+  LOG(INFO) << "Restarting module";
+  this->_restarting = true;
+  this->_pool.push_task(&KafkaBroker::_validate_broker_connection, this);
+  return true;
+}
+
+/**
+ *  @brief stop the producer: it sends the queued payloads and flushes the kafka producer within messaging['flush_timeout_ms'].
+ *      Returns when the producer closed, or at the deadline (plus the grace of close()) with the payloads left dropped.
  */
 void KafkaBroker::stop()
 {
   LOG(INFO) << "Stopping module";
+  std::chrono::milliseconds timeout(this->_configs.producer.flush_timeout_ms);
 
-  // check how many messages are on the queue
-  int num_producer_payloads = 1;
-  while (num_producer_payloads != 0) {
-    LOG(INFO) << "Checking kafka queue to see if unsent messages exist";
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  std::unique_lock<std::mutex> lock(this->producer_lock);
+  this->_stop_deadline = std::chrono::steady_clock::now() + timeout;
+  this->_stopping = true;
+  size_t queued = this->producer_q.size();
+  this->producer_ready.notify_all();
+  if (this->_producer_run) {
+    LOG(INFO) << "Flushing kafka producer (" << queued << " payloads queued, timeout=" << timeout.count() << "ms)";
+    // the producer checks the deadline between payloads, a send blocked on a full librdkafka queue gets one more timeout
+    if (!this->producer_stopped.wait_until(lock, this->_stop_deadline + timeout, [this]() { return !this->_producer_run; }))
+      LOG(WARNING) << "Kafka producer did not close before its deadline";
+  }
 
-    // check number of payloads in producer queue
-    this->producer_lock.lock();
-    num_producer_payloads = this->producer_q.size();
-    this->producer_lock.unlock();
+  // payloads the producer could not send in time (or queued while the broker was unreachable)
+  if (!this->producer_q.empty()) {
+    LOG(WARNING) << "Dropped " << this->producer_q.size() << " kafka payloads that were not sent before the flush deadline";
+    this->_metrics.unflushed.fetch_add(this->producer_q.size(), std::memory_order_relaxed);
+    this->producer_q = {};
+    this->_metrics.queue_depth.store(0, std::memory_order_relaxed);
   }
-  this->_producer_run = false;
 }
 
 /**
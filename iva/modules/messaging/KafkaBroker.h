@@ -6,7 +6,10 @@
 #include <kafka/KafkaProducer.h>
 
 #include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <thread>
@@ -14,6 +17,9 @@
 
 #include "BaseComponent.h"
 #include "logging.hpp"
+#include "metrics.hpp"
+#include "shutdownTimeline.hpp"
+#include "startupTimeline.hpp"
 
 // include namespace for json
 using njson = nlohmann::json;
@@ -33,10 +39,13 @@ class Mediator;
  * the default topic when a payload doesn't have a topic in it
  * @var bootstrap
  * kafka settings to setup
+ * @var flush_timeout_ms
+ * deadline of stop() to send the queued payloads and flush the producer, the payloads left are dropped (iva_kafka_unflushed_total)
  */
 struct ProducerSettings {
   std::string topic;
   std::string kafka_server_ip;
+  int flush_timeout_ms = 5000;
 };
 
 /**
@@ -63,10 +72,20 @@ struct KafkaSettings {
  * boolean that holds connection status with kafka server
  * @var _producer_run
  * control flag to enable or disable from another module (via stop() or start())
+ * @var _stopping
+ * set by stop(): the producer sends what is queued and exits, the broker validation stops retrying
+ * @var _restarting
+ * set by restart(), the mediator is notified of the recovery once the producer is connected again
  * @var producer_lock
  * thread safe lock on all producer objects (mainly its queue)
+ * @var producer_ready
+ * notified (under producer_lock) when a payload is queued or the producer must stop, the producer thread waits on it
+ * @var producer_stopped
+ * notified (under producer_lock) when the producer thread closed the kafka producer
  * @var producer_q
  * all data to be produced is added to this queue from other modules (via publish())
+ * @var _metrics
+ * producer statistics exported by core::Metrics (updated without locks, except the queue depth which is set under producer_lock)
  */
 class KafkaBroker : public BaseComponent {
  public:
@@ -83,6 +102,8 @@ class KafkaBroker : public BaseComponent {
   void start();
   bool get_run_state();
   void stop();
+  // reconnect after a failure of the producer (from the supervisor of ApplicationContext)
+  bool restart();
 
   // de-constructor
   ~KafkaBroker();
@@ -96,11 +117,27 @@ class KafkaBroker : public BaseComponent {
   bool _broker_connected = false;
 
   // producer members and attributes
-  bool _producer_run = false;
+  std::atomic<bool> _producer_run = false;
   bool _producer_enable = false;
+  std::atomic<bool> _stopping = false;
+  std::atomic<bool> _restarting = false;
+  std::chrono::steady_clock::time_point _stop_deadline;
   std::mutex producer_lock;
+  std::condition_variable producer_ready;
+  std::condition_variable producer_stopped;
   std::queue<njson> producer_q;
 
+  struct ProducerMetrics {
+    std::atomic<int64_t> &queue_depth = core::Metrics::get().gauge("iva_queue_depth", "Payloads waiting in a queue.", {{"queue", "producer"}});
+    std::atomic<uint64_t> &produced = core::Metrics::get().counter("iva_kafka_produced_total", "Payloads sent to the kafka producer.");
+    std::atomic<uint64_t> &delivered = core::Metrics::get().counter("iva_kafka_delivered_total", "Payloads acknowledged by the kafka broker.");
+    std::atomic<uint64_t> &delivery_errors =
+        core::Metrics::get().counter("iva_kafka_delivery_errors_total", "Payloads the kafka broker failed to acknowledge.");
+    std::atomic<uint64_t> &dropped = core::Metrics::get().counter("iva_kafka_dropped_total", "Payloads dropped before production (no topic).");
+    std::atomic<uint64_t> &unflushed =
+        core::Metrics::get().counter("iva_kafka_unflushed_total", "Payloads still queued when the flush deadline of stop() expired.");
+  } _metrics;
+
   // threaded members to get data in and out of application
   void _poll_producer();
 
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Measures the CPU cost of one encoded stream for every encoder profile (config.json pipeline['encoder_profiles']).
+# usage: ./benchmark_encoders.sh [config.json] [width] [height] [seconds]
+
+export CONFIG=${1:-"/tmp/.cache/configs/config.json"}
+export WIDTH=${2:-1280}
+export HEIGHT=${3:-720}
+export SECONDS_ENCODED=${4:-20}
+export FPS=30
+export FRAMES=$((SECONDS_ENCODED * FPS))
+
+# built-in profiles merged with the ones of config.json, one line per profile:
+# name preset tune bitrate crf key_int threads hardware
+PROFILES=$(python3 - "$CONFIG" <<'EOF'
+import json, sys
+profiles = {
+  "realtime": {"preset": "ultrafast", "tune": "zerolatency", "bitrate": 2000, "crf": 23, "key_int": 60, "threads": 2, "hardware": False},
+  "balanced": {"preset": "veryfast", "tune": "zerolatency", "bitrate": 4000, "crf": 23, "key_int": 60, "threads": 4, "hardware": False},
+  "quality": {"preset": "medium", "tune": "none", "bitrate": 0, "crf": 20, "key_int": 120, "threads": 0, "hardware": False},
+  "hardware": {"preset": "ultrafast", "tune": "zerolatency", "bitrate": 4000, "crf": 23, "key_int": 60, "threads": 0, "hardware": True},
+}
+try:
+  with open(sys.argv[1]) as f:
+    for name, conf in json.load(f).get("pipeline", {}).get("encoder_profiles", {}).items():
+      profiles[name] = {**profiles.get(name, profiles["realtime"]), **conf}
+except FileNotFoundError:
+  pass
+for name, p in profiles.items():
+  print(name, p["preset"], p["tune"], p["bitrate"], p["crf"], p["key_int"], p["threads"], int(p["hardware"]))
+EOF
+)
+
+printf "%-12s %-10s %12s %14s %12s\n" "profile" "encoder" "wall (s)" "cpu (s)" "cores/stream"
+while read -r NAME PRESET TUNE BITRATE CRF KEY_INT THREADS HARDWARE; do
+  if [ "$HARDWARE" == "1" ] && gst-inspect-1.0 nvv4l2h264enc > /dev/null 2>&1; then
+    ENCODER="nvv4l2h264enc iframeinterval=$KEY_INT"
+    [ "$BITRATE" -gt 0 ] && ENCODER="$ENCODER bitrate=$((BITRATE * 1000))"
+    CONVERT="nvvideoconvert ! video/x-raw(memory:NVMM),format=I420"
+    NAME_ENCODER="nvv4l2"
+  else
+    ENCODER="x264enc speed-preset=$PRESET key-int-max=$KEY_INT threads=$THREADS"
+    [ "$TUNE" != "none" ] && ENCODER="$ENCODER tune=$TUNE"
+    if [ "$BITRATE" -gt 0 ]; then
+      ENCODER="$ENCODER pass=cbr bitrate=$BITRATE"
+    else
+      ENCODER="$ENCODER pass=qual quantizer=$CRF"
+    fi
+    CONVERT="videoconvert ! video/x-raw,format=I420"
+    NAME_ENCODER="x264"
+  fi
+
+  # the raw source costs the same for every profile, so it is measured once and subtracted
+  START=$(date +%s.%N)
+  TIMES=$( { /usr/bin/time -f "%U %S" gst-launch-1.0 -q \
+    videotestsrc num-buffers=$FRAMES pattern=ball is-live=false ! \
+    video/x-raw,width=$WIDTH,height=$HEIGHT,framerate=$FPS/1 ! \
+    $CONVERT ! $ENCODER ! h264parse ! fakesink sync=false > /dev/null; } 2>&1 | tail -n 1)
+  END=$(date +%s.%N)
+  if [ -z "$BASELINE" ]; then
+    BASELINE=$( { /usr/bin/time -f "%U %S" gst-launch-1.0 -q \
+      videotestsrc num-buffers=$FRAMES pattern=ball is-live=false ! \
+      video/x-raw,width=$WIDTH,height=$HEIGHT,framerate=$FPS/1 ! \
+      videoconvert ! video/x-raw,format=I420 ! fakesink sync=false > /dev/null; } 2>&1 | tail -n 1 | awk '{print $1 + $2}')
+  fi
+
+  CPU=$(echo "$TIMES $BASELINE" | awk '{printf "%.2f", $1 + $2 - $3}')
+  WALL=$(echo "$START $END" | awk '{printf "%.2f", $2 - $1}')
+  CORES=$(echo "$CPU $SECONDS_ENCODED" | awk '{printf "%.3f", $1 / $2}')
+  printf "%-12s %-10s %12s %14s %12s\n" "$NAME" "$NAME_ENCODER" "$WALL" "$CPU" "$CORES"
+done <<< "$PROFILES"